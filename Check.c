@@ -10,20 +10,74 @@
 /**  Implementation of alternative calls of well known      **/
 /**  functions from 'stdio.h' and 'stdlib.h', and also      **/
 /**  functions from 'LAPACK' package, to avoid code         **/
-/**  repetition when checking errors.                       **/
+/**  repetition when checking errors. The blocks allocated  **/
+/**  by 'CHECKmalloc' and 'CHECKrealloc' are counted (per   **/
+/**  thread and for the process) until freed by 'CHECKfree' **/
+/**  (their sizes kept at a hash table of the addresses).   **/
 /**  *****************************************************  **/
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include "Extern.h"
 #include "Check.h"
 
+/* Hash table of the sizes of the allocated blocks (open */
+/* addressing, 'NULL' keys are empty slots).             */
+typedef struct CHECKBLOCK check_block;
+struct CHECKBLOCK {
+   void *ptr; /* block address */
+   size_t size; /* its size */
+   check_mem *owner; /* statistics of the allocating thread */
+};
+static check_block *blocks = NULL;
+static size_t nSlots = 0, nBlocks = 0;
+
+/* Statistics of the process (under 'memLock'). */
+static double memLive = 0.0, memPeak = 0.0;
+static double histCount[CHECK_MEM_BINS], histBytes[CHECK_MEM_BINS];
+static pthread_mutex_t memLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Statistics of the calling thread, allocated at its first */
+/* block and kept after it exits (its blocks may be freed by */
+/* other threads, which discount them from the owner).       */
+static __thread check_mem *threadMem = NULL;
+
+
+/* ********************************************************* */
+/* Returns a short description of the error code 'info'.     */
+const char *CHECKerrorString (int info)
+{
+   switch (info) {
+   case VIB_SUCCESS:
+      return "no error";
+   case VIB_ERR_MEMORY:
+      return "insufficient memory";
+   case VIB_ERR_FILE:
+      return "unable to open, read or close a file";
+   case VIB_ERR_FORMAT:
+      return "file not written correctly";
+   case VIB_ERR_LAPACK:
+      return "failure at a lapack rotine";
+   case VIB_ERR_INPUT:
+      return "wrong input or calling sequence";
+   case VIB_ERR_SCRIPT:
+      return "failure at 'setInput.sh' script";
+   case VIB_ERR_STOPPED:
+      return "stopped on request (checkpoint written)";
+   default:
+      return "unknown error";
+   }
+
+} /* CHECKerrorString */
+
 
 /* ********************************************************* */
 /* Lapack rotine: computes all eigenvalues and eigenvectors  */
 /* of a real symmetric matrix 'M' using "divide and conquer" */
 /* algorithm. Notice that in this program 'N = M = LDA = n'. */
-void CHECKdsyevd (int n, double *M, double *eigval)
+int CHECKdsyevd (int n, double *M, double *eigval)
 {
    int lwork, liwork, li, info = 0;
    double l;
@@ -37,34 +91,100 @@ void CHECKdsyevd (int n, double *M, double *eigval)
    liwork = li;
    iwork = CHECKmalloc (liwork * sizeof (int));
    work = CHECKmalloc (lwork * sizeof (double));
+   if (iwork == NULL || work == NULL) {
+      CHECKfree (work);
+      CHECKfree (iwork);
+      return VIB_ERR_MEMORY;
+   }
 
    /* Computes eigenvalues and eigenvectors. */
    dsyevd ("V", "U", &n, M, &n, eigval, work, &lwork, iwork, &liwork, &info);
+
+   /* Frees memory. */
+   CHECKfree (work);
+   CHECKfree (iwork);
+
    if (info < 0) {
       fprintf (stderr, "\n In lapack dsyevd: \n");
       fprintf (stderr, " The %d-th argument had an illegal value\n", -info);
-      exit (EXIT_FAILURE);
+      return VIB_ERR_LAPACK;
    }
    if (info > 0) {
       fprintf (stderr, "\n In lapack dsyevd: \n");
       fprintf (stderr, " The algorithm has failed to compute an eigenvalue\n");
       fprintf (stderr, " while working on the submatrix lying in rows and \n");
       fprintf (stderr, " columns %d through %d!\n\n", info/(n + 1), info%(n + 1));
-      exit (EXIT_FAILURE);
+      return VIB_ERR_LAPACK;
    }
 
-   /* Frees memory. */
-   free (work);
-   free (iwork);
+   return VIB_SUCCESS;
 
 } /* CHECKdsyevd */
 
 
+/* ********************************************************* */
+/* Lapack rotine: computes all eigenvalues and eigenvectors  */
+/* of the generalized problem 'M c = e S c' ('S' symmetric   */
+/* and positive definite) using "divide and conquer". On     */
+/* exit 'M' holds the eigenvectors (normalized as            */
+/* 'c^T S c = 1') and 'S' its Cholesky factor.               */
+int CHECKdsygvd (int n, double *M, double *S, double *eigval)
+{
+   int itype = 1, lwork, liwork, li, info = 0;
+   double l;
+   int *iwork = NULL;
+   double *work = NULL;
+
+   /* Workspace query: calculates the optimal sizes of 'work' and 'iwork'. */
+   lwork = liwork = -1;
+   dsygvd (&itype, "V", "U", &n, M, &n, S, &n, eigval, &l, &lwork,
+	   &li, &liwork, &info);
+   lwork = (int) l;
+   liwork = li;
+   iwork = CHECKmalloc (liwork * sizeof (int));
+   work = CHECKmalloc (lwork * sizeof (double));
+   if (iwork == NULL || work == NULL) {
+      CHECKfree (work);
+      CHECKfree (iwork);
+      return VIB_ERR_MEMORY;
+   }
+
+   /* Computes eigenvalues and eigenvectors. */
+   dsygvd (&itype, "V", "U", &n, M, &n, S, &n, eigval, work, &lwork,
+	   iwork, &liwork, &info);
+
+   /* Frees memory. */
+   CHECKfree (work);
+   CHECKfree (iwork);
+
+   if (info < 0) {
+      fprintf (stderr, "\n In lapack dsygvd: \n");
+      fprintf (stderr, " The %d-th argument had an illegal value\n", -info);
+      return VIB_ERR_LAPACK;
+   }
+   if (info > n) {
+      fprintf (stderr, "\n In lapack dsygvd: \n");
+      fprintf (stderr, " The leading minor of order %d of the overlap\n",
+	       info - n);
+      fprintf (stderr, " matrix is not positive definite!\n\n");
+      return VIB_ERR_LAPACK;
+   }
+   if (info > 0) {
+      fprintf (stderr, "\n In lapack dsygvd: \n");
+      fprintf (stderr, " The algorithm has failed to converge!\n\n");
+      return VIB_ERR_LAPACK;
+   }
+
+   return VIB_SUCCESS;
+
+} /* CHECKdsygvd */
+
+
 /* ********************************************************** */
 /* Lapack rotine: forms a triangular matrix factorization     */
 /* (trf) from a general matrix (ge) of double precision real  */
 /* (d). Notice that in this program 'N = M = LDA = n'.        */
-void CHECKdgetrf (int n, double *M, int *ipiv)
+int CHECKdgetrf (int n, double *M, int *ipiv)
 {
    int info = 0;
 
@@ -72,7 +192,7 @@ void CHECKdgetrf (int n, double *M, int *ipiv)
    if (info < 0) {
       fprintf (stderr, "\n In lapack dgetrf: \n");
       fprintf (stderr, "\n The %d-th argument had an illegal value.\n\n", info);
-      exit (EXIT_FAILURE);
+      return VIB_ERR_LAPACK;
    }
    else if (info > 0) {
       fprintf (stderr, "\n In lapack dgetrf: \n");
@@ -82,6 +202,8 @@ void CHECKdgetrf (int n, double *M, int *ipiv)
       fprintf (stderr, " it is used to solve a system of equations.\n\n");
    }
 
+   return VIB_SUCCESS;
+
 } /* CHECKdgetrf */
 
 
@@ -90,41 +212,189 @@ void CHECKdgetrf (int n, double *M, int *ipiv)
 /* factorization (tri) from a general matrix (ge) of double   */
 /* precision real (d). Notice that in this program            */
 /* 'N = LDA = lwork = n'.                                     */
-void CHECKdgetri (int n, double *M, int *ipiv)
+int CHECKdgetri (int n, double *M, int *ipiv)
 {
    int info = 0;
    double *work = CHECKmalloc (n * sizeof (double));
 
+   if (work == NULL)
+      return VIB_ERR_MEMORY;
+
    dgetri (&n, M, &n, ipiv, work, &n, &info);
+
+   /* Frees memory. */
+   CHECKfree (work);
+
    if (info < 0) {
       fprintf (stderr, "\n In lapack dgetri: \n");
       fprintf (stderr, " The %d-th argument had an illegal value\n", info);
-      exit (EXIT_FAILURE);
+      return VIB_ERR_LAPACK;
    }
    else if (info > 0) {
       fprintf (stderr, "\n In lapack dgetri: \n");
       fprintf (stderr, " U(%d,%d) is exactly zero. The matrix is singular\n", info, info);
       fprintf (stderr, " and its inverse could not be computed.\n\n");
-      exit (EXIT_FAILURE);
+      return VIB_ERR_LAPACK;
    }
 
-   /* Frees memory. */
-   free (work);
+   return VIB_SUCCESS;
 
 } /* CHECKdgetri */
 
 
+/* ********************************************************* */
+/* Returns the home slot of the address 'ptr' at the hash    */
+/* table (Fibonacci hashing, folded to the low bits).        */
+static size_t homeSlot (void *ptr)
+{
+   unsigned long long h;
+
+   h = ((unsigned long long) (size_t) ptr >> 4) * 11400714819323198485ULL;
+
+   return (size_t) (h ^ (h >> 32)) & (nSlots - 1);
+
+} /* homeSlot */
+
+
+/* ********************************************************* */
+/* Returns the slot of the block 'ptr' at the hash table     */
+/* (or the empty slot where it would be inserted).           */
+static size_t findBlock (void *ptr)
+{
+   size_t h;
+
+   for (h = homeSlot (ptr); blocks[h].ptr != NULL && blocks[h].ptr != ptr;
+	h = (h + 1) & (nSlots - 1));
+
+   return h;
+
+} /* findBlock */
+
+
+/* ********************************************************* */
+/* Returns the statistics of the calling thread (allocated   */
+/* at the first call, 'NULL' if there is not enough memory). */
+/* Called with 'memLock' held.                               */
+static check_mem *threadStats ()
+{
+
+   if (threadMem == NULL)
+      threadMem = calloc (1, sizeof (check_mem));
+
+   return threadMem;
+
+} /* threadStats */
+
+
+/* ********************************************************* */
+/* Removes the block 'ptr' from the hash table (if there) and */
+/* discounts its size from the process and from the thread    */
+/* that allocated it. Called with 'memLock' held.             */
+static void dropBlock (void *ptr)
+{
+   size_t h, g, home;
+
+   if (nSlots == 0)
+      return ;
+   h = findBlock (ptr);
+   if (blocks[h].ptr == NULL)
+      return ;
+   memLive -= blocks[h].size;
+   if (blocks[h].owner != NULL)
+      blocks[h].owner->live -= blocks[h].size;
+   blocks[h].ptr = NULL;
+   nBlocks--;
+
+   /* Moves back the following blocks of the cluster. */
+   for (g = (h + 1) & (nSlots - 1); blocks[g].ptr != NULL;
+	g = (g + 1) & (nSlots - 1)) {
+      home = homeSlot (blocks[g].ptr);
+      if ((g > h && (home <= h || home > g)) ||
+	  (g < h && home <= h && home > g)) {
+	 blocks[h] = blocks[g];
+	 blocks[g].ptr = NULL;
+	 h = g;
+      }
+   }
+
+} /* dropBlock */
+
+
+/* ********************************************************* */
+/* Adds the block 'ptr' of 'size' bytes to the hash table    */
+/* and to the statistics. Called with 'memLock' held. If the */
+/* table can't grow the block is just not counted.           */
+static void addBlock (void *ptr, size_t size)
+{
+   register int b;
+   size_t h, n;
+   check_block *old;
+   check_mem *m = threadStats ();
+
+   /* Doubles the table when half full. */
+   if (2 * (nBlocks + 1) > nSlots) {
+      old = blocks;
+      n = nSlots;
+      blocks = calloc (n > 0 ? 2 * n : 1024, sizeof (check_block));
+      if (blocks == NULL) {
+	 blocks = old;
+	 return ;
+      }
+      nSlots = (n > 0 ? 2 * n : 1024);
+      for (h = 0; h < n; h++)
+	 if (old[h].ptr != NULL)
+	    blocks[findBlock (old[h].ptr)] = old[h];
+      free (old);
+   }
+   h = findBlock (ptr);
+   if (blocks[h].ptr == ptr) { /* replaces a stale entry */
+      memLive -= blocks[h].size;
+      if (blocks[h].owner != NULL)
+	 blocks[h].owner->live -= blocks[h].size;
+   }
+   else
+      nBlocks++;
+   blocks[h].ptr = ptr;
+   blocks[h].size = size;
+   blocks[h].owner = m;
+
+   /* Process statistics. */
+   memLive += size;
+   if (memLive > memPeak)
+      memPeak = memLive;
+   for (b = 0; b < CHECK_MEM_BINS - 1 && (size >> (b + 1)) > 0; b++);
+   histCount[b] += 1.0;
+   histBytes[b] += size;
+
+   /* Thread statistics. */
+   if (m == NULL)
+      return ;
+   m->live += size;
+   if (m->live > m->peak)
+      m->peak = m->live;
+   if (size > m->largest)
+      m->largest = size;
+   m->allocs += 1.0;
+   m->bytes += size;
+
+} /* addBlock */
+
+
 /* ********************************************************* */
 /* Allocates a block of bytes if there are enough memory.    */
-/* Otherwise returns an error message and exits the program. */
-void *CHECKmalloc (unsigned int nbytes)
+/* Otherwise returns an error message and 'NULL'.            */
+void *CHECKmalloc (size_t nbytes)
 {
    void *ptr;
    ptr = malloc (nbytes);
 
-   if (ptr == NULL) {    
+   if (ptr == NULL)
       fprintf (stderr, "\n\n Insufficient memory.\n\n");
-      exit(EXIT_FAILURE);
+   else {
+      pthread_mutex_lock (&memLock);
+      dropBlock (ptr); /* a block reused after a plain 'free' */
+      addBlock (ptr, nbytes);
+      pthread_mutex_unlock (&memLock);
    }
 
    return ptr;
@@ -135,15 +405,28 @@ void *CHECKmalloc (unsigned int nbytes)
 /* ********************************************************* */
 /* Reallocates a block of bytes pointed by 'ptr' and change  */
 /* its size to 'nbytes' if there are enough memory.          */
-/* Otherwise returns an error message and exits the program. */
-void *CHECKrealloc (void *ptr1, unsigned int nbytes)
+/* Otherwise returns an error message and 'NULL' (the block  */
+/* pointed by 'ptr1' is left untouched).                     */
+void *CHECKrealloc (void *ptr1, size_t nbytes)
 {
    void *ptr2;
+
+   /* Discounted before, as its address may be reused right */
+   /* after (if 'realloc' fails it is left uncounted).       */
+   if (ptr1 != NULL) {
+      pthread_mutex_lock (&memLock);
+      dropBlock (ptr1);
+      pthread_mutex_unlock (&memLock);
+   }
    ptr2 = realloc (ptr1, nbytes);
 
-   if (ptr2 == NULL) {    
+   if (ptr2 == NULL)
       fprintf (stderr, "\n\n Insufficient memory.\n\n");
-      exit (EXIT_FAILURE);
+   else {
+      pthread_mutex_lock (&memLock);
+      dropBlock (ptr2);
+      addBlock (ptr2, nbytes);
+      pthread_mutex_unlock (&memLock);
    }
 
    return ptr2;
@@ -151,19 +434,125 @@ void *CHECKrealloc (void *ptr1, unsigned int nbytes)
 } /* CHECKrealloc */
 
 
+/* ********************************************************* */
+/* Frees the block 'ptr', discounting it from the statistics */
+/* if it was allocated by 'CHECKmalloc' or 'CHECKrealloc'.   */
+void CHECKfree (void *ptr)
+{
+
+   if (ptr == NULL)
+      return ;
+   pthread_mutex_lock (&memLock);
+   dropBlock (ptr);
+   pthread_mutex_unlock (&memLock);
+   free (ptr);
+
+} /* CHECKfree */
+
+
+/* ********************************************************* */
+/* Sets at 'm' the allocation statistics of the calling      */
+/* thread.                                                   */
+void CHECKmemStats (check_mem *m)
+{
+
+   pthread_mutex_lock (&memLock);
+   if (threadStats () != NULL)
+      *m = *threadMem;
+   else
+      memset (m, 0, sizeof (check_mem));
+   pthread_mutex_unlock (&memLock);
+
+} /* CHECKmemStats */
+
+
+/* ********************************************************* */
+/* Resets the peak (to the current live bytes) and the       */
+/* largest block of the calling thread, so that they refer   */
+/* to what follows (e.g. a timed stage).                     */
+void CHECKmemMark ()
+{
+
+   pthread_mutex_lock (&memLock);
+   if (threadStats () != NULL) {
+      threadMem->peak = threadMem->live;
+      threadMem->largest = 0.0;
+   }
+   pthread_mutex_unlock (&memLock);
+
+} /* CHECKmemMark */
+
+
+/* ********************************************************* */
+/* Returns the bytes allocated and not freed by the process, */
+/* and its peak at '*peak'.                                  */
+double CHECKmemTotal (double *peak)
+{
+   double live;
+
+   pthread_mutex_lock (&memLock);
+   live = memLive;
+   *peak = memPeak;
+   pthread_mutex_unlock (&memLock);
+
+   return live;
+
+} /* CHECKmemTotal */
+
+
+/* ********************************************************* */
+/* Sets at 'count[b]' and 'bytes[b]' the number and the      */
+/* bytes of the allocations of the process with sizes in     */
+/* '[2^b,2^(b+1))' (the last bin also holds the larger ones) */
+/* and the bin 0 the sizes 0 and 1.                          */
+void CHECKmemHistogram (double *count, double *bytes)
+{
+
+   pthread_mutex_lock (&memLock);
+   memcpy (count, histCount, sizeof (histCount));
+   memcpy (bytes, histBytes, sizeof (histBytes));
+   pthread_mutex_unlock (&memLock);
+
+} /* CHECKmemHistogram */
+
+
+/* ********************************************************* */
+/* Returns the peak resident set size of the process, read   */
+/* (as 'VmHWM') from '/proc/self/status' (0 if there is no   */
+/* such file, e.g. out of Linux).                            */
+double CHECKpeakRSS ()
+{
+   double kB = 0.0;
+   char line[128];
+   FILE *F;
+
+   F = fopen ("/proc/self/status", "r");
+   if (F == NULL)
+      return 0.0;
+   while (fgets (line, sizeof (line), F) != NULL)
+      if (strncmp (line, "VmHWM:", 6) == 0) {
+	 kB = atof (line + 6);
+	 break ;
+      }
+   fclose (F);
+
+   return 1024.0 * kB;
+
+} /* CHECKpeakRSS */
+
+
 /* ********************************************************* */
 /* Opens the file named 'filename' in order to execute an    */
 /* operation specified by 'mode' (operations of the 'fopen'  */
-/* function from 'stdio.h') and verifies error.              */
+/* function from 'stdio.h') and verifies error. Returns      */
+/* 'NULL' if the file could not be opened.                   */
 FILE *CHECKfopen (const char *filename, const char *mode)
 {
    FILE *pfile;
 
    pfile = fopen (filename, mode);
-   if (pfile == NULL) {
+   if (pfile == NULL)
       fprintf (stderr, "\n\n Error: Unable to open the file '%s'!\n\n", filename);
-      exit (EXIT_FAILURE);
-   }
 
    return pfile;
 
@@ -174,14 +563,16 @@ FILE *CHECKfopen (const char *filename, const char *mode)
 /* Receives the integer 'info' returned from a call to the   */
 /* 'fclose' function to close a File stream from the file    */
 /* named 'filename' and verifies error.                      */
-void CHECKfclose (int info, const char *filename)
+int CHECKfclose (int info, const char *filename)
 {
 
    if (info != 0) {
       fprintf (stderr, "\n\n Error: Unable to close the file '%s'!\n\n", filename);
-      exit (EXIT_FAILURE);
+      return VIB_ERR_FILE;
    }
 
+   return VIB_SUCCESS;
+
 } /* CHECKfclose */
 
 
@@ -191,12 +582,14 @@ void CHECKfclose (int info, const char *filename)
 /* 'filename' and checks if 'info = EOF', which indicates    */
 /* that an input failure happened before any data could be   */
 /* successfully read.                                        */
-void CHECKfscanf (int info, const char *filename)
+int CHECKfscanf (int info, const char *filename)
 {
    if (info == EOF) {
       fprintf (stderr, "\n\n Error: Unable to read the file '%s'!\n\n", filename);
-      exit (EXIT_FAILURE);
+      return VIB_ERR_FILE;
    }
+
+   return VIB_SUCCESS;
    
 } /* CHECKfscanf */
 
@@ -206,31 +599,37 @@ void CHECKfscanf (int info, const char *filename)
 /* 'sscanf' function to read data from an string 'str' and   */
 /* checks if 'info' differs from the number of variables     */
 /* 'nvar' that should be read.                               */
-void CHECKsscanf (int info, int nvar, char *str)
+int CHECKsscanf (int info, int nvar, char *str)
 {
    if (info != nvar) {
       fprintf (stderr, "\n\n Error: Problem reading the string '%s'!\n\n", str);
-      exit (EXIT_FAILURE);
+      return VIB_ERR_FORMAT;
    }
+
+   return VIB_SUCCESS;
    
 } /* CHECKsscanf */
 
 
 /* ********************************************************* */
-/* Receives the integer 'info' returned from a call to the   */
-/* 'fread' function to read 'count' blocks of data from the  */
-/* file named 'filename' and checks if 'info' differs from   */
-/* the 'count' parameter, which indicates either an error    */
-/* ocurred or the 'End Of File' was reached.                 */
-void CHECKfread (unsigned int info, unsigned int count, const char *filename)
+/* Receives the number 'info' of blocks returned from a call */
+/* to the 'fread' function to read 'count' blocks of data    */
+/* from the file 'F' named 'filename' and checks if 'info'   */
+/* differs from 'count', which indicates either an error     */
+/* ocurred ('VIB_ERR_FILE') or the 'End Of File' was reached */
+/* at a truncated file ('VIB_ERR_FORMAT').                   */
+int CHECKfread (size_t info, size_t count, FILE *F, const char *filename)
 {
    if (info != count) {
-      fprintf (stderr, "\n\n Error: Read something strange at file '%s'!\n\n", filename);
-      /* exit (EXIT_FAILURE); */
+      fprintf (stderr, "\n\n Error: Read something strange at file '%s'"
+	       " (%s)!\n\n", filename, ferror (F) ? "read error" :
+	       "unexpected end of file");
+      return (ferror (F) ? VIB_ERR_FILE : VIB_ERR_FORMAT);
    }
+
+   return VIB_SUCCESS;
    
 } /* CHECKfread */
 
 
 /* ************************ Drafts ************************* */
-
@@ -13,26 +13,86 @@
 /**  repetition when checking errors.                       **/
 /**  *****************************************************  **/
 
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Error codes returned by the library functions. */
+#define VIB_SUCCESS     0 /* no error */
+#define VIB_ERR_MEMORY  1 /* insufficient memory */
+#define VIB_ERR_FILE    2 /* unable to open, read or close a file */
+#define VIB_ERR_FORMAT  3 /* file not written correctly */
+#define VIB_ERR_LAPACK  4 /* failure at a lapack rotine */
+#define VIB_ERR_INPUT   5 /* wrong input or calling sequence */
+#define VIB_ERR_SCRIPT  6 /* failure at 'setInput.sh' script */
+#define VIB_ERR_STOPPED 7 /* stopped on request (checkpoint written) */
+
+/* Returns a short description of the error code 'info'. */
+const char *CHECKerrorString (int info);
 
 /* Calls Lapack rotine 'dsyevd' for computing all eigenvalues and     */
 /* eigenvectors of a real symmetric matrix and checks if it succeeds. */
-void CHECKdsyevd (int n, double *M, double *eigval);
+int CHECKdsyevd (int n, double *M, double *eigval);
+
+/* Calls Lapack rotine 'dsygvd' for computing all eigenvalues and  */
+/* eigenvectors of the generalized problem 'M c = e S c' (with 'S' */
+/* positive definite) and checks if it succeeds.                   */
+int CHECKdsygvd (int n, double *M, double *S, double *eigval);
 
 /* Calls Lapack rotine 'dgetrf' for triangular     */
 /* matrix factorization and checks if it succeeds. */
-void CHECKdgetrf (int n, double *M, int *ipiv);
+int CHECKdgetrf (int n, double *M, int *ipiv);
 
 /* Calls Lapack rotine 'dgetri' for computing the */
 /* inverse matrix and checks if it succeeds.      */
-void CHECKdgetri (int n, double *M, int *ipiv);
+int CHECKdgetri (int n, double *M, int *ipiv);
+
+/* Number of bins (powers of 2) of the allocation sizes histogram. */
+#define CHECK_MEM_BINS 48
+
+/* Allocation statistics of a thread: the blocks allocated with */
+/* 'CHECKmalloc' and 'CHECKrealloc' and freed with 'CHECKfree'.  */
+typedef struct CHECKMEM check_mem;
+struct CHECKMEM {
+   double live; /* bytes allocated and not yet freed (by any thread) */
+   double peak; /* largest 'live' since the last 'CHECKmemMark' */
+   double largest; /* largest block since the last 'CHECKmemMark' */
+   double allocs; /* number of allocations */
+   double bytes; /* bytes allocated */
+};
 
 /* Allocates a block of bytes if there are     */
-/* enough memory, otherwise exits the program. */
-void *CHECKmalloc (unsigned int nbytes);
+/* enough memory, otherwise returns 'NULL'.    */
+void *CHECKmalloc (size_t nbytes);
 
 /* Change the size of a block of bytes if there */
-/* are enough memory or exits the program.      */
-void *CHECKrealloc (void *ptr1, unsigned int nbytes);
+/* are enough memory or returns 'NULL'.         */
+void *CHECKrealloc (void *ptr1, size_t nbytes);
+
+/* Frees a block (allocated by 'CHECKmalloc' or 'CHECKrealloc' */
+/* to be counted as freed, or by any other 'malloc').          */
+void CHECKfree (void *ptr);
+
+/* Sets at 'm' the allocation statistics of the calling thread. */
+void CHECKmemStats (check_mem *m);
+
+/* Resets the peak and the largest block of the calling thread. */
+void CHECKmemMark ();
+
+/* Returns the bytes allocated and not freed by the process */
+/* (and its peak at '*peak').                               */
+double CHECKmemTotal (double *peak);
+
+/* Sets at 'count[b]' and 'bytes[b]' the allocations of the   */
+/* process with sizes in '[2^b,2^(b+1))' ('CHECK_MEM_BINS').  */
+void CHECKmemHistogram (double *count, double *bytes);
+
+/* Returns the peak resident set size of the process (bytes, */
+/* from '/proc/self/status', 0 if not available).            */
+double CHECKpeakRSS ();
 
 /* Opens the file named 'filename' in order to    */
 /* execute a 'mode' operation and verifies error. */
@@ -40,20 +100,25 @@ FILE *CHECKfopen (const char *filename, const char *mode);
 
 /* Verifies the returned value of a call to the    */
 /* 'fclose' function to close the file 'filename'. */
-void CHECKfclose (int info, const char *filename);
+int CHECKfclose (int info, const char *filename);
 
 /* Verifies the returned value of a call to the 'fscanf' */
 /* function to read data from the file named 'filename'. */
-void CHECKfscanf (int info, const char *filename);
+int CHECKfscanf (int info, const char *filename);
 
 /* Verifies the returned value of a call to the 'sscanf'   */
 /* function to read 'nvar' variables from an string 'str'. */
-void CHECKsscanf (int info, int nvar, char *str);
+int CHECKsscanf (int info, int nvar, char *str);
 
 /* Verifies the returned value of a call to the 'fread' function  */
-/* to read 'count' blocks of data from the file named 'filename'. */
-void CHECKfread (unsigned int info, unsigned int count, const char *filename);
+/* to read 'count' blocks of data from the file 'F' named         */
+/* 'filename' (a short read is 'VIB_ERR_FILE' on a read error and */
+/* 'VIB_ERR_FORMAT' at a truncated file).                         */
+int CHECKfread (size_t info, size_t count, FILE *F, const char *filename);
 
 
 /* ************************ Drafts ************************* */
 
+#ifdef __cplusplus
+}
+#endif
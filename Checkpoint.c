@@ -0,0 +1,382 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Implementation of the stage checkpoints of long runs   **/
+/**  and of the content-addressed 'dH' cache. Each stage    **/
+/**  file is written to a temporary name, synced and        **/
+/**  renamed, and only then appended to the manifest, so    **/
+/**  that a run killed at any point leaves a consistent     **/
+/**  checkpoint.                                            **/
+/**  *****************************************************  **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include "Check.h"
+#include "Phonon.h"
+#include "Log.h"
+#include "Checkpoint.h"
+#include "Symmetry.h"
+
+/* Stage files start with this 8 bytes tag. */
+static const char magic[8] = {'V','I','B','C','K','P','T','1'};
+
+/* Size of the buffer used to hash files. */
+#define HASHBUF (1 << 20)
+
+
+/* ********************************************************* */
+/* Returns (at 'path', with at least 'len' chars) the path   */
+/* of the file 'name' at the checkpoint directory.           */
+static void chkPath (vib_context *ctx, const char *name, char *path,
+		     size_t len)
+{
+
+   snprintf (path, len, "%s/%s", ctx->chkDir, name);
+
+} /* chkPath */
+
+
+/* ********************************************************* */
+/* Returns (at 'name') the file name of the stage 'stage' of */
+/* the displacement 'k' ('k < 0' for whole stages).          */
+static void stageName (const char *stage, int k, char *name, size_t len)
+{
+
+   if (k < 0)
+      snprintf (name, len, "%s.chk", stage);
+   else
+      snprintf (name, len, "%s_%.3d.chk", stage, k);
+
+} /* stageName */
+
+
+/* ********************************************************* */
+/* Continues the hash 'h' (start with 'CKPT_HASH_INIT') over */
+/* the 'n' bytes 'data'. It is the 64-bit FNV-1a taken over  */
+/* 8 bytes words (and single bytes at the tail), which is    */
+/* fast enough to hash large '.gHS' files.                   */
+unsigned long long CKPThash (unsigned long long h, const void *data,
+			     size_t n)
+{
+   register size_t i;
+   unsigned long long w;
+   const unsigned char *c = data;
+
+   for (i = 0; i + 8 <= n; i += 8) {
+      memcpy (&w, c + i, 8);
+      h ^= w;
+      h *= 1099511628211ULL;
+   }
+   for (; i < n; i++) {
+      h ^= c[i];
+      h *= 1099511628211ULL;
+   }
+
+   return h;
+
+} /* CKPThash */
+
+
+/* ********************************************************* */
+/* Continues the hash '*h' over the content of the file      */
+/* 'filename'.                                               */
+int CKPThashFile (const char *filename, unsigned long long *h)
+{
+   size_t n;
+   char *buf;
+   FILE *F;
+
+   buf = CHECKmalloc (HASHBUF);
+   if (buf == NULL)
+      return VIB_ERR_MEMORY;
+   F = CHECKfopen (filename, "rb");
+   if (F == NULL) {
+      CHECKfree (buf);
+      return VIB_ERR_FILE;
+   }
+
+   while ((n = fread (buf, 1, HASHBUF, F)) > 0)
+      *h = CKPThash (*h, buf, n);
+
+   CHECKfree (buf);
+   if (ferror (F)) {
+      fprintf (stderr, "\n ERROR: unable to read the file %s!\n\n",
+	       filename);
+      fclose (F);
+      return VIB_ERR_FILE;
+   }
+
+   return CHECKfclose (fclose (F), filename);
+
+} /* CKPThashFile */
+
+
+/* ********************************************************* */
+/* Writes the 'n' values of 'data' at the file 'path'. File  */
+/* layout: the 8 bytes tag, the number of values (size_t),   */
+/* the values and their hash. The file is written to a       */
+/* temporary name, synced and renamed.                       */
+static int writeData (const char *path, const double *data, size_t n)
+{
+   int info = VIB_SUCCESS;
+   unsigned long long sum;
+   char tmp[1040];
+   FILE *CHK;
+
+   /* Unique temporary name, as a cache may be shared by runs. */
+   snprintf (tmp, sizeof (tmp), "%s.%d.%p.tmp", path, (int) getpid (),
+	     (void *) data);
+   CHK = CHECKfopen (tmp, "wb");
+   if (CHK == NULL)
+      return VIB_ERR_FILE;
+   sum = CKPThash (CKPT_HASH_INIT, data, n * sizeof (double));
+   if (fwrite (magic, sizeof (magic), 1, CHK) != 1 ||
+       fwrite (&n, sizeof (size_t), 1, CHK) != 1 ||
+       fwrite (data, sizeof (double), n, CHK) != n ||
+       fwrite (&sum, sizeof (sum), 1, CHK) != 1 ||
+       fflush (CHK) != 0 || fsync (fileno (CHK)) != 0) {
+      fprintf (stderr, "\n ERROR: unable to write the checkpoint %s!\n\n",
+	       tmp);
+      info = VIB_ERR_FILE;
+   }
+   if (info == VIB_SUCCESS)
+      info = CHECKfclose (fclose (CHK), tmp);
+   else
+      fclose (CHK);
+   if (info == VIB_SUCCESS && rename (tmp, path) != 0) {
+      fprintf (stderr, "\n ERROR: unable to rename %s!\n\n", tmp);
+      info = VIB_ERR_FILE;
+   }
+   if (info != VIB_SUCCESS)
+      remove (tmp);
+
+   return info;
+
+} /* writeData */
+
+
+/* ********************************************************* */
+/* Reads the 'n' values at the file 'path' into 'data'.      */
+/* Returns 'VIB_ERR_FILE' (quietly) if there is no such file */
+/* and 'VIB_ERR_FORMAT' if it doesn't hold 'n' values or the */
+/* hash fails.                                               */
+static int readData (vib_context *ctx, const char *path, double *data,
+		     size_t n)
+{
+   size_t nFile;
+   unsigned long long sum;
+   char tag[8];
+   FILE *CHK;
+
+   CHK = fopen (path, "rb");
+   if (CHK == NULL)
+      return VIB_ERR_FILE;
+   if (fread (tag, sizeof (tag), 1, CHK) != 1 ||
+       memcmp (tag, magic, sizeof (magic)) != 0 ||
+       fread (&nFile, sizeof (size_t), 1, CHK) != 1 || nFile != n ||
+       fread (data, sizeof (double), n, CHK) != n ||
+       fread (&sum, sizeof (sum), 1, CHK) != 1 ||
+       sum != CKPThash (CKPT_HASH_INIT, data, n * sizeof (double))) {
+      LOGinfo (ctx, "\n File %s is corrupted, recomputing.\n", path);
+      fclose (CHK);
+      return VIB_ERR_FORMAT;
+   }
+
+   return CHECKfclose (fclose (CHK), path);
+
+} /* readData */
+
+
+/* ********************************************************* */
+/* Opens the checkpoint of the system at 'ctx'. The first    */
+/* line of the manifest identifies the system; if it doesn't */
+/* match (or there is no manifest) a new one is started and  */
+/* the previous stage files are ignored.                     */
+int CKPTopen (vib_context *ctx)
+{
+   char path[1024], system[256], line[256];
+   FILE *MAN;
+
+   chkPath (ctx, "manifest", path, sizeof (path));
+   snprintf (system, sizeof (system), "system %s %d %d %d %.10e\n",
+	     ctx->sysLabel, ctx->nAtoms, ctx->FCfirst, ctx->FClast,
+	     ctx->FCdispl);
+   if (ctx->actIdx != NULL) /* truncated basis (active region) */
+      snprintf (system + strlen (system) - 1, sizeof (system)
+		- strlen (system) + 1, " active %d %llx\n", ctx->nAct,
+		CKPThash (CKPT_HASH_INIT, ctx->actIdx,
+			  ctx->no_u * sizeof (int)));
+   if (ctx->sym != NULL) /* symmetry-reduced displacements */
+      snprintf (system + strlen (system) - 1, sizeof (system)
+		- strlen (system) + 1, " symmetry %d %llx\n", ctx->sym->nOps,
+		CKPThash (CKPThash (CKPT_HASH_INIT, ctx->sym->rot,
+				    9 * ctx->sym->nOps * sizeof (double)),
+			  ctx->sym->image,
+			  ctx->sym->nOps * ctx->nAtoms * sizeof (int)));
+
+   /* Keeps the manifest of the same system. */
+   MAN = fopen (path, "r");
+   if (MAN != NULL) {
+      if (fgets (line, sizeof (line), MAN) != NULL &&
+	  fgets (line, sizeof (line), MAN) != NULL &&
+	  strcmp (line, system) == 0) {
+	 fclose (MAN);
+	 return VIB_SUCCESS;
+      }
+      fclose (MAN);
+      LOGinfo (ctx,
+	       "\n Checkpoint at %s is from another system, ignoring it.\n",
+	       ctx->chkDir);
+   }
+
+   /* Starts a new manifest. */
+   MAN = CHECKfopen (path, "w");
+   if (MAN == NULL)
+      return VIB_ERR_FILE;
+   fprintf (MAN, "# vibrations checkpoint manifest (version 1)\n");
+   fprintf (MAN, "%s", system);
+   fflush (MAN);
+   fsync (fileno (MAN));
+
+   return CHECKfclose (fclose (MAN), path);
+
+} /* CKPTopen */
+
+
+/* ********************************************************* */
+/* Returns 1 if the stage 'stage' of the displacement 'k' is */
+/* recorded at the manifest, and 0 otherwise.                */
+int CKPTdone (vib_context *ctx, const char *stage, int k)
+{
+   int kk, found = 0;
+   char path[1024], line[256], st[64];
+   FILE *MAN;
+
+   if (ctx->chkDir == NULL)
+      return 0;
+
+   chkPath (ctx, "manifest", path, sizeof (path));
+   MAN = fopen (path, "r");
+   if (MAN == NULL)
+      return 0;
+   while (!found && fgets (line, sizeof (line), MAN) != NULL)
+      if (sscanf (line, "%63s %d", st, &kk) == 2 &&
+	  strcmp (st, stage) == 0 && kk == k)
+	 found = 1;
+   fclose (MAN);
+
+   return found;
+
+} /* CKPTdone */
+
+
+/* ********************************************************* */
+/* Writes the 'n' values of 'data' as the checkpoint of the  */
+/* stage 'stage' of the displacement 'k' and records it at   */
+/* the manifest.                                             */
+int CKPTsave (vib_context *ctx, const char *stage, int k,
+	      const double *data, size_t n)
+{
+   int info;
+   char name[64], path[1024];
+   FILE *MAN;
+
+   stageName (stage, k, name, sizeof (name));
+   chkPath (ctx, name, path, sizeof (path));
+   info = writeData (path, data, n);
+   if (info != VIB_SUCCESS)
+      return info;
+
+   /* Records the stage at the manifest. */
+   chkPath (ctx, "manifest", path, sizeof (path));
+   MAN = CHECKfopen (path, "a");
+   if (MAN == NULL)
+      return VIB_ERR_FILE;
+   fprintf (MAN, "%s %d %s\n", stage, k, name);
+   fflush (MAN);
+   fsync (fileno (MAN));
+
+   return CHECKfclose (fclose (MAN), path);
+
+} /* CKPTsave */
+
+
+/* ********************************************************* */
+/* Reads the checkpoint of the stage 'stage' of the          */
+/* displacement 'k' into 'data'. Returns 'VIB_ERR_FORMAT' if */
+/* the file doesn't hold 'n' values or the checksum fails,   */
+/* in which case the stage should be recomputed.             */
+int CKPTload (vib_context *ctx, const char *stage, int k,
+	      double *data, size_t n)
+{
+   int info;
+   char name[64], path[1024];
+
+   stageName (stage, k, name, sizeof (name));
+   chkPath (ctx, name, path, sizeof (path));
+   info = readData (ctx, path, data, n);
+   if (info == VIB_ERR_FILE)
+      fprintf (stderr, "\n ERROR: unable to read the checkpoint %s!\n\n",
+	       path);
+
+   return info;
+
+} /* CKPTload */
+
+
+/* ********************************************************* */
+/* Returns (at 'path') the path of the cache entry of kind   */
+/* 'kind' with key 'key'.                                    */
+static void cachePath (vib_context *ctx, const char *kind,
+		       unsigned long long key, char *path, size_t len)
+{
+
+   snprintf (path, len, "%s/%s_%016llx.chk", ctx->cacheDir, kind, key);
+
+} /* cachePath */
+
+
+/* ********************************************************* */
+/* Reads the cache entry of kind 'kind' with key 'key' into  */
+/* 'data'. Returns 'VIB_SUCCESS' on a hit.                   */
+int CKPTcacheLoad (vib_context *ctx, const char *kind,
+		   unsigned long long key, double *data, size_t n)
+{
+   char path[1024];
+
+   if (ctx->cacheDir == NULL)
+      return VIB_ERR_FILE;
+   cachePath (ctx, kind, key, path, sizeof (path));
+
+   return readData (ctx, path, data, n);
+
+} /* CKPTcacheLoad */
+
+
+/* ********************************************************* */
+/* Stores the 'n' values of 'data' as the cache entry of     */
+/* kind 'kind' with key 'key'.                               */
+int CKPTcacheSave (vib_context *ctx, const char *kind,
+		   unsigned long long key, const double *data, size_t n)
+{
+   char path[1024];
+
+   if (ctx->cacheDir == NULL)
+      return VIB_SUCCESS;
+   cachePath (ctx, kind, key, path, sizeof (path));
+
+   return writeData (path, data, n);
+
+} /* CKPTcacheSave */
+
+
+/* ************************ Drafts ************************* */
@@ -0,0 +1,62 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Interface for the stage checkpoints of long runs. A    **/
+/**  checkpoint directory holds a text 'manifest' with the  **/
+/**  completed stages and one binary file per stage:        **/
+/**   - 'modes.chk' and 'energies.chk': phonon modes;       **/
+/**   - 'dH_NNN.chk': raw 'dH' of the displacement NNN;     **/
+/**   - 'dHcorr.chk': corrected 'dH' of all displacements.  **/
+/**  The 'dH' cache holds entries named by the hash of      **/
+/**  their inputs, shared by all the runs using it:         **/
+/**   - 'dH_<key>.chk': raw 'dH' of a displacement pair;    **/
+/**   - 'dHc_<key>.chk': corrected 'dH' of a dynamic atom.  **/
+/**  *****************************************************  **/
+
+/* Initial value of the hashes. */
+#define CKPT_HASH_INIT 14695981039346656037ULL
+
+/* Continues the hash 'h' over the 'n' bytes 'data'. */
+unsigned long long CKPThash (unsigned long long h, const void *data,
+			     size_t n);
+
+/* Continues the hash '*h' over the content of a file. */
+int CKPThashFile (const char *filename, unsigned long long *h);
+
+
+/* Opens the checkpoint of the system at 'ctx' (starting a new */
+/* manifest if there is none or it belongs to other system).   */
+int CKPTopen (vib_context *ctx);
+
+/* Returns 1 if the stage 'stage' (of displacement 'k', or    */
+/* -1 for whole stages) is at the manifest, and 0 otherwise.  */
+int CKPTdone (vib_context *ctx, const char *stage, int k);
+
+/* Writes the 'n' values of 'data' as the checkpoint of the */
+/* stage 'stage' and records it at the manifest.            */
+int CKPTsave (vib_context *ctx, const char *stage, int k,
+	      const double *data, size_t n);
+
+/* Reads the 'n' values of the checkpoint of the stage 'stage' */
+/* into 'data', verifying its size and checksum.               */
+int CKPTload (vib_context *ctx, const char *stage, int k,
+	      double *data, size_t n);
+
+
+/* Reads the cache entry of kind 'kind' and key 'key' into  */
+/* 'data' (returns 'VIB_SUCCESS' on a hit).                  */
+int CKPTcacheLoad (vib_context *ctx, const char *kind,
+		   unsigned long long key, double *data, size_t n);
+
+/* Stores 'data' as the cache entry of kind 'kind' and key 'key'. */
+int CKPTcacheSave (vib_context *ctx, const char *kind,
+		   unsigned long long key, const double *data, size_t n);
+
+
+/* ************************ Drafts ************************* */
@@ -15,6 +15,7 @@
 /* For compiling with old version of Intel MKL. */
 #ifdef OLD
 #define dsyevd dsyevd_
+#define dsygvd dsygvd_
 #define dgetrf dgetrf_
 #define dgetri dgetri_
 #define dgemm dgemm_
@@ -27,6 +28,13 @@
 void dsyevd (char *jobz, char *uplo, int *n, double *a, int *lda, double *w,
 	     double *work, int *lwork, int *iwork, int *liwork, int *info);
 
+/* Lapack rotine: computes all eigenvalues and (optionally) */
+/* all eigenvectors of a real generalized symmetric-definite */
+/* eigenproblem using "divide and conquer" algorithm.        */
+void dsygvd (int *itype, char *jobz, char *uplo, int *n, double *a, int *lda,
+	     double *b, int *ldb, double *w, double *work, int *lwork,
+	     int *iwork, int *liwork, int *info);
+
 /* Lapack rotine: forms a triangular matrix factorization (trf) */
 /* from a general matrix (ge) of double precision real (d).     */
 void dgetrf (int *m, int *n, double *a, int *lda, int *ipiv, int *info);
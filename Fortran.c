@@ -0,0 +1,262 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Implementation of the fortran interface: wrappers that **/
+/**  dereference the context handle, turn the blank padded  **/
+/**  strings into C strings and return the error codes at   **/
+/**  'info'.                                                **/
+/**  *****************************************************  **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include "Check.h"
+#include "Phonon.h"
+#include "Fortran.h"
+
+
+/* ********************************************************* */
+/* Returns a copy of the fortran string 's' of length 'len'  */
+/* without the trailing blanks ('NULL' if there is not       */
+/* enough memory).                                           */
+static char *cString (const char *s, flen len)
+{
+   char *c;
+
+   while (len > 0 && s[len-1] == ' ')
+      len--;
+
+   c = CHECKmalloc ((len + 1) * sizeof (char));
+   if (c == NULL)
+      return NULL;
+   memcpy (c, s, len);
+   c[len] = '\0';
+
+   return c;
+
+} /* cString */
+
+
+/* ********************************************************* */
+/* Creates a context at the handle 'ctx'.                    */
+void phonnewcontext_ (vib_context **ctx)
+{
+
+   *ctx = PHONnewContext ();
+
+} /* phonnewcontext_ */
+
+
+/* ********************************************************* */
+/* Frees the context of the handle 'ctx'.                    */
+void phonfreecontext_ (vib_context **ctx)
+{
+
+   PHONfreeContext (*ctx);
+   *ctx = NULL;
+
+} /* phonfreecontext_ */
+
+
+/* ********************************************************* */
+/* Enables the stage checkpoints at the directory 'dir'.     */
+void phonsetcheckpoint_ (vib_context **ctx, const char *dir, int *info,
+			 flen dirLen)
+{
+   char *d;
+
+   d = cString (dir, dirLen);
+   *info = (d == NULL ? VIB_ERR_MEMORY : PHONsetCheckpoint (*ctx, d));
+
+   /* Frees memory. */
+   CHECKfree (d);
+
+} /* phonsetcheckpoint_ */
+
+
+/* ********************************************************* */
+/* Enables the 'dH' cache at the directory 'dir'.            */
+void phonsetcache_ (vib_context **ctx, const char *dir, int *info,
+		    flen dirLen)
+{
+   char *d;
+
+   d = cString (dir, dirLen);
+   *info = (d == NULL ? VIB_ERR_MEMORY : PHONsetCache (*ctx, d));
+
+   /* Frees memory. */
+   CHECKfree (d);
+
+} /* phonsetcache_ */
+
+
+/* ********************************************************* */
+/* Enables the per-mode coupling summaries.                  */
+void phonsetsummary_ (vib_context **ctx, int *nSubsets, int *subsets,
+		      int *info)
+{
+
+   *info = PHONsetSummary (*ctx, nSubsets, subsets);
+
+} /* phonsetsummary_ */
+
+
+/* ********************************************************* */
+/* Enables the symmetry-reduced displacements.               */
+void phonsetsymmetry_ (vib_context **ctx, const char *ops, int *info,
+		       flen opsLen)
+{
+   char *o;
+
+   o = cString (ops, opsLen);
+   *info = (o == NULL ? VIB_ERR_MEMORY : PHONsetSymmetry (*ctx, o));
+
+   /* Frees memory. */
+   CHECKfree (o);
+
+} /* phonsetsymmetry_ */
+
+
+/* ********************************************************* */
+/* Collects required informations from FC input 'fdf' file.  */
+void phonreadfcfdf_ (vib_context **ctx, const char *exec,
+		     const char *FCpath, const char *FCinput,
+		     int *calcType, const char *FCsplit, int *nDynTot,
+		     int *nDynOrb, int *spinPol, int *info, flen execLen,
+		     flen pathLen, flen inputLen, flen splitLen)
+{
+   char *e, *p, *i, *s;
+
+   e = cString (exec, execLen);
+   p = cString (FCpath, pathLen);
+   i = cString (FCinput, inputLen);
+   s = cString (FCsplit, splitLen);
+   if (e == NULL || p == NULL || i == NULL || s == NULL)
+      *info = VIB_ERR_MEMORY;
+   else
+      *info = PHONreadFCfdf (*ctx, e, p, i, *calcType, s, nDynTot,
+			     nDynOrb, spinPol);
+
+   /* Frees memory. */
+   CHECKfree (e);
+   CHECKfree (p);
+   CHECKfree (i);
+   CHECKfree (s);
+
+} /* phonreadfcfdf_ */
+
+
+/* ********************************************************* */
+/* Estimates the peak memory (in bytes) of the calculation.  */
+void phonmemestimate_ (vib_context **ctx, double *mem)
+{
+
+   *mem = PHONmemEstimate (*ctx);
+
+} /* phonmemestimate_ */
+
+
+/* ********************************************************* */
+/* Computes phonon frequencies and modes.                    */
+void phonfreq_ (vib_context **ctx, double *EigVec, double *EigVal,
+		int *info)
+{
+
+   *info = PHONfreq (*ctx, EigVec, EigVal);
+
+} /* phonfreq_ */
+
+
+/* ********************************************************* */
+/* Writes a 'xyz' file for each computed phonon mode.        */
+void phonjmolvib_ (vib_context **ctx, double *EigVec, int *info)
+{
+
+   *info = PHONjmolVib (*ctx, EigVec);
+
+} /* phonjmolvib_ */
+
+
+/* ********************************************************* */
+/* Writes the phonon modes for Jmol.                         */
+void phonjmolout_ (vib_context **ctx, double *EigVec, double *EigVal,
+		   int *info)
+{
+
+   *info = PHONjmolOut (*ctx, EigVec, EigVal);
+
+} /* phonjmolout_ */
+
+
+/* ********************************************************* */
+/* Computes electron-phonon coupling matrices.               */
+void phonephcoupling_ (vib_context **ctx, double *EigVec, double *EigVal,
+		       double *Meph, int *info)
+{
+
+   *info = PHONephCoupling (*ctx, EigVec, EigVal, Meph);
+
+} /* phonephcoupling_ */
+
+
+/* ********************************************************* */
+/* Sets up the context for an in-memory calculation.         */
+void phonsetsystem_ (vib_context **ctx, const char *label, int *nAtoms,
+		     int *nspin, int *FCfirst, int *FClast, double *displ,
+		     int *Zdyn, int *orbIndex, int *info, flen labelLen)
+{
+   char *l;
+
+   l = cString (label, labelLen);
+   if (l == NULL)
+      *info = VIB_ERR_MEMORY;
+   else
+      *info = PHONsetSystem (*ctx, l, nAtoms, nspin, FCfirst, FClast,
+			     displ, Zdyn, orbIndex);
+
+   /* Frees memory. */
+   CHECKfree (l);
+
+} /* phonsetsystem_ */
+
+
+/* ********************************************************* */
+/* Accumulates the data of the displacement 'disp'.          */
+void phonadddisplacement_ (vib_context **ctx, int *disp, int *numh,
+			   int *listh, double *H, double *S,
+			   double *forces, double *Ef, int *info)
+{
+
+   *info = PHONaddDisplacement (*ctx, disp, numh, listh, H, S, forces, Ef);
+
+} /* phonadddisplacement_ */
+
+
+/* ********************************************************* */
+/* Accumulates the sparse overlap of the 'onlyS' run 'disp'. */
+void phonaddonlys_ (vib_context **ctx, int *disp, int *numh, int *listh,
+		    double *S, int *info)
+{
+
+   *info = PHONaddOnlyS (*ctx, disp, numh, listh, S);
+
+} /* phonaddonlys_ */
+
+
+/* ********************************************************* */
+/* Computes phonon modes and electron-phonon coupling        */
+/* matrices from the accumulated data.                       */
+void phonephinmemory_ (vib_context **ctx, double *EigVec, double *EigVal,
+		       double *Meph, int *info)
+{
+
+   *info = PHONephInMemory (*ctx, EigVec, EigVal, Meph);
+
+} /* phonephinmemory_ */
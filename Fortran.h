@@ -0,0 +1,117 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Interface for calling the library from fortran         **/
+/**  programs (e.g. SIESTA). Each entry point of 'Phonon.h' **/
+/**  has a subroutine with the lower case name and a        **/
+/**  trailing underscore, where:                            **/
+/**   - the context is an 'integer(8)' handle, set by       **/
+/**   'phonnewcontext' and passed by reference;             **/
+/**   - all the scalars are passed by reference;            **/
+/**   - the strings are blank padded, with the hidden       **/
+/**   lengths appended by the compiler after the other      **/
+/**   arguments;                                            **/
+/**   - the error code ('VIB_*' at 'Check.h') is returned   **/
+/**   at the last argument 'info'.                          **/
+/**  Example:                                               **/
+/**     integer(8) :: ctx                                   **/
+/**     call phonnewcontext (ctx)                           **/
+/**     call phonsetsystem (ctx, 'label', nAtoms, nspin,    **/
+/**    &     FCfirst, FClast, displ, Zdyn, orbIndex, info)  **/
+/**     ...                                                 **/
+/**     call phonfreecontext (ctx)                          **/
+/**  The subroutines of version 1 ('phonheader_' and the    **/
+/**  'phonreadfcfdf_', 'phonfreq_' and 'phonephcoupling_'   **/
+/**  without a context, from the 'FORTRAN' macros of        **/
+/**  'Phonon.h') were removed: the callers must create a    **/
+/**  context and pass its handle first to the wrappers      **/
+/**  below (the header is printed by 'vibrations' only).    **/
+/**  *****************************************************  **/
+
+#include <stddef.h>
+#include "Phonon.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Hidden length of a fortran string argument ('size_t' at */
+/* gfortran 8 or later and at ifort).                      */
+typedef size_t flen;
+
+/* Creates a context at the handle 'ctx' (0 if there is not */
+/* enough memory).                                          */
+void phonnewcontext_ (vib_context **ctx);
+
+/* Frees the context of the handle 'ctx' and resets it to 0. */
+void phonfreecontext_ (vib_context **ctx);
+
+/* See 'PHONsetCheckpoint'. */
+void phonsetcheckpoint_ (vib_context **ctx, const char *dir, int *info,
+			 flen dirLen);
+
+/* See 'PHONsetCache'. */
+void phonsetcache_ (vib_context **ctx, const char *dir, int *info,
+		    flen dirLen);
+
+/* See 'PHONsetSummary'. */
+void phonsetsummary_ (vib_context **ctx, int *nSubsets, int *subsets,
+		      int *info);
+
+/* See 'PHONsetSymmetry'. */
+void phonsetsymmetry_ (vib_context **ctx, const char *ops, int *info,
+		       flen opsLen);
+
+/* See 'PHONreadFCfdf'. */
+void phonreadfcfdf_ (vib_context **ctx, const char *exec,
+		     const char *FCpath, const char *FCinput,
+		     int *calcType, const char *FCsplit, int *nDynTot,
+		     int *nDynOrb, int *spinPol, int *info, flen execLen,
+		     flen pathLen, flen inputLen, flen splitLen);
+
+/* See 'PHONmemEstimate' (bytes at 'mem'). */
+void phonmemestimate_ (vib_context **ctx, double *mem);
+
+/* See 'PHONfreq'. */
+void phonfreq_ (vib_context **ctx, double *EigVec, double *EigVal,
+		int *info);
+
+/* See 'PHONjmolVib'. */
+void phonjmolvib_ (vib_context **ctx, double *EigVec, int *info);
+
+/* See 'PHONjmolOut'. */
+void phonjmolout_ (vib_context **ctx, double *EigVec, double *EigVal,
+		   int *info);
+
+/* See 'PHONephCoupling'. */
+void phonephcoupling_ (vib_context **ctx, double *EigVec, double *EigVal,
+		       double *Meph, int *info);
+
+/* See 'PHONsetSystem'. */
+void phonsetsystem_ (vib_context **ctx, const char *label, int *nAtoms,
+		     int *nspin, int *FCfirst, int *FClast, double *displ,
+		     int *Zdyn, int *orbIndex, int *info, flen labelLen);
+
+/* See 'PHONaddDisplacement'. */
+void phonadddisplacement_ (vib_context **ctx, int *disp, int *numh,
+			   int *listh, double *H, double *S,
+			   double *forces, double *Ef, int *info);
+
+/* See 'PHONaddOnlyS'. */
+void phonaddonlys_ (vib_context **ctx, int *disp, int *numh, int *listh,
+		    double *S, int *info);
+
+/* See 'PHONephInMemory'. */
+void phonephinmemory_ (vib_context **ctx, double *EigVec, double *EigVal,
+		       double *Meph, int *info);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,324 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Implementation of the kernels of one instruction set   **/
+/**  path ('KERN_PATH', set by the makefiles together with  **/
+/**  the compiler flags of the path). The scalar object     **/
+/**  also holds the path selection ('KERNtable').           **/
+/**  *****************************************************  **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "Utils.h"
+#include "Kernels.h"
+
+#ifndef KERN_PATH
+#define KERN_PATH KERN_SCALAR
+#endif
+
+/* Names of the kernels of this path. */
+#if KERN_PATH == KERN_AVX512
+#define KFN(name) name##AVX512
+#define KERN_NAME "avx512"
+#elif KERN_PATH == KERN_AVX2
+#define KFN(name) name##AVX2
+#define KERN_NAME "avx2"
+#else
+#define KFN(name) name##Scalar
+#define KERN_NAME "scalar"
+#endif
+
+/* Exact powers of ten (as doubles). */
+static const double pow10[23] = {
+   1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+/**  ********************** Kernels **********************  **/
+
+/* ********************************************************* */
+/* Fermi energy shift: 'H(s) = H(s) - ef * S'.               */
+static void KFN(fermiShift) (int n, int nspin, double *H, const double *S,
+			     double ef)
+{
+   register int i, s;
+
+   for (s = 0; s < nspin; s++)
+      for (i = 0; i < n; i++)
+	 H[s*n+i] -= ef * S[i];
+
+} /* fermiShift */
+
+
+/* ********************************************************* */
+/* Finite differences of a pair of displacements:            */
+/* 'dH = (Hp - Hm - def * S0) / twoQ'.                       */
+static void KFN(finiteDiff) (int n, int nspin, double *dH, const double *Hm,
+			     const double *Hp, const double *S0, double def,
+			     double twoQ)
+{
+   register int i, s;
+
+   for (s = 0; s < nspin; s++)
+      for (i = 0; i < n; i++)
+	 dH[s*n+i] = (Hp[s*n+i] - Hm[s*n+i] - def * S0[i]) / twoQ;
+
+} /* finiteDiff */
+
+
+/* ********************************************************* */
+/* Egg-box removal (force conservation) of the columns of    */
+/* the FC matrix with all atoms. The three coordinates are   */
+/* summed in a single pass over each column, in the same     */
+/* order as one pass per coordinate.                         */
+static void KFN(eggBox) (int nAtoms, int nCols, int first, double *FC)
+{
+   register int i, j, dyn;
+   double sx, sy, sz, *col;
+
+   for (j = 0; j < nCols; j++) {
+      col = &FC[idx(0,j,3*nAtoms)];
+      dyn = first + j / 3; /* displaced atom */
+      col[3*dyn] = col[3*dyn+1] = col[3*dyn+2] = 0.0;
+      sx = sy = sz = 0.0;
+      for (i = 0; i < nAtoms; i++) {
+	 sx = sx + col[3*i];
+	 sy = sy + col[3*i+1];
+	 sz = sz + col[3*i+2];
+      }
+      col[3*dyn] = - 1.0 * sx;
+      col[3*dyn+1] = - 1.0 * sy;
+      col[3*dyn+2] = - 1.0 * sz;
+   }
+
+} /* eggBox */
+
+
+/* ********************************************************* */
+/* Symmetrizes and mass-scales the 'n x n' matrix 'FC'.      */
+static void KFN(symmScale) (int n, double *FC, const double *mass)
+{
+   register int i, j;
+   double aux;
+
+   for (j = 0; j < n; j++)
+      for (i = j; i < n; i++) {
+	 aux = (FC[idx(i,j,n)] + FC[idx(j,i,n)]) / 2.0;
+	 aux = aux / sqrt (mass[i/3] * mass[j/3]);
+	 FC[idx(i,j,n)] = FC[idx(j,i,n)] = aux;
+      }
+
+} /* symmScale */
+
+
+/* ********************************************************* */
+/* Accumulates the contribution of one coordinate to the     */
+/* coupling block of one mode: 'M = M + dH * e * cst / sq'.  */
+static void KFN(ephBlock) (int nOrb, int ld, double *M, const double *dH,
+			   double e, double cst, double sq)
+{
+   register int i, j;
+
+   for (j = 0; j < nOrb; j++)
+      for (i = 0; i < nOrb; i++)
+	 M[idx(i,j,nOrb)] += dH[idx(i,j,ld)] * e * cst / sq;
+
+} /* ephBlock */
+
+
+/* ********************************************************* */
+/* Parses up to 'n' numbers of 's' into 'v'. The numbers     */
+/* with at most 15 significant digits and a decimal exponent */
+/* up to 22 (all of the SIESTA '.FC' files) are exact as     */
+/* integer times or over a power of ten, so a single IEEE    */
+/* operation gives the correctly rounded value, the same as  */
+/* 'strtod'; the others are parsed by 'strtod'.              */
+static int KFN(parse) (const char *s, double *v, int n, const char **end)
+{
+   int count, digits, exp10, ex, neg, eneg, any;
+   unsigned long long w;
+   double val;
+   const char *p, *q, *r;
+   char *e;
+
+   p = s;
+   for (count = 0; count < n; count++) {
+      while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+	 p++;
+      if (*p == '\0')
+	 break ;
+
+      /* Sign, integer and fraction digits. */
+      q = p;
+      neg = (*q == '-');
+      if (*q == '-' || *q == '+')
+	 q++;
+      w = 0;
+      digits = exp10 = any = 0;
+      for (; *q >= '0' && *q <= '9'; q++, any = 1) {
+	 w = 10 * w + (*q - '0');
+	 digits += (w != 0);
+      }
+      if (*q == '.')
+	 for (q++; *q >= '0' && *q <= '9'; q++, any = 1) {
+	    w = 10 * w + (*q - '0');
+	    digits += (w != 0);
+	    exp10--;
+	 }
+
+      /* Exponent (only if it has digits, as at 'strtod'). */
+      if (any && (*q == 'e' || *q == 'E')) {
+	 r = q + 1;
+	 eneg = (*r == '-');
+	 if (*r == '-' || *r == '+')
+	    r++;
+	 if (*r >= '0' && *r <= '9') {
+	    for (ex = 0; *r >= '0' && *r <= '9'; r++)
+	       if (ex < 10000)
+		  ex = 10 * ex + (*r - '0');
+	    exp10 += (eneg ? -ex : ex);
+	    q = r;
+	 }
+      }
+
+      /* Fast (exact) path or 'strtod'. */
+      if (any && digits <= 15 && exp10 >= -22 && exp10 <= 22 &&
+	  (*q == '\0' || *q == ' ' || *q == '\t' || *q == '\n' ||
+	   *q == '\r')) {
+	 val = (exp10 < 0 ? (double) w / pow10[-exp10]
+		: (double) w * pow10[exp10]);
+	 v[count] = (neg ? -val : val);
+	 p = q;
+      }
+      else {
+	 v[count] = strtod (p, &e);
+	 if (e == p)
+	    break ;
+	 p = e;
+      }
+   }
+   if (end != NULL)
+      *end = p;
+
+   return count;
+
+} /* parse */
+
+
+/* Kernels of this path. */
+const kern_table KFN(kern) = {
+   KERN_NAME, KFN(fermiShift), KFN(finiteDiff), KFN(eggBox),
+   KFN(symmScale), KFN(ephBlock), KFN(parse)
+};
+
+
+#if KERN_PATH == KERN_SCALAR
+/**  ******************* Path selection ******************  **/
+
+/* Kernels of the other paths (other objects). */
+extern const kern_table kernAVX2, kernAVX512;
+
+/* Active path, selected once. */
+static const kern_table *active = NULL;
+static char description[80];
+static pthread_once_t selected = PTHREAD_ONCE_INIT;
+
+
+/* ********************************************************* */
+/* Returns 1 if the CPU (and the OS) supports the 'path'.    */
+static int supported (int path)
+{
+
+#if defined(__x86_64__) || defined(__i386__)
+   __builtin_cpu_init ();
+   if (path == KERN_AVX512)
+      return __builtin_cpu_supports ("avx512f");
+   if (path == KERN_AVX2)
+      return __builtin_cpu_supports ("avx2");
+#endif
+
+   return (path == KERN_SCALAR);
+
+} /* supported */
+
+
+/* ********************************************************* */
+/* Selects the best path supported by the CPU, or the one    */
+/* forced by 'VIB_KERNELS' (if supported).                   */
+static void selectPath ()
+{
+   register int p;
+   int best, forced = -1;
+   const char *env;
+   const kern_table *paths[KERN_N_PATHS] = {
+      &kernScalar, &kernAVX2, &kernAVX512
+   };
+
+   for (best = KERN_N_PATHS - 1; best > KERN_SCALAR; best--)
+      if (supported (best))
+	 break ;
+
+   env = getenv ("VIB_KERNELS");
+   if (env != NULL && env[0] != '\0') {
+      for (p = 0; p < KERN_N_PATHS; p++)
+	 if (strcmp (env, paths[p]->name) == 0)
+	    forced = p;
+      if (forced < 0)
+	 fprintf (stderr, " WARNING: unknown VIB_KERNELS=\"%s\" (scalar,"
+		  " avx2 or avx512), using %s!\n", env, paths[best]->name);
+      else if (!supported (forced)) {
+	 fprintf (stderr, " WARNING: the CPU doesn't support"
+		  " VIB_KERNELS=%s, using %s!\n", env, paths[best]->name);
+	 forced = -1;
+      }
+   }
+
+   if (forced >= 0) {
+      active = paths[forced];
+      sprintf (description, "%s (forced by VIB_KERNELS)", active->name);
+   }
+   else {
+      active = paths[best];
+      sprintf (description, "%s", active->name);
+   }
+
+} /* selectPath */
+
+
+/* ********************************************************* */
+/* Returns the kernels of the active path (selected at the   */
+/* first call).                                              */
+const kern_table *KERNtable ()
+{
+
+   pthread_once (&selected, selectPath);
+
+   return active;
+
+} /* KERNtable */
+
+
+/* ********************************************************* */
+/* Returns a description of the active path.                 */
+const char *KERNdescribe ()
+{
+
+   pthread_once (&selected, selectPath);
+
+   return description;
+
+} /* KERNdescribe */
+#endif
+
+
+/* ************************ Drafts ************************* */
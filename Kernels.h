@@ -0,0 +1,77 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Interface of the hot loops that are not BLAS calls.    **/
+/**  'Kernels.c' is compiled once for each instruction set  **/
+/**  path ('KERN_PATH' = 'KERN_SCALAR', 'KERN_AVX2' or      **/
+/**  'KERN_AVX512', see the makefiles) and the path used is **/
+/**  chosen at the first call to 'KERNtable' from the CPU   **/
+/**  (CPUID), or forced by the environment variable         **/
+/**  'VIB_KERNELS' (scalar, avx2 or avx512). None of the    **/
+/**  paths reorders the floating point operations (and FMA  **/
+/**  is not enabled), so all of them give the same results. **/
+/**  The paths differ only in the compiler flags: the same  **/
+/**  C source, with no intrinsics. Only the element-wise    **/
+/**  loops ('fermiShift', 'finiteDiff' and 'ephBlock') are  **/
+/**  vectorized wider by the compiler; the fixed-order sums **/
+/**  of 'eggBox' and the strided 'symmScale' stay scalar at **/
+/**  all paths. The 'vibbench' timings of the three paths   **/
+/**  are the same within the noise (these loops are memory  **/
+/**  bound and far from the BLAS calls in time).            **/
+/**  *****************************************************  **/
+
+/* Instruction set paths. */
+#define KERN_SCALAR  0
+#define KERN_AVX2    1
+#define KERN_AVX512  2
+#define KERN_N_PATHS 3
+
+/* Kernels of one path. */
+typedef struct KERNTABLE kern_table;
+struct KERNTABLE {
+   const char *name; /* path name */
+
+   /* 'H(s) = H(s) - ef * S' for the 'nspin' blocks of 'n' */
+   /* elements of 'H' (Fermi energy shift).                */
+   void (*fermiShift) (int n, int nspin, double *H, const double *S,
+		       double ef);
+
+   /* 'dH = (Hp - Hm - def * S0) / twoQ' for the 'nspin' blocks */
+   /* of 'n' elements (finite differences of a pair).           */
+   void (*finiteDiff) (int n, int nspin, double *dH, const double *Hm,
+		       const double *Hp, const double *S0, double def,
+		       double twoQ);
+
+   /* Egg-box removal of the 'nCols' columns of the FC matrix */
+   /* with all the 'nAtoms' atoms: the rows of the displaced   */
+   /* atom ('first' + column/3, from 0) are set to minus the   */
+   /* sum of the other rows of the same coordinate.            */
+   void (*eggBox) (int nAtoms, int nCols, int first, double *FC);
+
+   /* Symmetrizes and mass-scales the 'n x n' matrix 'FC' with */
+   /* the masses 'mass' of the atoms (one per 3 rows).         */
+   void (*symmScale) (int n, double *FC, const double *mass);
+
+   /* 'M = M + dH * e * cst / sq' for the 'nOrb x nOrb' blocks */
+   /* 'M' and 'dH' (leading dimension 'ld') of the couplings.  */
+   void (*ephBlock) (int nOrb, int ld, double *M, const double *dH,
+		     double e, double cst, double sq);
+
+   /* Parses up to 'n' numbers of the text 's' into 'v' (same  */
+   /* values as 'strtod'). Returns how many were parsed, with  */
+   /* '*end' after the last one.                               */
+   int (*parse) (const char *s, double *v, int n, const char **end);
+};
+
+/* Returns the kernels of the active path. */
+const kern_table *KERNtable ();
+
+/* Returns a description of the active path (e.g. "avx2", or  */
+/* "scalar (forced by VIB_KERNELS)").                         */
+const char *KERNdescribe ();
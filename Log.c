@@ -0,0 +1,130 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Implementation of the run log: verbosity levels,       **/
+/**  flushes at the stage boundaries (instead of an         **/
+/**  unbuffered 'stdout') and binary matrix dumps.          **/
+/**  *****************************************************  **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <signal.h>
+#include "Check.h"
+#include "Utils.h"
+#include "Phonon.h"
+#include "Log.h"
+
+
+/* ********************************************************* */
+/* Writes the message 'format' (as 'printf') to the log if   */
+/* the verbosity is at least 'info'.                         */
+void LOGinfo (vib_context *ctx, const char *format, ...)
+{
+   va_list args;
+
+   if (ctx->logLevel < LOG_INFO)
+      return ;
+   va_start (args, format);
+   vfprintf (ctx->out, format, args);
+   va_end (args);
+
+} /* LOGinfo */
+
+
+/* ********************************************************* */
+/* Writes the message 'format' (as 'printf') to the log if   */
+/* the verbosity is 'debug'.                                 */
+void LOGdebug (vib_context *ctx, const char *format, ...)
+{
+   va_list args;
+
+   if (ctx->logLevel < LOG_DEBUG)
+      return ;
+   va_start (args, format);
+   vfprintf (ctx->out, format, args);
+   va_end (args);
+
+} /* LOGdebug */
+
+
+/* ********************************************************* */
+/* Flushes the log. Called at the stage boundaries (and      */
+/* before running external scripts, which share 'stdout').   */
+void LOGflush (vib_context *ctx)
+{
+
+   fflush (ctx->out);
+   ctx->logFlushed = UTILwallTime ();
+
+} /* LOGflush */
+
+
+/* ********************************************************* */
+/* Flushes the log after a progress message, unless it was   */
+/* flushed less than 'LOG_PERIOD' seconds ago, so that long  */
+/* stages show their progress without a 'write' per line.    */
+void LOGprogress (vib_context *ctx)
+{
+
+   if (UTILwallTime () - ctx->logFlushed >= LOG_PERIOD)
+      LOGflush (ctx);
+
+} /* LOGprogress */
+
+
+/* ********************************************************* */
+/* At debug level, dumps the 'nrow x ncol' matrix 'M' to the */
+/* file '[FC directory][label]_[name].dump'.                 */
+int LOGmatrix (vib_context *ctx, const char *name, const double *M,
+	       int nrow, int ncol)
+{
+   int info = VIB_SUCCESS;
+   char *dumpFile;
+   FILE *DUMP;
+
+   if (ctx->logLevel < LOG_DEBUG)
+      return VIB_SUCCESS;
+
+   dumpFile = CHECKmalloc (strlen (ctx->FCdir) + strlen (ctx->sysLabel)
+			   + strlen (name) + 7);
+   if (dumpFile == NULL)
+      return VIB_ERR_MEMORY;
+   sprintf (dumpFile, "%s%s_%s.dump", ctx->FCdir, ctx->sysLabel, name);
+
+   DUMP = CHECKfopen (dumpFile, "wb");
+   if (DUMP == NULL) {
+      CHECKfree (dumpFile);
+      return VIB_ERR_FILE;
+   }
+   if (fwrite (&nrow, sizeof (int), 1, DUMP) != 1 ||
+       fwrite (&ncol, sizeof (int), 1, DUMP) != 1 ||
+       fwrite (M, sizeof (double), (size_t) nrow * ncol, DUMP)
+       != (size_t) nrow * ncol) {
+      fprintf (stderr, "\n ERROR: unable to write the file %s!\n\n",
+	       dumpFile);
+      fclose (DUMP);
+      info = VIB_ERR_FILE;
+   }
+   else
+      info = CHECKfclose (fclose (DUMP), dumpFile);
+   if (info == VIB_SUCCESS)
+      LOGdebug (ctx, "    (%d x %d matrix dumped at \"%s\")\n",
+		nrow, ncol, dumpFile);
+
+   /* Frees memory. */
+   CHECKfree (dumpFile);
+
+   return info;
+
+} /* LOGmatrix */
+
+
+/* ************************ Drafts ************************* */
@@ -0,0 +1,47 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Interface for the run log. Messages are written to     **/
+/**  'ctx->out' according to the verbosity 'ctx->logLevel', **/
+/**  through the normal stream buffer, which is flushed at  **/
+/**  the stage boundaries and, for progress messages, at    **/
+/**  most once every 'LOG_PERIOD' seconds. At debug level   **/
+/**  the large matrices are dumped to binary side files     **/
+/**  '[FC directory][label]_[name].dump' holding the number **/
+/**  of rows and columns (int) and the elements (double,    **/
+/**  column-major).                                         **/
+/**  *****************************************************  **/
+
+/* Verbosity levels. */
+#define LOG_QUIET 0 /* only the errors (at 'stderr') */
+#define LOG_INFO  1 /* stages and progress (default) */
+#define LOG_DEBUG 2 /* also the matrix dumps */
+
+/* Minimum interval (s) between flushes of progress messages. */
+#define LOG_PERIOD 1.0
+
+/* Writes a message at 'info' level. */
+void LOGinfo (vib_context *ctx, const char *format, ...);
+
+/* Writes a message at 'debug' level. */
+void LOGdebug (vib_context *ctx, const char *format, ...);
+
+/* Flushes the log (at the stage boundaries). */
+void LOGflush (vib_context *ctx);
+
+/* Flushes the log if it was not flushed in the last 'LOG_PERIOD' s. */
+void LOGprogress (vib_context *ctx);
+
+/* At debug level, dumps the 'nrow x ncol' matrix 'M' to the */
+/* side file of name 'name'.                                 */
+int LOGmatrix (vib_context *ctx, const char *name, const double *M,
+	       int nrow, int ncol);
+
+
+/* ************************ Drafts ************************* */
@@ -0,0 +1,848 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Implementation of the writer and the (zero-copy)       **/
+/**  reader of the version 2 of the binary electron-phonon  **/
+/**  coupling file ('.bMeph'), and of the fast writer of    **/
+/**  the text file ('.Meph').                               **/
+/**  *****************************************************  **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Check.h"
+#include "Utils.h"
+#include "Phonon.h"
+#include "Checkpoint.h"
+#include "Meph.h"
+
+/* Maximum number of writer threads. */
+#define MEPH_MAXTHREADS 8
+
+/* Blocks of at least this size are page aligned (so they can  */
+/* also be mapped alone), the smaller ones cache line aligned. */
+#define MEPH_PAGEBLOCK 65536
+#define MEPH_PAGE 4096
+#define MEPH_LINE 64
+
+/* Structure for the work of one writer thread. */
+typedef struct MEPHWORK meph_work;
+struct MEPHWORK {
+   int fd; /* file descriptor */
+   int first; /* first block of this thread */
+   int stride; /* number of threads */
+   int nBlocks; /* number of blocks */
+   int nOrb; /* block dimension */
+   const size_t *size; /* block sizes (bytes) */
+   size_t maxSize; /* largest block size */
+   const double **block; /* block data */
+   const meph_csr *csr; /* sparse block headers ('NULL' = dense) */
+   unsigned long long *table; /* blocks table */
+   int checksums; /* computes the hashes */
+   int info; /* returned error code */
+};
+
+
+/* Structure for the work of one text formatting thread. */
+typedef struct MEPHTEXT meph_text;
+struct MEPHTEXT {
+   const double *block; /* block to be formatted ('NULL' = none) */
+   int nOrb; /* block dimension */
+   char *buf; /* formatted text */
+   size_t len; /* length of the text */
+};
+
+
+/* ********************************************************* */
+/* Returns the number of writer threads for 'nBlocks' blocks */
+/* (the online processors, up to 'MEPH_MAXTHREADS').         */
+static int writerThreads (int nBlocks)
+{
+   int nThreads;
+
+   nThreads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+   if (nThreads > MEPH_MAXTHREADS)
+      nThreads = MEPH_MAXTHREADS;
+   if (nThreads > nBlocks)
+      nThreads = nBlocks;
+   if (nThreads < 1)
+      nThreads = 1;
+
+   return nThreads;
+
+} /* writerThreads */
+
+
+/* ********************************************************* */
+/* Rounds 'n' up to a multiple of 'align'.                   */
+static unsigned long long roundUp (unsigned long long n,
+				   unsigned long long align)
+{
+
+   return (n + align - 1) / align * align;
+
+} /* roundUp */
+
+
+/* ********************************************************* */
+/* Writes the 'n' bytes 'data' at the offset 'offset' of the */
+/* file 'fd', retrying on partial writes.                    */
+static int pwriteAll (int fd, const void *data, size_t n,
+		      unsigned long long offset)
+{
+   ssize_t w;
+   const char *c = data;
+
+   while (n > 0) {
+      w = pwrite (fd, c, n, (off_t) offset);
+      if (w <= 0)
+	 return VIB_ERR_FILE;
+      c += w;
+      n -= w;
+      offset += w;
+   }
+
+   return VIB_SUCCESS;
+
+} /* pwriteAll */
+
+
+/* ********************************************************* */
+/* Returns the size (bytes) of a sparse block of dimension   */
+/* 'nOrb' with 'nnz' elements.                               */
+static size_t sparseSize (int nOrb, unsigned long long nnz)
+{
+
+   return sizeof (meph_csr) + (nOrb + 1) * sizeof (unsigned long long)
+      + roundUp (nnz * sizeof (int), sizeof (double))
+      + nnz * sizeof (double);
+
+} /* sparseSize */
+
+
+/* ********************************************************* */
+/* Fills the header 'csr' of the sparse form of 'block' for  */
+/* the tolerance 'tol' (relative to the largest element of   */
+/* the block if 'relative').                                 */
+static void sparseStats (const double *block, int nOrb, double tol,
+			 int relative, meph_csr *csr)
+{
+   register size_t i, n;
+   double a, max, norm, dropped;
+
+   n = (size_t) nOrb * nOrb;
+   if (relative) {
+      max = 0.0;
+      for (i = 0; i < n; i++)
+	 if (fabs (block[i]) > max)
+	    max = fabs (block[i]);
+      tol *= max;
+   }
+
+   csr->nnz = 0;
+   norm = dropped = 0.0;
+   for (i = 0; i < n; i++) {
+      a = block[i] * block[i];
+      norm += a;
+      if (fabs (block[i]) >= tol)
+	 csr->nnz++;
+      else
+	 dropped += a;
+   }
+   csr->tol = tol;
+   csr->norm = sqrt (norm);
+   csr->dropped = sqrt (dropped);
+
+} /* sparseStats */
+
+
+/* ********************************************************* */
+/* Packs at 'buf' the sparse form (with header 'csr') of     */
+/* 'block'. The columns of 'block' are read in order, while  */
+/* 'next' ('nOrb' entries) holds the fill position of each   */
+/* row.                                                      */
+static void packBlock (const double *block, int nOrb, const meph_csr *csr,
+		       char *buf, unsigned long long *next)
+{
+   register int i, j;
+   unsigned long long *rowPtr, k;
+   int *col;
+   double *val;
+
+   memcpy (buf, csr, sizeof (meph_csr));
+   rowPtr = (unsigned long long *) (buf + sizeof (meph_csr));
+   col = (int *) (rowPtr + nOrb + 1);
+   val = (double *) ((char *) col
+		     + roundUp (csr->nnz * sizeof (int), sizeof (double)));
+
+   /* Row pointers. */
+   memset (next, 0, nOrb * sizeof (unsigned long long));
+   for (j = 0; j < nOrb; j++)
+      for (i = 0; i < nOrb; i++)
+	 if (fabs (block[idx(i,j,nOrb)]) >= csr->tol)
+	    next[i]++;
+   rowPtr[0] = 0;
+   for (i = 0; i < nOrb; i++) {
+      rowPtr[i+1] = rowPtr[i] + next[i];
+      next[i] = rowPtr[i];
+   }
+
+   /* Column indices and values (the padding is zeroed). */
+   if (csr->nnz % 2)
+      col[csr->nnz] = 0;
+   for (j = 0; j < nOrb; j++)
+      for (i = 0; i < nOrb; i++)
+	 if (fabs (block[idx(i,j,nOrb)]) >= csr->tol) {
+	    k = next[i]++;
+	    col[k] = j;
+	    val[k] = block[idx(i,j,nOrb)];
+	 }
+
+} /* packBlock */
+
+
+/* ********************************************************* */
+/* Writer thread: writes the blocks 'first', 'first +        */
+/* stride', ... at their offsets (already at the table),     */
+/* packing them first if the file is sparse.                 */
+static void *writeBlocks (void *arg)
+{
+   register int b;
+   char *buf;
+   const void *data;
+   unsigned long long *next;
+   meph_work *w = arg;
+
+   /* Buffers for the packed blocks. */
+   buf = NULL;
+   next = NULL;
+   if (w->csr != NULL) {
+      buf = CHECKmalloc (w->maxSize);
+      next = CHECKmalloc (w->nOrb * sizeof (unsigned long long));
+      if (buf == NULL || next == NULL)
+	 w->info = VIB_ERR_MEMORY;
+   }
+
+   for (b = w->first; b < w->nBlocks && w->info == VIB_SUCCESS;
+	b += w->stride) {
+      if (w->block[b] == NULL)
+	 continue ;
+      data = w->block[b];
+      if (w->csr != NULL) {
+	 packBlock (w->block[b], w->nOrb, &w->csr[b], buf, next);
+	 data = buf;
+      }
+      if (w->checksums)
+	 w->table[2*b+1] = CKPThash (CKPT_HASH_INIT, data, w->size[b]);
+      w->info = pwriteAll (w->fd, data, w->size[b], w->table[2*b]);
+   }
+
+   /* Frees memory. */
+   CHECKfree (buf);
+   CHECKfree (next);
+
+   return NULL;
+
+} /* writeBlocks */
+
+
+/* ********************************************************* */
+/* Writes the '.bMeph' version 2 file 'filename'. 'EigVal'   */
+/* and 'Meph' are in the order computed by 'PHONfreq' and    */
+/* 'PHONephCoupling' (lowest energy first), while the file   */
+/* lists the modes from the highest energy, as '.Meph'. The  */
+/* file is preallocated and its blocks written with 'pwrite' */
+/* by up to 'MEPH_MAXTHREADS' threads. With 'tol > 0' the    */
+/* kept elements of each block are counted first, to set the */
+/* offsets, and packed by the writer threads.                */
+int MEPHwrite (const char *filename, int nspin, int nDyn, int nOrb,
+	       int firstOrb, const double *EigVal, const double *Meph,
+	       int checksums, double tol, int relative)
+{
+   register int m, s, t, l, b;
+   int nModes, nBlocks, nThreads, fd, info = VIB_SUCCESS;
+   unsigned long long offset, *table;
+   size_t dense, maxSize, *size;
+   double *freq;
+   const double **block;
+   pthread_t *thread;
+   meph_work *work;
+   meph_csr *csr;
+   meph_header head;
+
+   nModes = 3 * nDyn;
+   nBlocks = nModes * nspin;
+   dense = (size_t) nOrb * nOrb * sizeof (double);
+
+   /* Header. */
+   memset (&head, 0, sizeof (head));
+   memcpy (head.magic, MEPH_MAGIC, sizeof (MEPH_MAGIC));
+   head.endian = MEPH_ENDIAN;
+   head.version = MEPH_VERSION;
+   head.flags = (checksums ? MEPH_CHECKSUMS : 0);
+   if (tol > 0.0)
+      head.flags |= MEPH_SPARSE;
+   head.nspin = nspin;
+   head.nDyn = nDyn;
+   head.nOrb = nOrb;
+   head.firstOrb = firstOrb;
+   head.lastOrb = firstOrb + nOrb - 1;
+   head.nModes = nModes;
+   head.align = MEPH_LINE;
+   if (dense >= MEPH_PAGEBLOCK && tol <= 0.0)
+      head.align = MEPH_PAGE;
+   head.freqOffset = roundUp (sizeof (head), MEPH_LINE);
+   head.tableOffset = roundUp (head.freqOffset + nModes * sizeof (double),
+			       MEPH_LINE);
+
+   /* Allocates memory. */
+   freq = CHECKmalloc (nModes * sizeof (double));
+   table = CHECKmalloc (2 * nBlocks * sizeof (unsigned long long));
+   block = CHECKmalloc (nBlocks * sizeof (double *));
+   size = CHECKmalloc (nBlocks * sizeof (size_t));
+   csr = NULL;
+   if (tol > 0.0)
+      csr = CHECKmalloc (nBlocks * sizeof (meph_csr));
+   if (freq == NULL || table == NULL || block == NULL || size == NULL ||
+       (tol > 0.0 && csr == NULL)) {
+      CHECKfree (freq);
+      CHECKfree (table);
+      CHECKfree (block);
+      CHECKfree (size);
+      CHECKfree (csr);
+      return VIB_ERR_MEMORY;
+   }
+
+   /* Energies and data of each block (mode 'm' corresponds */
+   /* to the computed mode 'l').                             */
+   for (m = 0; m < nModes; m++) {
+      l = nModes - 1 - m;
+      freq[m] = EigVal[l];
+      for (s = 0; s < nspin; s++)
+	 block[m*nspin+s] = (EigVal[l] > 0.0 ?
+			     &Meph[idx3d(0,0,l*nspin+s,nOrb,nOrb)] : NULL);
+   }
+
+   /* Sizes and offsets of the blocks. */
+   offset = roundUp (head.tableOffset
+		     + 2 * nBlocks * sizeof (unsigned long long), head.align);
+   maxSize = 0;
+   for (b = 0; b < nBlocks; b++) {
+      table[2*b] = table[2*b+1] = 0;
+      if (block[b] == NULL)
+	 continue ;
+      size[b] = dense;
+      if (csr != NULL) {
+	 sparseStats (block[b], nOrb, tol, relative, &csr[b]);
+	 size[b] = sparseSize (nOrb, csr[b].nnz);
+      }
+      if (size[b] > maxSize)
+	 maxSize = size[b];
+      table[2*b] = offset;
+      offset = roundUp (offset + size[b], head.align);
+   }
+   head.fileSize = offset;
+
+   /* Creates the preallocated file. */
+   fd = open (filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0 || ftruncate (fd, (off_t) head.fileSize) != 0) {
+      fprintf (stderr, "\n ERROR: unable to create the file %s!\n\n",
+	       filename);
+      if (fd >= 0)
+	 close (fd);
+      CHECKfree (freq);
+      CHECKfree (table);
+      CHECKfree (block);
+      CHECKfree (size);
+      CHECKfree (csr);
+      return VIB_ERR_FILE;
+   }
+
+   /* Writes the blocks (the calling thread is one of the writers). */
+   nThreads = writerThreads (nBlocks);
+   work = CHECKmalloc (nThreads * sizeof (meph_work));
+   thread = CHECKmalloc (nThreads * sizeof (pthread_t));
+   if (work == NULL || thread == NULL)
+      info = VIB_ERR_MEMORY;
+   for (t = 0; t < nThreads && info == VIB_SUCCESS; t++) {
+      work[t].fd = fd;
+      work[t].first = t;
+      work[t].stride = nThreads;
+      work[t].nBlocks = nBlocks;
+      work[t].nOrb = nOrb;
+      work[t].size = size;
+      work[t].maxSize = maxSize;
+      work[t].block = block;
+      work[t].csr = csr;
+      work[t].table = table;
+      work[t].checksums = checksums;
+      work[t].info = VIB_SUCCESS;
+   }
+   if (info == VIB_SUCCESS) {
+      for (l = 1; l < nThreads; l++)
+	 if (pthread_create (&thread[l], NULL, writeBlocks, &work[l]) != 0)
+	    break ;
+
+      /* The work of threads not created is done here. */
+      writeBlocks (&work[0]);
+      for (t = l; t < nThreads; t++)
+	 writeBlocks (&work[t]);
+      for (t = 1; t < l; t++)
+	 pthread_join (thread[t], NULL);
+      for (t = 0; t < nThreads; t++)
+	 if (work[t].info != VIB_SUCCESS)
+	    info = work[t].info;
+   }
+
+   /* Writes the header, the energies and the table. */
+   if (info == VIB_SUCCESS)
+      info = pwriteAll (fd, freq, nModes * sizeof (double), head.freqOffset);
+   if (info == VIB_SUCCESS)
+      info = pwriteAll (fd, table, 2 * nBlocks * sizeof (unsigned long long),
+			head.tableOffset);
+   if (info == VIB_SUCCESS)
+      info = pwriteAll (fd, &head, sizeof (head), 0);
+   if (close (fd) != 0 && info == VIB_SUCCESS)
+      info = VIB_ERR_FILE;
+   if (info == VIB_ERR_FILE)
+      fprintf (stderr, "\n ERROR: unable to write the file %s!\n\n",
+	       filename);
+
+   /* Frees memory. */
+   CHECKfree (work);
+   CHECKfree (thread);
+   CHECKfree (freq);
+   CHECKfree (table);
+   CHECKfree (block);
+   CHECKfree (size);
+   CHECKfree (csr);
+
+   return info;
+
+} /* MEPHwrite */
+
+
+/* ********************************************************* */
+/* Removes the trailing zeros of the mantissa of the number  */
+/* in scientific notation at 'buf' (and the point if no      */
+/* decimals are left). Returns its length.                   */
+static int trimZeros (char *buf)
+{
+   char *e, *m;
+
+   e = strchr (buf, 'e');
+   for (m = e; m[-1] == '0'; m--)
+      ;
+   if (m[-1] == '.')
+      m--;
+   memmove (m, e, strlen (e) + 1);
+
+   return (int) (m - buf + strlen (m));
+
+} /* trimZeros */
+
+
+/* ********************************************************* */
+/* Writes at 'buf' the shortest decimal representation of    */
+/* 'x' which reads back to the same double: the first of 15, */
+/* 16 and 17 significant digits (each one correctly rounded  */
+/* by 'sprintf') that does. Most values need 16 or 17, so 16 */
+/* is tried first (15 can only read back if 16 does).        */
+/* Returns its length.                                       */
+static int shortest (double x, char *buf)
+{
+   char e[32];
+
+   if (x == 0.0)
+      return sprintf (buf, "%s", signbit (x) ? "-0" : "0");
+   if (!isfinite (x))
+      return sprintf (buf, "%.17g", x);
+
+   sprintf (e, "%.15e", x);
+   if (strtod (e, NULL) != x)
+      sprintf (buf, "%.16e", x);
+   else {
+      sprintf (buf, "%.14e", x);
+      if (strtod (buf, NULL) != x)
+	 strcpy (buf, e);
+   }
+
+   return trimZeros (buf);
+
+} /* shortest */
+
+
+/* ********************************************************* */
+/* Text formatting thread: formats the block 'w->block' at   */
+/* 'w->buf' with the layout of '.Meph' (rows of 'nOrb'       */
+/* values and a blank line after the block).                 */
+static void *formatBlock (void *arg)
+{
+   register int i, j;
+   char *c;
+   meph_text *w = arg;
+
+   w->len = 0;
+   if (w->block == NULL)
+      return NULL;
+
+   c = w->buf;
+   for (i = 0; i < w->nOrb; i++) {
+      for (j = 0; j < w->nOrb; j ++) {
+	 *c++ = ' ';
+	 c += shortest (w->block[idx(i,j,w->nOrb)], c);
+      }
+      *c++ = '\n';
+   }
+   *c++ = '\n';
+   w->len = c - w->buf;
+
+   return NULL;
+
+} /* formatBlock */
+
+
+/* ********************************************************* */
+/* Writes the text '.Meph' file 'filename' with the layout   */
+/* of the original writer, but the coupling elements in      */
+/* their shortest round-trip form. The blocks are formatted  */
+/* in parallel, one per thread and per-thread buffers, and   */
+/* written in order.                                         */
+int MEPHwriteText (const char *filename, int nspin, int nDyn, int nOrb,
+		   int firstOrb, const double *EigVal, const double *Meph)
+{
+   register int l, s, t, b;
+   int nModes, nBlocks, nThreads, nt, info = VIB_SUCCESS;
+   const double **block;
+   pthread_t *thread;
+   meph_text *work;
+   FILE *EPH;
+
+   nModes = 3 * nDyn;
+
+   /* Blocks in the order of the file (highest energy first). */
+   block = CHECKmalloc (nModes * nspin * sizeof (double *));
+   if (block == NULL)
+      return VIB_ERR_MEMORY;
+   nBlocks = 0;
+   for (l = nModes - 1; l >= 0; l--)
+      if (EigVal[l] > 0.0)
+	 for (s = 0; s < nspin; s++)
+	    block[nBlocks++] = &Meph[idx3d(0,0,l*nspin+s,nOrb,nOrb)];
+
+   /* One buffer per thread (25 chars per element at most). */
+   nThreads = writerThreads (nBlocks);
+   work = CHECKmalloc (nThreads * sizeof (meph_text));
+   thread = CHECKmalloc (nThreads * sizeof (pthread_t));
+   if (work == NULL || thread == NULL) {
+      nThreads = 0;
+      info = VIB_ERR_MEMORY;
+   }
+   for (t = 0; t < nThreads; t++) {
+      work[t].nOrb = nOrb;
+      work[t].buf = CHECKmalloc ((size_t) nOrb * (25 * nOrb + 1) + 2);
+      if (work[t].buf == NULL)
+	 info = VIB_ERR_MEMORY;
+   }
+   EPH = NULL;
+   if (info == VIB_SUCCESS) {
+      EPH = CHECKfopen (filename, "w");
+      if (EPH == NULL)
+	 info = VIB_ERR_FILE;
+   }
+
+   /* Dimensions and phonon energies. */
+   if (info == VIB_SUCCESS) {
+      fprintf (EPH, "%d  %d  %d  %d  %d\n\n", nspin, nDyn, nOrb,
+	       firstOrb, firstOrb + nOrb - 1);
+      for (l = nModes - 1; l >= 0; l--)
+	 fprintf (EPH, "%.10e  ", EigVal[l]);
+      fprintf (EPH, "\n\n");
+   }
+
+   /* Formats 'nThreads' blocks at a time and writes them. */
+   for (b = 0; b < nBlocks && info == VIB_SUCCESS; b += nThreads) {
+      for (t = 0; t < nThreads; t++)
+	 work[t].block = (b + t < nBlocks ? block[b+t] : NULL);
+      for (nt = 1; nt < nThreads; nt++)
+	 if (pthread_create (&thread[nt], NULL, formatBlock, &work[nt]) != 0)
+	    break ;
+      formatBlock (&work[0]);
+      for (t = nt; t < nThreads; t++) /* threads not created */
+	 formatBlock (&work[t]);
+      for (t = 1; t < nt; t++)
+	 pthread_join (thread[t], NULL);
+      for (t = 0; t < nThreads && info == VIB_SUCCESS; t++)
+	 if (fwrite (work[t].buf, 1, work[t].len, EPH) != work[t].len) {
+	    fprintf (stderr, "\n ERROR: unable to write the file %s!\n\n",
+		     filename);
+	    info = VIB_ERR_FILE;
+	 }
+   }
+   if (EPH != NULL) {
+      if (info == VIB_SUCCESS)
+	 info = CHECKfclose (fclose (EPH), filename);
+      else
+	 fclose (EPH);
+   }
+
+   /* Frees memory. */
+   for (t = 0; t < nThreads; t++)
+      CHECKfree (work[t].buf);
+   CHECKfree (work);
+   CHECKfree (thread);
+   CHECKfree (block);
+
+   return info;
+
+} /* MEPHwriteText */
+
+
+/* ********************************************************* */
+/* Maps the '.bMeph' version 2 file 'filename' (read only)   */
+/* and checks its header and table. Returns 'NULL' on        */
+/* failure, with the error code at 'info'.                   */
+meph_file *MEPHopen (const char *filename, int *info)
+{
+   register int b;
+   int fd, nBlocks;
+   unsigned long long nnz;
+   size_t size;
+   struct stat st;
+   meph_file *m;
+   const meph_header *h;
+
+   /* Maps the file. */
+   *info = VIB_SUCCESS;
+   fd = open (filename, O_RDONLY);
+   if (fd < 0 || fstat (fd, &st) != 0) {
+      fprintf (stderr, "\n ERROR: unable to open the file %s!\n\n", filename);
+      if (fd >= 0)
+	 close (fd);
+      *info = VIB_ERR_FILE;
+      return NULL;
+   }
+   m = CHECKmalloc (sizeof (meph_file));
+   if (m == NULL) {
+      close (fd);
+      *info = VIB_ERR_MEMORY;
+      return NULL;
+   }
+   m->size = (size_t) st.st_size;
+   m->map = MAP_FAILED;
+   if (m->size >= sizeof (meph_header))
+      m->map = mmap (NULL, m->size, PROT_READ, MAP_SHARED, fd, 0);
+   close (fd);
+   if (m->map == MAP_FAILED) {
+      fprintf (stderr, "\n ERROR: unable to map the file %s!\n\n", filename);
+      CHECKfree (m);
+      *info = VIB_ERR_FILE;
+      return NULL;
+   }
+
+   /* Checks the header. */
+   h = m->head = m->map;
+   size = (size_t) h->nOrb * h->nOrb * sizeof (double);
+   nBlocks = h->nModes * h->nspin;
+   if (memcmp (h->magic, MEPH_MAGIC, sizeof (MEPH_MAGIC)) != 0 ||
+       h->endian != MEPH_ENDIAN || h->version != MEPH_VERSION ||
+       h->nspin < 1 || h->nOrb < 1 || h->nModes != 3 * h->nDyn ||
+       h->fileSize != m->size || h->freqOffset % sizeof (double) != 0 ||
+       h->tableOffset % sizeof (double) != 0 ||
+       h->freqOffset + h->nModes * sizeof (double) > m->size ||
+       h->tableOffset + 2 * nBlocks * sizeof (unsigned long long) > m->size)
+      *info = VIB_ERR_FORMAT;
+   else {
+      m->freq = (const double *) ((const char *) m->map + h->freqOffset);
+      m->table = (const unsigned long long *)
+	 ((const char *) m->map + h->tableOffset);
+
+      /* Checks the table (and the sizes of sparse blocks). */
+      for (b = 0; b < nBlocks && *info == VIB_SUCCESS; b++) {
+	 if (m->table[2*b] == 0)
+	    continue ;
+	 if (m->table[2*b] % sizeof (double) != 0 ||
+	     m->table[2*b] + sizeof (meph_csr) > m->size)
+	    *info = VIB_ERR_FORMAT;
+	 else if (h->flags & MEPH_SPARSE) {
+	    nnz = ((const meph_csr *)
+		   ((const char *) m->map + m->table[2*b]))->nnz;
+	    if (nnz > (unsigned long long) h->nOrb * h->nOrb ||
+		m->table[2*b] + sparseSize (h->nOrb, nnz) > m->size)
+	       *info = VIB_ERR_FORMAT;
+	 }
+	 else if (m->table[2*b] + size > m->size)
+	    *info = VIB_ERR_FORMAT;
+      }
+   }
+   if (*info != VIB_SUCCESS) {
+      fprintf (stderr,
+	       " ERROR: the file %s is not a '.bMeph' version %d file!\n\n",
+	       filename, MEPH_VERSION);
+      MEPHclose (m);
+      return NULL;
+   }
+
+   return m;
+
+} /* MEPHopen */
+
+
+/* ********************************************************* */
+/* Returns the offset of the block of mode 'mode' (0 =       */
+/* highest energy) and spin 'spin', or 0 if it is out of     */
+/* range or was not written.                                 */
+static unsigned long long blockOffset (const meph_file *m, int mode,
+				       int spin)
+{
+
+   if (mode < 0 || mode >= m->head->nModes ||
+       spin < 0 || spin >= m->head->nspin)
+      return 0;
+
+   return m->table[2*(mode*m->head->nspin+spin)];
+
+} /* blockOffset */
+
+
+/* ********************************************************* */
+/* Returns a pointer (into the mapped file) to the block of  */
+/* mode 'mode' (0 = highest energy) and spin 'spin', or      */
+/* 'NULL' if it is out of range, was not written or the file */
+/* is sparse.                                                */
+const double *MEPHblock (const meph_file *m, int mode, int spin)
+{
+   unsigned long long offset;
+
+   offset = blockOffset (m, mode, spin);
+   if (offset == 0 || (m->head->flags & MEPH_SPARSE))
+      return NULL;
+
+   return (const double *) ((const char *) m->map + offset);
+
+} /* MEPHblock */
+
+
+/* ********************************************************* */
+/* Sets 'sp' to the sparse block of mode 'mode' and spin     */
+/* 'spin' (pointers into the mapped file). Returns           */
+/* 'VIB_ERR_INPUT' if it doesn't exist or the file is dense. */
+int MEPHsparse (const meph_file *m, int mode, int spin, meph_sparse *sp)
+{
+   unsigned long long offset;
+   const char *c;
+
+   offset = blockOffset (m, mode, spin);
+   if (offset == 0 || !(m->head->flags & MEPH_SPARSE))
+      return VIB_ERR_INPUT;
+
+   c = (const char *) m->map + offset;
+   sp->head = (const meph_csr *) c;
+   sp->rowPtr = (const unsigned long long *) (c + sizeof (meph_csr));
+   sp->col = (const int *) (sp->rowPtr + m->head->nOrb + 1);
+   sp->val = (const double *)
+      ((const char *) sp->col
+       + roundUp (sp->head->nnz * sizeof (int), sizeof (double)));
+
+   return VIB_SUCCESS;
+
+} /* MEPHsparse */
+
+
+/* ********************************************************* */
+/* Expands the block of mode 'mode' and spin 'spin' at the   */
+/* column-major 'dense' ('nOrb * nOrb'), with zeros at the   */
+/* dropped elements of sparse files. Returns 'VIB_ERR_INPUT' */
+/* if the block doesn't exist and 'VIB_ERR_FORMAT' if its    */
+/* indices are out of range.                                 */
+int MEPHexpand (const meph_file *m, int mode, int spin, double *dense)
+{
+   register int i;
+   register unsigned long long k;
+   int nOrb;
+   const double *block;
+   meph_sparse sp;
+
+   nOrb = m->head->nOrb;
+   if (!(m->head->flags & MEPH_SPARSE)) {
+      block = MEPHblock (m, mode, spin);
+      if (block == NULL)
+	 return VIB_ERR_INPUT;
+      memcpy (dense, block, (size_t) nOrb * nOrb * sizeof (double));
+      return VIB_SUCCESS;
+   }
+
+   if (MEPHsparse (m, mode, spin, &sp) != VIB_SUCCESS)
+      return VIB_ERR_INPUT;
+   if (sp.rowPtr[0] != 0 || sp.rowPtr[nOrb] != sp.head->nnz)
+      return VIB_ERR_FORMAT;
+   memset (dense, 0, (size_t) nOrb * nOrb * sizeof (double));
+   for (i = 0; i < nOrb; i++) {
+      if (sp.rowPtr[i+1] < sp.rowPtr[i] || sp.rowPtr[i+1] > sp.head->nnz)
+	 return VIB_ERR_FORMAT;
+      for (k = sp.rowPtr[i]; k < sp.rowPtr[i+1]; k++) {
+	 if (sp.col[k] < 0 || sp.col[k] >= nOrb)
+	    return VIB_ERR_FORMAT;
+	 dense[idx(i,sp.col[k],nOrb)] = sp.val[k];
+      }
+   }
+
+   return VIB_SUCCESS;
+
+} /* MEPHexpand */
+
+
+/* ********************************************************* */
+/* Verifies the hash of the block of mode 'mode' and spin    */
+/* 'spin'. Returns 'VIB_ERR_INPUT' if the block doesn't      */
+/* exist or the file has no checksums.                       */
+int MEPHverify (const meph_file *m, int mode, int spin)
+{
+   unsigned long long offset;
+   size_t size;
+
+   offset = blockOffset (m, mode, spin);
+   if (offset == 0 || !(m->head->flags & MEPH_CHECKSUMS))
+      return VIB_ERR_INPUT;
+   size = (size_t) m->head->nOrb * m->head->nOrb * sizeof (double);
+   if (m->head->flags & MEPH_SPARSE)
+      size = sparseSize (m->head->nOrb,
+			 ((const meph_csr *)
+			  ((const char *) m->map + offset))->nnz);
+   if (CKPThash (CKPT_HASH_INIT, (const char *) m->map + offset, size)
+       != m->table[2*(mode*m->head->nspin+spin)+1])
+      return VIB_ERR_FORMAT;
+
+   return VIB_SUCCESS;
+
+} /* MEPHverify */
+
+
+/* ********************************************************* */
+/* Unmaps the file and frees 'm'.                            */
+void MEPHclose (meph_file *m)
+{
+
+   if (m == NULL)
+      return ;
+
+   munmap (m->map, m->size);
+   CHECKfree (m);
+
+} /* MEPHclose */
+
+
+/* ************************ Drafts ************************* */
@@ -0,0 +1,146 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Interface for writing and reading the version 2 of     **/
+/**  the binary electron-phonon coupling file ('.bMeph').   **/
+/**  Layout (offsets in bytes from the file start):         **/
+/**   - the header 'meph_header' below;                     **/
+/**   - 'nModes' phonon energies (eV) at 'freqOffset', from **/
+/**   the highest (mode 0) to the lowest, as at '.Meph';    **/
+/**   - at 'tableOffset', 'nModes * nspin' entries {offset, **/
+/**   hash} (unsigned 64 bits), the entry of mode 'm' and   **/
+/**   spin 's' being 'm * nspin + s'; offset 0 means the    **/
+/**   block was not written (modes with zero energy);       **/
+/**   - the blocks of 'nOrb * nOrb' doubles (column-major), **/
+/**   each aligned to 'align' bytes.                        **/
+/**  Sparse files ('MEPH_SPARSE' flag) hold each block in   **/
+/**  CSR form, without the elements below a tolerance:      **/
+/**   - 'meph_csr' below (number of kept elements and norms **/
+/**   of the whole block and of the dropped elements);      **/
+/**   - 'nOrb + 1' row pointers (unsigned 64 bits);         **/
+/**   - 'nnz' column indices (int), padded to 8 bytes;      **/
+/**   - 'nnz' values (double).                              **/
+/**  All values are in the byte order of the writer, which  **/
+/**  is checked with the 'endian' field.                    **/
+/**  *****************************************************  **/
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Format identification. */
+#define MEPH_MAGIC "VIBMEPH"
+#define MEPH_VERSION 2
+#define MEPH_ENDIAN 0x01020304U
+
+/* Formats of the text '.Meph' file. */
+#define MEPH_TEXT_OFF    0 /* not written */
+#define MEPH_TEXT_COMPAT 1 /* original format (" % .15e") */
+#define MEPH_TEXT_FAST   2 /* shortest round-trip, formatted in parallel */
+
+/* Header flags. */
+#define MEPH_CHECKSUMS 1 /* blocks have hashes at the table */
+#define MEPH_SPARSE 2 /* blocks in CSR form */
+
+/* Header of '.bMeph' version 2 files (80 bytes). */
+typedef struct MEPHHEADER meph_header;
+struct MEPHHEADER {
+   char magic[8]; /* 'MEPH_MAGIC' */
+   unsigned int endian; /* 'MEPH_ENDIAN' */
+   unsigned int version; /* 'MEPH_VERSION' */
+   unsigned int flags; /* 'MEPH_CHECKSUMS' | 'MEPH_SPARSE' */
+   int nspin; /* spin polarization */
+   int nDyn; /* number of dynamic atoms */
+   int nOrb; /* number of orbitals of the dynamic atoms */
+   int firstOrb; /* first dynamic orbital (starting at 1) */
+   int lastOrb; /* last dynamic orbital */
+   int nModes; /* number of phonon modes ('3 * nDyn') */
+   int reserved; /* (zero) */
+   unsigned long long align; /* alignment of the blocks */
+   unsigned long long freqOffset; /* offset of the energies */
+   unsigned long long tableOffset; /* offset of the blocks table */
+   unsigned long long fileSize; /* total size of the file */
+};
+
+/* Header of the blocks of sparse files (32 bytes). */
+typedef struct MEPHCSR meph_csr;
+struct MEPHCSR {
+   unsigned long long nnz; /* number of kept elements */
+   double tol; /* absolute tolerance applied to the block */
+   double norm; /* Frobenius norm of the whole block */
+   double dropped; /* Frobenius norm of the dropped elements */
+};
+
+/* Structure for a sparse block inside a mapped file. */
+typedef struct MEPHSPARSE meph_sparse;
+struct MEPHSPARSE {
+   const meph_csr *head; /* block header */
+   const unsigned long long *rowPtr; /* row 'i' is at [rowPtr[i],rowPtr[i+1]) */
+   const int *col; /* column indices */
+   const double *val; /* values */
+};
+
+/* Structure for a '.bMeph' file mapped in memory. */
+typedef struct MEPHFILE meph_file;
+struct MEPHFILE {
+   const meph_header *head; /* file header */
+   const double *freq; /* phonon energies (eV) */
+   const unsigned long long *table; /* blocks table */
+   void *map; /* mapped file */
+   size_t size; /* mapped size */
+};
+
+/* Writes a '.bMeph' version 2 file from the phonon energies      */
+/* 'EigVal' and the coupling matrices 'Meph' (as computed by      */
+/* 'PHONephCoupling'), with the blocks written by several threads. */
+/* If 'tol > 0' the blocks are stored sparse, without the         */
+/* elements below 'tol' (or below 'tol' times the largest element */
+/* of the block if 'relative').                                   */
+int MEPHwrite (const char *filename, int nspin, int nDyn, int nOrb,
+	       int firstOrb, const double *EigVal, const double *Meph,
+	       int checksums, double tol, int relative);
+
+/* Writes the text '.Meph' file with the elements in their   */
+/* shortest round-trip form, formatted by several threads.    */
+int MEPHwriteText (const char *filename, int nspin, int nDyn, int nOrb,
+		   int firstOrb, const double *EigVal, const double *Meph);
+
+/* Maps the '.bMeph' file 'filename' in memory (returns 'NULL' */
+/* and the error code at 'info' on failure).                   */
+meph_file *MEPHopen (const char *filename, int *info);
+
+/* Returns a pointer to the 'nOrb * nOrb' block of mode 'mode'    */
+/* and spin 'spin' inside the mapped file ('NULL' if not written  */
+/* or if the file is sparse).                                     */
+const double *MEPHblock (const meph_file *m, int mode, int spin);
+
+/* Sets 'sp' to the sparse block of mode 'mode' and spin 'spin'  */
+/* inside the mapped file ('VIB_ERR_INPUT' if not written or if  */
+/* the file is dense).                                           */
+int MEPHsparse (const meph_file *m, int mode, int spin, meph_sparse *sp);
+
+/* Expands the block of mode 'mode' and spin 'spin' (of a dense */
+/* or sparse file) at the 'nOrb * nOrb' column-major 'dense'.   */
+int MEPHexpand (const meph_file *m, int mode, int spin, double *dense);
+
+/* Verifies the hash of the block of mode 'mode' and spin 'spin'. */
+int MEPHverify (const meph_file *m, int mode, int spin);
+
+/* Unmaps the file and frees 'm'. */
+void MEPHclose (meph_file *m);
+
+
+/* ************************ Drafts ************************* */
+
+#ifdef __cplusplus
+}
+#endif
@@ -23,48 +23,56 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "Extern.h"
 #include "Check.h"
 #include "Utils.h"
 #include "Phonon.h"
-
-/* Structure for atomic number and mass. */
-typedef struct ATNMASS nmass;
-struct ATNMASS {
-   int Z; /* atomic number */
-   double A; /* atomic mass */
-};
-
-/* Structure for chemical element info. */
-typedef struct CHEMIC element;
-struct CHEMIC {
-   int id; /* number of the atom at system structure */
-   nmass atom; /* atomic number and mass */
-};
+#include "Log.h"
+#include "Checkpoint.h"
+#include "Meph.h"
+#include "Timing.h"
+#include "Kernels.h"
+#include "Symmetry.h"
 
 /* Structure for 'xyz' coordinates. */
 typedef struct ATCOORD xyzcoord;
 struct ATCOORD {
-   char name[2]; /* element specie */
+   char name[8]; /* element specie */
    double x; /* x coordinate */
    double y; /* y coordinate */
    double z; /* z coordinate */
 };
 
-static char *workDir; /* work directory */
-static char *FCdir; /* FC directory */
-static char sysLabel[30]; /* system label */
-static int nAtoms; /* number of atoms */
-static int nspin; /* spin polarization */
-static int FCfirst; /* first dynamic atom */
-static int FClast; /* last dynamic atom */
-static int nDyn; /* number of dynamic atoms */
-static int no_u; /* number of basis orbitals from unit cell */
-static int *orbIdx; /* first orbital index of each atom. */
-static double FCdispl; /* atoms displacement */
-static double *ef; /* Fermi energy values */
-static element *dynAtoms; /* dynamic atoms chemical info */
-static nmass periodicTable[95] = { /* {Z,A} - from SIESTA 3.1 */
+/* Maximum length of the lines of Jmol files and size of the */
+/* buffer of the multi-frame file.                           */
+#define JMOL_LINE 128
+#define JMOL_BUFFER (1 << 20)
+
+/* Number of largest elements at the per-mode summaries. */
+#define MSUM_TOP 3
+
+/* Structure for the summary of a coupling matrix block. */
+typedef struct MODESUM modesum;
+struct MODESUM {
+   double norm; /* Frobenius norm */
+   double top[MSUM_TOP]; /* largest elements (absolute value) */
+   int topI[MSUM_TOP]; /* their rows */
+   int topJ[MSUM_TOP]; /* and columns */
+};
+
+/* Selects the active region of the electronic basis (defined */
+/* with the electron-phonon coupling functions).              */
+static int activeBasis (vib_context *ctx);
+
+/* Sets up the symmetry-reduced displacements (defined with */
+/* the electron-phonon coupling functions).                 */
+static int symmetrySetup (vib_context *ctx);
+
+static const nmass periodicTable[95] = { /* {Z,A} - from SIESTA 3.1 */
    { 0,  0.00},{ 1,  1.01},{ 2,  4.00},{ 3,  6.94},{ 4,  9.01},
    { 5, 10.81},{ 6, 12.01},{ 7, 14.01},{ 8, 16.00},{ 9, 19.00},
    {10, 20.18},{11, 22.99},{12, 24.31},{13, 26.98},{14, 28.09},
@@ -88,63 +96,305 @@ static nmass periodicTable[95] = { /* {Z,A} - from SIESTA 3.1 */
 
 
 /* ********************************************************* */
-/* Reads the file 'inputFC.in' and assigns static global     */
-/* variables.                                                */
-static void assignGlobalVar ()
+/* Frees the data owned by the context 'ctx' and resets it   */
+/* to an empty state.                                        */
+static void resetContext (vib_context *ctx)
 {
-   register int i, j, len;
-   int nSpecies;
-   element *species;
-   char FCdisplUnit[5]; /* unit of the displacement */
-   char **name; /* element name */
-   char *inputFile;
-   FILE *FCinfo;
+   CHECKfree (ctx->workDir);
+   CHECKfree (ctx->FCdir);
+   CHECKfree (ctx->orbIdx);
+   CHECKfree (ctx->actIdx);
+   CHECKfree (ctx->ef);
+   CHECKfree (ctx->dynAtoms);
+   CHECKfree (ctx->H0);
+   CHECKfree (ctx->S0);
+   CHECKfree (ctx->dH);
+   CHECKfree (ctx->dS);
+   CHECKfree (ctx->fullFCneg);
+   CHECKfree (ctx->fullFCpos);
+   CHECKfree (ctx->received);
+   SYMMfree (ctx);
+
+   ctx->workDir = NULL;
+   ctx->FCdir = NULL;
+   ctx->sysLabel[0] = '\0';
+   ctx->calcType = 0;
+   ctx->nAtoms = 0;
+   ctx->nspin = 0;
+   ctx->FCfirst = 0;
+   ctx->FClast = 0;
+   ctx->nDyn = 0;
+   ctx->no_u = 0;
+   ctx->orbIdx = NULL;
+   ctx->nAct = 0;
+   ctx->actIdx = NULL;
+   ctx->orbShift = 0;
+   ctx->FCdispl = 0.0;
+   ctx->ef = NULL;
+   ctx->dynAtoms = NULL;
+   ctx->H0 = NULL;
+   ctx->S0 = NULL;
+   ctx->dH = NULL;
+   ctx->dS = NULL;
+   ctx->fullFCneg = NULL;
+   ctx->fullFCpos = NULL;
+   ctx->received = NULL;
+
+} /* resetContext */
 
-   /* Sets the file name 'inputFC.in' with work directory path. */
-   len = strlen (workDir);
-   inputFile = CHECKmalloc ((len + 11) * sizeof (char));
-   sprintf (inputFile, "%sinputFC.in", workDir);
 
-   /* Opens the file with FC run informations. */
-   FCinfo = CHECKfopen (inputFile, "r");
+/* ********************************************************* */
+/* Allocates and initializes an empty calculation context.   */
+/* Returns 'NULL' if there is not enough memory.             */
+vib_context *PHONnewContext ()
+{
+   vib_context *ctx;
+
+   ctx = CHECKmalloc (sizeof (vib_context));
+   if (ctx == NULL)
+      return NULL;
+
+   ctx->workDir = NULL;
+   ctx->FCdir = NULL;
+   ctx->orbIdx = NULL;
+   ctx->actIdx = NULL;
+   ctx->ef = NULL;
+   ctx->dynAtoms = NULL;
+   ctx->H0 = NULL;
+   ctx->S0 = NULL;
+   ctx->dH = NULL;
+   ctx->dS = NULL;
+   ctx->fullFCneg = NULL;
+   ctx->fullFCpos = NULL;
+   ctx->received = NULL;
+   ctx->out = stdout;
+   ctx->logLevel = LOG_INFO;
+   ctx->logFlushed = 0.0;
+   ctx->wallStart = UTILwallTime ();
+   ctx->cpuStart = UTILcpuTime ();
+   ctx->stages = NULL;
+   ctx->nStages = 0;
+   ctx->curStage = -1;
+   ctx->progress = NULL;
+   ctx->perfFd = NULL;
+   ctx->mephSummary = 0;
+   ctx->nSubsets = 0;
+   ctx->subsets = NULL;
+   ctx->activeShells = 0;
+   ctx->activeCutoff = 0.0;
+   ctx->activeCheck = 0;
+   ctx->symOps = NULL;
+   ctx->sym = NULL;
+   ctx->chkDir = NULL;
+   ctx->cacheDir = NULL;
+   ctx->onlySwait = 0.0;
+   ctx->stop = NULL;
+   ctx->bMeph = 1;
+   ctx->bMephSum = 0;
+   ctx->mephText = MEPH_TEXT_COMPAT;
+   ctx->mephTol = 0.0;
+   ctx->mephRelTol = 0;
+   ctx->project = 0;
+   ctx->projEmin = ctx->projEmax = 0.0;
+   ctx->jmol = JMOL_FILES;
+   ctx->jmolFirst = ctx->jmolLast = 0;
+   ctx->jmolWindow = 0;
+   ctx->jmolEmin = ctx->jmolEmax = 0.0;
+   resetContext (ctx);
+
+   return ctx;
+
+} /* PHONnewContext */
+
+
+/* ********************************************************* */
+/* Frees the calculation context 'ctx' and all data owned by */
+/* it.                                                       */
+void PHONfreeContext (vib_context *ctx)
+{
+   if (ctx == NULL)
+      return ;
+
+   resetContext (ctx);
+   CHECKfree (ctx->chkDir);
+   CHECKfree (ctx->cacheDir);
+   CHECKfree (ctx->subsets);
+   CHECKfree (ctx->symOps);
+   TIMEfree (ctx);
+   CHECKfree (ctx);
+
+} /* PHONfreeContext */
+
+
+/* ********************************************************* */
+/* Creates (if needed) the directory 'dir' and stores a copy */
+/* of its path at '*field'.                                  */
+static int setDirectory (char **field, const char *dir)
+{
+
+   if (mkdir (dir, 0755) != 0 && errno != EEXIST) {
+      fprintf (stderr, "\n ERROR: unable to create the directory %s!\n\n",
+	       dir);
+      return VIB_ERR_FILE;
+   }
+
+   CHECKfree (*field);
+   *field = CHECKmalloc ((strlen (dir) + 1) * sizeof (char));
+   if (*field == NULL)
+      return VIB_ERR_MEMORY;
+   strcpy (*field, dir);
+
+   return VIB_SUCCESS;
+
+} /* setDirectory */
 
-   /* Reads and assigns global variables. */
-   CHECKfscanf (fscanf (FCinfo, "%s", sysLabel), inputFile);
-   printf ("    System label:\t\t\t%s\n", sysLabel);
 
-   CHECKfscanf (fscanf (FCinfo, "%d", &nAtoms), inputFile);
-   printf ("    Number of atoms:\t\t\t%d\n", nAtoms);
+/* ********************************************************* */
+/* Enables the stage checkpoints (phonon modes, raw 'dH' of  */
+/* each displacement and corrected 'dH') at the directory    */
+/* 'dir', which is created if needed. Stages found there are */
+/* read instead of recomputed. Unlike the system data, the   */
+/* setting survives new calls to 'PHONreadFCfdf'.            */
+int PHONsetCheckpoint (vib_context *ctx, const char *dir)
+{
+
+   if (ctx == NULL || dir == NULL)
+      return VIB_ERR_INPUT;
+
+   return setDirectory (&ctx->chkDir, dir);
+
+} /* PHONsetCheckpoint */
+
+
+/* ********************************************************* */
+/* Enables the content-addressed 'dH' cache at the directory */
+/* 'dir' (created if needed). The raw 'dH' of each           */
+/* displacement pair is stored under a hash of its '.gHS'    */
+/* files, Fermi energies and 'S0', and the corrected 'dH' of */
+/* each dynamic atom under a hash of these keys, 'H0', 'S0'  */
+/* and 'dS'. A rerun after some FC directories were rerun    */
+/* recomputes only the columns whose inputs changed. The     */
+/* cache may be shared by runs of different systems.         */
+int PHONsetCache (vib_context *ctx, const char *dir)
+{
+
+   if (ctx == NULL || dir == NULL)
+      return VIB_ERR_INPUT;
+
+   return setDirectory (&ctx->cacheDir, dir);
+
+} /* PHONsetCache */
+
+
+/* ********************************************************* */
+/* Enables the symmetry-reduced displacements: only the      */
+/* first dynamic atom of each orbit of the point group is    */
+/* displaced and the FC columns and 'dH' of the others are   */
+/* rebuilt from it. The operations 'ops' are "auto"          */
+/* (detected at the '.xyz') or the name of a file (see       */
+/* 'readOps' at 'Symmetry.c'). Unlike the system data, the   */
+/* setting survives new calls to 'PHONreadFCfdf'.            */
+int PHONsetSymmetry (vib_context *ctx, const char *ops)
+{
 
-   /* Different species from the system. */
-   CHECKfscanf (fscanf (FCinfo, "%d", &nSpecies), inputFile);
-   printf ("    Different system species:\t\t%d\n", nSpecies);
-   species = CHECKmalloc (nSpecies * sizeof (element));
-   name = CHECKmalloc (nSpecies * sizeof (*name));
-   for (i = 0; i < nSpecies; i++) {
-      CHECKfscanf (fscanf (FCinfo, "%d", &species[i].id), inputFile);
-      CHECKfscanf (fscanf (FCinfo, "%d", &species[i].atom.Z), inputFile);
-      name[i] = CHECKmalloc (10 * sizeof (char));
-      CHECKfscanf (fscanf (FCinfo, "%s", name[i]), inputFile);
-      printf ("\t\t\t\t\t %d %d %s\n", species[i].id,
-	      species[i].atom.Z, name[i]);
+   if (ctx == NULL || ops == NULL)
+      return VIB_ERR_INPUT;
+
+   CHECKfree (ctx->symOps);
+   ctx->symOps = CHECKmalloc ((strlen (ops) + 1) * sizeof (char));
+   if (ctx->symOps == NULL)
+      return VIB_ERR_MEMORY;
+   strcpy (ctx->symOps, ops);
+
+   return VIB_SUCCESS;
+
+} /* PHONsetSymmetry */
+
+
+/* ********************************************************* */
+/* Enables the per-mode coupling summary ('.Msum' file),     */
+/* with the sums over the orbitals of the 'nSubsets' atom    */
+/* ranges 'subsets' (pairs of first and last atoms,          */
+/* starting at 1, which must be dynamic).                    */
+int PHONsetSummary (vib_context *ctx, int *nSubsets, int *subsets)
+{
+   register int i;
+
+   if (ctx == NULL || *nSubsets < 0 || (*nSubsets > 0 && subsets == NULL))
+      return VIB_ERR_INPUT;
+
+   CHECKfree (ctx->subsets);
+   ctx->subsets = NULL;
+   if (*nSubsets > 0) {
+      ctx->subsets = CHECKmalloc (2 * *nSubsets * sizeof (int));
+      if (ctx->subsets == NULL)
+	 return VIB_ERR_MEMORY;
+      for (i = 0; i < 2 * *nSubsets; i++)
+	 ctx->subsets[i] = subsets[i];
    }
+   ctx->nSubsets = *nSubsets;
+   ctx->mephSummary = 1;
+
+   return VIB_SUCCESS;
 
-   CHECKfscanf (fscanf (FCinfo, "%d", &nspin), inputFile);
-   printf ("    Spin polarization (1 or 2):\t\t%d\n", nspin);
+} /* PHONsetSummary */
 
-   CHECKfscanf (fscanf (FCinfo, "%d", &FCfirst), inputFile);
-   printf ("    First dynamic atom:\t\t\t%d\n", FCfirst);
 
-   CHECKfscanf (fscanf (FCinfo, "%d", &FClast), inputFile);
-   printf ("    Last dynamic atom:\t\t\t%d\n", FClast);
+/* ********************************************************* */
+/* Returns 1 if a stop was requested at 'ctx->stop' (e.g. by */
+/* a signal handler), and 0 otherwise.                       */
+static int stopRequested (vib_context *ctx)
+{
+
+   return (ctx->stop != NULL && *ctx->stop != 0);
+
+} /* stopRequested */
+
+
+/* ********************************************************* */
+/* Reads from the (already opened) 'inputFC.in' file the     */
+/* spin polarization, the dynamic atoms range and species,   */
+/* and the atoms displacement. The 'nSpecies' species of the */
+/* system are given at 'species' and 'name'.                 */
+static int readDynamicAtoms (vib_context *ctx, FILE *FCinfo,
+			     char *inputFile, int nSpecies,
+			     element *species, char (*name)[10])
+{
+   register int i, j;
+   int info;
+   char FCdisplUnit[5]; /* unit of the displacement */
 
-   nDyn = FClast - FCfirst + 1;
-   printf ("    Number of dynamic atoms:\t\t%d\n", nDyn);
+   info = CHECKfscanf (fscanf (FCinfo, "%d", &ctx->nspin), inputFile);
+   if (info != VIB_SUCCESS)
+      return info;
+   LOGinfo (ctx, "    Spin polarization (1 or 2):\t\t%d\n", ctx->nspin);
+
+   info = CHECKfscanf (fscanf (FCinfo, "%d", &ctx->FCfirst), inputFile);
+   if (info != VIB_SUCCESS)
+      return info;
+   LOGinfo (ctx, "    First dynamic atom:\t\t\t%d\n", ctx->FCfirst);
+
+   info = CHECKfscanf (fscanf (FCinfo, "%d", &ctx->FClast), inputFile);
+   if (info != VIB_SUCCESS)
+      return info;
+   LOGinfo (ctx, "    Last dynamic atom:\t\t\t%d\n", ctx->FClast);
+
+   ctx->nDyn = ctx->FClast - ctx->FCfirst + 1;
+   LOGinfo (ctx, "    Number of dynamic atoms:\t\t%d\n", ctx->nDyn);
+   if (ctx->FCfirst < 1 || ctx->FClast > ctx->nAtoms || ctx->nDyn < 1) {
+      fprintf (stderr, "\n ERROR: wrong dynamic atoms range at FC");
+      fprintf (stderr, " fdf input file!\n\n");
+      return VIB_ERR_INPUT;
+   }
 
-   CHECKfscanf (fscanf (FCinfo, "%lf", &FCdispl), inputFile);
-   CHECKfscanf (fscanf (FCinfo, "%s", FCdisplUnit), inputFile);
+   info = CHECKfscanf (fscanf (FCinfo, "%lf", &ctx->FCdispl), inputFile);
+   if (info != VIB_SUCCESS)
+      return info;
+   info = CHECKfscanf (fscanf (FCinfo, "%4s", FCdisplUnit), inputFile);
+   if (info != VIB_SUCCESS)
+      return info;
    if (strcmp (FCdisplUnit, "bohr") == 0) {
-      FCdispl = bohr2ang * FCdispl;
+      ctx->FCdispl = bohr2ang * ctx->FCdispl;
    }
    else if (strcmp (FCdisplUnit, "ang") != 0) {
       fprintf (stderr,
@@ -153,124 +403,231 @@ static void assignGlobalVar ()
       fprintf (stderr,
 	       "       fdf input file! It must be \"Ang\" or \"Bohr\"!");
       fprintf (stderr, "\n\n");
-      exit (EXIT_FAILURE);
+      return VIB_ERR_INPUT;
    }
-   printf ("    Atoms displacement:\t\t\t%.5f (ang)\n", FCdispl);
+   LOGinfo (ctx, "    Atoms displacement:\t\t\t%.5f (ang)\n",
+	    ctx->FCdispl);
 
    /* Species of the dynamic atoms. */
-   printf ("    Dynamic atoms species:\n");
-   dynAtoms = CHECKmalloc (nDyn * sizeof (element));
-   for (i = 0; i < nDyn; i++)
-      CHECKfscanf (fscanf (FCinfo, "%d", &dynAtoms[i].id), inputFile);
-   for (i = 0; i < nDyn; i++)
+   LOGinfo (ctx, "    Dynamic atoms species:\n");
+   ctx->dynAtoms = CHECKmalloc (ctx->nDyn * sizeof (element));
+   if (ctx->dynAtoms == NULL)
+      return VIB_ERR_MEMORY;
+   for (i = 0; i < ctx->nDyn; i++) {
+      info = CHECKfscanf (fscanf (FCinfo, "%d", &ctx->dynAtoms[i].id),
+			  inputFile);
+      if (info != VIB_SUCCESS)
+	 return info;
+   }
+   for (i = 0; i < ctx->nDyn; i++)
       for (j = 0; j < nSpecies; j++) {
 	 /* Searches the correspondent atom specie. */
-	 if (dynAtoms[i].id == species[j].id) {
-	    dynAtoms[i].id = FCfirst + i;
-	    dynAtoms[i].atom.Z = species[j].atom.Z;
-	    dynAtoms[i].atom.A = periodicTable[dynAtoms[i].atom.Z].A;
-	    printf ("\t\t\t\t\t%d %d %.2f %s\n", dynAtoms[i].id,
-		    dynAtoms[i].atom.Z, dynAtoms[i].atom.A, name[j]);
+	 if (ctx->dynAtoms[i].id == species[j].id) {
+	    ctx->dynAtoms[i].id = ctx->FCfirst + i;
+	    ctx->dynAtoms[i].atom.Z = species[j].atom.Z;
+	    ctx->dynAtoms[i].atom.A =
+	       periodicTable[ctx->dynAtoms[i].atom.Z].A;
+	    LOGinfo (ctx, "\t\t\t\t\t%d %d %.2f %s\n", ctx->dynAtoms[i].id,
+			       ctx->dynAtoms[i].atom.Z, ctx->dynAtoms[i].atom.A,
+			       name[j]);
 	    break ;
 	 }
       }
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
+   LOGprogress (ctx);
+
+   return VIB_SUCCESS;
+
+} /* readDynamicAtoms */
+
+
+/* ********************************************************* */
+/* Reads the file 'inputFC.in' (written by 'setInput.sh' at  */
+/* the FC directory) and assigns the context variables.      */
+static int assignContextVar (vib_context *ctx)
+{
+   register int i, len;
+   int nSpecies, info;
+   element *species;
+   char (*name)[10]; /* element name */
+   char *inputFile;
+   FILE *FCinfo;
 
-   /* Closes the file 'inputFC.in'. */
-   CHECKfclose (fclose (FCinfo), inputFile);
+   /* Sets the file name 'inputFC.in' with FC directory path. */
+   len = strlen (ctx->FCdir);
+   inputFile = CHECKmalloc ((len + 11) * sizeof (char));
+   if (inputFile == NULL)
+      return VIB_ERR_MEMORY;
+   sprintf (inputFile, "%sinputFC.in", ctx->FCdir);
+
+   /* Opens the file with FC run informations. */
+   FCinfo = CHECKfopen (inputFile, "r");
+   if (FCinfo == NULL) {
+      CHECKfree (inputFile);
+      return VIB_ERR_FILE;
+   }
+
+   /* Reads and assigns context variables. */
+   species = NULL;
+   name = NULL;
+   info = CHECKfscanf (fscanf (FCinfo, "%29s", ctx->sysLabel), inputFile);
+   if (info == VIB_SUCCESS) {
+      LOGinfo (ctx, "    System label:\t\t\t%s\n", ctx->sysLabel);
+      info = CHECKfscanf (fscanf (FCinfo, "%d", &ctx->nAtoms), inputFile);
+   }
+   if (info == VIB_SUCCESS) {
+      LOGinfo (ctx, "    Number of atoms:\t\t\t%d\n", ctx->nAtoms);
+
+      /* Different species from the system. */
+      info = CHECKfscanf (fscanf (FCinfo, "%d", &nSpecies), inputFile);
+   }
+   if (info == VIB_SUCCESS) {
+      LOGinfo (ctx, "    Different system species:\t\t%d\n", nSpecies);
+      species = CHECKmalloc (nSpecies * sizeof (element));
+      name = CHECKmalloc (nSpecies * sizeof (*name));
+      if (species == NULL || name == NULL)
+	 info = VIB_ERR_MEMORY;
+   }
+   for (i = 0; i < nSpecies && info == VIB_SUCCESS; i++) {
+      info = CHECKfscanf (fscanf (FCinfo, "%d %d %9s", &species[i].id,
+				  &species[i].atom.Z, name[i]), inputFile);
+      if (info == VIB_SUCCESS)
+	 LOGinfo (ctx, "\t\t\t\t\t %d %d %s\n", species[i].id,
+			    species[i].atom.Z, name[i]);
+   }
+   if (info == VIB_SUCCESS)
+      info = readDynamicAtoms (ctx, FCinfo, inputFile,
+			       nSpecies, species, name);
+
+   /* Closes and removes the file 'inputFC.in'. */
+   if (info == VIB_SUCCESS)
+      info = CHECKfclose (fclose (FCinfo), inputFile);
+   else
+      fclose (FCinfo);
+   remove (inputFile);
 
    /* Frees memory. */
-   free (inputFile);
-   free (species);
-   for (i = 0; i < nSpecies; i++)
-      free (name[i]);
-   free (name);
+   CHECKfree (inputFile);
+   CHECKfree (species);
+   CHECKfree (name);
+
+   return info;
    
-} /* assignGlobalVar */
+} /* assignContextVar */
 
 
 /* ********************************************************* */
 /* Reads at '.ef' file the Fermi energy from the undisplaced */
 /* system and the Fermi energy obtained after each           */
 /* displacement.                                             */
-static void readFermiEnergy ()
+static int readFermiEnergy (vib_context *ctx)
 {
    register int i, len;
+   int info = VIB_SUCCESS;
    char *efFile;
    FILE *EF;
 
    /* Sets the '.ef' file name with 'FCdir' path. */
-   len = strlen (FCdir);
-   len += strlen (sysLabel);
+   len = strlen (ctx->FCdir);
+   len += strlen (ctx->sysLabel);
    efFile = CHECKmalloc ((len + 4) * sizeof (char));
-   efFile[0] = '\0';
-   sprintf (efFile, "%s%s.ef", FCdir, sysLabel);
+   if (efFile == NULL)
+      return VIB_ERR_MEMORY;
+   sprintf (efFile, "%s%s.ef", ctx->FCdir, ctx->sysLabel);
 
    /* Opens the '.ef' file. */
-   printf ("\n    reading \"%s\" file... ", efFile);
+   LOGinfo (ctx, "\n    reading \"%s\" file... ", efFile);
    EF = CHECKfopen (efFile, "r");
+   if (EF == NULL) {
+      CHECKfree (efFile);
+      return VIB_ERR_FILE;
+   }
 
    /* Reads the Fermi energies. */
-   ef = UTILdoubleVector (6 * nDyn + 1);
-   for (i = 0; i < 6 * nDyn + 1; i++)
-      CHECKfscanf (fscanf (EF, "%*d %lf", &ef[i]), efFile);
+   ctx->ef = UTILdoubleVector (6 * ctx->nDyn + 1);
+   if (ctx->ef == NULL)
+      info = VIB_ERR_MEMORY;
+   for (i = 0; i < 6 * ctx->nDyn + 1 && info == VIB_SUCCESS; i++)
+      info = CHECKfscanf (fscanf (EF, "%*d %lf", &ctx->ef[i]), efFile);
 
    /* Closes the file. */
-   CHECKfclose (fclose (EF), efFile);
-   printf ("ok!\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
+   if (info == VIB_SUCCESS)
+      info = CHECKfclose (fclose (EF), efFile);
+   else
+      fclose (EF);
+   if (info == VIB_SUCCESS)
+      LOGinfo (ctx, "ok!\n");
+   LOGprogress (ctx);
 
    /* Frees memory. */
-   free (efFile);
+   CHECKfree (efFile);
+
+   return info;
 
 } /* readFermiEnergy */
 
 
 /* ********************************************************* */
 /* Reads the first orbital index of each atom in the unit    */
-/* cell from the '.orb' file.                                */
-static void readOrbitalIndex ()
+/* cell from the '.orb' file at the directory 'dir'.         */
+static int readOrbitalIndex (vib_context *ctx, const char *dir)
 {
    register int i, len;
+   int info = VIB_SUCCESS;
    char *orbFile;
    FILE *ORB;
 
-   /* Sets the '.orb' file name with 'FCdir' path. */
-   len = strlen (FCdir);
-   len += strlen (sysLabel);
+   /* Sets the '.orb' file name with 'dir' path. */
+   len = strlen (dir);
+   len += strlen (ctx->sysLabel);
    orbFile = CHECKmalloc ((len + 5) * sizeof (char));
-   orbFile[0] = '\0';
-   sprintf (orbFile, "%s%s.orb", FCdir, sysLabel);
+   if (orbFile == NULL)
+      return VIB_ERR_MEMORY;
+   sprintf (orbFile, "%s%s.orb", dir, ctx->sysLabel);
 
    /* Opens the '.orb' file. */
-   printf ("\n    reading \"%s\" file... ", orbFile);
+   LOGinfo (ctx, "\n    reading \"%s\" file... ", orbFile);
    ORB = CHECKfopen (orbFile, "r");
+   if (ORB == NULL) {
+      CHECKfree (orbFile);
+      return VIB_ERR_FILE;
+   }
 
    /* Reads the first orbital index of each atom. */
-   orbIdx = CHECKmalloc ((nAtoms + 1) * sizeof (int));
-   for (i = 0; i < nAtoms + 1; i++)
-      CHECKfscanf (fscanf (ORB, "%d", &orbIdx[i]), orbFile);
+   ctx->orbIdx = CHECKmalloc ((ctx->nAtoms + 1) * sizeof (int));
+   if (ctx->orbIdx == NULL)
+      info = VIB_ERR_MEMORY;
+   for (i = 0; i < ctx->nAtoms + 1 && info == VIB_SUCCESS; i++)
+      info = CHECKfscanf (fscanf (ORB, "%d", &ctx->orbIdx[i]), orbFile);
 
    /* Closes the file. */
-   CHECKfclose (fclose (ORB), orbFile);
-   printf ("ok!\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
+   if (info == VIB_SUCCESS)
+      info = CHECKfclose (fclose (ORB), orbFile);
+   else
+      fclose (ORB);
+
+   /* Frees memory. */
+   CHECKfree (orbFile);
+
+   if (info != VIB_SUCCESS)
+      return info;
+   LOGinfo (ctx, "ok!\n");
+   LOGprogress (ctx);
 
    /* Number of basis orbitals from unit cell. */
-   no_u = orbIdx[nAtoms];
-   printf ("\n    Basis orbitals per unit cell:\t\t%d\n", no_u);
+   ctx->no_u = ctx->nAct = ctx->orbIdx[ctx->nAtoms];
+   ctx->orbShift = 0;
+   LOGinfo (ctx, "\n    Basis orbitals per unit cell:\t\t%d\n", ctx->no_u);
 
    /* First orbital of the first dynamic atom. */
-   printf ("    First orbital from dynamic atom:\t\t%d\n",
-	   orbIdx[FCfirst-1] + 1);
+   LOGinfo (ctx, "    First orbital from dynamic atom:\t\t%d\n",
+		      ctx->orbIdx[ctx->FCfirst-1] + 1);
 
    /* Dynamic atoms orbitals quantity. */
-   printf ("    Number of dynamic atoms basis orbitals:\t%d\n",
-	   orbIdx[FClast] - orbIdx[FCfirst-1]);
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
+   LOGinfo (ctx, "    Number of dynamic atoms basis orbitals:\t%d\n",
+		      ctx->orbIdx[ctx->FClast] - ctx->orbIdx[ctx->FCfirst-1]);
+   LOGflush (ctx);
 
-   /* Frees memory. */
-   free (orbFile);
+   return VIB_SUCCESS;
 
 } /* readOrbitalIndex */
 
@@ -278,204 +635,307 @@ static void readOrbitalIndex ()
 /* ********************************************************* */
 /* Runs a script that collects required informations from FC */
 /* input 'fdf' file and writes them at 'inputFC.in' file.    */
-/* Calls 'assignGlobalVar' function to assign global         */
-/* variables.                                                */
-void PHONreadFCfdf (char *exec, char *FCpath, char *FCinput,
-		    int calcType, char *FCsplit, int *nDynTot,
-		    int *nDynOrb, int *spinPol)
+/* Calls 'assignContextVar' function to assign the context   */
+/* variables. Any data previously held by 'ctx' is released. */
+static int readFCfdf (vib_context *ctx, char *exec, char *FCpath,
+		      char *FCinput, int calcType, char *FCsplit,
+		      int *nDynTot, int *nDynOrb, int *spinPol)
 {
    register int i, len;
+   int info;
    char calc[2];
    char *scriptCall;
 
+   if (ctx == NULL || (calcType != 1 && calcType != 2))
+      return VIB_ERR_INPUT;
+   resetContext (ctx);
+   ctx->calcType = calcType;
+
    /* For calling the script, one should use a string     */
    /* like this: "[script name with path] [FC directory]" */
    len = strlen(FCpath) + strlen(FCinput) + strlen(FCsplit);
-   scriptCall = CHECKmalloc ((len + 19) * sizeof (char));
-   scriptCall[0] = '\0';
-   calc[0] = '\0';
+   scriptCall = CHECKmalloc ((len + 31) * sizeof (char));
+   if (scriptCall == NULL)
+      return VIB_ERR_MEMORY;
    sprintf(&calc[0], "%d", calcType);
-   strcpy (scriptCall, "setInput.sh ");
-   strcat (scriptCall, FCpath);
-   strcat (scriptCall, " ");
-   strcat (scriptCall, FCinput);
-   strcat (scriptCall, " ");
-   strcat (scriptCall, calc);
-   strcat (scriptCall, " ");
-   strcat (scriptCall, FCsplit);
-
-   /* Assigns the work directory global variable. */
+   sprintf (scriptCall, "setInput.sh %s %s %s %s",
+	    FCpath, FCinput, calc, FCsplit);
+   if (ctx->logLevel == LOG_QUIET) /* only its errors */
+      strcat (scriptCall, " > /dev/null");
+
+   /* Assigns the work directory (the path of 'exec'). */
    len = strlen (exec);
-   workDir = CHECKmalloc ((len - 9) * sizeof (char));
-   for (i = 0; i < len - 10; i++)
-      workDir[i] = exec[i];
-   workDir[i] = '\0';
+   while (len > 0 && exec[len - 1] != '/')
+      len--;
+   ctx->workDir = CHECKmalloc ((len + 1) * sizeof (char));
+   if (ctx->workDir == NULL) {
+      CHECKfree (scriptCall);
+      return VIB_ERR_MEMORY;
+   }
+   for (i = 0; i < len; i++)
+      ctx->workDir[i] = exec[i];
+   ctx->workDir[i] = '\0';
 
-   /* Assigns the force constants directory global variable. */
+   /* Assigns the force constants directory. */
    len = strlen (FCpath);
-   if (FCpath[len - 1] == '/') {
-      FCdir = CHECKmalloc ((len + 1) * sizeof (char));
-      strcpy (FCdir, FCpath);
+   ctx->FCdir = CHECKmalloc ((len + 2) * sizeof (char));
+   if (ctx->FCdir == NULL) {
+      CHECKfree (scriptCall);
+      return VIB_ERR_MEMORY;
    }
-   else {
-      FCdir = CHECKmalloc ((len + 2) * sizeof (char));
-      strcpy (FCdir, FCpath);
-      FCdir[len] = '/';
-      FCdir[len + 1] = '\0';
+   strcpy (ctx->FCdir, FCpath);
+   if (len == 0 || FCpath[len - 1] != '/') {
+      ctx->FCdir[len] = '/';
+      ctx->FCdir[len + 1] = '\0';
    }
 
    /* Runs the script that collects required informations from */
    /* the input 'fdf' file and puts at 'inputFC.in' file.      */
+   LOGflush (ctx); /* the script shares 'stdout' */
    i = system (scriptCall);
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
+   CHECKfree (scriptCall);
    if (i != 0) {
       fprintf (stderr, " ERROR: problem when trying to run");
       fprintf (stderr, " 'setInput.sh' script!\n\n");
-      exit (EXIT_FAILURE);
+      return VIB_ERR_SCRIPT;
    }
 
-   /* Reads the file 'inputFC.in' and assigns global variables. */
-   assignGlobalVar ();
+   /* Reads the file 'inputFC.in' and assigns context variables. */
+   info = assignContextVar (ctx);
+   if (info != VIB_SUCCESS)
+      return info;
 
    if (calcType == 1) { /* 'full' calculation */
 
       /* Reads the Fermi energies. */
-      printf ("\n Gets Fermi energies from (un)displaced systems:\n");
-      setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
-      readFermiEnergy ();
+      LOGinfo (ctx,
+	       "\n Gets Fermi energies from (un)displaced systems:\n");
+      LOGflush (ctx);
+      info = readFermiEnergy (ctx);
+      if (info != VIB_SUCCESS)
+	 return info;
 
       /* Gets the first orbital index of each atom. */
-      printf ("\n Gets basis orbitals dimensions info:\n");
-      setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
-      readOrbitalIndex ();
+      LOGinfo (ctx, "\n Gets basis orbitals dimensions info:\n");
+      LOGflush (ctx);
+      info = readOrbitalIndex (ctx, ctx->FCdir);
+      if (info != VIB_SUCCESS)
+	 return info;
+
+      /* Selects the active region of the basis. */
+      if (ctx->activeShells > 0 || ctx->activeCutoff > 0.0) {
+	 info = activeBasis (ctx);
+	 if (info != VIB_SUCCESS)
+	    return info;
+      }
 
       /* Returns the total number of orbitals for 'e-ph' coupling matrix. */
-      *nDynOrb = orbIdx[FClast] - orbIdx[FCfirst-1];
+      *nDynOrb = ctx->orbIdx[ctx->FClast] - ctx->orbIdx[ctx->FCfirst-1];
+
+   }
 
+   /* Symmetry-reduced displacements. */
+   if (ctx->symOps != NULL) {
+      info = symmetrySetup (ctx);
+      if (info != VIB_SUCCESS)
+	 return info;
    }
 
    /* Returns the dimension of 'FC' matrix. */
-   *nDynTot = 3 * nDyn;
-   *spinPol = nspin;
-
-   /* Removes 'inputFC.in' file. */
-   scriptCall[0] = '\0';
-   strcpy (scriptCall, "rm ");
-   strcat (scriptCall, exec);
-   scriptCall[strlen (scriptCall)-10] = '\0'; /* removes 'exec' */
-   strcat (scriptCall, "inputFC.in");
-   i = system (scriptCall);
+   *nDynTot = 3 * ctx->nDyn;
+   *spinPol = ctx->nspin;
 
-   /* Frees memory. */
-   free (scriptCall);
+   return VIB_SUCCESS;
+
+} /* readFCfdf */
+
+
+/* ********************************************************* */
+/* Collects required informations from FC input 'fdf' file   */
+/* (see 'readFCfdf'), timed as the stage 'readFCfdf'.        */
+int PHONreadFCfdf (vib_context *ctx, char *exec, char *FCpath,
+		   char *FCinput, int calcType, char *FCsplit,
+		   int *nDynTot, int *nDynOrb, int *spinPol)
+{
+   int info;
+
+   if (ctx == NULL)
+      return VIB_ERR_INPUT;
+   TIMEstart (ctx, "readFCfdf");
+   info = readFCfdf (ctx, exec, FCpath, FCinput, calcType, FCsplit,
+		     nDynTot, nDynOrb, spinPol);
+   TIMEstop (ctx, "readFCfdf");
+
+   return info;
 
 } /* PHONreadFCfdf */
 
 
+/* ********************************************************* */
+/* Estimates the peak memory (in bytes) allocated by the     */
+/* library and by its caller ('EigVec', 'EigVal' and 'Meph') */
+/* for the calculation read at 'PHONreadFCfdf'.              */
+double PHONmemEstimate (vib_context *ctx)
+{
+   double nDynTot, nOrb, n2, base, dHpeak, corrPeak;
+
+   nDynTot = 3.0 * ctx->nDyn;
+
+   /* "onlyPh": the reduced FC matrix (the file is streamed). */
+   if (ctx->calcType != 1)
+      return sizeof (double) * (nDynTot * nDynTot + 3.0 * nDynTot);
+
+   /* "full": 'H0', 'S0', 'dH', 'Meph' and the phonon modes... */
+   nOrb = ctx->orbIdx[ctx->FClast] - ctx->orbIdx[ctx->FCfirst-1];
+   n2 = (double) ctx->nAct * ctx->nAct; /* (active region) */
+   base = (ctx->nspin + 1.0) * n2 + nDynTot * ctx->nspin * n2
+      + (double) nOrb * nOrb * nDynTot * ctx->nspin + nDynTot * nDynTot
+      + nDynTot;
+
+   /* ... plus 'Hm', 'Hp' and 'S' at 'deltaH'... */
+   dHpeak = 2.0 * nDynTot * ctx->nspin * n2 + n2;
+
+   /* ... or 'dStot', 'invS0', 'dS', 'Aux', 'Sm', 'Sp' */
+   /* and 'St' at 'dHCorrection'.                      */
+   corrPeak = 13.0 * n2;
+
+   return sizeof (double) * (base + (dHpeak > corrPeak ? dHpeak : corrPeak));
+
+} /* PHONmemEstimate */
+
+
 /* ********************************************************* */
 /* Removes egg-box effect by imposing force conservation.    */
-static void rmEggBox (double *fullFCM)
+static void rmEggBox (vib_context *ctx, double *fullFCM)
 {
-   register int i, j, k, dyn;
-   double sum;
-
-   for (j = 0; j < 3 * nDyn; j++) {
-      dyn = FCfirst - 1 + j / 3; /* dynamic atom */
-      for (k = 0; k < 3; k++) { /* coordinates (x,y,z) */
-	 fullFCM[idx(dyn*3+k,j,3*nAtoms)] = 0.0;
-	 sum = 0.0;
-	 for (i = 0; i < nAtoms; i++) /* sum over all atoms coord 'k' */
-	    sum = sum + fullFCM[idx(i*3+k,j,3*nAtoms)];
-	 fullFCM[idx(dyn*3+k,j,3*nAtoms)] = - 1.0 * sum;
-      }
-   }
+
+   KERNtable()->eggBox (ctx->nAtoms, 3 * ctx->nDyn, ctx->FCfirst - 1,
+			fullFCM);
 
 } /* rmEggBox */
 
 
 /* ********************************************************* */
 /* Symmetrizes and mass-scales the 'FC' matrix.              */
-static void symmetrizesAndMassScale (double *FC)
+static int symmetrizesAndMassScale (vib_context *ctx, double *FC)
 {
-   register int i, j;
-   double aux;
+   register int i;
+   int nDyn = ctx->nDyn;
+   double *mass;
+
+   /* Masses of the dynamic atoms. */
+   mass = CHECKmalloc (nDyn * sizeof (double));
+   if (mass == NULL)
+      return VIB_ERR_MEMORY;
+   for (i = 0; i < nDyn; i++)
+      mass[i] = ctx->dynAtoms[i].atom.A;
 
-   for (j = 0; j < 3 * nDyn; j++)
-      for (i = j; i < 3 * nDyn; i++) {
-	 /* Computes the mean. */
-	 aux = (FC[idx(i,j,3*nDyn)] + FC[idx(j,i,3*nDyn)]) / 2.0;
+   KERNtable()->symmScale (3 * nDyn, FC, mass);
 
-	 /* Mass-scales. */
-	 aux = aux / sqrt (dynAtoms[i/3].atom.A * dynAtoms[j/3].atom.A);
+   /* Frees memory. */
+   CHECKfree (mass);
 
-	 /* Simetrizes. */
-	 FC[idx(i,j,3*nDyn)] = FC[idx(j,i,3*nDyn)] = aux;
-      }
+   return VIB_SUCCESS;
 
 } /* symmetrizesAndMassScale */
 
 
 /* ********************************************************* */
-/* Reads the SIESTA force constants matrix and computes      */
-/* phonon modes and frequencies with finite differences.     */
-void PHONfreq (double *EigVec, double *EigVal)
+/* From the FC matrix reduced to the dynamic atoms at        */
+/* 'EigVec' (egg-box free mean of the negative and positive  */
+/* displacements, in eV/Ang^2), symmetrizes and mass-scales, */
+/* and computes the phonon modes ('EigVec') and energies     */
+/* ('EigVal').                                               */
+static int reducedModes (vib_context *ctx, double *EigVec, double *EigVal)
 {
-   register int i, j, len;
+   register int i;
+   int nDyn, info;
    double cst;
-   double *fullFCneg, *fullFCpos;
-   char check[25];
-   char *FCMfile;
-   FILE *FCM;
 
-   /* Sets the SIESTA FC matrix file name with 'FCdir' path. */
-   len = strlen (FCdir);
-   len += strlen (sysLabel);
-   FCMfile = CHECKmalloc ((len + 4) * sizeof (char));
-   sprintf (FCMfile, "%s%s.FC", FCdir, sysLabel);
+   nDyn = ctx->nDyn;
 
-   /* Opens the SIESTA FC matrix file. */
-   printf ("\n Reading %s file... ", FCMfile);
-   FCM = CHECKfopen (FCMfile, "r");
+   /* Symmetrizes and mass-scales the matrix. */
+   LOGinfo (ctx, "\n \"Symmetrizing\" and mass-scaling the FC matrix... ");
+   TIMEstart (ctx, "symmetrize");
+   info = symmetrizesAndMassScale (ctx, EigVec);
+   TIMEstop (ctx, "symmetrize");
+   if (info != VIB_SUCCESS)
+      return info;
+   TIMEbytes (ctx, "symmetrize", 2.0 * 9 * nDyn * nDyn * sizeof (double),
+	      9.0 * nDyn * nDyn * sizeof (double));
+   TIMEflops (ctx, "symmetrize", 3.0 * 9 * nDyn * nDyn);
+   LOGinfo (ctx, "ok!\n");
+   LOGprogress (ctx);
+
+   /* Dumps the reduced, mass-scaled and symmetrized FC */
+   /* matrix (debug level).                              */
+   LOGdebug (ctx, "\n Reduced force constants matrix:\n");
+   info = LOGmatrix (ctx, "FCreduced", EigVec, 3 * nDyn, 3 * nDyn);
+   if (info != VIB_SUCCESS)
+      return info;
+
+   /* Computes all eigenvalues and eigenvectors (about '4 n^3' */
+   /* flops: reduction to tridiagonal form, divide and conquer  */
+   /* and back-transformation).                                 */
+   TIMEstart (ctx, "dsyevd");
+   info = CHECKdsyevd (3 * nDyn, EigVec, EigVal);
+   TIMEstop (ctx, "dsyevd");
+   TIMEflops (ctx, "dsyevd", 4.0 * 27 * nDyn * nDyn * nDyn);
+   if (info != VIB_SUCCESS)
+      return info;
 
-   /* Checks if the file starts correctly. */
-   if ((fgets(check,24,FCM)==NULL) ||
-       (strncmp(check,"Force constants matrix",22)!=0)) {
-      fprintf (stderr,
-	       " ERROR: the file %s is not written correctly!\n\n",
-	       FCMfile);
-      exit (EXIT_FAILURE);
+   /* Prints on screen the phonon energies. */
+   LOGinfo (ctx, "\n Phonon energies (eV):\n\n");
+   cst = hbar * sqrt (1.0e20 * eV2joule / amu2kg);
+   for (i = 0; i < 3 * nDyn; i++) {
+      if (EigVal[i] < 0.0) {
+	 LOGinfo (ctx, "  %d % .5e\n", i + 1, - cst * sqrt(-EigVal[i]));
+	 EigVal[i] = 0.0;
+      } else {
+	 EigVal[i] = cst * sqrt(EigVal[i]);
+	 LOGinfo (ctx, "  %d % .5e\n", i + 1, EigVal[i]);
+      }
    }
+   LOGprogress (ctx);
 
-   /* FC matrix with all atoms                             */
-   /* [negative (minus) and positive (plus) displacement]. */
-   fullFCneg = CHECKmalloc (3 * nAtoms * 3 * nDyn * sizeof (double));
-   fullFCpos = CHECKmalloc (3 * nAtoms * 3 * nDyn * sizeof (double));
+   /* Dumps the phonon modes (debug level). */
+   LOGdebug (ctx, "\n Normalized phonon modes (Ang*amu^0.5):\n");
+   info = LOGmatrix (ctx, "modes", EigVec, 3 * nDyn, 3 * nDyn);
+   if (info != VIB_SUCCESS)
+      return info;
+   LOGflush (ctx);
 
-   /* Reads the SIESTA FC matrix file       */
-   /* (obs.: matrix in column-major order). */
-   for (j = 0; j < 3 * nDyn; j++) {
-      /* Negative displacement. */
-      for (i = 0; i < 3 * nAtoms; i++)
-	 CHECKfscanf (fscanf (FCM, "%lE",
-			      &fullFCneg[idx(i,j,3*nAtoms)]), FCMfile);
+   return VIB_SUCCESS;
 
-      /* Positive displacement. */
-      for (i = 0; i < 3 * nAtoms; i++)
-	 CHECKfscanf (fscanf (FCM, "%lE",
-			      &fullFCpos[idx(i,j,3*nAtoms)]), FCMfile);
-   }
+} /* reducedModes */
 
-   /* Closes the SIESTA FC matrix file. */
-   CHECKfclose (fclose (FCM), FCMfile);
-   printf ("ok!\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
+
+/* ********************************************************* */
+/* From the FC matrices with all atoms for negative and      */
+/* positive displacements ('fullFCneg' and 'fullFCpos', in   */
+/* eV/Ang^2), removes the egg-box effect, reduces to the     */
+/* dynamic atoms, symmetrizes and mass-scales, and computes  */
+/* the phonon modes ('EigVec') and energies ('EigVal').      */
+static int phononModes (vib_context *ctx, double *fullFCneg,
+			double *fullFCpos, double *EigVec, double *EigVal)
+{
+   register int i, j;
+   int nAtoms, nDyn, first;
+
+   nAtoms = ctx->nAtoms;
+   nDyn = ctx->nDyn;
 
    /* Removes egg-box effect. */
-   printf ("\n Removing egg-box effect... ");
-   rmEggBox (fullFCneg);
-   rmEggBox (fullFCpos);
-   printf ("ok!\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
+   LOGinfo (ctx, "\n Removing egg-box effect... ");
+   TIMEstart (ctx, "eggBox");
+   rmEggBox (ctx, fullFCneg);
+   rmEggBox (ctx, fullFCpos);
+   TIMEstop (ctx, "eggBox");
+   TIMEbytes (ctx, "eggBox", 2.0 * 9 * nAtoms * nDyn * sizeof (double),
+	      2.0 * 9 * nDyn * sizeof (double));
+   TIMEflops (ctx, "eggBox", 2.0 * 9 * nAtoms * nDyn);
+   LOGinfo (ctx, "ok!\n");
+   LOGprogress (ctx);
 
    /* The SIESTA FC matrix file contains the values of force    */
    /* by displacement [eV/Ang^2]. In order to compute the       */
@@ -483,432 +943,1377 @@ void PHONfreq (double *EigVec, double *EigVal)
    /* one has only to subtract the value corresponding to the   */
    /* negative displacement by the value corresponding to the   */
    /* positive displacement and divide by 2.                    */
-   printf ("\n Reducing to dynamic atoms dimension");
-   printf (" and computing finite differences... ");
-   len = (FCfirst - 1) * 3;
+   LOGinfo (ctx, "\n Reducing to dynamic atoms dimension");
+   LOGinfo (ctx, " and computing finite differences... ");
+   first = (ctx->FCfirst - 1) * 3;
    for (j = 0; j < 3 * nDyn; j++)
-      for (i = len; i < FClast * 3; i++)
-	 EigVec[idx(i-len,j,3*nDyn)] =
+      for (i = first; i < ctx->FClast * 3; i++)
+	 EigVec[idx(i-first,j,3*nDyn)] =
 	    (fullFCneg[idx(i,j,3*nAtoms)] +
 	     fullFCpos[idx(i,j,3*nAtoms)]) / 2.0;
-   printf ("ok!\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
+   LOGinfo (ctx, "ok!\n");
+   LOGprogress (ctx);
 
-   /* Symmetrizes and mass-scales the matrix. */
-   printf ("\n \"Symmetrizing\" and mass-scaling the FC matrix... ");
-   symmetrizesAndMassScale (EigVec);
-   printf ("ok!\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
-
-   /* Prints on screen the reduced,          */
-   /* mass-scaled and symmetrized FC matrix. */
-   printf ("\n Reduced force constants matrix:\n\n");
-   for (i = 0; i < 3 * nDyn; i++) {
-      for (j = 0; j < 3 * nDyn; j++)
-	 printf (" % .5e  ", EigVec[idx(i,j,3*nDyn)]);
-      printf ("\n");
+   return reducedModes (ctx, EigVec, EigVal);
+
+} /* phononModes */
+
+
+/* ********************************************************* */
+/* Streams the SIESTA FC matrix file 'FCM' (after the        */
+/* header), which alternates one column of the negative and  */
+/* one of the positive displacement (all atoms) per displaced */
+/* coordinate, into the FC matrix reduced to the dynamic     */
+/* atoms 'FC'. While each column is parsed, only its dynamic */
+/* rows are kept and the per-coordinate sums of the egg-box  */
+/* removal (see 'rmEggBox') are accumulated, in the same     */
+/* order; at the end of each pair of columns the rows of the */
+/* displaced atom are replaced and the mean of the pair is   */
+/* stored (see 'phononModes'). The numbers are parsed by the */
+/* active kernels path.                                      */
+static int readFCmatrix (vib_context *ctx, FILE *FCM, const char *FCMfile,
+			 double *FC)
+{
+   register int i, r, c;
+   int n, len, dlen, first, last, half, atom, dyn, col, total, got = 0;
+   double v[32], sum[6], *buf;
+   char *line = NULL;
+   const char *p;
+   size_t size = 0;
+   const kern_table *kern = KERNtable ();
+
+   len = 3 * ctx->nAtoms; /* rows of a column */
+   dlen = 3 * ctx->nDyn; /* dynamic rows */
+   first = ctx->FCfirst - 1; /* first and last dynamic atoms */
+   last = ctx->FClast - 1;
+   total = 2 * len * dlen;
+
+   /* Dynamic rows of the negative and positive columns. */
+   buf = CHECKmalloc (2 * dlen * sizeof (double));
+   if (buf == NULL)
+      return VIB_ERR_MEMORY;
+
+   while (got < total && getline (&line, &size, FCM) != -1) {
+      p = line;
+      while (got < total &&
+	     (n = kern->parse (p, v, (total - got < 32 ? total - got : 32),
+			       &p)) > 0)
+	 for (i = 0; i < n; i++, got++) {
+	    col = got / (2 * len);
+	    r = got % (2 * len);
+	    half = (r >= len); /* positive displacement */
+	    r -= half * len;
+	    atom = r / 3;
+	    dyn = first + col / 3; /* displaced atom */
+	    if (r == 0 && half == 0)
+	       sum[0] = sum[1] = sum[2] = sum[3] = sum[4] = sum[5] = 0.0;
+	    if (atom != dyn) /* its rows are zero at the sums */
+	       sum[3*half+r%3] = sum[3*half+r%3] + v[i];
+	    if (atom >= first && atom <= last)
+	       buf[half*dlen+r-3*first] = v[i];
+
+	    /* Pair complete. */
+	    if (half == 1 && r == len - 1) {
+	       for (c = 0; c < 3; c++) {
+		  buf[3*(dyn-first)+c] = - 1.0 * sum[c];
+		  buf[dlen+3*(dyn-first)+c] = - 1.0 * sum[3+c];
+	       }
+	       for (c = 0; c < dlen; c++)
+		  FC[idx(c,col,dlen)] = (buf[c] + buf[dlen+c]) / 2.0;
+	    }
+	 }
+      while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+	 p++;
+      if (got < total && *p != '\0') {
+	 fprintf (stderr, "\n\n Error: Problem reading the file '%s'"
+		  " (value %d)!\n\n", FCMfile, got + 1);
+	 free (line); /* allocated by 'getline' */
+	 CHECKfree (buf);
+	 return VIB_ERR_FORMAT;
+      }
    }
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
 
-   /* Computes all eigenvalues and eigenvectors. */
-   CHECKdsyevd (3 * nDyn, EigVec, EigVal);
+   /* Frees memory. */
+   free (line); /* allocated by 'getline' */
+   CHECKfree (buf);
 
-   /* Prints on screen the phonon energies. */
-   printf ("\n Phonon energies (eV):\n\n");
-   cst = hbar * sqrt (1.0e20 * eV2joule / amu2kg);
-   for (i = 0; i < 3 * nDyn; i++) {
-      if (EigVal[i] < 0.0) {
-	 printf ("  %d % .5e\n", i + 1, - cst * sqrt(-EigVal[i]));
-	 EigVal[i] = 0.0;
-      } else {
-	 EigVal[i] = cst * sqrt(EigVal[i]);
-	 printf ("  %d % .5e\n", i + 1, EigVal[i]);
+   if (got < total) {
+      fprintf (stderr, "\n\n Error: Unable to read the file '%s'!\n\n",
+	       FCMfile);
+      return VIB_ERR_FILE;
+   }
+
+   return VIB_SUCCESS;
+
+} /* readFCmatrix */
+
+
+/* ********************************************************* */
+/* Reads the SIESTA force constants matrix and computes      */
+/* phonon modes and frequencies with finite differences.     */
+int PHONfreq (vib_context *ctx, double *EigVec, double *EigVal)
+{
+   register int len;
+   int nDyn, info = VIB_SUCCESS;
+   char check[25];
+   char *FCMfile;
+   FILE *FCM;
+
+   if (ctx == NULL || ctx->dynAtoms == NULL)
+      return VIB_ERR_INPUT;
+   nDyn = ctx->nDyn;
+
+   /* Reads the modes from a previous run checkpoint. */
+   if (ctx->chkDir != NULL) {
+      info = CKPTopen (ctx);
+      if (info != VIB_SUCCESS)
+	 return info;
+      if (CKPTdone (ctx, "modes", -1) && CKPTdone (ctx, "energies", -1) &&
+	  CKPTload (ctx, "modes", -1, EigVec, 9 * nDyn * nDyn)
+	  == VIB_SUCCESS &&
+	  CKPTload (ctx, "energies", -1, EigVal, 3 * nDyn) == VIB_SUCCESS) {
+	 LOGinfo (ctx, "\n Phonon modes read from checkpoint at %s.\n",
+		  ctx->chkDir);
+	 LOGflush (ctx);
+	 return VIB_SUCCESS;
       }
    }
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
 
-   /* Prints on screen the phonon modes. */
-   printf ("\n Normalized phonon modes (Ang*amu^0.5):\n\n");
-   for (i = 0; i < 3 * nDyn; i++)
-      printf (" %7d       ", i+1);
-   printf ("\n");
-   for (i = 0; i < 3 * nDyn; i++) {
-      for (j = 0; j < 3 * nDyn; j++)
-	 printf (" % .5e  ", EigVec[idx(i,j,3*nDyn)]);
-      printf ("\n");
+   /* Sets the SIESTA FC matrix file name with 'FCdir' path. */
+   len = strlen (ctx->FCdir);
+   len += strlen (ctx->sysLabel);
+   FCMfile = CHECKmalloc ((len + 4) * sizeof (char));
+   if (FCMfile == NULL)
+      return VIB_ERR_MEMORY;
+   sprintf (FCMfile, "%s%s.FC", ctx->FCdir, ctx->sysLabel);
+
+   /* Opens the SIESTA FC matrix file. */
+   LOGinfo (ctx, "\n Reading %s file (egg-box removal and reduction"
+	    " to dynamic atoms)... ", FCMfile);
+   TIMEstart (ctx, "readFC");
+   FCM = CHECKfopen (FCMfile, "r");
+   if (FCM == NULL)
+      info = VIB_ERR_FILE;
+
+   /* Checks if the file starts correctly. */
+   else if ((fgets(check,24,FCM)==NULL) ||
+	    (strncmp(check,"Force constants matrix",22)!=0)) {
+      fprintf (stderr,
+	       " ERROR: the file %s is not written correctly!\n\n",
+	       FCMfile);
+      info = VIB_ERR_FORMAT;
    }
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
 
-   /* Frees memory. */
-   free (fullFCneg);
-   free (fullFCpos);
-   free (FCMfile);
+   /* Streams the SIESTA FC matrix file into the FC matrix */
+   /* reduced to the dynamic atoms (obs.: matrices in       */
+   /* column-major order).                                  */
+   else
+      info = readFCmatrix (ctx, FCM, FCMfile, EigVec);
+
+   /* Closes the SIESTA FC matrix file. */
+   if (info == VIB_SUCCESS)
+      info = CHECKfclose (fclose (FCM), FCMfile);
+   else if (FCM != NULL)
+      fclose (FCM);
+   TIMEstop (ctx, "readFC");
+   if (info == VIB_SUCCESS)
+      TIMEfile (ctx, "readFC", FCMfile, 0);
+   CHECKfree (FCMfile);
+   if (info != VIB_SUCCESS)
+      return info;
+   LOGinfo (ctx, "ok!\n");
+   LOGprogress (ctx);
+
+   /* Rebuilds the columns of the symmetry-equivalent atoms. */
+   if (ctx->sym != NULL) {
+      LOGinfo (ctx, "\n Rebuilding the FC columns of %d atoms by"
+	       " symmetry... ", nDyn - ctx->sym->nIrr);
+      TIMEstart (ctx, "symmetry");
+      info = SYMMrebuildFC (ctx, EigVec);
+      TIMEstop (ctx, "symmetry");
+      if (info != VIB_SUCCESS)
+	 return info;
+      LOGinfo (ctx, "ok!\n");
+   }
+
+   /* Computes the phonon modes and frequencies. */
+   info = reducedModes (ctx, EigVec, EigVal);
+
+   /* Checkpoints the modes. */
+   if (info == VIB_SUCCESS && ctx->chkDir != NULL)
+      info = CKPTsave (ctx, "modes", -1, EigVec, 9 * nDyn * nDyn);
+   if (info == VIB_SUCCESS && ctx->chkDir != NULL)
+      info = CKPTsave (ctx, "energies", -1, EigVal, 3 * nDyn);
+
+   return info;
 
 } /* PHONfreq */
 
 
 /* ********************************************************* */
-/* Reads the SIESTA 'xyz' file and write 'xyz's files for    */
-/* each computed phonon mode.                                */
-void PHONjmolVib (double *EigVec)
+/* Reads the SIESTA 'xyz' file of the system into '*coord'   */
+/* (allocated here).                                         */
+static int readXYZ (vib_context *ctx, xyzcoord **coord)
 {
-   register int i, j, k, len;
-   int aux;
-   xyzcoord *coord;
-   char *XYZfile, *JMOLfile;
-   FILE *XYZ, *JMOL;
+   register int i;
+   int aux, len, info;
+   char *XYZfile;
+   FILE *XYZ;
 
    /* Sets the SIESTA 'xyz' file name with 'FCdir' path. */
-   len = strlen (FCdir);
-   len += strlen (sysLabel);
+   len = strlen (ctx->FCdir);
+   len += strlen (ctx->sysLabel);
    XYZfile = CHECKmalloc ((len + 5) * sizeof (char));
-   sprintf (XYZfile, "%s%s.xyz", FCdir, sysLabel);
+   if (XYZfile == NULL)
+      return VIB_ERR_MEMORY;
+   sprintf (XYZfile, "%s%s.xyz", ctx->FCdir, ctx->sysLabel);
 
    /* Opens the SIESTA 'xyz' file. */
-   printf ("\n Reading %s file... ", XYZfile);
+   LOGinfo (ctx, "\n Reading %s file... ", XYZfile);
    XYZ = CHECKfopen (XYZfile, "r");
+   if (XYZ == NULL) {
+      CHECKfree (XYZfile);
+      return VIB_ERR_FILE;
+   }
 
    /* Checks if the file starts correctly. */
-   CHECKfscanf (fscanf (XYZ, "%d", &aux), XYZfile);
-   if (aux != nAtoms) {
+   info = CHECKfscanf (fscanf (XYZ, "%d", &aux), XYZfile);
+   if (info == VIB_SUCCESS && aux != ctx->nAtoms) {
       fprintf (stderr,
 	       " ERROR: the file %s is not written correctly!\n\n",
 	       XYZfile);
-      exit (EXIT_FAILURE);
+      info = VIB_ERR_FORMAT;
    }
 
    /* Allocs structure for atomic species and coordinates. */
-   coord = CHECKmalloc (nAtoms * sizeof (xyzcoord));
+   *coord = NULL;
+   if (info == VIB_SUCCESS) {
+      *coord = CHECKmalloc (ctx->nAtoms * sizeof (xyzcoord));
+      if (*coord == NULL)
+	 info = VIB_ERR_MEMORY;
+   }
 
    /* Reads the SIESTA 'xyz' file. */
-   for (i = 0; i < nAtoms; i++)
-      CHECKfscanf (fscanf (XYZ, "%s %le %le %le",
-			   coord[i].name, &coord[i].x,
-			   &coord[i].y, &coord[i].z), XYZfile);
+   for (i = 0; i < ctx->nAtoms && info == VIB_SUCCESS; i++)
+      info = CHECKfscanf (fscanf (XYZ, "%7s %le %le %le",
+				  (*coord)[i].name, &(*coord)[i].x,
+				  &(*coord)[i].y, &(*coord)[i].z), XYZfile);
 
    /* Closes the SIESTA 'xyz' file. */
-   CHECKfclose (fclose (XYZ), XYZfile);
-   printf ("ok!\n\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
-
-   /* Sets the path for the output Jmol files. */
-   len = strlen (workDir);
-   len += strlen (sysLabel);
-   JMOLfile = CHECKmalloc ((len + 12) * sizeof (char));
-
-   for (i = 0, j = 1; i < 3*nDyn; i++) {
-         
-	 /* Opens the JMOL 'xyz' output file. */
-	 sprintf (JMOLfile, "%s%sJMOL%d.xyz", workDir, sysLabel, j);
-	 printf (" Writing %s file... ", JMOLfile);
-	 JMOL = CHECKfopen (JMOLfile, "w");
-
-	 fprintf (JMOL, "   %d\n\n", nAtoms);
-
-	 /* Writes only the coordinates. */
-	 for (k = 0; k < FCfirst - 1; k++)
-	    fprintf (JMOL, "%s\t% e\t% e\t% e\n", coord[k].name,
-		     coord[k].x, coord[k].y, coord[k].z);
-
-	 /* Writes the coordinates and the normalized phonon mode. */
-	 for (k = FCfirst - 1; k < FClast; k++)
-	    fprintf (JMOL, "%s\t% e\t% e\t% e\t% e\t% e\t% e\n",
-		     coord[k].name, coord[k].x, coord[k].y, coord[k].z,
-		     EigVec[idx(3*(k-FCfirst+1),i,3*nDyn)],
-		     EigVec[idx(3*(k-FCfirst+1)+1,i,3*nDyn)],
-		     EigVec[idx(3*(k-FCfirst+1)+2,i,3*nDyn)]);
-
-	 /* Writes only the coordinates. */
-	 for (k = FClast; k < nAtoms; k++)
-	    fprintf (JMOL, "%s\t% e\t% e\t% e\n", coord[k].name,
-		     coord[k].x, coord[k].y, coord[k].z);
-
-	 /* Closes the JMOL 'xyz' output file. */
-	 CHECKfclose (fclose (JMOL), JMOLfile);
-	 printf ("ok!\n");
-	 setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
-
-	 j++;
-
-   } /* for (i = 0, j = 1; ...  */
+   if (info == VIB_SUCCESS)
+      info = CHECKfclose (fclose (XYZ), XYZfile);
+   else
+      fclose (XYZ);
+   CHECKfree (XYZfile);
+   if (info != VIB_SUCCESS) {
+      CHECKfree (*coord);
+      *coord = NULL;
+      return info;
+   }
+   LOGinfo (ctx, "ok!\n\n");
+   LOGprogress (ctx);
 
-   /* Frees memory. */
-   free (coord);
-   free (XYZfile);
-   free (JMOLfile);
+   return VIB_SUCCESS;
 
-} /* PHONjmolVib */
+} /* readXYZ */
 
 
 /* ********************************************************* */
-/* Reads the Hamiltonian and the overlap matrices from       */
-/* '.gHS' file.                                              */
-static void readHSfile (char *HSfile, double *H, double *S, int efIdx)
+/* Returns 1 if the mode 'i' (starting at 0, energy          */
+/* 'EigVal[i]') passes the Jmol filters of 'ctx' (the energy */
+/* window is ignored without 'EigVal').                      */
+static int jmolSelected (vib_context *ctx, int i, double *EigVal)
 {
-   register int i, j, k, s, foo;
-   int CKno_u, CKnspin, maxnhtot;
-   double *Hsparse, *Ssparse;
-   int *numh, *listh;
-   FILE *gHS;
 
-   /* Opens the '.gHS' binary file. */
-   printf ("    reading \"%s\" file... ", HSfile);
-   gHS = CHECKfopen (HSfile, "rb");
+   if (ctx->jmolFirst > 0 && i + 1 < ctx->jmolFirst)
+      return 0;
+   if (ctx->jmolLast > 0 && i + 1 > ctx->jmolLast)
+      return 0;
+   if (ctx->jmolWindow && EigVal != NULL &&
+       (EigVal[i] < ctx->jmolEmin || EigVal[i] > ctx->jmolEmax))
+      return 0;
 
-   /* Reads matrices dimensions and checks file consistency. */
-   fseek (gHS, 0L, SEEK_SET);
-   CHECKfread (fread (&CKno_u, sizeof (int), 1, gHS), 1, HSfile);
-   CHECKfread (fread (&CKnspin, sizeof (int), 1, gHS), 1, HSfile);
-   CHECKfread (fread (&maxnhtot, sizeof (int), 1, gHS), 1, HSfile);
-   if ((CKno_u != no_u) || (CKnspin != nspin)) {
-      fprintf (stderr,
-	       " ERROR: the file %s is not written correctly!\n\n",
-	       HSfile);
-      exit (EXIT_FAILURE);
-   }
+   return 1;
 
-   /* Allocates memory. */
-   Hsparse = UTILdoubleVector (nspin * maxnhtot);
-   Ssparse = UTILdoubleVector (maxnhtot);
-   numh = UTILintVector (no_u);
-   listh = UTILintVector (maxnhtot);
+} /* jmolSelected */
 
-   /* Reads the number of nonzero elements of each row of H. */
-   CHECKfread (fread (numh, no_u * sizeof (int), 1, gHS), 1, HSfile);
 
-   /* Reads the nonzero Hamiltonian-matrix */
-   /* element column indexes for each row. */
-   for (i = 0, k = 0; i < no_u; i++) {
-      CHECKfread (fread (&(listh[k]),
-			 numh[i]*sizeof(int), 1, gHS), 1, HSfile);
-      k = k + numh[i];
-   }
+/* ********************************************************* */
+/* Writes one 'xyz' file ('[label]JMOL[mode].xyz') for each  */
+/* selected phonon mode.                                     */
+static int jmolFiles (vib_context *ctx, xyzcoord *coord, double *EigVec,
+		      double *EigVal)
+{
+   register int i, k;
+   int len, nDyn, FCfirst, info = VIB_SUCCESS;
+   char *JMOLfile;
+   FILE *JMOL;
+
+   nDyn = ctx->nDyn;
+   FCfirst = ctx->FCfirst;
 
-   /* Reads the Hamiltonian matrix in sparse form. */
-   for (j = 0, k = 0; j < nspin; j++)
-      for (i = 0; i < no_u; i++) {
-   	 CHECKfread (fread (&(Hsparse[k]),
-			    numh[i]*sizeof(double), 1, gHS), 1, HSfile);
-   	 k = k + numh[i];
+   /* Sets the path for the output Jmol files. */
+   len = strlen (ctx->workDir);
+   len += strlen (ctx->sysLabel);
+   JMOLfile = CHECKmalloc ((len + 17) * sizeof (char));
+   if (JMOLfile == NULL)
+      return VIB_ERR_MEMORY;
+
+   for (i = 0; i < 3*nDyn; i++) {
+
+      if (!jmolSelected (ctx, i, EigVal))
+	 continue ;
+
+      /* Opens the JMOL 'xyz' output file. */
+      sprintf (JMOLfile, "%s%sJMOL%d.xyz", ctx->workDir, ctx->sysLabel,
+	       i + 1);
+      LOGinfo (ctx, " Writing %s file... ", JMOLfile);
+      JMOL = CHECKfopen (JMOLfile, "w");
+      if (JMOL == NULL) {
+	 info = VIB_ERR_FILE;
+	 break ;
       }
 
-   /* Reads the overlap matrix in sparse form. */
-   for (i = 0, k = 0; i < no_u; i++) {
-      CHECKfread (fread (&(Ssparse[k]),
-			 numh[i]*sizeof (double), 1, gHS), 1, HSfile);
-      k = k + numh[i];
-   }
+      fprintf (JMOL, "   %d\n\n", ctx->nAtoms);
 
-   /* Assigns nonzero elements from 'Hsparse' and 'Ssparse'.    */
-   /* The index 'k' runs over 'Hsparse' and 'Ssparse' matrices. */
-   for (i = 0, k = 0; i < no_u; i++)
-      for (j = 0; j < numh[i]; j++, k++) {
-   	 foo = (listh[k] - 1) % no_u; /* column index */
-   	 H[idx3d(i,foo,0,no_u,no_u)] += rydberg2eV * Hsparse[k];
-   	 S[idx(i,foo,no_u)] += Ssparse[k];
-      }
-   for (s = 1; s < nspin; s++) /* 'H' is bigger if 'nspin' > 1 */
-      for (i = 0, k = 0; i < no_u; i++)
-   	 for (j = 0; j < numh[i]; j++, k++) {
-  	    foo = (listh[k] - 1) % no_u; /* column index */
-   	    H[idx3d(i,foo,s,no_u,no_u)] += rydberg2eV * Hsparse[k];
-   	 }
+      /* Writes only the coordinates. */
+      for (k = 0; k < FCfirst - 1; k++)
+	 fprintf (JMOL, "%s\t% e\t% e\t% e\n", coord[k].name,
+		  coord[k].x, coord[k].y, coord[k].z);
 
-   /* "Shifts" the Fermi energy to 0. */
-   for (s = 0; s < nspin; s++)
-      for (i = 0; i < no_u; i++)
-   	 for (j = 0; j < no_u; j++)
-   	    H[idx3d(i,j,s,no_u,no_u)] -= ef[efIdx] * S[idx(i,j,no_u)];
+      /* Writes the coordinates and the normalized phonon mode. */
+      for (k = FCfirst - 1; k < ctx->FClast; k++)
+	 fprintf (JMOL, "%s\t% e\t% e\t% e\t% e\t% e\t% e\n",
+		  coord[k].name, coord[k].x, coord[k].y, coord[k].z,
+		  EigVec[idx(3*(k-FCfirst+1),i,3*nDyn)],
+		  EigVec[idx(3*(k-FCfirst+1)+1,i,3*nDyn)],
+		  EigVec[idx(3*(k-FCfirst+1)+2,i,3*nDyn)]);
 
-   /* Closes file. */
-   CHECKfclose (fclose (gHS), HSfile);
-   printf ("ok!\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
+      /* Writes only the coordinates. */
+      for (k = ctx->FClast; k < ctx->nAtoms; k++)
+	 fprintf (JMOL, "%s\t% e\t% e\t% e\n", coord[k].name,
+		  coord[k].x, coord[k].y, coord[k].z);
 
-   /* Frees memory. */
-   free (numh);
-   free (listh);
-   free (Hsparse);
-   free (Ssparse);
+      /* Closes the JMOL 'xyz' output file. */
+      info = CHECKfclose (fclose (JMOL), JMOLfile);
+      if (info != VIB_SUCCESS)
+	 break ;
+      TIMEfile (ctx, "jmol", JMOLfile, 1);
+      LOGinfo (ctx, "ok!\n");
+      LOGprogress (ctx);
+
+   } /* for (i = 0; ...  */
+
+   /* Frees memory. */
+   CHECKfree (JMOLfile);
+
+   return info;
+
+} /* jmolFiles */
+
+
+/* ********************************************************* */
+/* Writes all the selected phonon modes as the frames of the */
+/* extended 'xyz' file '[label]JMOL.xyz' (read by Jmol as an */
+/* animation). The lines of the static atoms and the         */
+/* coordinates of the dynamic ones are formatted once, and   */
+/* the file is fully buffered.                               */
+static int jmolMulti (vib_context *ctx, xyzcoord *coord, double *EigVec,
+		      double *EigVal)
+{
+   register int i, k;
+   int len, nDyn, FCfirst, nFrames, info = VIB_SUCCESS;
+   size_t lenPre, lenPost;
+   char *JMOLfile, *pre, *post, *dyn, *c, *iobuf;
+   FILE *JMOL;
+
+   nDyn = ctx->nDyn;
+   FCfirst = ctx->FCfirst;
+
+   /* Allocates memory (lines have at most 'JMOL_LINE' chars). */
+   len = strlen (ctx->workDir) + strlen (ctx->sysLabel);
+   JMOLfile = CHECKmalloc ((len + 9) * sizeof (char));
+   pre = CHECKmalloc ((FCfirst - 1) * JMOL_LINE + 1);
+   post = CHECKmalloc ((ctx->nAtoms - ctx->FClast) * JMOL_LINE + 1);
+   dyn = CHECKmalloc (nDyn * JMOL_LINE);
+   iobuf = CHECKmalloc (JMOL_BUFFER);
+   if (JMOLfile == NULL || pre == NULL || post == NULL || dyn == NULL ||
+       iobuf == NULL) {
+      CHECKfree (JMOLfile);
+      CHECKfree (pre);
+      CHECKfree (post);
+      CHECKfree (dyn);
+      CHECKfree (iobuf);
+      return VIB_ERR_MEMORY;
+   }
+   sprintf (JMOLfile, "%s%sJMOL.xyz", ctx->workDir, ctx->sysLabel);
+
+   /* Formats the static atoms (zero vectors) and the */
+   /* coordinates of the dynamic ones.                 */
+   for (k = 0, c = pre; k < FCfirst - 1; k++)
+      c += sprintf (c, "%s\t% e\t% e\t% e\t% e\t% e\t% e\n", coord[k].name,
+		    coord[k].x, coord[k].y, coord[k].z, 0.0, 0.0, 0.0);
+   lenPre = c - pre;
+   for (k = ctx->FClast, c = post; k < ctx->nAtoms; k++)
+      c += sprintf (c, "%s\t% e\t% e\t% e\t% e\t% e\t% e\n", coord[k].name,
+		    coord[k].x, coord[k].y, coord[k].z, 0.0, 0.0, 0.0);
+   lenPost = c - post;
+   for (k = FCfirst - 1; k < ctx->FClast; k++)
+      sprintf (&dyn[(k-FCfirst+1)*JMOL_LINE], "%s\t% e\t% e\t% e",
+	       coord[k].name, coord[k].x, coord[k].y, coord[k].z);
+
+   /* Opens the Jmol file. */
+   LOGinfo (ctx, " Writing %s file... ", JMOLfile);
+   JMOL = CHECKfopen (JMOLfile, "w");
+   if (JMOL == NULL)
+      info = VIB_ERR_FILE;
+   else
+      setvbuf (JMOL, iobuf, _IOFBF, JMOL_BUFFER);
+
+   /* One frame for each selected mode. */
+   nFrames = 0;
+   for (i = 0; i < 3 * nDyn && info == VIB_SUCCESS; i++) {
+      if (!jmolSelected (ctx, i, EigVal))
+	 continue ;
+      fprintf (JMOL, "%d\n", ctx->nAtoms);
+      fprintf (JMOL, "Properties=species:S:1:pos:R:3:vib:R:3 mode=%d", i + 1);
+      if (EigVal != NULL)
+	 fprintf (JMOL, " energy=%.10e", EigVal[i]);
+      fprintf (JMOL, "\n");
+      fwrite (pre, 1, lenPre, JMOL);
+      for (k = 0; k < nDyn; k++)
+	 fprintf (JMOL, "%s\t% e\t% e\t% e\n", &dyn[k*JMOL_LINE],
+		  EigVec[idx(3*k,i,3*nDyn)], EigVec[idx(3*k+1,i,3*nDyn)],
+		  EigVec[idx(3*k+2,i,3*nDyn)]);
+      fwrite (post, 1, lenPost, JMOL);
+      nFrames++;
+   }
+
+   /* Closes the Jmol file. */
+   if (JMOL != NULL) {
+      if (ferror (JMOL)) {
+	 fprintf (stderr, "\n ERROR: unable to write the file %s!\n\n",
+		  JMOLfile);
+	 fclose (JMOL);
+	 info = VIB_ERR_FILE;
+      }
+      else
+	 info = CHECKfclose (fclose (JMOL), JMOLfile);
+   }
+   if (info == VIB_SUCCESS) {
+      TIMEfile (ctx, "jmol", JMOLfile, 1);
+      LOGinfo (ctx, "ok! (%d modes)\n", nFrames);
+   }
+   LOGprogress (ctx);
+
+   /* Frees memory. */
+   CHECKfree (JMOLfile);
+   CHECKfree (pre);
+   CHECKfree (post);
+   CHECKfree (dyn);
+   CHECKfree (iobuf);
+
+   return info;
+
+} /* jmolMulti */
+
+
+/* ********************************************************* */
+/* Reads the SIESTA 'xyz' file and writes the phonon modes   */
+/* (energies 'EigVal', which may be 'NULL') for Jmol as set  */
+/* at 'ctx->jmol': one 'xyz' file per mode, a single         */
+/* multi-frame file or nothing.                              */
+int PHONjmolOut (vib_context *ctx, double *EigVec, double *EigVal)
+{
+   int info;
+   double time;
+   xyzcoord *coord;
+
+   if (ctx == NULL || ctx->dynAtoms == NULL)
+      return VIB_ERR_INPUT;
+   if (ctx->jmol == JMOL_OFF) {
+      LOGinfo (ctx, "\n Jmol output skipped.\n");
+      return VIB_SUCCESS;
+   }
+   time = UTILwallTime ();
+
+   info = readXYZ (ctx, &coord);
+   if (info != VIB_SUCCESS)
+      return info;
+   TIMEstart (ctx, "jmol");
+   if (ctx->jmol == JMOL_MULTI)
+      info = jmolMulti (ctx, coord, EigVec, EigVal);
+   else
+      info = jmolFiles (ctx, coord, EigVec, EigVal);
+   TIMEstop (ctx, "jmol");
+   LOGinfo (ctx, "    output took %.2f s\n", UTILwallTime () - time);
+   LOGflush (ctx);
+
+   /* Frees memory. */
+   CHECKfree (coord);
+
+   return info;
+
+} /* PHONjmolOut */
+
+
+/* ********************************************************* */
+/* Reads the SIESTA 'xyz' file and write 'xyz's files for    */
+/* each computed phonon mode (as set at 'ctx->jmol', without */
+/* the energy window).                                       */
+int PHONjmolVib (vib_context *ctx, double *EigVec)
+{
+
+   return PHONjmolOut (ctx, EigVec, NULL);
+
+} /* PHONjmolVib */
+
+
+/* ********************************************************* */
+/* Reads the sparsity ('numh' and 'listh', allocated here)   */
+/* of the Hamiltonian and overlap matrices of '.gHS' file.   */
+static int readHSpattern (vib_context *ctx, char *HSfile, int **numh,
+			  int **listh)
+{
+   register int i, k;
+   int CKno_u, CKnspin, maxnhtot, no_u, info = VIB_SUCCESS;
+   FILE *gHS;
+
+   no_u = ctx->no_u;
+   *numh = *listh = NULL;
+
+   /* Opens the '.gHS' binary file. */
+   gHS = CHECKfopen (HSfile, "rb");
+   if (gHS == NULL)
+      return VIB_ERR_FILE;
+
+   /* Reads matrices dimensions and checks file consistency. */
+   CKno_u = CKnspin = maxnhtot = -1;
+   info = CHECKfread (fread (&CKno_u, sizeof (int), 1, gHS), 1, gHS, HSfile);
+   if (info == VIB_SUCCESS)
+      info = CHECKfread (fread (&CKnspin, sizeof (int), 1, gHS), 1, gHS,
+			 HSfile);
+   if (info == VIB_SUCCESS)
+      info = CHECKfread (fread (&maxnhtot, sizeof (int), 1, gHS), 1, gHS,
+			 HSfile);
+   if (info == VIB_SUCCESS &&
+       ((CKno_u != no_u) || (CKnspin != ctx->nspin) || (maxnhtot < 0)))
+      info = VIB_ERR_FORMAT;
+
+   /* Allocates memory. */
+   if (info == VIB_SUCCESS) {
+      *numh = UTILintVector (no_u);
+      *listh = UTILintVector (maxnhtot + 1);
+      if (*numh == NULL || *listh == NULL)
+	 info = VIB_ERR_MEMORY;
+   }
+
+   /* Reads the number of nonzero elements of each row and */
+   /* their column indexes.                                 */
+   if (info == VIB_SUCCESS)
+      info = CHECKfread (fread (*numh, sizeof (int), no_u, gHS), no_u,
+			 gHS, HSfile);
+   for (i = 0, k = 0; i < no_u && info == VIB_SUCCESS; i++) {
+      if ((*numh)[i] < 0 || k + (*numh)[i] > maxnhtot)
+	 info = VIB_ERR_FORMAT;
+      else {
+	 info = CHECKfread (fread (&((*listh)[k]), sizeof (int),
+				   (*numh)[i], gHS), (*numh)[i], gHS, HSfile);
+	 k = k + (*numh)[i];
+      }
+   }
+   fclose (gHS);
+
+   if (info == VIB_ERR_FORMAT)
+      fprintf (stderr,
+	       " ERROR: the file %s is not written correctly!\n\n",
+	       HSfile);
+   if (info != VIB_SUCCESS) {
+      CHECKfree (*numh);
+      CHECKfree (*listh);
+      *numh = *listh = NULL;
+   }
+
+   return info;
+
+} /* readHSpattern */
+
+
+/* ********************************************************* */
+/* Selects the active region of the electronic basis: the    */
+/* atoms with orbitals within 'ctx->activeShells' neighbour  */
+/* shells of the dynamic orbitals (shell 'n+1' are the       */
+/* orbitals with nonzero 'H0' or 'S0' elements with those of */
+/* shell 'n', at the non-displaced '.gHS'), and/or the atoms */
+/* within 'ctx->activeCutoff' (Ang) of a dynamic atom (at    */
+/* the '.xyz'). All the dense matrices are then built only   */
+/* on the orbitals of these atoms, in their original order   */
+/* (see 'denseHS').                                          */
+static int activeBasis (vib_context *ctx)
+{
+   register int i, j, k, a, b;
+   int no_u, nAtoms, first, nActAtoms, len, info = VIB_SUCCESS;
+   int *atom, *orb, *next, *start, *numh, *listh;
+   double dx, dy, dz, cut2;
+   char *HSfile;
+   xyzcoord *coord;
+
+   no_u = ctx->no_u;
+   nAtoms = ctx->nAtoms;
+   first = ctx->FCfirst - 1;
+
+   /* Allocates memory. */
+   atom = UTILintVector (nAtoms); /* atoms of the active region */
+   ctx->actIdx = CHECKmalloc (no_u * sizeof (int));
+   if (atom == NULL || ctx->actIdx == NULL) {
+      CHECKfree (atom);
+      return VIB_ERR_MEMORY;
+   }
+   for (a = first; a < ctx->FClast; a++)
+      atom[a] = 1;
+
+   /* Neighbour shells at the sparsity of 'H0' and 'S0'. */
+   if (ctx->activeShells > 0) {
+      len = strlen (ctx->FCdir) + strlen (ctx->sysLabel);
+      HSfile = CHECKmalloc ((len + 16) * sizeof (char));
+      if (HSfile == NULL) {
+	 CHECKfree (atom);
+	 return VIB_ERR_MEMORY;
+      }
+      sprintf (HSfile, "%s%s_%.3d.gHS", ctx->FCdir, ctx->sysLabel, 0);
+      LOGinfo (ctx, "\n    reading the sparsity of \"%s\" file... ",
+	       HSfile);
+      info = readHSpattern (ctx, HSfile, &numh, &listh);
+      CHECKfree (HSfile);
+      if (info != VIB_SUCCESS) {
+	 CHECKfree (atom);
+	 return info;
+      }
+      LOGinfo (ctx, "ok!\n");
+      orb = UTILintVector (no_u); /* orbitals within the shells */
+      next = UTILintVector (no_u);
+      start = UTILintVector (no_u + 1); /* first element of each row */
+      if (orb == NULL || next == NULL || start == NULL)
+	 info = VIB_ERR_MEMORY;
+      else {
+	 for (i = 0; i < no_u; i++)
+	    start[i+1] = start[i] + numh[i];
+	 for (i = ctx->orbIdx[first]; i < ctx->orbIdx[ctx->FClast]; i++)
+	    orb[i] = 1;
+	 for (b = 0; b < ctx->activeShells; b++) {
+	    for (i = 0; i < no_u; i++)
+	       next[i] = orb[i];
+	    for (i = 0; i < no_u; i++)
+	       if (orb[i])
+		  for (k = start[i]; k < start[i+1]; k++)
+		     next[(listh[k] - 1) % no_u] = 1;
+	    for (i = 0; i < no_u; i++)
+	       orb[i] = next[i];
+	 }
+	 for (a = 0; a < nAtoms; a++)
+	    for (i = ctx->orbIdx[a]; i < ctx->orbIdx[a+1]; i++)
+	       if (orb[i])
+		  atom[a] = 1;
+      }
+      CHECKfree (orb);
+      CHECKfree (next);
+      CHECKfree (start);
+      CHECKfree (numh);
+      CHECKfree (listh);
+   }
+
+   /* Distance cutoff from the dynamic atoms. */
+   if (info == VIB_SUCCESS && ctx->activeCutoff > 0.0) {
+      info = readXYZ (ctx, &coord);
+      if (info == VIB_SUCCESS) {
+	 cut2 = ctx->activeCutoff * ctx->activeCutoff;
+	 for (a = 0; a < nAtoms; a++)
+	    for (b = first; b < ctx->FClast && !atom[a]; b++) {
+	       dx = coord[a].x - coord[b].x;
+	       dy = coord[a].y - coord[b].y;
+	       dz = coord[a].z - coord[b].z;
+	       if (dx * dx + dy * dy + dz * dz <= cut2)
+		  atom[a] = 1;
+	    }
+	 CHECKfree (coord);
+      }
+   }
+   if (info != VIB_SUCCESS) {
+      CHECKfree (atom);
+      return info;
+   }
+
+   /* Positions of the orbitals at the active region. */
+   ctx->nAct = nActAtoms = 0;
+   for (a = 0; a < nAtoms; a++) {
+      nActAtoms += atom[a];
+      for (j = ctx->orbIdx[a]; j < ctx->orbIdx[a+1]; j++)
+	 ctx->actIdx[j] = (atom[a] ? ctx->nAct++ : -1);
+   }
+   ctx->orbShift = ctx->orbIdx[first] - ctx->actIdx[ctx->orbIdx[first]];
+   LOGinfo (ctx, "    Active region (atoms, orbitals):\t\t%d, %d\n",
+	    nActAtoms, ctx->nAct);
+   LOGflush (ctx);
+
+   /* Frees memory. */
+   CHECKfree (atom);
+
+   return VIB_SUCCESS;
+
+} /* activeBasis */
+
+
+/* ********************************************************* */
+/* Sets up the symmetry-reduced displacements (see           */
+/* 'SYMMsetup') from the atoms at the '.xyz' file, the atoms */
+/* with the same name being of the same species.             */
+static int symmetrySetup (vib_context *ctx)
+{
+   register int a, b;
+   int info;
+   int *species;
+   double *pos;
+   xyzcoord *coord;
+
+   info = readXYZ (ctx, &coord);
+   if (info != VIB_SUCCESS)
+      return info;
+
+   /* Allocates memory. */
+   pos = CHECKmalloc (3 * ctx->nAtoms * sizeof (double));
+   species = CHECKmalloc (ctx->nAtoms * sizeof (int));
+   if (pos == NULL || species == NULL) {
+      CHECKfree (coord);
+      CHECKfree (pos);
+      CHECKfree (species);
+      return VIB_ERR_MEMORY;
+   }
+
+   /* Positions and species (first atom of the same name). */
+   for (a = 0; a < ctx->nAtoms; a++) {
+      pos[3*a] = coord[a].x;
+      pos[3*a+1] = coord[a].y;
+      pos[3*a+2] = coord[a].z;
+      for (b = 0; strcmp (coord[b].name, coord[a].name) != 0; b++)
+	 ;
+      species[a] = b;
+   }
+   info = SYMMsetup (ctx, pos, species);
+
+   /* Frees memory. */
+   CHECKfree (coord);
+   CHECKfree (pos);
+   CHECKfree (species);
+
+   return info;
+
+} /* symmetrySetup */
+
+
+/* ********************************************************* */
+/* Assigns to the dense matrices 'H' and 'S' the Hamiltonian */
+/* ('Hsparse', in Ry) and overlap ('Ssparse') matrices in    */
+/* SIESTA sparse form ('numh' and 'listh') and "shifts" the  */
+/* Fermi energy 'efermi' (in eV) to 0. With an active region */
+/* ('ctx->actIdx'), only its rows and columns are kept.      */
+static void denseHS (vib_context *ctx, int *numh, int *listh,
+		     double *Hsparse, double *Ssparse,
+		     double *H, double *S, double efermi)
+{
+   register int i, j, k, s, foo, r, c;
+   int no_u, nAct, nspin, nnz;
+   int *map = ctx->actIdx;
+
+   no_u = ctx->no_u;
+   nAct = ctx->nAct;
+   nspin = ctx->nspin;
+
+   /* The spin 's' block of 'Hsparse' starts at 's*nnz'. */
+   for (i = 0, nnz = 0; i < no_u; i++)
+      nnz += numh[i];
+
+   /* Assigns nonzero elements from 'Hsparse' and 'Ssparse'.    */
+   /* The index 'k' runs over 'Hsparse' and 'Ssparse' matrices. */
+   for (s = 0; s < nspin; s++) /* 'H' is bigger if 'nspin' > 1 */
+      for (i = 0, k = 0; i < no_u; i++)
+	 for (j = 0; j < numh[i]; j++, k++) {
+	    foo = (listh[k] - 1) % no_u; /* column index */
+	    if (map == NULL) {
+	       r = i;
+	       c = foo;
+	    }
+	    else if (map[i] < 0 || map[foo] < 0)
+	       continue ; /* outside the active region */
+	    else {
+	       r = map[i];
+	       c = map[foo];
+	    }
+	    H[idx3d(r,c,s,nAct,nAct)] += rydberg2eV * Hsparse[s*nnz+k];
+	    if (s == 0)
+	       S[idx(r,c,nAct)] += Ssparse[k];
+	 }
+
+   /* "Shifts" the Fermi energy to 0. */
+   KERNtable()->fermiShift (nAct * nAct, nspin, H, S, efermi);
+
+} /* denseHS */
+
+
+/* ********************************************************* */
+/* Reads the Hamiltonian and the overlap matrices from       */
+/* '.gHS' file.                                              */
+static int readHSfile (vib_context *ctx, char *HSfile,
+		       double *H, double *S, int efIdx)
+{
+   register int i, j, k;
+   int CKno_u, CKnspin, maxnhtot, no_u, nspin, info = VIB_SUCCESS;
+   double *Hsparse = NULL, *Ssparse = NULL;
+   int *numh = NULL, *listh = NULL;
+   FILE *gHS;
+
+   no_u = ctx->no_u;
+   nspin = ctx->nspin;
+
+   /* Opens the '.gHS' binary file. */
+   LOGinfo (ctx, "    reading \"%s\" file... ", HSfile);
+   TIMEstart (ctx, "readHSfile");
+   gHS = CHECKfopen (HSfile, "rb");
+   if (gHS == NULL)
+      info = VIB_ERR_FILE;
+
+   /* Reads matrices dimensions and checks file consistency. */
+   if (info == VIB_SUCCESS) {
+      fseek (gHS, 0L, SEEK_SET);
+      CKno_u = CKnspin = maxnhtot = -1;
+      info = CHECKfread (fread (&CKno_u, sizeof (int), 1, gHS), 1, gHS,
+			 HSfile);
+      if (info == VIB_SUCCESS)
+	 info = CHECKfread (fread (&CKnspin, sizeof (int), 1, gHS), 1, gHS,
+			    HSfile);
+      if (info == VIB_SUCCESS)
+	 info = CHECKfread (fread (&maxnhtot, sizeof (int), 1, gHS), 1, gHS,
+			    HSfile);
+      if (info == VIB_SUCCESS &&
+	  ((CKno_u != no_u) || (CKnspin != nspin) || (maxnhtot < 0))) {
+	 fprintf (stderr,
+		  " ERROR: the file %s is not written correctly!\n\n",
+		  HSfile);
+	 info = VIB_ERR_FORMAT;
+      }
+   }
+
+   /* Allocates memory. */
+   if (info == VIB_SUCCESS) {
+      Hsparse = UTILdoubleVector ((size_t) nspin * maxnhtot);
+      Ssparse = UTILdoubleVector (maxnhtot);
+      numh = UTILintVector (no_u);
+      listh = UTILintVector (maxnhtot);
+      if (Hsparse == NULL || Ssparse == NULL || numh == NULL
+	  || listh == NULL)
+	 info = VIB_ERR_MEMORY;
+   }
+
+   /* Reads the number of nonzero elements of each row of H. */
+   if (info == VIB_SUCCESS)
+      info = CHECKfread (fread (numh, sizeof (int), no_u, gHS), no_u, gHS,
+			 HSfile);
+
+   /* Reads the nonzero Hamiltonian-matrix */
+   /* element column indexes for each row. */
+   for (i = 0, k = 0; i < no_u && info == VIB_SUCCESS; i++) {
+      if (numh[i] < 0 || k + numh[i] > maxnhtot) {
+	 fprintf (stderr,
+		  " ERROR: the file %s is not written correctly!\n\n",
+		  HSfile);
+	 info = VIB_ERR_FORMAT;
+	 break ;
+      }
+      info = CHECKfread (fread (&(listh[k]), sizeof (int), numh[i], gHS),
+			 numh[i], gHS, HSfile);
+      k = k + numh[i];
+   }
+
+   if (info == VIB_SUCCESS) {
+
+      /* Reads the Hamiltonian matrix in sparse form. */
+      for (j = 0, k = 0; j < nspin; j++)
+	 for (i = 0; i < no_u && info == VIB_SUCCESS; i++) {
+	    info = CHECKfread (fread (&(Hsparse[k]), sizeof (double),
+				      numh[i], gHS), numh[i], gHS, HSfile);
+	    k = k + numh[i];
+	 }
+
+      /* Reads the overlap matrix in sparse form. */
+      for (i = 0, k = 0; i < no_u && info == VIB_SUCCESS; i++) {
+	 info = CHECKfread (fread (&(Ssparse[k]), sizeof (double),
+				   numh[i], gHS), numh[i], gHS, HSfile);
+	 k = k + numh[i];
+      }
+
+      /* Builds the dense matrices with the Fermi energy at 0. */
+      if (info == VIB_SUCCESS)
+	 denseHS (ctx, numh, listh, Hsparse, Ssparse, H, S,
+		  ctx->ef[efIdx]);
+   }
+
+   /* Frees memory. */
+   CHECKfree (numh);
+   CHECKfree (listh);
+   CHECKfree (Hsparse);
+   CHECKfree (Ssparse);
+
+   /* Closes file (the stage is stopped on all the paths). */
+   if (info == VIB_SUCCESS)
+      info = CHECKfclose (fclose (gHS), HSfile);
+   else if (gHS != NULL)
+      fclose (gHS);
+   TIMEstop (ctx, "readHSfile");
+   if (info != VIB_SUCCESS)
+      return info;
+   TIMEfile (ctx, "readHSfile", HSfile, 0);
+   LOGinfo (ctx, "ok!\n");
+   LOGprogress (ctx);
+
+   return VIB_SUCCESS;
 
 } /* readHSfile */
 
 
+/* ********************************************************* */
+/* Computes at 'dH' the finite differences of the pair of    */
+/* displacements 'k' from 'Hm' ('H(-Q)') and 'Hp' ('H(Q)'):  */
+/* 'dH = {H(Q)-H(-Q)-[ef(Q)-ef(-Q)]*S0} / 2Q'. The matrices  */
+/* are those of the pair (all spins), 'k' selects the Fermi  */
+/* energies.                                                 */
+static void finiteDifference (vib_context *ctx, int k, double *dH,
+			      double *Hm, double *Hp, double *S0)
+{
+
+   KERNtable()->finiteDiff (ctx->nAct * ctx->nAct, ctx->nspin, dH, Hm, Hp,
+			    S0, ctx->ef[2*k+2] - ctx->ef[2*k+1],
+			    2.0 * ctx->FCdispl);
+
+} /* finiteDifference */
+
+
+/* ********************************************************* */
+/* Computes the cache key of the raw 'dH' of the             */
+/* displacement pair 'k' from the hash 'hS0' of 'S0', the    */
+/* Fermi energies, the displacement and the content of the   */
+/* two '.gHS' files, numbered 'n' and 'n+1' at the directory */
+/* 'dir' ('Hfile' is used as buffer).                        */
+static int deltaHkey (vib_context *ctx, int k, unsigned long long hS0,
+		      const char *dir, int n, char *Hfile,
+		      unsigned long long *key)
+{
+   int info;
+
+   *key = CKPThash (hS0, &ctx->ef[2*k+1], 2 * sizeof (double));
+   *key = CKPThash (*key, &ctx->FCdispl, sizeof (double));
+   sprintf (Hfile, "%s%s_%.3d.gHS", dir, ctx->sysLabel, n);
+   info = CKPThashFile (Hfile, key);
+   if (info != VIB_SUCCESS)
+      return info;
+   sprintf (Hfile, "%s%s_%.3d.gHS", dir, ctx->sysLabel, n + 1);
+
+   return CKPThashFile (Hfile, key);
+
+} /* deltaHkey */
+
+
 /* ********************************************************* */
 /* Computes Hamiltonian derivative matrix by reading the     */
 /* Hamiltonian and overlap matrices from '.gHs' files for    */
-/* the displaced system.                                     */
-static void deltaH (double *dH, double *S0)
+/* the displaced system. With a 'dH' cache, the key of each  */
+/* displacement pair is returned at 'key', the pairs whose   */
+/* inputs didn't change are read from the cache and the      */
+/* other ones (also those read from a checkpoint) stored.    */
+static int deltaH (vib_context *ctx, double *dH, double *S0,
+		   unsigned long long *key)
 {
-   register int i, j, k, s, len;
-   double *Hm, *Hp, *S;
+   register int k, len;
+   int no_u, nspin, found, nCached = 0, info = VIB_SUCCESS;
+   unsigned long long hS0 = CKPT_HASH_INIT;
+   double *Hm, *Hp, *S, *dHk;
    char *Hfile;
 
+   no_u = ctx->nAct; /* dense matrices (active region) */
+   nspin = ctx->nspin;
+
    /* Allocates memory. */
-   Hm = UTILdoubleVector (3 * nDyn * nspin * no_u * no_u);
-   Hp = UTILdoubleVector (3 * nDyn * nspin * no_u * no_u);
+   Hm = UTILdoubleVector ((size_t) 3 * ctx->nDyn * nspin * no_u * no_u);
+   Hp = UTILdoubleVector ((size_t) 3 * ctx->nDyn * nspin * no_u * no_u);
    S = CHECKmalloc (no_u * no_u * sizeof (double));
 
    /* Sets the '.gHS' file name with 'FCdir' path. */
-   len = strlen (FCdir);
-   len += strlen (sysLabel);
-   Hfile = CHECKmalloc ((len + 9) * sizeof (char));
+   len = strlen (ctx->FCdir);
+   len += strlen (ctx->sysLabel);
+   Hfile = CHECKmalloc ((len + 16) * sizeof (char));
+
+   if (Hm == NULL || Hp == NULL || S == NULL || Hfile == NULL)
+      info = VIB_ERR_MEMORY;
+   if (key != NULL)
+      hS0 = CKPThash (hS0, S0, no_u * no_u * sizeof (double));
+   if (key != NULL && ctx->actIdx != NULL)
+      hS0 = CKPThash (hS0, ctx->actIdx, ctx->no_u * sizeof (int));
+
+   TIMEprogressStart (ctx, "deltaH", "readHSfile", "displacement pairs",
+		      3 * ctx->nDyn);
+   for (k = 0; k < 3 * ctx->nDyn && info == VIB_SUCCESS; k++) {
+      dHk = &dH[idx3d(0,0,k*nspin,no_u,no_u)];
+
+      /* Displacements of the atoms rebuilt by symmetry. */
+      if (!SYMMirreducible (ctx, k / 3)) {
+	 LOGinfo (ctx, "    displacements %.3d and %.3d rebuilt by"
+		  " symmetry\n", 2*k+1, 2*k+2);
+	 TIMEprogress (ctx, k + 1);
+	 continue ;
+      }
+
+      /* Displacements done by a previous run. */
+      found = 0;
+      if (CKPTdone (ctx, "dH", k) &&
+	  CKPTload (ctx, "dH", k, dHk, (size_t) nspin * no_u * no_u)
+	  == VIB_SUCCESS) {
+	 LOGinfo (ctx, "    displacements %.3d and %.3d read from"
+		  " checkpoint\n", 2*k+1, 2*k+2);
+	 found = 1;
+      }
+
+      /* Displacements whose inputs are at the cache. */
+      if (key != NULL)
+	 info = deltaHkey (ctx, k, hS0, ctx->FCdir, 2*k+1, Hfile, &key[k]);
+      if (info == VIB_SUCCESS && !found && key != NULL &&
+	  CKPTcacheLoad (ctx, "dH", key[k], dHk, (size_t) nspin * no_u * no_u)
+	  == VIB_SUCCESS) {
+	 LOGinfo (ctx, "    displacements %.3d and %.3d reused from"
+		  " cache\n", 2*k+1, 2*k+2);
+	 nCached++;
+	 found = 2;
+      }
+
+      /* Stores at the cache the pairs of the checkpoint too. */
+      if (info == VIB_SUCCESS && found == 1 && key != NULL)
+	 info = CKPTcacheSave (ctx, "dH", key[k], dHk,
+			       (size_t) nspin * no_u * no_u);
 
-   for (k = 0; k < 3 * nDyn; k++) {
       /* 'H(-Q)' */
-      Hfile[0] = '\0';
-      sprintf (Hfile, "%s%s_%.3d.gHS", FCdir, sysLabel, 2 * k + 1);
-      UTILresetDoubleVector (no_u * no_u, S);
-      readHSfile (Hfile, &Hm[idx3d(0,0,k*nspin,no_u,no_u)], S, 2*k+1);
+      if (info == VIB_SUCCESS && !found) {
+	 sprintf (Hfile, "%s%s_%.3d.gHS", ctx->FCdir, ctx->sysLabel, 2*k+1);
+	 UTILresetDoubleVector (no_u * no_u, S);
+	 info = readHSfile (ctx, Hfile, &Hm[idx3d(0,0,k*nspin,no_u,no_u)],
+			    S, 2*k+1);
+      }
 
       /* 'H(Q)' */
-      Hfile[0] = '\0';
-      sprintf (Hfile, "%s%s_%.3d.gHS", FCdir, sysLabel, 2 * k + 2);
-      UTILresetDoubleVector (no_u * no_u, S);
-      readHSfile (Hfile, &Hp[idx3d(0,0,k*nspin,no_u,no_u)], S, 2*k+2);
+      if (info == VIB_SUCCESS && !found) {
+	 sprintf (Hfile, "%s%s_%.3d.gHS", ctx->FCdir, ctx->sysLabel, 2*k+2);
+	 UTILresetDoubleVector (no_u * no_u, S);
+	 info = readHSfile (ctx, Hfile, &Hp[idx3d(0,0,k*nspin,no_u,no_u)],
+			    S, 2*k+2);
+      }
 
       /* 'dH = {H(Q) - (ef(Q)-ef0)*S0 - [H(-Q)-(ef(-Q)-ef0)*S0]} / 2Q' */
-      /* or, simplifying: 'dH = {H(Q)-H(-Q)-[ef(Q)-ef(-Q)]*S0} / 2Q'   */
-      for (s = 0; s < nspin; s++)
-      	 for (i = 0; i < no_u; i++)
-      	    for (j = 0; j < no_u; j++)
-      	       dH[idx3d(i,j,k*nspin+s,no_u,no_u)] = 
-		  (Hp[idx3d(i,j,k*nspin+s,no_u,no_u)]
-		   - Hm[idx3d(i,j,k*nspin+s,no_u,no_u)]
-		   - (ef[2*k+2] - ef[2*k+1]) * S0[idx(i,j,no_u)])
-		  / (2.0 * FCdispl);
+      if (info == VIB_SUCCESS && !found) {
+	 finiteDifference (ctx, k, dHk, &Hm[idx3d(0,0,k*nspin,no_u,no_u)],
+			   &Hp[idx3d(0,0,k*nspin,no_u,no_u)], S0);
+	 if (key != NULL)
+	    info = CKPTcacheSave (ctx, "dH", key[k], dHk,
+				  (size_t) nspin * no_u * no_u);
+      }
 
+      /* Checkpoints the displacement and stops if requested. */
+      if (info == VIB_SUCCESS && found != 1 && ctx->chkDir != NULL)
+	 info = CKPTsave (ctx, "dH", k, dHk, (size_t) nspin * no_u * no_u);
+      if (info == VIB_SUCCESS && stopRequested (ctx))
+	 info = VIB_ERR_STOPPED;
+      TIMEprogress (ctx, k + 1);
    }
+   TIMEprogressEnd (ctx);
+   if (key != NULL && info == VIB_SUCCESS)
+      LOGinfo (ctx, "    %d of %d displacement pairs reused from the"
+	       " cache\n", nCached, 3 * ctx->nDyn);
 
    /* Frees memory. */
-   free (Hfile);
-   free (Hp);
-   free (Hm);
-   free (S);
+   CHECKfree (Hfile);
+   CHECKfree (Hp);
+   CHECKfree (Hm);
+   CHECKfree (S);
+
+   return info;
 
 } /* deltaH */
 
 
+/* ********************************************************* */
+/* Picks from the overlap matrix of the doubled system       */
+/* ('Ssparse', in SIESTA sparse form, with the displaced     */
+/* copy 'j'' of each orbital 'j' after the 'no_u' originals) */
+/* only the terms from dynamic atoms:                        */
+/*           'S(i,j) = [ <i|j'> + <j'|i> ] / 2'               */
+/* on the active region, accumulating the terms '<j'|i>' at  */
+/* 'St' (instead of the whole doubled matrix).               */
+static void pickOnlyS (vib_context *ctx, int *numh, int *listh,
+		       double *Ssparse, double *St, double *S)
+{
+   register int i, j, k, foo, r, c;
+   int no_u = ctx->no_u, nAct = ctx->nAct;
+   int *map = ctx->actIdx;
+   double *T;
+
+   UTILresetDoubleVector (nAct * nAct, S);
+   UTILresetDoubleVector (nAct * nAct, St);
+
+   /* Assigns nonzero elements from 'Ssparse'.  */
+   /* The index 'k' runs over 'Ssparse' matrix. */
+   for (i = 0, k = 0; i < 2 * no_u; i++)
+      for (j = 0; j < numh[i]; j++, k++) {
+   	 foo = (listh[k] - 1) % (2 * no_u); /* column index */
+	 if (i < no_u && foo >= no_u) { /* '<i|j'>' */
+	    r = i;
+	    c = foo - no_u;
+	    T = S;
+	 }
+	 else if (i >= no_u && foo < no_u) { /* '<j'|i>' */
+	    r = foo;
+	    c = i - no_u;
+	    T = St;
+	 }
+	 else
+	    continue ;
+	 if (map != NULL) {
+	    if (map[r] < 0 || map[c] < 0)
+	       continue ; /* outside the active region */
+	    r = map[r];
+	    c = map[c];
+	 }
+	 T[idx(r,c,nAct)] += Ssparse[k];
+      }
+
+   /* Mean of the two terms. */
+   for (j = 0; j < nAct; j++)
+      for (i = 0; i < nAct; i++)
+   	 S[idx(i,j,nAct)] = (S[idx(i,j,nAct)] + St[idx(i,j,nAct)]) / 2.0;
+
+} /* pickOnlyS */
+
+
 /* ********************************************************* */
 /* Reads the overlap matrix from '.onlyS' binary file.       */
-static void readOnlyS (char *Sfile, double *S)
+static int readOnlyS (vib_context *ctx, char *Sfile, double *S)
 {
-   register int i, j, k, foo;
-   int CKno_u, maxnhtot;
-   double *Ssparse, *Sbig;
-   int *numh, *listh;
+   register int i, k;
+   int CKno_u, maxnhtot, no_u, info = VIB_SUCCESS;
+   double *Ssparse = NULL, *St = NULL;
+   int *numh = NULL, *listh = NULL;
    FILE *OnlyS;
 
+   no_u = ctx->no_u;
+
    /* Opens the '.onlyS' binary file. */
-   printf ("    reading \"%s\" file... ", Sfile);
+   LOGinfo (ctx, "    reading \"%s\" file... ", Sfile);
+   TIMEstart (ctx, "readOnlyS");
    OnlyS = CHECKfopen (Sfile, "rb");
+   if (OnlyS == NULL)
+      info = VIB_ERR_FILE;
 
    /* Reads matrices dimensions and checks file consistency. */
-   fseek (OnlyS, 0L, SEEK_SET);
-   CHECKfread (fread (&CKno_u, sizeof (int), 1, OnlyS), 1, Sfile);
-   CHECKfread (fread (&maxnhtot, sizeof (int), 1, OnlyS), 1, Sfile);
-   if (CKno_u != 2 * no_u) {
-      fprintf (stderr,
-	       " ERROR: the file %s is not written correctly!\n\n",
-	       Sfile);
-      exit (EXIT_FAILURE);
+   if (info == VIB_SUCCESS) {
+      fseek (OnlyS, 0L, SEEK_SET);
+      CKno_u = maxnhtot = -1;
+      info = CHECKfread (fread (&CKno_u, sizeof (int), 1, OnlyS), 1, OnlyS,
+			 Sfile);
+      if (info == VIB_SUCCESS)
+	 info = CHECKfread (fread (&maxnhtot, sizeof (int), 1, OnlyS), 1,
+			    OnlyS, Sfile);
+      if (info == VIB_SUCCESS && ((CKno_u != 2 * no_u) || (maxnhtot < 0))) {
+	 fprintf (stderr,
+		  " ERROR: the file %s is not written correctly!\n\n",
+		  Sfile);
+	 info = VIB_ERR_FORMAT;
+      }
    }
 
    /* Allocates memory. */
-   Ssparse = UTILdoubleVector (maxnhtot);
-   Sbig = UTILdoubleVector (2 * no_u * 2 * no_u);
-   numh = UTILintVector (2 * no_u);
-   listh = UTILintVector (maxnhtot);
+   if (info == VIB_SUCCESS) {
+      Ssparse = UTILdoubleVector (maxnhtot);
+      St = UTILdoubleVector (ctx->nAct * ctx->nAct);
+      numh = UTILintVector (2 * no_u);
+      listh = UTILintVector (maxnhtot);
+      if (Ssparse == NULL || St == NULL || numh == NULL || listh == NULL)
+	 info = VIB_ERR_MEMORY;
+   }
 
    /* Reads the number of nonzero elements of each row of S. */
-   CHECKfread (fread (numh, 2*no_u*sizeof(int), 1, OnlyS), 1, Sfile);
+   if (info == VIB_SUCCESS)
+      info = CHECKfread (fread (numh, sizeof (int), 2 * no_u, OnlyS),
+			 2 * no_u, OnlyS, Sfile);
 
    /* Reads the nonzero overlap-matrix     */
    /* element column indexes for each row. */
-   for (i = 0, k = 0; i < 2 * no_u; i++) {
-      CHECKfread (fread (&(listh[k]), numh[i]*sizeof(int),
-			 1, OnlyS), 1, Sfile);
+   for (i = 0, k = 0; i < 2 * no_u && info == VIB_SUCCESS; i++) {
+      if (numh[i] < 0 || k + numh[i] > maxnhtot) {
+	 fprintf (stderr,
+		  " ERROR: the file %s is not written correctly!\n\n",
+		  Sfile);
+	 info = VIB_ERR_FORMAT;
+	 break ;
+      }
+      info = CHECKfread (fread (&(listh[k]), sizeof (int), numh[i], OnlyS),
+			 numh[i], OnlyS, Sfile);
       k = k + numh[i];
    }
 
-   /* Reads the overlap matrix in sparse form. */
-   for (i = 0, k = 0; i < 2 * no_u; i++) {
-      CHECKfread (fread (&(Ssparse[k]), numh[i]*sizeof(double),
-			 1, OnlyS), 1, Sfile);
-      k = k + numh[i];
-   }
+   if (info == VIB_SUCCESS) {
 
-   /* Assigns nonzero elements from 'Ssparse'.  */
-   /* The index 'k' runs over 'Ssparse' matrix. */
-   for (i = 0, k = 0; i < 2 * no_u; i++)
-      for (j = 0; j < numh[i]; j++, k++) {
-   	 foo = (listh[k] - 1) % (2 * no_u); /* column index */
-   	 Sbig[idx(i,foo,2*no_u)] += Ssparse[k];
+      /* Reads the overlap matrix in sparse form. */
+      for (i = 0, k = 0; i < 2 * no_u && info == VIB_SUCCESS; i++) {
+	 info = CHECKfread (fread (&(Ssparse[k]), sizeof (double), numh[i],
+				   OnlyS), numh[i], OnlyS, Sfile);
+	 k = k + numh[i];
       }
 
-   /* Picks only the terms <i|j'> from dynamic atoms. */
-   for (j = 0; j < no_u; j++)
-      for (i = 0; i < no_u; i++)
-   	 S[idx(i,j,no_u)] = (Sbig[idx(i,j+no_u,2*no_u)]
-			     + Sbig[idx(j+no_u,i,2*no_u)]) / 2.0;
-
-   /* Closes file. */
-   CHECKfclose (fclose (OnlyS), Sfile);
-   printf ("ok!\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
+      /* Picks the overlap terms from the dynamic atoms. */
+      if (info == VIB_SUCCESS)
+	 pickOnlyS (ctx, numh, listh, Ssparse, St, S);
+   }
 
    /* Frees memory. */
-   free (numh);
-   free (listh);
-   free (Ssparse);
-   free (Sbig);
+   CHECKfree (numh);
+   CHECKfree (listh);
+   CHECKfree (Ssparse);
+   CHECKfree (St);
+
+   /* Closes file (the stage is stopped on all the paths). */
+   if (info == VIB_SUCCESS)
+      info = CHECKfclose (fclose (OnlyS), Sfile);
+   else if (OnlyS != NULL)
+      fclose (OnlyS);
+   TIMEstop (ctx, "readOnlyS");
+   if (info != VIB_SUCCESS)
+      return info;
+   TIMEfile (ctx, "readOnlyS", Sfile, 0);
+   LOGinfo (ctx, "ok!\n");
+   LOGprogress (ctx);
+
+   return VIB_SUCCESS;
 
 } /* readOnlyS */
 
 
+/* ********************************************************* */
+/* Sets at 'k' the next direction (x, y or z not yet 'done') */
+/* whose pair of '.onlyS' files is at the FC directory. With */
+/* 'ctx->onlySwait' it waits up to that time (s) for a pair  */
+/* written by concurrent 'onlyS' runs (the 'runOS' drivers   */
+/* move each file there once it is complete); otherwise, or  */
+/* when the time is over, it is the first direction left.    */
+static int nextOnlyS (vib_context *ctx, char *Sfile, int *done, int *k)
+{
+   register int i;
+   int waiting = 0;
+   double start;
+   struct stat st;
+
+   start = UTILwallTime ();
+   for (;;) {
+      for (i = 0; i < 3; i++) {
+	 if (done[i])
+	    continue ;
+	 sprintf (Sfile, "%s%s_%d.onlyS", ctx->FCdir, ctx->sysLabel, 2*i+1);
+	 if (stat (Sfile, &st) != 0)
+	    continue ;
+	 sprintf (Sfile, "%s%s_%d.onlyS", ctx->FCdir, ctx->sysLabel, 2*i+2);
+	 if (stat (Sfile, &st) != 0)
+	    continue ;
+	 *k = i;
+	 if (waiting)
+	    LOGinfo (ctx, "    direction %c ready after %.1f s\n", 'x' + i,
+		     UTILwallTime () - start);
+	 return VIB_SUCCESS;
+      }
+      if (ctx->onlySwait <= 0.0 || UTILwallTime () - start > ctx->onlySwait)
+	 break ;
+      if (stopRequested (ctx))
+	 return VIB_ERR_STOPPED;
+      if (!waiting) {
+	 LOGinfo (ctx, "    waiting for the '.onlyS' files...\n");
+	 LOGflush (ctx);
+	 waiting = 1;
+      }
+      sleep (1);
+   }
+   for (i = 0; done[i]; i++)
+      ;
+   *k = i;
+
+   return VIB_SUCCESS;
+
+} /* nextOnlyS */
+
+
 /* ********************************************************* */
 /* Computes 'dS = [ <i|j(Q)> - <i|j(-Q)> ] / 2Q' by reading  */
 /* the overlap matrix from '.onlyS' files for the displaced  */
-/* system.                                                   */
-static void deltaS (double *dS)
+/* system. The directions are read in the order their pairs  */
+/* of files are complete (see 'nextOnlyS').                  */
+static int deltaS (vib_context *ctx, double *dS)
 {
-   register int i, j, k, len;
+   register int i, j, n, len;
+   int k, no_u, info = VIB_SUCCESS;
+   int done[3] = {0, 0, 0};
    double *Sm, *Sp;
    char *Sfile;
 
+   no_u = ctx->nAct; /* dense matrices (active region) */
+
    /* Allocates memory and initializes with '0'. */
-   Sm = UTILdoubleVector (3 * no_u * no_u);
-   Sp = UTILdoubleVector (3 * no_u * no_u);
+   Sm = UTILdoubleVector ((size_t) 3 * no_u * no_u);
+   Sp = UTILdoubleVector ((size_t) 3 * no_u * no_u);
 
    /* Sets the '.onlyS' file name with 'FCdir' path. */
-   len = strlen (FCdir);
-   len += strlen (sysLabel);
+   len = strlen (ctx->FCdir);
+   len += strlen (ctx->sysLabel);
    Sfile = CHECKmalloc ((len + 9) * sizeof (char));
 
-   for (k = 0; k < 3; k++) {
+   if (Sm == NULL || Sp == NULL || Sfile == NULL)
+      info = VIB_ERR_MEMORY;
+
+   TIMEprogressStart (ctx, "deltaS", "readOnlyS", "directions", 3);
+   for (n = 0; n < 3 && info == VIB_SUCCESS; n++) {
+      info = nextOnlyS (ctx, Sfile, done, &k);
+      if (info != VIB_SUCCESS)
+	 break ;
+      done[k] = 1;
+
       /* '<i|j(-Q)>' */
-      Sfile[0] = '\0';
-      sprintf (Sfile, "%s%s_%d.onlyS", FCdir, sysLabel, 2 * k + 1);
-      readOnlyS (Sfile, &Sm[idx3d(0,0,k,no_u,no_u)]);
+      sprintf (Sfile, "%s%s_%d.onlyS", ctx->FCdir, ctx->sysLabel, 2*k+1);
+      info = readOnlyS (ctx, Sfile, &Sm[idx3d(0,0,k,no_u,no_u)]);
+      if (info != VIB_SUCCESS)
+	 break ;
 
       /* '<i|j(Q)>' */
-      Sfile[0] = '\0';
-      sprintf (Sfile, "%s%s_%d.onlyS", FCdir, sysLabel, 2 * k + 2);
-      readOnlyS (Sfile, &Sp[idx3d(0,0,k,no_u,no_u)]);
+      sprintf (Sfile, "%s%s_%d.onlyS", ctx->FCdir, ctx->sysLabel, 2*k+2);
+      info = readOnlyS (ctx, Sfile, &Sp[idx3d(0,0,k,no_u,no_u)]);
+      if (info != VIB_SUCCESS)
+	 break ;
 
       /* 'dS = [ <i|j(Q)> - <i|j(-Q)> ] / 2Q' */
       for (i = 0; i < no_u; i++)
 	 for (j = 0; j < no_u; j++)
 	    dS[idx3d(i,j,k,no_u,no_u)] =
 	       (Sp[idx3d(i,j,k,no_u,no_u)] - Sm[idx3d(i,j,k,no_u,no_u)])
-	       / (2.0 * FCdispl);
-
+	       / (2.0 * ctx->FCdispl);
+      TIMEprogress (ctx, n + 1);
    }
+   TIMEprogressEnd (ctx);
 
    /* Frees memory. */
-   free (Sfile);
-   free (Sp);
-   free (Sm);
+   CHECKfree (Sfile);
+   CHECKfree (Sp);
+   CHECKfree (Sm);
+
+   return info;
 
 } /* deltaS */
 
@@ -917,38 +2322,90 @@ static void deltaS (double *dS)
 /* Applies a correction due to the change in basis orbitals  */
 /* with displacement:                                        */
 /*         'dH = dH - dS*S0^-1*H0 - H0*S0^-1*(dS)^T'         */
-static void dHCorrection (double *dH, double *H0, double *S0)
+/* where 'dStot' holds 'dS' for each direction (x,y,z). With */
+/* a 'dH' cache ('key' holds the keys of the raw 'dH'), the  */
+/* corrected 'dH' of each dynamic atom is read from the      */
+/* cache when its inputs didn't change.                      */
+static int dHCorrection (vib_context *ctx, double *dH, double *H0,
+			 double *S0, double *dStot,
+			 unsigned long long *key)
 {
    register int i, j, k, s, coord, h;
+   int no_u, nspin, nCached = 0, info;
    int *ipiv;
+   unsigned long long hHS = CKPT_HASH_INIT, akey = 0;
    double alpha, beta;
-   double *dStot, *dS, *invS0, *Aux;
+   double *dS, *invS0, *Aux;
 
-   /* Computes 'dS = [ <i|j(Q)> - <i|j(-Q)> ] / 2Q'. */
-   dStot = UTILdoubleVector (3 * no_u * no_u);
-   deltaS (dStot);
+   no_u = ctx->nAct; /* dense matrices (active region) */
+   nspin = ctx->nspin;
 
-   /* Initializes 'invS0' with 'S0'. */
-   invS0 = UTILdoubleVector (no_u * no_u);
-   UTILcopyVector (invS0, S0, no_u * no_u);
+   /* The corrected 'dH' of an atom depends also on 'H0', 'S0' and 'dS'. */
+   if (key != NULL) {
+      hHS = CKPThash (hHS, H0, nspin * no_u * no_u * sizeof (double));
+      hHS = CKPThash (hHS, S0, no_u * no_u * sizeof (double));
+      hHS = CKPThash (hHS, dStot, 3 * no_u * no_u * sizeof (double));
+   }
 
-   /* Computes 'invS0 = S0^-1'. */
+   /* Allocates memory. */
+   invS0 = UTILdoubleVector (no_u * no_u);
    ipiv = CHECKmalloc (no_u * sizeof (int));
-   CHECKdgetrf (no_u, invS0, ipiv); /* triangular matrix factorization */
-   CHECKdgetri (no_u, invS0, ipiv); /* matrix inversion */
+   dS = CHECKmalloc (no_u * no_u * sizeof (double));
+   Aux = CHECKmalloc (no_u * no_u * sizeof (double));
+   if (invS0 == NULL || ipiv == NULL || dS == NULL || Aux == NULL)
+      info = VIB_ERR_MEMORY;
+
+   /* Initializes 'invS0' with 'S0'. */
+   else {
+      UTILcopyVector (invS0, S0, no_u * no_u);
+
+      /* Computes 'invS0 = S0^-1'. */
+      info = CHECKdgetrf (no_u, invS0, ipiv); /* triangular factorization */
+   }
+   if (info == VIB_SUCCESS)
+      info = CHECKdgetri (no_u, invS0, ipiv); /* matrix inversion */
+   TIMEflops (ctx, "dHCorrection", 2.0 * no_u * no_u * no_u);
+   if (info != VIB_SUCCESS) {
+      CHECKfree (ipiv);
+      CHECKfree (dS);
+      CHECKfree (invS0);
+      CHECKfree (Aux);
+      return info;
+   }
 
    /* Computes 'dH = dH - dS*S0^-1*H0 - H0*S0^-1*(dS)^T' */
    /* for each displacement direction.                   */
-   printf ("\n    correcting Hamiltonian derivatives elements... ");
-   dS = CHECKmalloc (no_u * no_u * sizeof (double));
-   Aux = CHECKmalloc (no_u * no_u * sizeof (double));
-   for (k = 0; k < nDyn; k++) {
+   LOGinfo (ctx, "\n    correcting Hamiltonian derivatives elements... ");
+   TIMEprogressStart (ctx, "dHCorrection", "dHCorrection", "atoms",
+		      ctx->nDyn);
+   for (k = 0; k < ctx->nDyn && info == VIB_SUCCESS &&
+	   !stopRequested (ctx); k++) {
+
+      /* Atoms rebuilt by symmetry (see 'SYMMrebuildDH'). */
+      if (!SYMMirreducible (ctx, k)) {
+	 TIMEprogress (ctx, k + 1);
+	 continue ;
+      }
+
+      /* Atoms whose inputs are at the cache. */
+      if (key != NULL) {
+	 akey = CKPThash (hHS, &key[3*k], 3 * sizeof (unsigned long long));
+	 if (CKPTcacheLoad (ctx, "dHc", akey,
+			    &dH[idx3d(0,0,3*k*nspin,no_u,no_u)],
+			    (size_t) 3 * nspin * no_u * no_u) == VIB_SUCCESS) {
+	    nCached++;
+	    TIMEprogress (ctx, k + 1);
+	    continue ;
+	 }
+      }
+
       UTILresetDoubleVector (no_u * no_u, dS);
       for (coord = 0; coord < 3; coord++) { /* xyz */
 
 	 /* The only non-zero elements from 'dS' matrix are those    */
 	 /* corresponding to the orbitals from the dynamic atom 'k'. */
-	 for (j = orbIdx[FCfirst+k-1]; j < orbIdx[FCfirst+k]; j++)
+	 for (j = ctx->orbIdx[ctx->FCfirst+k-1] - ctx->orbShift;
+	      j < ctx->orbIdx[ctx->FCfirst+k] - ctx->orbShift; j++)
 	    for (i = 0; i < no_u; i++)
 	       dS[idx(i,j,no_u)] = dStot[idx3d(i,j,coord,no_u,no_u)];
 
@@ -982,109 +2439,520 @@ static void dHCorrection (double *dH, double *H0, double *S0)
 	    	   &no_u, &beta, &dH[idx3d(0,0,h,no_u,no_u)], &no_u);
 	 }
       }
+      TIMEflops (ctx, "dHCorrection", 3.0 * nspin * 8.0 * no_u * no_u * no_u);
+      if (key != NULL)
+	 info = CKPTcacheSave (ctx, "dHc", akey,
+			       &dH[idx3d(0,0,3*k*nspin,no_u,no_u)],
+			       (size_t) 3 * nspin * no_u * no_u);
+      TIMEprogress (ctx, k + 1);
    }
-   printf ("ok!\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
+   TIMEprogressEnd (ctx);
+   LOGinfo (ctx, k < ctx->nDyn ? "stopped!\n" : "ok!\n");
+   if (key != NULL)
+      LOGinfo (ctx, "    %d of %d atoms reused from the cache\n",
+	       nCached, ctx->nDyn);
+   LOGflush (ctx);
 
    /* Frees memory. */
-   free (ipiv);
-   free (dStot);
-   free (dS);
-   free (invS0);
-   free (Aux);
+   CHECKfree (ipiv);
+   CHECKfree (dS);
+   CHECKfree (invS0);
+   CHECKfree (Aux);
+
+   /* A partially corrected 'dH' is not checkpointed. */
+   if (info != VIB_SUCCESS)
+      return info;
+   if (k < ctx->nDyn)
+      return VIB_ERR_STOPPED;
+
+   return VIB_SUCCESS;
 
 } /* dHCorrection */
 
 
+/* ********************************************************* */
+/* Returns the sum of the squares of the 'n' values 'x'. The */
+/* four partial sums let the compiler vectorize the loop     */
+/* (without reassociating floating point operations).        */
+static double sumSquares (const double *x, int n)
+{
+   register int i;
+   double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+
+   for (i = 0; i + 4 <= n; i += 4) {
+      s0 += x[i] * x[i];
+      s1 += x[i+1] * x[i+1];
+      s2 += x[i+2] * x[i+2];
+      s3 += x[i+3] * x[i+3];
+   }
+   for (; i < n; i++)
+      s0 += x[i] * x[i];
+
+   return (s0 + s1) + (s2 + s3);
+
+} /* sumSquares */
+
+
+/* ********************************************************* */
+/* Computes the summary 'sum' of the 'nOrb x nOrb' coupling  */
+/* matrix 'M': its Frobenius norm, its 'MSUM_TOP' largest    */
+/* elements (of the upper triangle, as 'M' is symmetric) and */
+/* the norms 'sub' of its diagonal blocks over the orbitals  */
+/* '[lo[p],hi[p])' of the 'nSub' subsets.                    */
+static void blockSummary (const double *M, int nOrb, int nSub,
+			  const int *lo, const int *hi, modesum *sum,
+			  double *sub)
+{
+   register int i, j, t, p;
+   double a;
+
+   /* Frobenius norm (column by column). */
+   a = 0.0;
+   for (j = 0; j < nOrb; j++)
+      a += sumSquares (&M[idx(0,j,nOrb)], nOrb);
+   sum->norm = sqrt (a);
+
+   /* Largest elements, kept sorted. */
+   for (t = 0; t < MSUM_TOP; t++) {
+      sum->top[t] = 0.0;
+      sum->topI[t] = sum->topJ[t] = -1;
+   }
+   for (j = 0; j < nOrb; j++)
+      for (i = 0; i <= j; i++)
+	 if (fabs (M[idx(i,j,nOrb)]) > fabs (sum->top[MSUM_TOP-1])) {
+	    for (t = MSUM_TOP - 1;
+		 t > 0 && fabs (M[idx(i,j,nOrb)]) > fabs (sum->top[t-1]); t--) {
+	       sum->top[t] = sum->top[t-1];
+	       sum->topI[t] = sum->topI[t-1];
+	       sum->topJ[t] = sum->topJ[t-1];
+	    }
+	    sum->top[t] = M[idx(i,j,nOrb)];
+	    sum->topI[t] = i;
+	    sum->topJ[t] = j;
+	 }
+
+   /* Norms over the orbital subsets. */
+   for (p = 0; p < nSub; p++) {
+      a = 0.0;
+      for (j = lo[p]; j < hi[p]; j++)
+	 a += sumSquares (&M[idx(lo[p],j,nOrb)], hi[p] - lo[p]);
+      sub[p] = sqrt (a);
+   }
+
+} /* blockSummary */
+
+
 /* ********************************************************* */
 /* Having calculated the phonon energies ('EigVal') and      */
 /* modes ('EigVec') and the Hamiltonian derivatives ('dH'),  */
 /* it computes the elements of the electron-phonon coupling  */
-/* matrix.                                                   */
-static void eph (double *EigVec, double *EigVal,
-		 double *dH, double *Meph)
+/* matrix. If 'sum' is not 'NULL', the summary of each block */
+/* (and at 'sub' the norms over the orbital subsets '[lo,hi)' */
+/* of 'ctx->subsets') is computed as soon as it is complete, */
+/* while it is still in cache.                               */
+static void eph (vib_context *ctx, double *EigVec, double *EigVal,
+		 double *dH, double *Meph, modesum *sum, double *sub,
+		 const int *lo, const int *hi)
 {
-   register int i, j, k, s, l, firstOrb, nOrb;
+   register int k, s, l, firstOrb, nOrb;
+   int nDyn, nspin, no_u;
    double cst;
+   const kern_table *kern = KERNtable ();
+
+   nDyn = ctx->nDyn;
+   nspin = ctx->nspin;
+   no_u = ctx->nAct; /* dense matrices (active region) */
 
    /* Computes each element of 'Meph'. */
-   printf ("    computing the electron-phonon coupling elements... ");
-   firstOrb = orbIdx[FCfirst - 1]; /* first orb of first dyn atom */
-   nOrb = orbIdx[FClast] - orbIdx[FCfirst - 1]; /* number of dyn orbs */
+   LOGinfo (ctx,
+	    "    computing the electron-phonon coupling elements... ");
+   firstOrb = ctx->orbIdx[ctx->FCfirst - 1]; /* first orb of first dyn atom */
+   nOrb = ctx->orbIdx[ctx->FClast] - firstOrb; /* number of dyn orbs */
+   firstOrb -= ctx->orbShift; /* (at the dense matrices) */
    cst = hbar * sqrt (1.0e20 * eV2joule / amu2kg);
-   for (l = 0; l < 3 * nDyn; l++) /* modes */
+   TIMEprogressStart (ctx, "eph", "eph", "modes", 3 * nDyn);
+   for (l = 0; l < 3 * nDyn; l++) { /* modes */
       for (k = 0; k < 3 * nDyn; k++) /* coordinates */
 	 for (s = 0; s < nspin; s++) /* spin */
-	    for (j = 0; j < nOrb; j++)
-	       for (i = 0; i < nOrb; i++)
-		  Meph[idx3d(i,j,l*nspin+s,nOrb,nOrb)] +=
-		     dH[idx3d(firstOrb+i,firstOrb+j,k*nspin+s,no_u,no_u)]
-		     * EigVec[idx(k,l,3*nDyn)] * cst
-		     / sqrt (2 * dynAtoms[k/3].atom.A * EigVal[l]);
-   printf ("ok!\n\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
+	    kern->ephBlock (nOrb, no_u, &Meph[idx3d(0,0,l*nspin+s,nOrb,nOrb)],
+			    &dH[idx3d(firstOrb,firstOrb,k*nspin+s,no_u,no_u)],
+			    EigVec[idx(k,l,3*nDyn)], cst,
+			    sqrt (2 * ctx->dynAtoms[k/3].atom.A * EigVal[l]));
+
+      /* Summaries of the complete blocks of mode 'l'. */
+      if (sum != NULL && EigVal[l] > 0.0)
+	 for (s = 0; s < nspin; s++)
+	    blockSummary (&Meph[idx3d(0,0,l*nspin+s,nOrb,nOrb)], nOrb,
+			  ctx->nSubsets, lo, hi, &sum[l*nspin+s],
+			  &sub[(l*nspin+s)*ctx->nSubsets]);
+      TIMEflops (ctx, "eph", 2.0 * 3 * nDyn * nspin * nOrb * nOrb);
+      TIMEprogress (ctx, l + 1);
+   }
+   TIMEprogressEnd (ctx);
+   LOGinfo (ctx, "ok!\n\n");
+   LOGflush (ctx);
 
 } /* eph */
 
 
+/* ********************************************************* */
+/* Sets the orbital ranges '[lo,hi)' (relative to the first  */
+/* dynamic orbital) of the atom ranges at 'ctx->subsets'.    */
+static int subsetOrbitals (vib_context *ctx, int *lo, int *hi)
+{
+   register int p;
+   int first, last, firstOrb;
+
+   firstOrb = ctx->orbIdx[ctx->FCfirst - 1];
+   for (p = 0; p < ctx->nSubsets; p++) {
+      first = ctx->subsets[2*p];
+      last = ctx->subsets[2*p+1];
+      if (first < ctx->FCfirst || last > ctx->FClast || last < first) {
+	 fprintf (stderr, "\n ERROR: the atoms %d to %d are not a range of"
+		  " dynamic atoms (%d to %d)!\n\n", first, last,
+		  ctx->FCfirst, ctx->FClast);
+	 return VIB_ERR_INPUT;
+      }
+      lo[p] = ctx->orbIdx[first - 1] - firstOrb;
+      hi[p] = ctx->orbIdx[last] - firstOrb;
+   }
+
+   return VIB_SUCCESS;
+
+} /* subsetOrbitals */
+
+
+/* ********************************************************* */
+/* Writes the per-mode summary table '.Msum': for each mode  */
+/* (as numbered at the log, lowest energy first) and spin,   */
+/* the norm of the coupling matrix, its largest elements     */
+/* (with the orbitals indices as at '.Meph') and the norms   */
+/* over the orbital subsets.                                 */
+static int summaryOut (vib_context *ctx, double *EigVal, modesum *sum,
+		       double *sub)
+{
+   register int l, s, t, p;
+   int len, nspin, firstOrb, info;
+   char *sumFile;
+   FILE *SUM;
+
+   nspin = ctx->nspin;
+   firstOrb = ctx->orbIdx[ctx->FCfirst - 1] + 1;
+
+   len = strlen (ctx->FCdir) + strlen (ctx->sysLabel);
+   sumFile = CHECKmalloc ((len + 6) * sizeof (char));
+   if (sumFile == NULL)
+      return VIB_ERR_MEMORY;
+   sprintf (sumFile, "%s%s.Msum", ctx->FCdir, ctx->sysLabel);
+   LOGinfo (ctx, " Writing coupling summary at \"%s\" file... ", sumFile);
+   SUM = CHECKfopen (sumFile, "w");
+   if (SUM == NULL) {
+      CHECKfree (sumFile);
+      return VIB_ERR_FILE;
+   }
+
+   /* Header: columns and orbital subsets. */
+   fprintf (SUM, "# mode  energy(eV)  spin  norm");
+   for (t = 0; t < MSUM_TOP; t++)
+      fprintf (SUM, "  max%d  i%d  j%d", t + 1, t + 1, t + 1);
+   for (p = 0; p < ctx->nSubsets; p++)
+      fprintf (SUM, "  norm_%d", p + 1);
+   fprintf (SUM, "\n");
+   for (p = 0; p < ctx->nSubsets; p++)
+      fprintf (SUM, "# subset %d: atoms %d to %d\n", p + 1,
+	       ctx->subsets[2*p], ctx->subsets[2*p+1]);
+
+   /* One line per mode and spin (modes of zero energy have */
+   /* no coupling matrix).                                  */
+   for (l = 0; l < 3 * ctx->nDyn; l++)
+      if (EigVal[l] > 0.0)
+	 for (s = 0; s < nspin; s++) {
+	    fprintf (SUM, "%5d  %.10e  %d  %.10e", l + 1, EigVal[l], s + 1,
+		     sum[l*nspin+s].norm);
+	    for (t = 0; t < MSUM_TOP; t++)
+	       fprintf (SUM, "  % .10e  %d  %d", sum[l*nspin+s].top[t],
+			sum[l*nspin+s].topI[t] + firstOrb,
+			sum[l*nspin+s].topJ[t] + firstOrb);
+	    for (p = 0; p < ctx->nSubsets; p++)
+	       fprintf (SUM, "  %.10e", sub[(l*nspin+s)*ctx->nSubsets+p]);
+	    fprintf (SUM, "\n");
+	 }
+
+   info = CHECKfclose (fclose (SUM), sumFile);
+   if (info == VIB_SUCCESS)
+      LOGinfo (ctx, "ok!\n");
+
+   /* Frees memory. */
+   CHECKfree (sumFile);
+
+   return info;
+
+} /* summaryOut */
+
+
+/* ********************************************************* */
+/* Projects the coupling matrices 'Meph' onto the electronic */
+/* states of the dynamic block, solving 'H0 c = e S0 c' on   */
+/* the dynamic orbitals ('H0' is shifted so that 'E_F = 0'). */
+/* Only the states with energies in [ctx->projEmin,          */
+/* ctx->projEmax] are kept; for 'nspin = 2' the same range   */
+/* of states (the union of the windows of both spins) is     */
+/* kept for both. On exit 'Meph' holds the '*nState *        */
+/* *nState' blocks (same order) starting at the state        */
+/* '*first', whose energies are written at '.Mstates' file.  */
+/* For each spin, the products 'C^T M' of the modes are one  */
+/* GEMM when their blocks are contiguous ('nspin = 1').      */
+static int projectMeph (vib_context *ctx, double *H0, double *S0,
+			double *Meph, int *nState, int *first)
+{
+   register int i, j, s, l, b;
+   int nOrb, firstOrb, a, nModes, nspin, nB, nb, lo, hi, nW, len, info;
+   double alpha = 1.0, beta = 0.0;
+   double *C, *E, *Sd, *T, *P;
+   char *stFile;
+   FILE *ST;
+
+   nspin = ctx->nspin;
+   nModes = 3 * ctx->nDyn;
+   nB = nModes * nspin;
+   firstOrb = ctx->orbIdx[ctx->FCfirst - 1];
+   nOrb = ctx->orbIdx[ctx->FClast] - firstOrb;
+   a = firstOrb - ctx->orbShift; /* at the dense 'H0' and 'S0' */
+
+   /* Allocates memory. */
+   C = CHECKmalloc ((size_t) nspin * nOrb * nOrb * sizeof (double));
+   E = CHECKmalloc (nspin * nOrb * sizeof (double));
+   Sd = CHECKmalloc (nOrb * nOrb * sizeof (double));
+   if (C == NULL || E == NULL || Sd == NULL) {
+      CHECKfree (C);
+      CHECKfree (E);
+      CHECKfree (Sd);
+      return VIB_ERR_MEMORY;
+   }
+
+   /* Solves 'H0 c = e S0 c' on the dynamic block of each spin. */
+   LOGinfo (ctx, "    solving H0 c = e S0 c on the dynamic block... ");
+   LOGprogress (ctx);
+   info = VIB_SUCCESS;
+   for (s = 0; s < nspin && info == VIB_SUCCESS; s++) {
+      for (j = 0; j < nOrb; j++)
+	 for (i = 0; i < nOrb; i++) {
+	    C[idx3d(i,j,s,nOrb,nOrb)] =
+	       H0[idx3d(a+i,a+j,s,ctx->nAct,ctx->nAct)];
+	    Sd[idx(i,j,nOrb)] = S0[idx(a+i,a+j,ctx->nAct)];
+	 }
+      info = CHECKdsygvd (nOrb, &C[idx3d(0,0,s,nOrb,nOrb)], Sd,
+			  &E[idx(0,s,nOrb)]);
+   }
+   CHECKfree (Sd);
+   if (info != VIB_SUCCESS) {
+      CHECKfree (C);
+      CHECKfree (E);
+      return info;
+   }
+   LOGinfo (ctx, "ok!\n");
+
+   /* Fixes the arbitrary sign of each state (its largest */
+   /* component positive), so the output doesn't depend   */
+   /* on the LAPACK implementation.                        */
+   for (s = 0; s < nspin; s++)
+      for (j = 0; j < nOrb; j++) {
+	 for (i = 1, b = 0; i < nOrb; i++)
+	    if (fabs (C[idx3d(i,j,s,nOrb,nOrb)]) >
+		fabs (C[idx3d(b,j,s,nOrb,nOrb)]))
+	       b = i;
+	 if (C[idx3d(b,j,s,nOrb,nOrb)] < 0.0)
+	    for (i = 0; i < nOrb; i++)
+	       C[idx3d(i,j,s,nOrb,nOrb)] = - C[idx3d(i,j,s,nOrb,nOrb)];
+      }
+
+   /* States inside the energy window (ascending energies). */
+   lo = nOrb;
+   hi = -1;
+   for (s = 0; s < nspin; s++)
+      for (i = 0; i < nOrb; i++)
+	 if (E[idx(i,s,nOrb)] >= ctx->projEmin &&
+	     E[idx(i,s,nOrb)] <= ctx->projEmax) {
+	    if (i < lo)
+	       lo = i;
+	    if (i > hi)
+	       hi = i;
+	 }
+   if (hi < lo) {
+      fprintf (stderr, "\n ERROR: no electronic states in the window"
+	       " [%g, %g] eV!\n\n", ctx->projEmin, ctx->projEmax);
+      CHECKfree (C);
+      CHECKfree (E);
+      return VIB_ERR_INPUT;
+   }
+   nW = hi - lo + 1;
+   LOGinfo (ctx, "    %d states (%d to %d) in [%g, %g] eV\n",
+	    nW, lo + 1, hi + 1, ctx->projEmin, ctx->projEmax);
+
+   /* Allocates memory for the products. */
+   nb = (nspin == 1 ? nModes : 1);
+   T = CHECKmalloc ((size_t) nW * nOrb * nb * sizeof (double));
+   P = CHECKmalloc ((size_t) nW * nW * nB * sizeof (double));
+   if (T == NULL || P == NULL) {
+      CHECKfree (C);
+      CHECKfree (E);
+      CHECKfree (T);
+      CHECKfree (P);
+      return VIB_ERR_MEMORY;
+   }
+
+   /* Computes 'P = C^T Meph C' (with 'C' the kept states). */
+   LOGinfo (ctx, "    projecting the coupling matrices... ");
+   LOGprogress (ctx);
+   for (s = 0; s < nspin; s++)
+      for (l = 0; l < nModes; l += nb) {
+	 len = nOrb * nb;
+	 dgemm ("T", "N", &nW, &len, &nOrb, &alpha,
+		&C[idx3d(0,lo,s,nOrb,nOrb)], &nOrb,
+		&Meph[idx3d(0,0,l*nspin+s,nOrb,nOrb)], &nOrb,
+		&beta, T, &nW);
+	 for (b = 0; b < nb; b++)
+	    dgemm ("N", "N", &nW, &nW, &nOrb, &alpha,
+		   &T[(size_t) b*nW*nOrb], &nW,
+		   &C[idx3d(0,lo,s,nOrb,nOrb)], &nOrb, &beta,
+		   &P[idx3d(0,0,(l+b)*nspin+s,nW,nW)], &nW);
+      }
+   UTILcopyVector (Meph, P, (size_t) nW * nW * nB);
+   LOGinfo (ctx, "ok!\n");
+   CHECKfree (T);
+   CHECKfree (P);
+   CHECKfree (C);
+
+   /* Writes the energies of the kept states. */
+   len = strlen (ctx->FCdir) + strlen (ctx->sysLabel);
+   stFile = CHECKmalloc ((len + 9) * sizeof (char));
+   if (stFile == NULL) {
+      CHECKfree (E);
+      return VIB_ERR_MEMORY;
+   }
+   sprintf (stFile, "%s%s.Mstates", ctx->FCdir, ctx->sysLabel);
+   LOGinfo (ctx, "    writing the states energies at \"%s\" file... ",
+	    stFile);
+   ST = CHECKfopen (stFile, "w");
+   if (ST == NULL)
+      info = VIB_ERR_FILE;
+   else {
+      fprintf (ST, "%d  %d  %d  %d\n\n", nspin, nW, lo + 1, hi + 1);
+      for (s = 0; s < nspin; s++) {
+	 for (i = lo; i <= hi; i++)
+	    fprintf (ST, "%.10e  ", E[idx(i,s,nOrb)]);
+	 fprintf (ST, "\n\n");
+      }
+      info = CHECKfclose (fclose (ST), stFile);
+   }
+   if (info == VIB_SUCCESS)
+      LOGinfo (ctx, "ok!\n\n");
+   LOGflush (ctx);
+
+   /* Frees memory. */
+   CHECKfree (stFile);
+   CHECKfree (E);
+
+   *nState = nW;
+   *first = lo + 1;
+
+   return info;
+
+} /* projectMeph */
+
+
 /* ********************************************************* */
 /* For each phonon energy ('EigVal'), ouputs the             */
-/* corresponding electron-phonon coupling matrix.            */
-static void ephOut (double *EigVal, double *Meph)
+/* corresponding electron-phonon coupling matrix ('nOrb *    */
+/* nOrb', starting at the orbital or state 'firstOrb'): the  */
+/* text '.Meph' file (in the format 'ctx->mephText') and the */
+/* binary '.bMeph' file (in the version 'ctx->bMeph').       */
+static int ephOut (vib_context *ctx, double *EigVal, double *Meph,
+		   int nOrb, int firstOrb)
 {
    register int i, j, l, s, len;
-   int nOrb, foo;
+   int nDyn, nspin, foo, compat, info;
+   double time;
    char *ephFile, *ephFileB;
    FILE *EPH, *EPHb;
 
+   nDyn = ctx->nDyn;
+   nspin = ctx->nspin;
+   time = UTILwallTime ();
+
    /* Sets the '.Meph' file name with 'FCdir' path. */
-   len = strlen (FCdir);
-   len += strlen (sysLabel);
+   len = strlen (ctx->FCdir);
+   len += strlen (ctx->sysLabel);
    ephFile = CHECKmalloc ((len + 6) * sizeof (char));
-   ephFile[0] = '\0';
-   sprintf (ephFile, "%s%s.Meph", FCdir, sysLabel);
    ephFileB = CHECKmalloc ((len + 7) * sizeof (char));
-   ephFileB[0] = '\0';
-   sprintf (ephFileB, "%s%s.bMeph", FCdir, sysLabel);
-
-   /* Opens the '.Meph' file. */
-   printf (" Writing electron-phonon coupling matrix at \"%s\" file... ",
-	   ephFile);
-   EPH = CHECKfopen (ephFile, "w");
-   EPHb = CHECKfopen (ephFileB, "wb");
+   if (ephFile == NULL || ephFileB == NULL) {
+      CHECKfree (ephFile);
+      CHECKfree (ephFileB);
+      return VIB_ERR_MEMORY;
+   }
+   sprintf (ephFile, "%s%s.Meph", ctx->FCdir, ctx->sysLabel);
+   sprintf (ephFileB, "%s%s.bMeph", ctx->FCdir, ctx->sysLabel);
+
+   /* Opens the files written here: the text '.Meph' in the */
+   /* original format and the '.bMeph' version 1.           */
+   LOGinfo (ctx,
+	    " Writing electron-phonon coupling matrix at \"%s\" file... ",
+	    ctx->mephText == MEPH_TEXT_OFF ? ephFileB : ephFile);
+   compat = (ctx->mephText == MEPH_TEXT_COMPAT);
+   EPH = EPHb = NULL;
+   if (compat)
+      EPH = CHECKfopen (ephFile, "w");
+   if (ctx->bMeph == 1)
+      EPHb = CHECKfopen (ephFileB, "wb");
+   if ((compat && EPH == NULL) || (ctx->bMeph == 1 && EPHb == NULL)) {
+      if (EPH != NULL)
+	 fclose (EPH);
+      if (EPHb != NULL)
+	 fclose (EPHb);
+      CHECKfree (ephFile);
+      CHECKfree (ephFileB);
+      return VIB_ERR_FILE;
+   }
 
    /* Writes the dimensions. */
-   nOrb = orbIdx[FClast] - orbIdx[FCfirst - 1]; /* number of dyn orbs */
-   fprintf (EPH, "%d  %d  %d  %d  %d\n\n", nspin, nDyn,
-	    nOrb, orbIdx[FCfirst-1]+1, orbIdx[FCfirst-1]+nOrb);
-   fwrite (&nspin, sizeof(int), 1, EPHb);
-   fwrite (&nDyn, sizeof(int), 1, EPHb);
-   fwrite (&nOrb, sizeof(int), 1, EPHb);
-   foo = orbIdx[FCfirst-1]+1;
-   fwrite (&foo, sizeof(int), 1, EPHb);
-   foo = orbIdx[FCfirst-1]+nOrb;
-   fwrite (&foo, sizeof(int), 1, EPHb);
+   if (EPH != NULL)
+      fprintf (EPH, "%d  %d  %d  %d  %d\n\n", nspin, nDyn, nOrb,
+	       firstOrb, firstOrb+nOrb-1);
+   if (EPHb != NULL) {
+      fwrite (&nspin, sizeof(int), 1, EPHb);
+      fwrite (&nDyn, sizeof(int), 1, EPHb);
+      fwrite (&nOrb, sizeof(int), 1, EPHb);
+      fwrite (&firstOrb, sizeof(int), 1, EPHb);
+      foo = firstOrb+nOrb-1;
+      fwrite (&foo, sizeof(int), 1, EPHb);
+   }
 
    /* Prints the phonon frequencies. */
    for (l = 3 * nDyn - 1; l >= 0; l--) {
-      fprintf (EPH, "%.10e  ", EigVal[l]);
-      fwrite (&(EigVal[l]), sizeof(double), 1, EPHb);
+      if (EPH != NULL)
+	 fprintf (EPH, "%.10e  ", EigVal[l]);
+      if (EPHb != NULL)
+	 fwrite (&(EigVal[l]), sizeof(double), 1, EPHb);
    }
-   fprintf (EPH, "\n\n");
+   if (EPH != NULL)
+      fprintf (EPH, "\n\n");
 
    /* Prints the electron-phonon coupling matrix. */
    for (l = 3 * nDyn - 1; l >= 0; l--)
       if (EigVal[l] > 0.0)
 	 for (s = 0; s < nspin; s++) {
-	    for (i = 0; i < nOrb; i++) {
-	       for (j = 0; j < nOrb; j ++)
-		  fprintf (EPH, " % .15e",
-			   Meph[idx3d(i,j,l*nspin+s,nOrb,nOrb)]);
+	    if (EPH != NULL) {
+	       for (i = 0; i < nOrb; i++) {
+		  for (j = 0; j < nOrb; j ++)
+		     fprintf (EPH, " % .15e",
+			      Meph[idx3d(i,j,l*nspin+s,nOrb,nOrb)]);
+		  fprintf (EPH, "\n");
+	       }
 	       fprintf (EPH, "\n");
 	    }
-	    fprintf (EPH, "\n");
-	    fwrite (&(Meph[idx3d(0,0,l*nspin+s,nOrb,nOrb)]),
-		    sizeof(double), nOrb*nOrb, EPHb);
+	    if (EPHb != NULL)
+	       fwrite (&(Meph[idx3d(0,0,l*nspin+s,nOrb,nOrb)]),
+		       sizeof(double), nOrb*nOrb, EPHb);
 	 }
 
    /* /\* for (l = 0; l < 3 * nDyn; l++) *\/ */
@@ -1101,70 +2969,870 @@ static void ephOut (double *EigVal, double *Meph)
    /* 	 fprintf (EPH, "\n"); */
    /*    } */
 
-   /* Closes the file. */
-   CHECKfclose (fclose (EPH), ephFile);
-   CHECKfclose (fclose (EPHb), ephFileB);
-   printf ("ok!\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
+   /* Closes the files. */
+   info = VIB_SUCCESS;
+   if (EPH != NULL)
+      info = CHECKfclose (fclose (EPH), ephFile);
+   if (EPHb != NULL && CHECKfclose (fclose (EPHb), ephFileB) != VIB_SUCCESS)
+      info = VIB_ERR_FILE;
+
+   /* Writes the text file in the fast format. */
+   if (info == VIB_SUCCESS && ctx->mephText == MEPH_TEXT_FAST)
+      info = MEPHwriteText (ephFile, nspin, nDyn, nOrb, firstOrb,
+			    EigVal, Meph);
+
+   /* Writes the indexed binary file (version 2). */
+   if (info == VIB_SUCCESS && ctx->bMeph != 1)
+      info = MEPHwrite (ephFileB, nspin, nDyn, nOrb, firstOrb, EigVal, Meph,
+			ctx->bMephSum, ctx->mephTol, ctx->mephRelTol);
+   if (info == VIB_SUCCESS) {
+      if (ctx->mephText != MEPH_TEXT_OFF)
+	 TIMEfile (ctx, "ephOut", ephFile, 1);
+      TIMEfile (ctx, "ephOut", ephFileB, 1);
+      LOGinfo (ctx, "ok!\n");
+   }
+   LOGinfo (ctx, "    output took %.2f s\n", UTILwallTime () - time);
+   LOGflush (ctx);
 
    /* Frees memory. */
-   free (ephFile);
-   free (ephFileB);
+   CHECKfree (ephFile);
+   CHECKfree (ephFileB);
+
+   return info;
 
 } /* ephOut */
 
 
+/* ********************************************************* */
+/* Reports the truncation error of the coupling matrices     */
+/* 'Meph' computed on the active region: computes them again */
+/* on the full basis (without checkpoints nor cache) and     */
+/* logs the largest and the relative Frobenius differences   */
+/* over the modes with positive energies.                    */
+static int activeError (vib_context *ctx, double *EigVec, double *EigVal,
+			double *Meph)
+{
+   register int i, b;
+   int no_u, nspin, nOrb, nB, nAct, orbShift, len, worst, info;
+   int *actIdx;
+   double d, r, dmax, rmax, dnorm, rnorm, dtot, rtot, rel, relMax;
+   double *H0, *S0, *dH, *dStot, *Mref;
+   char *chkDir, *HSfile;
+
+   /* Full basis, without checkpoints. */
+   actIdx = ctx->actIdx;
+   nAct = ctx->nAct;
+   orbShift = ctx->orbShift;
+   chkDir = ctx->chkDir;
+   ctx->actIdx = NULL;
+   ctx->nAct = no_u = ctx->no_u;
+   ctx->orbShift = 0;
+   ctx->chkDir = NULL;
+   nspin = ctx->nspin;
+   nOrb = ctx->orbIdx[ctx->FClast] - ctx->orbIdx[ctx->FCfirst - 1];
+   nB = 3 * ctx->nDyn * nspin;
+
+   /* Allocates memory. */
+   len = strlen (ctx->FCdir) + strlen (ctx->sysLabel);
+   HSfile = CHECKmalloc ((len + 16) * sizeof (char));
+   H0 = UTILdoubleVector ((size_t) nspin * no_u * no_u);
+   S0 = UTILdoubleVector (no_u * no_u);
+   dH = UTILdoubleVector ((size_t) 3 * ctx->nDyn * nspin * no_u * no_u);
+   dStot = UTILdoubleVector ((size_t) 3 * no_u * no_u);
+   Mref = UTILdoubleVector ((size_t) nOrb * nOrb * nB);
+   info = VIB_SUCCESS;
+   if (HSfile == NULL || H0 == NULL || S0 == NULL || dH == NULL ||
+       dStot == NULL || Mref == NULL)
+      info = VIB_ERR_MEMORY;
+
+   /* Same stages as 'PHONephCoupling'. */
+   LOGinfo (ctx, "\n Reference on the full basis (%d orbitals):\n\n", no_u);
+   LOGflush (ctx);
+   if (info == VIB_SUCCESS) {
+      sprintf (HSfile, "%s%s_%.3d.gHS", ctx->FCdir, ctx->sysLabel, 0);
+      info = readHSfile (ctx, HSfile, H0, S0, 0);
+   }
+   if (info == VIB_SUCCESS)
+      info = deltaH (ctx, dH, S0, NULL);
+   if (info == VIB_SUCCESS)
+      info = deltaS (ctx, dStot);
+   if (info == VIB_SUCCESS)
+      info = dHCorrection (ctx, dH, H0, S0, dStot, NULL);
+   if (info == VIB_SUCCESS && ctx->sym != NULL)
+      info = SYMMrebuildDH (ctx, dH);
+   if (info == VIB_SUCCESS)
+      eph (ctx, EigVec, EigVal, dH, Mref, NULL, NULL, NULL, NULL);
+
+   /* Restores the active region. */
+   ctx->actIdx = actIdx;
+   ctx->nAct = nAct;
+   ctx->orbShift = orbShift;
+   ctx->chkDir = chkDir;
+
+   /* Differences of the blocks (mode 'b/nspin', spin 'b%nspin'). */
+   if (info == VIB_SUCCESS) {
+      dmax = rmax = dtot = rtot = relMax = 0.0;
+      worst = -1;
+      for (b = 0; b < nB; b++) {
+	 if (EigVal[b/nspin] <= 0.0)
+	    continue ;
+	 dnorm = rnorm = 0.0;
+	 for (i = 0; i < nOrb * nOrb; i++) {
+	    r = Mref[(size_t) b*nOrb*nOrb+i];
+	    d = fabs (Meph[(size_t) b*nOrb*nOrb+i] - r);
+	    dnorm += d * d;
+	    rnorm += r * r;
+	    if (d > dmax)
+	       dmax = d;
+	    if (fabs (r) > rmax)
+	       rmax = fabs (r);
+	 }
+	 dtot += dnorm;
+	 rtot += rnorm;
+	 rel = (rnorm > 0.0 ? sqrt (dnorm / rnorm) : 0.0);
+	 if (worst < 0 || rel > relMax) {
+	    relMax = rel;
+	    worst = b;
+	 }
+      }
+      LOGinfo (ctx, "\n Truncation error of the active region (%d of %d"
+	       " orbitals):\n\n", nAct, no_u);
+      LOGinfo (ctx, "    largest difference:\t\t\t% .5e (% .3e of the"
+	       " largest element)\n", dmax, rmax > 0.0 ? dmax / rmax : 0.0);
+      LOGinfo (ctx, "    relative Frobenius difference:\t\t% .5e\n",
+	       rtot > 0.0 ? sqrt (dtot / rtot) : 0.0);
+      if (worst >= 0)
+	 LOGinfo (ctx, "    worst mode (spin):\t\t\t%d (%d), % .5e\n",
+		  worst / nspin + 1, worst % nspin + 1, relMax);
+      LOGinfo (ctx, "\n");
+      LOGflush (ctx);
+   }
+
+   /* Frees memory. */
+   CHECKfree (HSfile);
+   CHECKfree (H0);
+   CHECKfree (S0);
+   CHECKfree (dH);
+   CHECKfree (dStot);
+   CHECKfree (Mref);
+
+   return info;
+
+} /* activeError */
+
+
 /* ********************************************************* */
 /* Computes the electron-phonon coupling matrices.           */
-void PHONephCoupling (double *EigVec, double *EigVal, double *Meph)
+int PHONephCoupling (vib_context *ctx, double *EigVec,
+		     double *EigVal, double *Meph)
 {
    register int len;
-   double *H0, *S0, *dH;
+   int no_u, nspin, done, nOrb, firstOrb, info;
+   int *lo, *hi;
+   unsigned long long *key;
+   double *H0, *S0, *dH, *dStot, *sub;
    char *HSfile;
+   modesum *sum;
+
+   /* Requires a previous 'full' call to 'PHONreadFCfdf'. */
+   if (ctx == NULL || ctx->orbIdx == NULL || ctx->ef == NULL)
+      return VIB_ERR_INPUT;
+   no_u = ctx->nAct; /* dense matrices (active region) */
+   nspin = ctx->nspin;
 
    /* Sets the '.only(X)' file name with 'FCdir' path. */
-   len = strlen (FCdir);
-   len = len + strlen (sysLabel);
-   HSfile = CHECKmalloc ((len + 9) * sizeof (char));
-
-   /* Reads 'H0' and 'S0' matrices (non-displaced system). */
-   printf ("\n 'H0' and 'S0' matrices (non-displaced system):\n\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
-   H0 = UTILdoubleVector (nspin * no_u * no_u);
+   len = strlen (ctx->FCdir);
+   len = len + strlen (ctx->sysLabel);
+   HSfile = CHECKmalloc ((len + 16) * sizeof (char));
+
+   /* Allocates memory. */
+   H0 = UTILdoubleVector ((size_t) nspin * no_u * no_u);
    S0 = UTILdoubleVector (no_u * no_u);
-   HSfile[0] = '\0';
-   sprintf (HSfile, "%s%s_%.3d.gHS", FCdir, sysLabel, 0);
-   readHSfile (HSfile, H0, S0, 0);
+   dH = UTILdoubleVector ((size_t) 3 * ctx->nDyn * nspin * no_u * no_u);
+   key = NULL;
+   if (ctx->cacheDir != NULL)
+      key = CHECKmalloc (3 * ctx->nDyn * sizeof (unsigned long long));
+   if (HSfile == NULL || H0 == NULL || S0 == NULL || dH == NULL ||
+       (ctx->cacheDir != NULL && key == NULL)) {
+      CHECKfree (H0);
+      CHECKfree (S0);
+      CHECKfree (dH);
+      CHECKfree (key);
+      CHECKfree (HSfile);
+      return VIB_ERR_MEMORY;
+   }
+   dStot = NULL;
+   done = 0;
+
+   /* Reads the corrected 'dH' from a previous run checkpoint. */
+   if (ctx->chkDir != NULL) {
+      info = CKPTopen (ctx);
+      if (info == VIB_SUCCESS && CKPTdone (ctx, "dHcorr", -1) &&
+	  CKPTload (ctx, "dHcorr", -1, dH,
+		    (size_t) 3 * ctx->nDyn * nspin * no_u * no_u)
+	  == VIB_SUCCESS) {
+	 LOGinfo (ctx, "\n Corrected 'dH' read from checkpoint at %s.\n",
+		  ctx->chkDir);
+	 LOGflush (ctx);
+	 done = 1;
+      }
+   }
+   else
+      info = VIB_SUCCESS;
+
+   /* Reads 'H0' and 'S0' matrices (non-displaced system, also */
+   /* needed by the projection onto the 'H0' eigenstates).      */
+   if (info == VIB_SUCCESS && (!done || ctx->project)) {
+      LOGinfo (ctx,
+	       "\n 'H0' and 'S0' matrices (non-displaced system):\n\n");
+      LOGflush (ctx);
+      sprintf (HSfile, "%s%s_%.3d.gHS", ctx->FCdir, ctx->sysLabel, 0);
+      info = readHSfile (ctx, HSfile, H0, S0, 0);
+   }
 
    /* Computes 'dH={H(Q)-(ef(Q)-ef0)*S0-[H(-Q)-(ef(-Q)-ef0)*S0]}/2Q'. */
-   printf ("\n 'H' matrix derivative:\n\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
-   dH = UTILdoubleVector (3 * nDyn * nspin * no_u * no_u);
-   deltaH (dH, S0);
+   if (info == VIB_SUCCESS && !done) {
+      LOGinfo (ctx, "\n 'H' matrix derivative:\n\n");
+      LOGflush (ctx);
+      TIMEstart (ctx, "deltaH");
+      info = deltaH (ctx, dH, S0, key);
+      TIMEstop (ctx, "deltaH");
+   }
 
    /* Applies a correction due to the change in basis orbitals with */
    /* displacements: 'dH = dH - dS * S^-1 * H0 - H0 * S^-1 * dS'.   */
-   printf ("\n 'dH' correction due to the changes in basis orbitals:");
-   printf ("\n\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
-   dHCorrection (dH, H0, S0);
+   if (info == VIB_SUCCESS && !done) {
+      LOGinfo (ctx,
+	       "\n 'dH' correction due to the changes in basis orbitals:");
+      LOGinfo (ctx, "\n\n");
+      LOGflush (ctx);
+
+      /* Computes 'dS = [ <i|j(Q)> - <i|j(-Q)> ] / 2Q'. */
+      dStot = UTILdoubleVector ((size_t) 3 * no_u * no_u);
+      if (dStot == NULL)
+	 info = VIB_ERR_MEMORY;
+      else {
+	 TIMEstart (ctx, "deltaS");
+	 info = deltaS (ctx, dStot);
+	 TIMEstop (ctx, "deltaS");
+      }
+      if (info == VIB_SUCCESS) {
+	 TIMEstart (ctx, "dHCorrection");
+	 info = dHCorrection (ctx, dH, H0, S0, dStot, key);
+	 TIMEstop (ctx, "dHCorrection");
+      }
+
+      /* Rebuilds the 'dH' of the symmetry-equivalent atoms. */
+      if (info == VIB_SUCCESS && ctx->sym != NULL) {
+	 TIMEstart (ctx, "symmetry");
+	 info = SYMMrebuildDH (ctx, dH);
+	 TIMEstop (ctx, "symmetry");
+      }
+
+      /* Checkpoints the corrected 'dH'. */
+      if (info == VIB_SUCCESS && ctx->chkDir != NULL)
+	 info = CKPTsave (ctx, "dHcorr", -1, dH,
+			  (size_t) 3 * ctx->nDyn * nspin * no_u * no_u);
+   }
 
    /* Computes the electron-phonon coupling matrices. */
-   printf ("\n Computes electron-phonon coupling matrix.\n\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
-   eph (EigVec, EigVal, dH, Meph);
+   if (info == VIB_SUCCESS) {
+      LOGinfo (ctx, "\n Computes electron-phonon coupling matrix.\n\n");
+      LOGflush (ctx);
+      sum = NULL;
+      sub = NULL;
+      lo = hi = NULL;
+      if (ctx->mephSummary) {
+	 sum = CHECKmalloc (3 * ctx->nDyn * nspin * sizeof (modesum));
+	 sub = UTILdoubleVector (3 * ctx->nDyn * nspin * ctx->nSubsets + 1);
+	 lo = CHECKmalloc ((2 * ctx->nSubsets + 1) * sizeof (int));
+	 if (sum == NULL || sub == NULL || lo == NULL)
+	    info = VIB_ERR_MEMORY;
+	 else {
+	    hi = lo + ctx->nSubsets;
+	    info = subsetOrbitals (ctx, lo, hi);
+	 }
+      }
+      if (info == VIB_SUCCESS) {
+	 TIMEstart (ctx, "eph");
+	 eph (ctx, EigVec, EigVal, dH, Meph, sum, sub, lo, hi);
+	 TIMEstop (ctx, "eph");
+      }
+
+      /* Truncation error of the active region (on demand). */
+      if (info == VIB_SUCCESS && ctx->activeCheck && ctx->actIdx != NULL) {
+	 TIMEstart (ctx, "activeCheck");
+	 info = activeError (ctx, EigVec, EigVal, Meph);
+	 TIMEstop (ctx, "activeCheck");
+      }
 
-   /* Outputs the electron-phonon coupling matrices. */
-   ephOut (EigVal, Meph);
+      /* Outputs the per-mode summaries (at the orbitals basis). */
+      if (info == VIB_SUCCESS && ctx->mephSummary)
+	 info = summaryOut (ctx, EigVal, sum, sub);
+      CHECKfree (sum);
+      CHECKfree (sub);
+      CHECKfree (lo);
+
+      /* Projects them onto the 'H0' eigenstates near 'E_F'. */
+      nOrb = ctx->orbIdx[ctx->FClast] - ctx->orbIdx[ctx->FCfirst - 1];
+      firstOrb = ctx->orbIdx[ctx->FCfirst - 1] + 1;
+      if (info == VIB_SUCCESS && ctx->project) {
+	 LOGinfo (ctx, " Projection onto the 'H0' eigenstates:\n\n");
+	 TIMEstart (ctx, "project");
+	 info = projectMeph (ctx, H0, S0, Meph, &nOrb, &firstOrb);
+	 TIMEstop (ctx, "project");
+      }
+
+      /* Outputs the electron-phonon coupling matrices. */
+      if (info == VIB_SUCCESS) {
+	 TIMEstart (ctx, "ephOut");
+	 info = ephOut (ctx, EigVal, Meph, nOrb, firstOrb);
+	 TIMEstop (ctx, "ephOut");
+      }
+   }
 
    /* Frees memory. */
-   free (H0);
-   free (S0);
-   free (dH);
-   free (HSfile);
+   CHECKfree (H0);
+   CHECKfree (S0);
+   CHECKfree (dH);
+   CHECKfree (dStot);
+   CHECKfree (key);
+   CHECKfree (HSfile);
+
+   return info;
 
 } /* PHONephCoupling */
 
 
-/* ************************ Drafts ************************* */
+/**  ****************** Watch interface *******************  **/
+
+/* ********************************************************* */
+/* Reads the Fermi energies of the dynamic atom 'atom' from  */
+/* the '.ef' file of its own run at 'dir'. Each value goes   */
+/* through the format of the concatenated '.ef' written by   */
+/* 'setInput.sh', so that the 'dH' cache keys are the same.  */
+static int watchFermi (vib_context *ctx, const char *dir, int atom)
+{
+   register int i, j;
+   int info = VIB_SUCCESS;
+   double ef;
+   char *efFile, value[64];
+   FILE *EF;
+
+   efFile = CHECKmalloc ((strlen (dir) + strlen (ctx->sysLabel) + 4)
+			 * sizeof (char));
+   if (efFile == NULL)
+      return VIB_ERR_MEMORY;
+   sprintf (efFile, "%s%s.ef", dir, ctx->sysLabel);
+   EF = CHECKfopen (efFile, "r");
+   if (EF == NULL) {
+      CHECKfree (efFile);
+      return VIB_ERR_FILE;
+   }
+
+   /* Non-displaced system and the 6 displacements of 'atom'. */
+   j = 6 * (atom - ctx->FCfirst);
+   for (i = 0; i < 7 && info == VIB_SUCCESS; i++) {
+      info = CHECKfscanf (fscanf (EF, "%*d %lf", &ef), efFile);
+      if (info == VIB_SUCCESS && i > 0) {
+	 sprintf (value, "% .14f", ef);
+	 ctx->ef[j+i] = strtod (value, NULL);
+      }
+   }
+
+   /* Closes the file. */
+   if (info == VIB_SUCCESS)
+      info = CHECKfclose (fclose (EF), efFile);
+   else
+      fclose (EF);
+
+   /* Frees memory. */
+   CHECKfree (efFile);
+
+   return info;
+
+} /* watchFermi */
+
+
+/* ********************************************************* */
+/* Reads the orbital indexes and 'S0' from the run of the    */
+/* first dynamic atom at 'dir' (the files copied to the FC   */
+/* directory by 'setInput.sh'), keeping 'S0' at 'ctx->S0'.    */
+static int watchSetup (vib_context *ctx, const char *dir)
+{
+   int no_u, info;
+   double *H0;
+   char *HSfile;
+
+   info = readOrbitalIndex (ctx, dir);
+   if (info != VIB_SUCCESS)
+      return info;
+   ctx->no_u = ctx->nAct = no_u = ctx->orbIdx[ctx->nAtoms];
+
+   /* Allocates memory. */
+   ctx->ef = UTILdoubleVector (6 * ctx->nDyn + 1);
+   ctx->S0 = UTILdoubleVector (no_u * no_u);
+   H0 = UTILdoubleVector ((size_t) ctx->nspin * no_u * no_u);
+   HSfile = CHECKmalloc ((strlen (dir) + strlen (ctx->sysLabel) + 16)
+			 * sizeof (char));
+   if (ctx->ef == NULL || ctx->S0 == NULL || H0 == NULL || HSfile == NULL)
+      info = VIB_ERR_MEMORY;
+
+   /* Non-displaced overlap. */
+   if (info == VIB_SUCCESS) {
+      sprintf (HSfile, "%s%s_%.3d.gHS", dir, ctx->sysLabel, 0);
+      info = readHSfile (ctx, HSfile, H0, ctx->S0, 0);
+   }
+
+   /* Frees memory. */
+   CHECKfree (H0);
+   CHECKfree (HSfile);
+
+   return info;
+
+} /* watchSetup */
+
+
+/* ********************************************************* */
+/* Computes the raw 'dH' of the dynamic atom 'atom' as soon  */
+/* as its own run (split FC layout, at '[FC directory]FC     */
+/* [atom]/') is complete, and stores it at the 'dH' cache.   */
+/* The final 'splitFC' run then reads all the displacement   */
+/* pairs from the cache. Requires a previous call to         */
+/* 'PHONreadFCfdf' and a cache ('PHONsetCache'); the first   */
+/* call reads 'S0' from the run of the first dynamic atom,   */
+/* which must be complete.                                   */
+int PHONwatchAtom (vib_context *ctx, int atom)
+{
+   register int p, k;
+   int no_u, nspin, info;
+   unsigned long long hS0, key;
+   double *Hm, *Hp, *S, *dHk;
+   char *dir, *Hfile;
+
+   if (ctx == NULL || ctx->FCdir == NULL || ctx->cacheDir == NULL ||
+       atom < ctx->FCfirst || atom > ctx->FClast)
+      return VIB_ERR_INPUT;
+
+   /* Directory of the first dynamic atom (and of 'atom'). */
+   dir = CHECKmalloc ((strlen (ctx->FCdir) + 16) * sizeof (char));
+   if (dir == NULL)
+      return VIB_ERR_MEMORY;
+   info = VIB_SUCCESS;
+   if (ctx->S0 == NULL) {
+      sprintf (dir, "%sFC%d/", ctx->FCdir, ctx->FCfirst);
+      info = watchSetup (ctx, dir);
+   }
+   sprintf (dir, "%sFC%d/", ctx->FCdir, atom);
+   if (info == VIB_SUCCESS)
+      info = watchFermi (ctx, dir, atom);
+   if (info != VIB_SUCCESS) {
+      CHECKfree (dir);
+      return info;
+   }
+   no_u = ctx->no_u;
+   nspin = ctx->nspin;
+   TIMEstart (ctx, "watchAtom");
+
+   /* Allocates memory. */
+   Hm = UTILdoubleVector ((size_t) nspin * no_u * no_u);
+   Hp = UTILdoubleVector ((size_t) nspin * no_u * no_u);
+   dHk = UTILdoubleVector ((size_t) nspin * no_u * no_u);
+   S = CHECKmalloc (no_u * no_u * sizeof (double));
+   Hfile = CHECKmalloc ((strlen (dir) + strlen (ctx->sysLabel) + 16)
+			* sizeof (char));
+   if (Hm == NULL || Hp == NULL || dHk == NULL || S == NULL || Hfile == NULL)
+      info = VIB_ERR_MEMORY;
+   hS0 = CKPThash (CKPT_HASH_INIT, ctx->S0, no_u * no_u * sizeof (double));
+
+   /* Pairs of displacements of 'atom' (x, y and z). */
+   for (p = 0; p < 3 && info == VIB_SUCCESS; p++) {
+      k = 3 * (atom - ctx->FCfirst) + p;
+      info = deltaHkey (ctx, k, hS0, dir, 2*p+1, Hfile, &key);
+      if (info == VIB_SUCCESS &&
+	  CKPTcacheLoad (ctx, "dH", key, dHk, (size_t) nspin * no_u * no_u)
+	  == VIB_SUCCESS) {
+	 LOGinfo (ctx, "    displacements %.3d and %.3d already at the"
+		  " cache\n", 2*k+1, 2*k+2);
+	 continue ;
+      }
+
+      /* 'H(-Q)' and 'H(Q)' */
+      if (info == VIB_SUCCESS) {
+	 sprintf (Hfile, "%s%s_%.3d.gHS", dir, ctx->sysLabel, 2*p+1);
+	 UTILresetDoubleVector ((size_t) nspin * no_u * no_u, Hm);
+	 UTILresetDoubleVector (no_u * no_u, S);
+	 info = readHSfile (ctx, Hfile, Hm, S, 2*k+1);
+      }
+      if (info == VIB_SUCCESS) {
+	 sprintf (Hfile, "%s%s_%.3d.gHS", dir, ctx->sysLabel, 2*p+2);
+	 UTILresetDoubleVector ((size_t) nspin * no_u * no_u, Hp);
+	 UTILresetDoubleVector (no_u * no_u, S);
+	 info = readHSfile (ctx, Hfile, Hp, S, 2*k+2);
+      }
+      if (info == VIB_SUCCESS) {
+	 finiteDifference (ctx, k, dHk, Hm, Hp, ctx->S0);
+	 info = CKPTcacheSave (ctx, "dH", key, dHk,
+			       (size_t) nspin * no_u * no_u);
+      }
+   }
+   TIMEstop (ctx, "watchAtom");
+
+   /* Frees memory. */
+   CHECKfree (Hfile);
+   CHECKfree (dHk);
+   CHECKfree (Hp);
+   CHECKfree (Hm);
+   CHECKfree (S);
+   CHECKfree (dir);
+
+   return info;
+
+} /* PHONwatchAtom */
 
+
+/**  **************** In-memory interface ****************  **/
+
+/* ********************************************************* */
+/* Sets up the context 'ctx' for an in-memory calculation:   */
+/* instead of writing '.gHS', '.FC', '.ef' and '.onlyS'      */
+/* files, the host code (e.g. SIESTA) hands each displaced   */
+/* system with 'PHONaddDisplacement' (and 'PHONaddOnlyS')    */
+/* and finally calls 'PHONephInMemory'. All arguments are    */
+/* pointers so it can be called from fortran:               */
+/*   label: system label;                                    */
+/*   nAtoms, nspin: number of atoms and spin polarization;   */
+/*   FCfirst, FClast: first and last dynamic atoms;          */
+/*   displ: atoms displacement (Bohr);                       */
+/*   Zdyn[nDyn]: atomic numbers of the dynamic atoms;        */
+/*   orbIndex[nAtoms+1]: first orbital index of each atom    */
+/*   (the last one is the number of orbitals 'no_u').        */
+int PHONsetSystem (vib_context *ctx, char *label, int *nAtoms,
+		   int *nspin, int *FCfirst, int *FClast, double *displ,
+		   int *Zdyn, int *orbIndex)
+{
+   register int i;
+   int nDyn, no_u;
+
+   if (ctx == NULL)
+      return VIB_ERR_INPUT;
+   resetContext (ctx);
+
+   nDyn = *FClast - *FCfirst + 1;
+   if (*nAtoms < 1 || *nspin < 1 || *nspin > 2 || *FCfirst < 1
+       || *FClast > *nAtoms || nDyn < 1 || *displ <= 0.0)
+      return VIB_ERR_INPUT;
+   for (i = 0; i < nDyn; i++)
+      if (Zdyn[i] < 1 || Zdyn[i] > 94)
+	 return VIB_ERR_INPUT;
+
+   /* Assigns the context variables. */
+   snprintf (ctx->sysLabel, sizeof (ctx->sysLabel), "%s", label);
+   ctx->calcType = 1;
+   ctx->nAtoms = *nAtoms;
+   ctx->nspin = *nspin;
+   ctx->FCfirst = *FCfirst;
+   ctx->FClast = *FClast;
+   ctx->nDyn = nDyn;
+   ctx->FCdispl = bohr2ang * (*displ);
+   ctx->workDir = CHECKmalloc (3 * sizeof (char));
+   ctx->FCdir = CHECKmalloc (3 * sizeof (char));
+   ctx->dynAtoms = CHECKmalloc (nDyn * sizeof (element));
+   ctx->orbIdx = CHECKmalloc ((*nAtoms + 1) * sizeof (int));
+   ctx->ef = UTILdoubleVector (6 * nDyn + 1);
+   ctx->received = UTILintVector (6 * nDyn + 1 + 6);
+   if (ctx->workDir == NULL || ctx->FCdir == NULL || ctx->dynAtoms == NULL
+       || ctx->orbIdx == NULL || ctx->ef == NULL || ctx->received == NULL) {
+      resetContext (ctx);
+      return VIB_ERR_MEMORY;
+   }
+   strcpy (ctx->workDir, "./");
+   strcpy (ctx->FCdir, "./");
+   for (i = 0; i < nDyn; i++) {
+      ctx->dynAtoms[i].id = *FCfirst + i;
+      ctx->dynAtoms[i].atom.Z = Zdyn[i];
+      ctx->dynAtoms[i].atom.A = periodicTable[Zdyn[i]].A;
+   }
+   for (i = 0; i < *nAtoms + 1; i++)
+      ctx->orbIdx[i] = orbIndex[i];
+   no_u = ctx->no_u = ctx->nAct = orbIndex[*nAtoms];
+
+   /* Allocates the accumulators. */
+   ctx->H0 = UTILdoubleVector ((size_t) *nspin * no_u * no_u);
+   ctx->S0 = UTILdoubleVector (no_u * no_u);
+   ctx->dH = UTILdoubleVector ((size_t) 3 * nDyn * (*nspin) * no_u * no_u);
+   ctx->dS = UTILdoubleVector ((size_t) 3 * no_u * no_u);
+   ctx->fullFCneg = UTILdoubleVector (3 * (*nAtoms) * 3 * nDyn);
+   ctx->fullFCpos = UTILdoubleVector (3 * (*nAtoms) * 3 * nDyn);
+   if (ctx->H0 == NULL || ctx->S0 == NULL || ctx->dH == NULL
+       || ctx->dS == NULL || ctx->fullFCneg == NULL
+       || ctx->fullFCpos == NULL) {
+      resetContext (ctx);
+      return VIB_ERR_MEMORY;
+   }
+
+   return VIB_SUCCESS;
+
+} /* PHONsetSystem */
+
+
+/* ********************************************************* */
+/* Checks that the column indexes of a SIESTA sparse matrix  */
+/* with 'nrows' rows ('numh' and 'listh') are valid.         */
+static int checkSparse (int nrows, int *numh, int *listh)
+{
+   register int i, j, k;
+
+   for (i = 0, k = 0; i < nrows; i++) {
+      if (numh[i] < 0)
+	 return VIB_ERR_INPUT;
+      for (j = 0; j < numh[i]; j++, k++)
+	 if (listh[k] < 1)
+	    return VIB_ERR_INPUT;
+   }
+
+   return VIB_SUCCESS;
+
+} /* checkSparse */
+
+
+/* ********************************************************* */
+/* Accumulates the data from the displacement 'disp' (with   */
+/* the same numbering of the '.gHS' files: 0 for the         */
+/* non-displaced system, '2k+1' and '2k+2' for the negative  */
+/* and positive displacements along the coordinate 'k'):     */
+/*   numh, listh: SIESTA sparse pattern of 'H' and 'S';      */
+/*   H[nspin*nnz]: Hamiltonian in sparse form (Ry);          */
+/*   S[nnz]: overlap in sparse form;                         */
+/*   forces[3*nAtoms]: atomic forces (Ry/Bohr);              */
+/*   Ef: Fermi energy (Ry).                                  */
+/* Displacements may be given in any order. A repeated       */
+/* non-displaced system replaces the previous one, while a   */
+/* repeated displacement is rejected ('VIB_ERR_INPUT', its   */
+/* contribution is already at 'dH').                         */
+int PHONaddDisplacement (vib_context *ctx, int *disp, int *numh,
+			 int *listh, double *H, double *S,
+			 double *forces, double *Ef)
+{
+   register int i, j, k, s, foo;
+   int no_u, nspin, nnz, h, coord;
+   double sign, efermi, *fullFC;
+
+   if (ctx == NULL || ctx->received == NULL || *disp < 0
+       || *disp > 6 * ctx->nDyn)
+      return VIB_ERR_INPUT;
+   no_u = ctx->no_u;
+   nspin = ctx->nspin;
+   if (checkSparse (no_u, numh, listh) != VIB_SUCCESS)
+      return VIB_ERR_INPUT;
+
+   /* Checks for a repeated displacement before storing anything. */
+   if (*disp > 0 && ctx->received[*disp])
+      return VIB_ERR_INPUT;
+   efermi = ctx->ef[*disp] = rydberg2eV * (*Ef);
+
+   /* Non-displaced system: dense 'H0' and 'S0'. */
+   if (*disp == 0) {
+      UTILresetDoubleVector ((size_t) nspin * no_u * no_u, ctx->H0);
+      UTILresetDoubleVector (no_u * no_u, ctx->S0);
+      denseHS (ctx, numh, listh, H, S, ctx->H0, ctx->S0, efermi);
+      ctx->received[0] = 1;
+      return VIB_SUCCESS;
+   }
+
+   /* Each displacement contributes with '+-[H(+-Q)-ef(+-Q)S(+-Q)]/2Q' */
+   /* to 'dH' (the '[ef(Q)-ef(-Q)]*S0' term is added at the end).     */
+   coord = (*disp - 1) / 2;
+   sign = (*disp % 2 == 1 ? -1.0 : 1.0);
+   for (i = 0, nnz = 0; i < no_u; i++)
+      nnz += numh[i];
+   for (s = 0; s < nspin; s++) {
+      h = coord * nspin + s;
+      for (i = 0, k = 0; i < no_u; i++)
+	 for (j = 0; j < numh[i]; j++, k++) {
+	    foo = (listh[k] - 1) % no_u; /* column index */
+	    ctx->dH[idx3d(i,foo,h,no_u,no_u)] += sign
+	       * (rydberg2eV * H[s*nnz+k] - efermi * S[k])
+	       / (2.0 * ctx->FCdispl);
+	 }
+   }
+
+   /* Force by displacement [eV/Ang^2], as at the SIESTA '.FC' file. */
+   fullFC = (sign < 0.0 ? ctx->fullFCneg : ctx->fullFCpos);
+   for (i = 0; i < 3 * ctx->nAtoms; i++)
+      fullFC[idx(i,coord,3*ctx->nAtoms)] = - sign * forces[i]
+	 * (rydberg2eV / bohr2ang) / ctx->FCdispl;
+
+   ctx->received[*disp] = 1;
+
+   return VIB_SUCCESS;
+
+} /* PHONaddDisplacement */
+
+
+/* ********************************************************* */
+/* Accumulates the overlap matrix 'S' (SIESTA sparse form    */
+/* 'numh' and 'listh' of the doubled system with '2*no_u'    */
+/* orbitals) from the 'onlyS' run 'disp' (1 to 6, as the     */
+/* '.onlyS' files: -x, +x, -y, +y, -z, +z).                  */
+int PHONaddOnlyS (vib_context *ctx, int *disp, int *numh,
+		  int *listh, double *S)
+{
+   register int i;
+   int no_u, coord;
+   double sign, *Sbig, *Spick;
+
+   if (ctx == NULL || ctx->received == NULL || *disp < 1 || *disp > 6
+       || ctx->received[6*ctx->nDyn+*disp])
+      return VIB_ERR_INPUT;
+   no_u = ctx->no_u;
+   if (checkSparse (2 * no_u, numh, listh) != VIB_SUCCESS)
+      return VIB_ERR_INPUT;
+
+   Sbig = UTILdoubleVector ((size_t) 2 * no_u * 2 * no_u);
+   Spick = CHECKmalloc (no_u * no_u * sizeof (double));
+   if (Sbig == NULL || Spick == NULL) {
+      CHECKfree (Sbig);
+      CHECKfree (Spick);
+      return VIB_ERR_MEMORY;
+   }
+
+   /* 'dS = [ <i|j(Q)> - <i|j(-Q)> ] / 2Q' */
+   pickOnlyS (ctx, numh, listh, S, Sbig, Spick);
+   coord = (*disp - 1) / 2;
+   sign = (*disp % 2 == 1 ? -1.0 : 1.0);
+   for (i = 0; i < no_u * no_u; i++)
+      ctx->dS[idx(i,coord,no_u*no_u)] +=
+	 sign * Spick[i] / (2.0 * ctx->FCdispl);
+   ctx->received[6*ctx->nDyn+*disp] = 1;
+
+   CHECKfree (Sbig);
+   CHECKfree (Spick);
+
+   return VIB_SUCCESS;
+
+} /* PHONaddOnlyS */
+
+
+/* ********************************************************* */
+/* Having received all the displacements (and 'onlyS' runs), */
+/* computes the phonon modes ('EigVec') and energies         */
+/* ('EigVal') and the electron-phonon coupling matrices      */
+/* ('Meph', with the same layout of 'PHONephCoupling'). The  */
+/* accumulated data is released, so it can be called once.  */
+int PHONephInMemory (vib_context *ctx, double *EigVec,
+		     double *EigVal, double *Meph)
+{
+   register int i, k;
+   int no_u, nspin, nOrb, info;
+   double def;
+
+   if (ctx == NULL || ctx->received == NULL)
+      return VIB_ERR_INPUT;
+   no_u = ctx->no_u;
+   nspin = ctx->nspin;
+
+   /* Checks that nothing is missing. */
+   for (i = 0; i < 6 * ctx->nDyn + 1 + 6; i++)
+      if (!ctx->received[i]) {
+	 fprintf (stderr, "\n ERROR: missing %s %d!\n\n",
+		  i <= 6 * ctx->nDyn ? "displacement" : "onlyS run",
+		  i <= 6 * ctx->nDyn ? i : i - 6 * ctx->nDyn);
+	 return VIB_ERR_INPUT;
+      }
+
+   /* Computes phonon frequencies and modes. */
+   info = phononModes (ctx, ctx->fullFCneg, ctx->fullFCpos, EigVec, EigVal);
+   if (info != VIB_SUCCESS)
+      return info;
+
+   /* Adds the '- [ef(Q)-ef(-Q)]*S0 / 2Q' term to 'dH'. */
+   for (k = 0; k < 3 * ctx->nDyn; k++) {
+      def = (ctx->ef[2*k+2] - ctx->ef[2*k+1]) / (2.0 * ctx->FCdispl);
+      KERNtable()->fermiShift (no_u * no_u, nspin,
+			       &ctx->dH[idx(0,k*nspin,no_u*no_u)], ctx->S0, def);
+   }
+
+   /* Applies the correction due to the changes in basis orbitals. */
+   LOGinfo (ctx,
+	    "\n 'dH' correction due to the changes in basis orbitals:");
+   LOGinfo (ctx, "\n");
+   TIMEstart (ctx, "dHCorrection");
+   info = dHCorrection (ctx, ctx->dH, ctx->H0, ctx->S0, ctx->dS, NULL);
+   TIMEstop (ctx, "dHCorrection");
+   if (info != VIB_SUCCESS)
+      return info;
+
+   /* Computes the electron-phonon coupling matrices (accumulated */
+   /* by 'eph', so the host array is reset first).                 */
+   LOGinfo (ctx, "\n Computes electron-phonon coupling matrix.\n\n");
+   LOGflush (ctx);
+   nOrb = ctx->orbIdx[ctx->FClast] - ctx->orbIdx[ctx->FCfirst-1];
+   UTILresetDoubleVector ((size_t) 3 * ctx->nDyn * nspin * nOrb * nOrb,
+			  Meph);
+   TIMEstart (ctx, "eph");
+   eph (ctx, EigVec, EigVal, ctx->dH, Meph, NULL, NULL, NULL, NULL);
+   TIMEstop (ctx, "eph");
+
+   /* Releases the accumulated data. */
+   CHECKfree (ctx->H0);
+   CHECKfree (ctx->S0);
+   CHECKfree (ctx->dH);
+   CHECKfree (ctx->dS);
+   CHECKfree (ctx->fullFCneg);
+   CHECKfree (ctx->fullFCpos);
+   CHECKfree (ctx->received);
+   ctx->H0 = ctx->S0 = ctx->dH = ctx->dS = NULL;
+   ctx->fullFCneg = ctx->fullFCpos = NULL;
+   ctx->received = NULL;
+
+   return VIB_SUCCESS;
+
+} /* PHONephInMemory */
+
+
+/**  ******************** Kernels ***********************  **/
+
+/* ********************************************************* */
+/* Runs once the kernel 'kernel' ('PHON_KERNEL_*' at         */
+/* 'Phonon.h') on the operands 'd', with the sizes of the    */
+/* calculation at 'ctx' (as set by 'PHONsetSystem'). The     */
+/* accumulating kernels ('SCATTER' and 'EPH') add to their   */
+/* outputs. Used by the microbenchmark 'vibbench'.           */
+int PHONkernel (vib_context *ctx, int kernel, vib_kernel_data *d)
+{
+   register int k;
+   int nspin = ctx->nspin, no_u = ctx->no_u;
+
+   switch (kernel) {
+   case PHON_KERNEL_EGGBOX:
+      rmEggBox (ctx, d->fullFC);
+      break;
+   case PHON_KERNEL_SYMM:
+      return symmetrizesAndMassScale (ctx, d->FC);
+   case PHON_KERNEL_SCATTER:
+      denseHS (ctx, d->numh, d->listh, d->Hsparse, d->Ssparse,
+	       d->H0, d->S0, d->efermi);
+      break;
+   case PHON_KERNEL_DELTAH:
+      for (k = 0; k < 3 * ctx->nDyn; k++)
+	 finiteDifference (ctx, k, &d->dH[idx3d(0,0,k*nspin,no_u,no_u)],
+			   &d->Hm[idx3d(0,0,k*nspin,no_u,no_u)],
+			   &d->Hp[idx3d(0,0,k*nspin,no_u,no_u)], d->S0);
+      break;
+   case PHON_KERNEL_DHCORR:
+      return dHCorrection (ctx, d->dH, d->H0, d->S0, d->dS, NULL);
+   case PHON_KERNEL_EPH:
+      eph (ctx, d->EigVec, d->EigVal, d->dH, d->Meph,
+	   NULL, NULL, NULL, NULL);
+      break;
+   default:
+      return VIB_ERR_INPUT;
+   }
+
+   return VIB_SUCCESS;
+
+} /* PHONkernel */
+
+
+/* ************************ Drafts ************************* */
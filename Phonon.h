@@ -19,25 +19,219 @@
 /**   calculate the electron-phonon coupling matrix.        **/
 /**  *****************************************************  **/
 
+#ifndef PHONON_H
+#define PHONON_H
 
-/* For calling from fortran prograns. */
-#ifdef FORTRAN
-#define PHONheader phonheader_
-#define PHONreadFCfdf phonreadfcfdf_
-#define PHONfreq phonfreq_
-#define PHONephCoupling phonephcoupling_
+#include <stdio.h>
+#include <signal.h>
+
+#ifdef __cplusplus
+extern "C" {
 #endif
 
+
+/* Structure for atomic number and mass. */
+typedef struct ATNMASS nmass;
+struct ATNMASS {
+   int Z; /* atomic number */
+   double A; /* atomic mass */
+};
+
+/* Structure for chemical element info. */
+typedef struct CHEMIC element;
+struct CHEMIC {
+   int id; /* number of the atom at system structure */
+   nmass atom; /* atomic number and mass */
+};
+
+/* Jmol output of the phonon modes. */
+#define JMOL_FILES 0 /* one 'xyz' file per mode */
+#define JMOL_MULTI 1 /* a single multi-frame extended 'xyz' file */
+#define JMOL_OFF   2 /* not written */
+
+/* Calculation context: owns all the state of one FC system, */
+/* so that several systems can be processed in the same      */
+/* process (or in different threads).                        */
+typedef struct VIBCONTEXT vib_context;
+struct VIBCONTEXT {
+   char *workDir; /* work directory */
+   char *FCdir; /* FC directory */
+   char sysLabel[30]; /* system label */
+   int calcType; /* calculation type (1 = full, 2 = onlyPh) */
+   int nAtoms; /* number of atoms */
+   int nspin; /* spin polarization */
+   int FCfirst; /* first dynamic atom */
+   int FClast; /* last dynamic atom */
+   int nDyn; /* number of dynamic atoms */
+   int no_u; /* number of basis orbitals from unit cell */
+   int *orbIdx; /* first orbital index of each atom. */
+   int nAct; /* orbitals of the dense matrices ('no_u' or the active) */
+   int *actIdx; /* position of each orbital at the active region */
+		/* (-1 = outside, 'NULL' = all orbitals)         */
+   int orbShift; /* dense index of a dynamic orbital = its index - it */
+   double FCdispl; /* atoms displacement */
+   double *ef; /* Fermi energy values */
+   element *dynAtoms; /* dynamic atoms chemical info */
+   FILE *out; /* stream for the run log (default 'stdout') */
+   int logLevel; /* log verbosity ('LOG_*' at 'Log.h') */
+   double logFlushed; /* wall time of the last log flush */
+   double wallStart, cpuStart; /* wall and CPU times at the creation */
+   struct VIBSTAGE *stages; /* timed stages (see 'Timing.h') */
+   int nStages; /* number of timed stages */
+   int curStage; /* innermost running stage (-1 = none) */
+   struct VIBPROGRESS *progress; /* progress of the loops ('NULL' = off) */
+   int *perfFd; /* hardware counters of the stages ('NULL' = off) */
+   char *chkDir; /* checkpoint directory ('NULL' = no checkpoints) */
+   char *cacheDir; /* 'dH' cache directory ('NULL' = no cache) */
+   double onlySwait; /* waits up to it (s) for each pair of '.onlyS' */
+		     /* files of concurrent runs (0 = no wait)       */
+   volatile sig_atomic_t *stop; /* set (e.g. by a signal handler) to */
+				/* stop at the next checkpoint       */
+   int bMeph; /* '.bMeph' format version (1 or 2, default 1) */
+   int bMephSum; /* per-block checksums at '.bMeph' version 2 */
+   int mephText; /* text '.Meph' format ('MEPH_TEXT_*' at 'Meph.h') */
+   double mephTol; /* tolerance of the sparse '.bMeph' (0 = dense) */
+   int mephRelTol; /* 'mephTol' relative to the largest element */
+   int project; /* 'Meph' projected onto the 'H0' eigenstates */
+   double projEmin, projEmax; /* energy window (eV, from 'E_F') */
+   int jmol; /* Jmol output ('JMOL_FILES', 'JMOL_MULTI' or 'JMOL_OFF') */
+   int jmolFirst, jmolLast; /* modes written (from 1, 0 = all) */
+   int jmolWindow; /* only the modes with energies in: */
+   double jmolEmin, jmolEmax; /* (eV) */
+   int mephSummary; /* per-mode coupling summaries ('.Msum') */
+   int nSubsets; /* number of atom subsets of the summaries */
+   int *subsets; /* atom ranges (first,last) of the subsets */
+   int activeShells; /* active region: atoms with orbitals within */
+		     /* these neighbour shells of the dynamic      */
+		     /* orbitals at the '.gHS' sparsity (0 = off)  */
+   double activeCutoff; /* and/or within this distance (Ang) of a */
+			/* dynamic atom at the '.xyz' (0 = off)   */
+   int activeCheck; /* truncation error against the full basis */
+   char *symOps; /* symmetry operations: "auto" (detected at the */
+		 /* '.xyz'), a file, or 'NULL' (off)             */
+   struct VIBSYMMETRY *sym; /* symmetry of the system ('Symmetry.h') */
+
+   /* Data accumulated by in-memory runs ('PHONsetSystem'). */
+   double *H0, *S0; /* non-displaced Hamiltonian and overlap */
+   double *dH; /* Hamiltonian derivatives (without 'ef' terms) */
+   double *dS; /* overlap derivatives (x,y,z) */
+   double *fullFCneg, *fullFCpos; /* FC matrices with all atoms */
+   int *received; /* displacements (and 'onlyS' runs) received */
+};
+
+/* Kernels of the calculation timed by the microbenchmark   */
+/* 'vibbench' (see 'PHONkernel').                           */
+#define PHON_KERNEL_EGGBOX   0 /* egg-box removal of the full FC */
+#define PHON_KERNEL_SYMM     1 /* symmetrization and mass scaling */
+#define PHON_KERNEL_SCATTER  2 /* sparse to dense 'H' and 'S' and */
+			       /* Fermi energy shift              */
+#define PHON_KERNEL_DELTAH   3 /* finite differences of 'dH' */
+#define PHON_KERNEL_DHCORR   4 /* 'dH' basis correction (GEMMs) */
+#define PHON_KERNEL_EPH      5 /* electron-phonon coupling */
+#define PHON_N_KERNELS       6
+
+/* Operands of the kernels (only those of the called kernel */
+/* are used), with the sizes of the calculation at 'ctx'.   */
+typedef struct VIBKERNELDATA vib_kernel_data;
+struct VIBKERNELDATA {
+   double *fullFC; /* FC matrix with all atoms ('3nAtoms x 3nDyn') */
+   double *FC; /* FC matrix of the dynamic atoms ('3nDyn x 3nDyn') */
+   int *numh, *listh; /* SIESTA sparse form of 'Hsparse', 'Ssparse' */
+   double *Hsparse, *Ssparse; /* sparse Hamiltonian (Ry) and overlap */
+   double efermi; /* Fermi energy (eV) */
+   double *H0, *S0; /* dense Hamiltonian (all spins) and overlap */
+   double *Hm, *Hp; /* Hamiltonians of the -Q and +Q displacements */
+   double *dH; /* Hamiltonian derivatives */
+   double *dS; /* overlap derivatives (x,y,z) */
+   double *EigVec, *EigVal; /* phonon modes and energies */
+   double *Meph; /* electron-phonon coupling matrices */
+};
+
+/* Fortran programs call the wrappers of 'Fortran.h', with the */
+/* context as a handle passed by reference.                     */
+
+/* Allocates and initializes an empty calculation context */
+/* (returns 'NULL' if there is not enough memory).        */
+vib_context *PHONnewContext ();
+
+/* Frees a calculation context and all data owned by it. */
+void PHONfreeContext (vib_context *ctx);
+
+/* Enables stage checkpoints at the directory 'dir' (created */
+/* if needed), from which an interrupted run is resumed.      */
+int PHONsetCheckpoint (vib_context *ctx, const char *dir);
+
+/* Enables the content-addressed 'dH' cache at the directory */
+/* 'dir', so that only the 'dH' columns whose inputs changed */
+/* are recomputed.                                           */
+int PHONsetCache (vib_context *ctx, const char *dir);
+
+/* Enables the per-mode coupling summaries ('.Msum' file), with */
+/* the norms over the '*nSubsets' atom ranges 'subsets' (pairs  */
+/* first,last of dynamic atoms).                                */
+int PHONsetSummary (vib_context *ctx, int *nSubsets, int *subsets);
+
+/* Enables the symmetry-reduced displacements, with the */
+/* operations 'ops' ("auto" = detected at the '.xyz', or */
+/* the name of a file, see 'Symmetry.h').                */
+int PHONsetSymmetry (vib_context *ctx, const char *ops);
+
 /* Collects required informations from FC input 'fdf' file. */
-void PHONreadFCfdf (char *exec, char *FCpath, char *FCinput,
-		    int calcType, char *FCsplit, int *nDynTot,
-		    int *nDynOrb, int *spinPol);
+int PHONreadFCfdf (vib_context *ctx, char *exec, char *FCpath,
+		   char *FCinput, int calcType, char *FCsplit,
+		   int *nDynTot, int *nDynOrb, int *spinPol);
+
+/* Estimates the peak memory (in bytes) of the calculation. */
+double PHONmemEstimate (vib_context *ctx);
 
 /* Computes phonon frequencies and modes. */
-void PHONfreq (double *EigVec, double *EigVal);
+int PHONfreq (vib_context *ctx, double *EigVec, double *EigVal);
 
 /* Writes a 'xyz' file for each computed phonon mode. */
-void PHONjmolVib (double *EigVec);
+int PHONjmolVib (vib_context *ctx, double *EigVec);
+
+/* Writes the phonon modes for Jmol as set at 'ctx->jmol', */
+/* filtered by mode index and energy window.               */
+int PHONjmolOut (vib_context *ctx, double *EigVec, double *EigVal);
 
 /* Computes electron-phonon coupling matrices. */
-void PHONephCoupling (double *EigVec, double *EigVal, double *Meph);
+int PHONephCoupling (vib_context *ctx, double *EigVec,
+		     double *EigVal, double *Meph);
+
+/* Computes the raw 'dH' of the dynamic atom 'atom' from its */
+/* own run at '[FC directory]FC[atom]/' and stores it at the */
+/* 'dH' cache (watch mode, see 'vibrations watch').          */
+int PHONwatchAtom (vib_context *ctx, int atom);
+
+/* Sets up 'ctx' for an in-memory calculation fed by the host */
+/* code (e.g. SIESTA), one displacement at a time.            */
+int PHONsetSystem (vib_context *ctx, char *label, int *nAtoms,
+		   int *nspin, int *FCfirst, int *FClast, double *displ,
+		   int *Zdyn, int *orbIndex);
+
+/* Accumulates the sparse 'H' and 'S', the forces and the Fermi */
+/* energy of the displacement 'disp' (0 = non-displaced, which  */
+/* replaces a previous call, while a repeated displacement is   */
+/* rejected with 'VIB_ERR_INPUT' and leaves 'ctx' unchanged).   */
+int PHONaddDisplacement (vib_context *ctx, int *disp, int *numh,
+			 int *listh, double *H, double *S,
+			 double *forces, double *Ef);
+
+/* Accumulates the sparse overlap of the 'onlyS' run 'disp'. */
+int PHONaddOnlyS (vib_context *ctx, int *disp, int *numh,
+		  int *listh, double *S);
+
+/* Computes phonon modes and electron-phonon coupling matrices */
+/* from the data accumulated with 'PHONaddDisplacement'.       */
+int PHONephInMemory (vib_context *ctx, double *EigVec,
+		     double *EigVal, double *Meph);
+
+/* Runs once the kernel 'kernel' ('PHON_KERNEL_*') on the */
+/* operands 'd' (for the microbenchmark 'vibbench').      */
+int PHONkernel (vib_context *ctx, int kernel, vib_kernel_data *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PHONON_H */
@@ -0,0 +1,1021 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Implementation of the symmetry-reduced displacements:  **/
+/**  detection (or reading) of the point-group operations,  **/
+/**  orbits of the dynamic atoms and rebuilding of the FC   **/
+/**  columns and 'dH' of the atoms that are not displaced.  **/
+/**  *****************************************************  **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include "Check.h"
+#include "Utils.h"
+#include "Phonon.h"
+#include "Log.h"
+#include "Symmetry.h"
+
+/* Offset of the rotation of each 'l' at the 'D' of an operation. */
+static const int dOff[SYMM_LMAX+1] = {0, 1, 10, 35};
+
+/* Gauss-Legendre nodes and weights (4 points) of the 'cos(theta)' */
+/* integrals, which with 8 equally spaced 'phi' are exact for the  */
+/* products of two harmonics up to 'l = 3'.                        */
+static const double glNode[4] = {
+   -0.86113631159405258, -0.33998104358485626,
+   0.33998104358485626, 0.86113631159405258
+};
+static const double glWeight[4] = {
+   0.34785484513745386, 0.65214515486254614,
+   0.65214515486254614, 0.34785484513745386
+};
+
+
+/* ********************************************************* */
+/* Returns the real spherical harmonic 'l', 'm' (up to its   */
+/* normalization) at the unit vector '(x,y,z)', with the     */
+/* order ('m = -l..l') and signs of the SIESTA orbitals.     */
+static double harmonic (int l, int m, double x, double y, double z)
+{
+
+   switch (l * 10 + m + l) {
+   case 0: return 1.0; /* s */
+   case 10: return y; /* p */
+   case 11: return z;
+   case 12: return x;
+   case 20: return x * y; /* d */
+   case 21: return y * z;
+   case 22: return 3.0 * z * z - 1.0;
+   case 23: return x * z;
+   case 24: return x * x - y * y;
+   case 30: return y * (3.0 * x * x - y * y); /* f */
+   case 31: return x * y * z;
+   case 32: return y * (5.0 * z * z - 1.0);
+   case 33: return z * (5.0 * z * z - 3.0);
+   case 34: return x * (5.0 * z * z - 1.0);
+   case 35: return z * (x * x - y * y);
+   case 36: return x * (x * x - 3.0 * y * y);
+   }
+
+   return 0.0;
+
+} /* harmonic */
+
+
+/* ********************************************************* */
+/* Computes at 'D' the rotations of the real spherical       */
+/* harmonics (each 'l' up to 'SYMM_LMAX') by the rotation    */
+/* 'R', 'Y(m)(R^T u) = sum_m' D(m',m) Y(m')(u)' for the      */
+/* normalized harmonics, projecting on them with a quadrature */
+/* on the sphere that is exact for their products.            */
+static void harmonicRotation (const double *R, double *D)
+{
+   register int i, j, l, m, n;
+   int d;
+   double u[3], v[3], w, st, phi, norm[2*SYMM_LMAX+1];
+   double *Dl;
+
+   for (i = 0; i < SYMM_DSIZE; i++)
+      D[i] = 0.0;
+   for (l = 0; l <= SYMM_LMAX; l++) {
+      d = 2 * l + 1;
+      Dl = &D[dOff[l]];
+      for (m = 0; m < d; m++)
+	 norm[m] = 0.0;
+      for (i = 0; i < 4; i++)
+	 for (j = 0; j < 8; j++) {
+	    phi = 2.0 * M_PI * j / 8.0;
+	    st = sqrt (1.0 - glNode[i] * glNode[i]);
+	    u[0] = st * cos (phi);
+	    u[1] = st * sin (phi);
+	    u[2] = glNode[i];
+	    for (n = 0; n < 3; n++) /* 'v = R^T u' */
+	       v[n] = R[idx(0,n,3)] * u[0] + R[idx(1,n,3)] * u[1]
+		  + R[idx(2,n,3)] * u[2];
+	    w = glWeight[i];
+	    for (m = 0; m < d; m++) {
+	       norm[m] += w * harmonic (l, m - l, u[0], u[1], u[2])
+		  * harmonic (l, m - l, u[0], u[1], u[2]);
+	       for (n = 0; n < d; n++)
+		  Dl[idx(m,n,d)] += w * harmonic (l, m - l, u[0], u[1], u[2])
+		     * harmonic (l, n - l, v[0], v[1], v[2]);
+	    }
+	 }
+      for (m = 0; m < d; m++) /* (normalized harmonics) */
+	 for (n = 0; n < d; n++)
+	    Dl[idx(m,n,d)] /= sqrt (norm[m] * norm[n]);
+   }
+
+} /* harmonicRotation */
+
+
+/* ********************************************************* */
+/* Makes the 3 x 3 matrix 'R' orthogonal (nearest one, by    */
+/* the Newton iteration of the polar decomposition, as the   */
+/* given operations may have few digits). Returns 0 if it is */
+/* not close to an orthogonal matrix.                        */
+static int orthonormalize (double *R)
+{
+   register int i, j, it;
+   double inv[9], det, err;
+
+   for (it = 0; it < 20; it++) {
+
+      /* 'inv = R^-T' (cofactors over the determinant). */
+      for (i = 0; i < 3; i++)
+	 for (j = 0; j < 3; j++)
+	    inv[idx(i,j,3)] =
+	       R[idx((i+1)%3,(j+1)%3,3)] * R[idx((i+2)%3,(j+2)%3,3)]
+	       - R[idx((i+1)%3,(j+2)%3,3)] * R[idx((i+2)%3,(j+1)%3,3)];
+      det = R[0] * inv[0] + R[3] * inv[3] + R[6] * inv[6];
+      if (fabs (det) < 0.5)
+	 return 0;
+
+      /* 'R = (R + R^-T) / 2' */
+      err = 0.0;
+      for (i = 0; i < 9; i++) {
+	 inv[i] /= det;
+	 err += fabs (inv[i] - R[i]);
+	 R[i] = (R[i] + inv[i]) / 2.0;
+      }
+      if (it == 0 && err > 1.0e-2)
+	 return 0;
+      if (err < 1.0e-15)
+	 break ;
+   }
+
+   return 1;
+
+} /* orthonormalize */
+
+
+/* ********************************************************* */
+/* Reads the operations of the file 'file' into 'rot' and    */
+/* 'tr' after the identity (the number at '*nOps'). Each     */
+/* line holds the rotation (by rows) and optionally the      */
+/* translation (Ang); without it, the rotation is about the  */
+/* centroid 'c'. '#' starts a comment.                       */
+static int readOps (const char *file, const double *c, double *rot,
+		    double *tr, int *nOps)
+{
+   register int i, j;
+   int n, line = 0, info = VIB_SUCCESS;
+   double v[12], *R;
+   char buf[1024], *p, *end;
+   FILE *OPS;
+
+   OPS = CHECKfopen (file, "r");
+   if (OPS == NULL)
+      return VIB_ERR_FILE;
+
+   *nOps = 1;
+   while (info == VIB_SUCCESS && fgets (buf, sizeof (buf), OPS) != NULL) {
+      line++;
+      if ((p = strchr (buf, '#')) != NULL)
+	 *p = '\0';
+      for (n = 0, p = buf; n < 12; n++, p = end) {
+	 v[n] = strtod (p, &end);
+	 if (end == p)
+	    break ;
+      }
+      while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+	 p++;
+      if (n == 0 && *p == '\0')
+	 continue ; /* empty line */
+      if ((n != 9 && n != 12) || *p != '\0') {
+	 fprintf (stderr, "\n ERROR: line %d of %s must hold 9 (rotation)"
+		  " or 12 (and translation) numbers!\n\n", line, file);
+	 info = VIB_ERR_FORMAT;
+      }
+      else if (*nOps == SYMM_MAX_OPS) {
+	 fprintf (stderr, "\n ERROR: more than %d operations at %s!\n\n",
+		  SYMM_MAX_OPS, file);
+	 info = VIB_ERR_FORMAT;
+      }
+      else {
+	 R = &rot[9*(*nOps)];
+	 for (i = 0; i < 3; i++)
+	    for (j = 0; j < 3; j++)
+	       R[idx(i,j,3)] = v[3*i+j];
+	 if (!orthonormalize (R)) {
+	    fprintf (stderr, "\n ERROR: the rotation at line %d of %s is not"
+		     " orthogonal!\n\n", line, file);
+	    info = VIB_ERR_FORMAT;
+	 }
+	 for (i = 0; i < 3; i++)
+	    tr[3*(*nOps)+i] = (n == 12 ? v[9+i] :
+			       c[i] - R[idx(i,0,3)] * c[0]
+			       - R[idx(i,1,3)] * c[1] - R[idx(i,2,3)] * c[2]);
+	 (*nOps)++;
+      }
+   }
+
+   /* Closes the file. */
+   if (info == VIB_SUCCESS)
+      info = CHECKfclose (fclose (OPS), file);
+   else
+      fclose (OPS);
+
+   return info;
+
+} /* readOps */
+
+
+/* ********************************************************* */
+/* Reads the angular momentum of each orbital (and the first */
+/* orbital of its shell) from the SIESTA '.ORB_INDX' file.   */
+static int readOrbitals (vib_context *ctx, vib_symmetry *sym)
+{
+   register int i;
+   int len, io, ia, l, m, s, info = VIB_SUCCESS;
+   int *mm;
+   char *orbFile, line[512];
+   FILE *ORB;
+
+   /* Sets the '.ORB_INDX' file name with 'FCdir' path. */
+   len = strlen (ctx->FCdir) + strlen (ctx->sysLabel);
+   orbFile = CHECKmalloc ((len + 10) * sizeof (char));
+   sym->ell = CHECKmalloc (ctx->no_u * sizeof (int));
+   sym->shell = CHECKmalloc (ctx->no_u * sizeof (int));
+   mm = CHECKmalloc (ctx->no_u * sizeof (int));
+   if (orbFile == NULL || sym->ell == NULL || sym->shell == NULL ||
+       mm == NULL) {
+      CHECKfree (orbFile);
+      CHECKfree (mm);
+      return VIB_ERR_MEMORY;
+   }
+   sprintf (orbFile, "%s%s.ORB_INDX", ctx->FCdir, ctx->sysLabel);
+
+   /* Opens the '.ORB_INDX' file. */
+   LOGinfo (ctx, "    reading \"%s\" file... ", orbFile);
+   ORB = CHECKfopen (orbFile, "r");
+   if (ORB == NULL) {
+      CHECKfree (orbFile);
+      CHECKfree (mm);
+      return VIB_ERR_FILE;
+   }
+
+   /* Skips the header and reads 'l' and 'm' of each orbital */
+   /* ('io ia is spec iao n l m ...').                        */
+   for (i = 0; i < 3 && info == VIB_SUCCESS; i++)
+      if (fgets (line, sizeof (line), ORB) == NULL)
+	 info = VIB_ERR_FORMAT;
+   for (i = 0; i < ctx->no_u && info == VIB_SUCCESS; i++) {
+      if (fgets (line, sizeof (line), ORB) == NULL ||
+	  sscanf (line, "%d %d %*d %*s %*d %*d %d %d", &io, &ia, &l, &m) != 4
+	  || io != i + 1 || ia < 1 || ia > ctx->nAtoms ||
+	  i < ctx->orbIdx[ia-1] || i >= ctx->orbIdx[ia])
+	 info = VIB_ERR_FORMAT;
+      else if (l < 0 || l > SYMM_LMAX || m < -l || m > l) {
+	 fprintf (stderr, "\n ERROR: the symmetry supports orbitals up to"
+		  " l = %d (orbital %d)!\n", SYMM_LMAX, io);
+	 info = VIB_ERR_INPUT;
+      }
+      else {
+	 sym->ell[i] = l;
+	 mm[i] = m;
+	 sym->shell[i] = s = i - (m + l);
+
+	 /* The shell starts at 'm = -l' of the same atom. */
+	 if (s < ctx->orbIdx[ia-1] || sym->ell[s] != l || mm[s] != -l)
+	    info = VIB_ERR_FORMAT;
+      }
+   }
+   if (info == VIB_ERR_FORMAT)
+      fprintf (stderr, "\n ERROR: the file %s is not written correctly"
+	       " (or doesn't match the '.orb' file)!\n\n", orbFile);
+
+   /* Closes the file. */
+   if (info == VIB_SUCCESS)
+      info = CHECKfclose (fclose (ORB), orbFile);
+   else
+      fclose (ORB);
+   if (info == VIB_SUCCESS)
+      LOGinfo (ctx, "ok!\n");
+
+   /* Frees memory. */
+   CHECKfree (orbFile);
+   CHECKfree (mm);
+
+   return info;
+
+} /* readOrbitals */
+
+
+/* ********************************************************* */
+/* Computes at 'image' the image of each atom by the         */
+/* operation 'x -> R x + t'. Returns 1 if it is a symmetry   */
+/* of the system: each atom is taken to an atom of the same  */
+/* species (within 'SYMM_TOL') with the same basis shells    */
+/* (if they are known), and 0 otherwise.                     */
+static int atomImages (vib_context *ctx, vib_symmetry *sym,
+		       const double *pos, const int *species,
+		       const double *R, const double *t, int *image)
+{
+   register int a, b, i;
+   int n, ok = 1;
+   int *hit;
+   double y[3], d, tol2 = SYMM_TOL * SYMM_TOL;
+
+   hit = UTILintVector (ctx->nAtoms);
+   if (hit == NULL)
+      return -1;
+
+   for (a = 0; a < ctx->nAtoms && ok; a++) {
+      for (i = 0; i < 3; i++)
+	 y[i] = R[idx(i,0,3)] * pos[3*a] + R[idx(i,1,3)] * pos[3*a+1]
+	    + R[idx(i,2,3)] * pos[3*a+2] + t[i];
+      for (b = 0; b < ctx->nAtoms; b++) {
+	 if (species[b] != species[a] || hit[b])
+	    continue ;
+	 d = (y[0] - pos[3*b]) * (y[0] - pos[3*b])
+	    + (y[1] - pos[3*b+1]) * (y[1] - pos[3*b+1])
+	    + (y[2] - pos[3*b+2]) * (y[2] - pos[3*b+2]);
+	 if (d <= tol2)
+	    break ;
+      }
+      if (b == ctx->nAtoms)
+	 ok = 0;
+      else {
+	 image[a] = b;
+	 hit[b] = 1;
+      }
+
+      /* Same basis shells. */
+      if (ok && sym->ell != NULL) {
+	 n = ctx->orbIdx[a+1] - ctx->orbIdx[a];
+	 if (ctx->orbIdx[b+1] - ctx->orbIdx[b] != n)
+	    ok = 0;
+	 for (i = 0; i < n && ok; i++)
+	    if (sym->ell[ctx->orbIdx[a]+i] != sym->ell[ctx->orbIdx[b]+i] ||
+		sym->shell[ctx->orbIdx[a]+i] - ctx->orbIdx[a] !=
+		sym->shell[ctx->orbIdx[b]+i] - ctx->orbIdx[b])
+	       ok = 0;
+      }
+   }
+
+   /* Frees memory. */
+   CHECKfree (hit);
+
+   return ok;
+
+} /* atomImages */
+
+
+/* ********************************************************* */
+/* Sets at 'F' (3 x 3, column-major) the orthonormal frame   */
+/* of the direction 'u' and the plane of 'u' and 'v', with   */
+/* the third axis flipped if 'flip'.                         */
+static void frame (const double *u, const double *v, int flip, double *F)
+{
+   register int i;
+   double d, n;
+
+   for (i = 0, n = 0.0; i < 3; i++)
+      n += u[i] * u[i];
+   for (i = 0; i < 3; i++)
+      F[i] = u[i] / sqrt (n);
+   for (i = 0, d = 0.0; i < 3; i++)
+      d += v[i] * F[i];
+   for (i = 0, n = 0.0; i < 3; i++) {
+      F[3+i] = v[i] - d * F[i];
+      n += F[3+i] * F[3+i];
+   }
+   for (i = 0; i < 3; i++)
+      F[3+i] /= sqrt (n);
+   for (i = 0; i < 3; i++)
+      F[6+i] = (flip ? -1.0 : 1.0) * (F[(i+1)%3] * F[3+(i+2)%3]
+				       - F[(i+2)%3] * F[3+(i+1)%3]);
+
+} /* frame */
+
+
+/* ********************************************************* */
+/* Adds to the 'nOps' operations at 'rot' the rotation       */
+/* 'R = G F^T' about the centroid 'c' if it is a symmetry of */
+/* the system not yet there ('image' is used as buffer).     */
+/* Returns -1 if there is not enough memory.                 */
+static int addCandidate (vib_context *ctx, vib_symmetry *sym,
+			 const double *pos, const int *species,
+			 const double *c, const double *F, const double *G,
+			 double *rot, int *nOps, int *image)
+{
+   register int i, j, g;
+   int k;
+   double R[9], t[3], d;
+
+   for (i = 0; i < 3; i++)
+      for (j = 0; j < 3; j++)
+	 R[idx(i,j,3)] = G[i] * F[j] + G[3+i] * F[3+j] + G[6+i] * F[6+j];
+   for (i = 0; i < 3; i++)
+      t[i] = c[i] - R[idx(i,0,3)] * c[0] - R[idx(i,1,3)] * c[1]
+	 - R[idx(i,2,3)] * c[2];
+   for (g = 0; g < *nOps; g++) {
+      for (i = 0, d = 0.0; i < 9; i++)
+	 d += fabs (rot[9*g+i] - R[i]);
+      if (d < 1.0e-6)
+	 return 0;
+   }
+   if (*nOps == SYMM_MAX_OPS)
+      return 0;
+
+   k = atomImages (ctx, sym, pos, species, R, t, image);
+   if (k == 1) {
+      for (i = 0; i < 9; i++)
+	 rot[9*(*nOps)+i] = R[i];
+      (*nOps)++;
+   }
+
+   return k;
+
+} /* addCandidate */
+
+
+/* ********************************************************* */
+/* Finds the operations about the centroid 'c' that are      */
+/* symmetries of the system, at 'rot' (and the number at     */
+/* '*nOps', with the identity first). An operation takes two */
+/* atoms 'A' and 'B' (not aligned with 'c') to atoms 'A'' and */
+/* 'B'' of the same species, distances to 'c' and distance   */
+/* between them, and so it is the rotation of the frame of   */
+/* 'A' and 'B' onto the frame of 'A'' and 'B'' (or that with  */
+/* a reflection through their plane). 'A' and 'B' are taken  */
+/* from the smallest sets of such atoms, so few candidates   */
+/* are tried. If all the atoms are on a line through 'c', the */
+/* rotations by multiples of 90 degrees about it (and the    */
+/* reflections) are tried.                                   */
+static int structureOps (vib_context *ctx, vib_symmetry *sym,
+			 const double *pos, const int *species,
+			 const double *c, double *rot, int *nOps)
+{
+   register int a, b, i, n;
+   int nAtoms, A, B, k, flip, info = VIB_SUCCESS;
+   int *shell, *image;
+   double v[3], w[3], F[9], G[9], cross, best, d;
+   double *r, *len;
+
+   nAtoms = ctx->nAtoms;
+   *nOps = 1;
+   for (i = 0; i < 9; i++)
+      rot[i] = (i % 4 == 0 ? 1.0 : 0.0);
+
+   /* Positions relative to the centroid and number of atoms */
+   /* of the same species at the same distance of each atom. */
+   r = CHECKmalloc (3 * nAtoms * sizeof (double));
+   len = CHECKmalloc (nAtoms * sizeof (double));
+   shell = UTILintVector (nAtoms);
+   image = CHECKmalloc (nAtoms * sizeof (int));
+   if (r == NULL || len == NULL || shell == NULL || image == NULL) {
+      CHECKfree (r);
+      CHECKfree (len);
+      CHECKfree (shell);
+      CHECKfree (image);
+      return VIB_ERR_MEMORY;
+   }
+   for (a = 0; a < nAtoms; a++) {
+      for (i = 0; i < 3; i++)
+	 r[3*a+i] = pos[3*a+i] - c[i];
+      len[a] = sqrt (r[3*a] * r[3*a] + r[3*a+1] * r[3*a+1]
+		     + r[3*a+2] * r[3*a+2]);
+   }
+   for (a = 0; a < nAtoms; a++)
+      for (b = 0; b < nAtoms; b++)
+	 if (species[b] == species[a] && fabs (len[b] - len[a]) <= SYMM_TOL)
+	    shell[a]++;
+
+   /* 'A' away from the centroid and 'B' away from the line of */
+   /* 'A' (or -1 if there is none), from the smallest shells.  */
+   A = B = -1;
+   for (a = 0; a < nAtoms; a++)
+      if (len[a] > SYMM_TOL && (A < 0 || shell[a] < shell[A]))
+	 A = a;
+   for (b = 0, best = 0.0; b < nAtoms && A >= 0; b++) {
+      for (i = 0, cross = 0.0; i < 3; i++) {
+	 d = r[3*A+(i+1)%3] * r[3*b+(i+2)%3] - r[3*A+(i+2)%3] * r[3*b+(i+1)%3];
+	 cross += d * d;
+      }
+      if (sqrt (cross) / len[A] > SYMM_TOL
+	  && (B < 0 || shell[b] < shell[B]
+	      || (shell[b] == shell[B] && cross > best))) {
+	 B = b;
+	 best = cross;
+      }
+   }
+
+   /* Frames of the images of 'A' and 'B'. */
+   for (a = 0; a < nAtoms && B >= 0 && info == VIB_SUCCESS; a++) {
+      if (species[a] != species[A] || fabs (len[a] - len[A]) > SYMM_TOL)
+	 continue ;
+      for (b = 0; b < nAtoms && info == VIB_SUCCESS; b++) {
+	 if (b == a || species[b] != species[B]
+	     || fabs (len[b] - len[B]) > SYMM_TOL)
+	    continue ;
+	 for (i = 0, d = 0.0; i < 3; i++)
+	    d += (r[3*a+i] - r[3*b+i]) * (r[3*a+i] - r[3*b+i])
+	       - (r[3*A+i] - r[3*B+i]) * (r[3*A+i] - r[3*B+i]);
+	 if (fabs (d) > 4.0 * SYMM_TOL * (len[A] + len[B]))
+	    continue ;
+	 frame (&r[3*A], &r[3*B], 0, F);
+	 for (flip = 0; flip < 2 && info == VIB_SUCCESS; flip++) {
+	    frame (&r[3*a], &r[3*b], flip, G);
+	    k = addCandidate (ctx, sym, pos, species, c, F, G, rot, nOps,
+			      image);
+	    if (k < 0)
+	       info = VIB_ERR_MEMORY;
+	 }
+      }
+   }
+
+   /* All the atoms on a line: a second axis normal to it. */
+   if (A >= 0 && B < 0) {
+      for (i = 0, n = 0; i < 3; i++) {
+	 if (fabs (r[3*A+i]) < fabs (r[3*A+n]))
+	    n = i;
+	 v[i] = 0.0;
+      }
+      v[n] = 1.0;
+      frame (&r[3*A], v, 0, F);
+   }
+   for (a = 0; a < nAtoms && A >= 0 && B < 0 && info == VIB_SUCCESS; a++) {
+      if (species[a] != species[A] || fabs (len[a] - len[A]) > SYMM_TOL)
+	 continue ;
+      for (k = 0; k < 8 && info == VIB_SUCCESS; k++) {
+	 for (i = 0; i < 3; i++)
+	    w[i] = (k % 4 == 0 ? F[3+i] : (k % 4 == 1 ? F[6+i] :
+				(k % 4 == 2 ? -F[3+i] : -F[6+i])));
+	 frame (&r[3*a], w, k / 4, G);
+	 if (addCandidate (ctx, sym, pos, species, c, F, G, rot, nOps,
+			   image) < 0)
+	    info = VIB_ERR_MEMORY;
+      }
+   }
+
+   /* Frees memory. */
+   CHECKfree (r);
+   CHECKfree (len);
+   CHECKfree (shell);
+   CHECKfree (image);
+
+   return info;
+
+} /* structureOps */
+
+
+/* ********************************************************* */
+/* Returns the index of the operation with rotation 'R' and  */
+/* atom images 'image' among the 'nOps' of 'sym', or -1.     */
+static int findOp (vib_context *ctx, vib_symmetry *sym, int nOps,
+		   const double *R, const int *image)
+{
+   register int g, i;
+   int same;
+
+   for (g = 0; g < nOps; g++) {
+      same = 1;
+      for (i = 0; i < 9 && same; i++)
+	 same = (fabs (sym->rot[9*g+i] - R[i]) < 1.0e-6);
+      for (i = 0; i < ctx->nAtoms && same; i++)
+	 same = (sym->image[g*ctx->nAtoms+i] == image[i]);
+      if (same)
+	 return g;
+   }
+
+   return -1;
+
+} /* findOp */
+
+
+/* ********************************************************* */
+/* Returns 1 if the operation 'g' maps the dynamic atoms and */
+/* the atoms of the active region onto themselves.           */
+static int keepsRegions (vib_context *ctx, vib_symmetry *sym, int g)
+{
+   register int a;
+   int b, dynA, dynB;
+   int *image = &sym->image[g*ctx->nAtoms];
+
+   for (a = 0; a < ctx->nAtoms; a++) {
+      b = image[a];
+      dynA = (a >= ctx->FCfirst - 1 && a < ctx->FClast);
+      dynB = (b >= ctx->FCfirst - 1 && b < ctx->FClast);
+      if (dynA != dynB)
+	 return 0;
+      if (ctx->actIdx != NULL &&
+	  (ctx->actIdx[ctx->orbIdx[a]] < 0) != (ctx->actIdx[ctx->orbIdx[b]] < 0))
+	 return 0;
+   }
+
+   return 1;
+
+} /* keepsRegions */
+
+
+/* ********************************************************* */
+/* Sets up the symmetry of the system at 'ctx' (atoms at     */
+/* 'pos', in Ang, and 'species'): reads the orbital shells   */
+/* ("full" runs), finds the operations ('ctx->symOps' =      */
+/* "auto" or a file, see 'readOps'), closes them into a      */
+/* group, keeps those that preserve the dynamic atoms and    */
+/* the active region, and finds the orbits of the dynamic    */
+/* atoms.                                                    */
+int SYMMsetup (vib_context *ctx, const double *pos, const int *species)
+{
+   register int a, g, h, i;
+   int nAtoms, first, nCand = 0, nOps, nKept, k, info = VIB_SUCCESS;
+   int *image;
+   double c[3], R[9], *rot, *tr;
+   vib_symmetry *sym;
+
+   nAtoms = ctx->nAtoms;
+   first = ctx->FCfirst - 1;
+   SYMMfree (ctx);
+   LOGinfo (ctx, "\n Symmetry of the system:\n\n");
+
+   /* Allocates memory. */
+   sym = CHECKmalloc (sizeof (vib_symmetry));
+   if (sym == NULL)
+      return VIB_ERR_MEMORY;
+   sym->ell = sym->shell = NULL;
+   sym->D = NULL;
+   sym->rot = CHECKmalloc (9 * SYMM_MAX_OPS * sizeof (double));
+   sym->image = CHECKmalloc (SYMM_MAX_OPS * nAtoms * sizeof (int));
+   sym->rep = CHECKmalloc (ctx->nDyn * sizeof (int));
+   sym->op = CHECKmalloc (ctx->nDyn * sizeof (int));
+   rot = CHECKmalloc (9 * SYMM_MAX_OPS * sizeof (double));
+   tr = CHECKmalloc (3 * SYMM_MAX_OPS * sizeof (double));
+   image = CHECKmalloc (nAtoms * sizeof (int));
+   ctx->sym = sym;
+   if (sym->rot == NULL || sym->image == NULL || sym->rep == NULL ||
+       sym->op == NULL || rot == NULL || tr == NULL || image == NULL)
+      info = VIB_ERR_MEMORY;
+
+   /* Orbital shells ("full" runs). */
+   if (info == VIB_SUCCESS && ctx->orbIdx != NULL)
+      info = readOrbitals (ctx, sym);
+
+   /* Candidate operations (the identity first). */
+   if (info == VIB_SUCCESS) {
+      for (i = 0; i < 3; i++)
+	 c[i] = 0.0;
+      for (a = 0; a < nAtoms; a++)
+	 for (i = 0; i < 3; i++)
+	    c[i] += pos[3*a+i] / nAtoms;
+      if (strcmp (ctx->symOps, "auto") == 0)
+	 info = structureOps (ctx, sym, pos, species, c, rot, &nCand);
+      else
+	 info = readOps (ctx->symOps, c, rot, tr, &nCand);
+   }
+   if (info == VIB_SUCCESS) {
+      for (i = 0; i < 9; i++)
+	 rot[i] = (i % 4 == 0 ? 1.0 : 0.0);
+      for (g = 0; g < nCand; g++) /* about the centroid */
+	 if (g == 0 || strcmp (ctx->symOps, "auto") == 0)
+	    for (i = 0; i < 3; i++)
+	       tr[3*g+i] = c[i] - rot[9*g+i] * c[0] - rot[9*g+i+3] * c[1]
+		  - rot[9*g+i+6] * c[2];
+   }
+
+   /* Symmetries of the system among the candidates (the given */
+   /* ones must all be).                                       */
+   nOps = 0;
+   for (g = 0; g < nCand && info == VIB_SUCCESS; g++) {
+      k = atomImages (ctx, sym, pos, species, &rot[9*g], &tr[3*g], image);
+      if (k < 0)
+	 info = VIB_ERR_MEMORY;
+      else if (k == 0 && strcmp (ctx->symOps, "auto") != 0) {
+	 fprintf (stderr, "\n ERROR: the operation %d of %s is not a"
+		  " symmetry of the system!\n\n", g, ctx->symOps);
+	 info = VIB_ERR_INPUT;
+      }
+      else if (k == 1 && findOp (ctx, sym, nOps, &rot[9*g], image) < 0) {
+	 for (i = 0; i < 9; i++)
+	    sym->rot[9*nOps+i] = rot[9*g+i];
+	 for (a = 0; a < nAtoms; a++)
+	    sym->image[nOps*nAtoms+a] = image[a];
+	 nOps++;
+      }
+   }
+
+   /* Closes them into a group ('R = Rg Rh', 'image = g(h(a))'). */
+   for (g = 0; g < nOps && info == VIB_SUCCESS; g++)
+      for (h = 0; h < nOps && info == VIB_SUCCESS; h++) {
+	 for (i = 0; i < 9; i++)
+	    R[i] = sym->rot[9*g+idx(i%3,0,3)] * sym->rot[9*h+idx(0,i/3,3)]
+	       + sym->rot[9*g+idx(i%3,1,3)] * sym->rot[9*h+idx(1,i/3,3)]
+	       + sym->rot[9*g+idx(i%3,2,3)] * sym->rot[9*h+idx(2,i/3,3)];
+	 for (a = 0; a < nAtoms; a++)
+	    image[a] = sym->image[g*nAtoms+sym->image[h*nAtoms+a]];
+	 if (findOp (ctx, sym, nOps, R, image) >= 0)
+	    continue ;
+	 if (nOps == SYMM_MAX_OPS) {
+	    fprintf (stderr, "\n ERROR: the operations generate more than"
+		     " %d ones (check them and the coordinates)!\n\n",
+		     SYMM_MAX_OPS);
+	    info = VIB_ERR_INPUT;
+	 }
+	 else {
+	    for (i = 0; i < 9; i++)
+	       sym->rot[9*nOps+i] = R[i];
+	    for (a = 0; a < nAtoms; a++)
+	       sym->image[nOps*nAtoms+a] = image[a];
+	    nOps++;
+	 }
+      }
+   if (info == VIB_SUCCESS)
+      LOGinfo (ctx, "    Operations of the point group (%s):\t%d\n",
+	       strcmp (ctx->symOps, "auto") == 0 ? "detected" : "given",
+	       nOps);
+
+   /* Keeps the subgroup that preserves the dynamic atoms */
+   /* and the active region.                              */
+   nKept = 0;
+   for (g = 0; g < nOps && info == VIB_SUCCESS; g++)
+      if (keepsRegions (ctx, sym, g)) {
+	 for (i = 0; i < 9; i++)
+	    sym->rot[9*nKept+i] = sym->rot[9*g+i];
+	 for (a = 0; a < nAtoms; a++)
+	    sym->image[nKept*nAtoms+a] = sym->image[g*nAtoms+a];
+	 nKept++;
+      }
+   sym->nOps = nKept;
+   if (info == VIB_SUCCESS && nKept == 1)
+      fprintf (stderr, "\n WARNING: %s, so all the dynamic atoms are"
+	       " displaced!\n", nOps > 1 ? "no symmetry operation keeps"
+	       " the dynamic atoms and the active region" :
+	       (strcmp (ctx->symOps, "auto") == 0 ? "only the identity was"
+		" detected (the operations may be given with"
+		" '--symmetry=file')" : "the given operations are only the"
+		" identity"));
+
+   /* Orbits of the dynamic atoms (the first one is displaced). */
+   if (info == VIB_SUCCESS) {
+      for (a = 0; a < ctx->nDyn; a++)
+	 sym->rep[a] = -1;
+      sym->nIrr = 0;
+      for (a = 0; a < ctx->nDyn; a++) {
+	 if (sym->rep[a] >= 0)
+	    continue ;
+	 sym->nIrr++;
+	 for (g = 0; g < sym->nOps; g++) {
+	    k = sym->image[g*nAtoms+first+a] - first;
+	    if (sym->rep[k] < 0) {
+	       sym->rep[k] = a;
+	       sym->op[k] = g;
+	    }
+	 }
+      }
+      LOGinfo (ctx, "    Operations keeping the dynamic atoms:\t%d\n",
+	       sym->nOps);
+      LOGinfo (ctx, "    Irreducible (displaced) dynamic atoms:\t%d of"
+	       " %d\n      ", sym->nIrr, ctx->nDyn);
+      for (a = 0; a < ctx->nDyn; a++)
+	 if (sym->rep[a] == a)
+	    LOGinfo (ctx, " %d", first + a + 1);
+      LOGinfo (ctx, "\n");
+   }
+
+   /* Rotations of the orbitals. */
+   if (info == VIB_SUCCESS && sym->ell != NULL) {
+      sym->D = CHECKmalloc (sym->nOps * SYMM_DSIZE * sizeof (double));
+      if (sym->D == NULL)
+	 info = VIB_ERR_MEMORY;
+      else
+	 for (g = 0; g < sym->nOps; g++)
+	    harmonicRotation (&sym->rot[9*g], &sym->D[g*SYMM_DSIZE]);
+   }
+   LOGflush (ctx);
+
+   /* Frees memory. */
+   CHECKfree (rot);
+   CHECKfree (tr);
+   CHECKfree (image);
+   if (info != VIB_SUCCESS)
+      SYMMfree (ctx);
+
+   return info;
+
+} /* SYMMsetup */
+
+
+/* ********************************************************* */
+/* Frees the symmetry of the context 'ctx' (if any).         */
+void SYMMfree (vib_context *ctx)
+{
+   vib_symmetry *sym = ctx->sym;
+
+   if (sym == NULL)
+      return ;
+
+   CHECKfree (sym->rot);
+   CHECKfree (sym->image);
+   CHECKfree (sym->rep);
+   CHECKfree (sym->op);
+   CHECKfree (sym->shell);
+   CHECKfree (sym->ell);
+   CHECKfree (sym->D);
+   CHECKfree (sym);
+   ctx->sym = NULL;
+
+} /* SYMMfree */
+
+
+/* ********************************************************* */
+/* Returns 1 if the dynamic atom 'dyn' (from 0) is displaced */
+/* (the first of its orbit, or there is no symmetry), and 0  */
+/* if its FC columns and 'dH' are rebuilt.                   */
+int SYMMirreducible (vib_context *ctx, int dyn)
+{
+
+   return (ctx->sym == NULL || ctx->sym->rep[dyn] == dyn);
+
+} /* SYMMirreducible */
+
+
+/* ********************************************************* */
+/* Rebuilds the FC columns of the atoms that are not         */
+/* displaced at the FC matrix reduced to the dynamic atoms   */
+/* 'FC' (after the egg-box removal), from those of the       */
+/* irreducible atom of their orbits, which must be nonzero.  */
+int SYMMrebuildFC (vib_context *ctx, double *FC)
+{
+   register int a, b, i, j, k, l;
+   int n, r, g, img, first, nonzero;
+   double sum, *R;
+   vib_symmetry *sym = ctx->sym;
+
+   n = 3 * ctx->nDyn;
+   first = ctx->FCfirst - 1;
+
+   /* The columns of the displaced atoms were read. */
+   for (a = 0; a < ctx->nDyn; a++) {
+      if (sym->rep[a] != a)
+	 continue ;
+      for (i = 0, nonzero = 0; i < 3 * n && !nonzero; i++)
+	 nonzero = (FC[idx(i%n,3*a+i/n,n)] != 0.0);
+      if (!nonzero) {
+	 fprintf (stderr, "\n ERROR: the FC columns of the irreducible atom"
+		  " %d are missing!\n\n", first + a + 1);
+	 return VIB_ERR_FORMAT;
+      }
+   }
+
+   /* 'FC(g(b),g(r)) = R FC(b,r) R^T' */
+   for (a = 0; a < ctx->nDyn; a++) {
+      r = sym->rep[a];
+      if (r == a)
+	 continue ;
+      g = sym->op[a];
+      R = &sym->rot[9*g];
+      for (b = 0; b < ctx->nDyn; b++) {
+	 img = sym->image[g*ctx->nAtoms+first+b] - first;
+	 for (i = 0; i < 3; i++)
+	    for (j = 0; j < 3; j++) {
+	       sum = 0.0;
+	       for (k = 0; k < 3; k++)
+		  for (l = 0; l < 3; l++)
+		     sum += R[idx(i,k,3)] * R[idx(j,l,3)]
+			* FC[idx(3*b+k,3*r+l,n)];
+	       FC[idx(3*img+i,3*a+j,n)] = sum;
+	    }
+      }
+   }
+
+   return VIB_SUCCESS;
+
+} /* SYMMrebuildFC */
+
+
+/* ********************************************************* */
+/* Rebuilds the 'dH' of the atoms that are not displaced     */
+/* (all spins, dense at the active region) from that of the  */
+/* irreducible atom of their orbits:                         */
+/*         'dH(g(r),j) = sum_i R(j,i) D dH(r,i) D^T'         */
+/* where 'D' takes each shell of orbitals to the same shell  */
+/* of the image atom, rotated by the 'D' of its 'l'.         */
+int SYMMrebuildDH (vib_context *ctx, double *dH)
+{
+   register int a, i, j, s, p, q, m, mp;
+   int n, nspin, r, g, l, d, nSh, at, src, dst;
+   int *shSrc, *shDst, *shL, *map = ctx->actIdx;
+   double sum, *R, *Dg, *Dl, *X, *T, *Y, *Z;
+   vib_symmetry *sym = ctx->sym;
+
+   n = ctx->nAct;
+   nspin = ctx->nspin;
+
+   /* Allocates memory. */
+   shSrc = CHECKmalloc (ctx->no_u * sizeof (int));
+   shDst = CHECKmalloc (ctx->no_u * sizeof (int));
+   shL = CHECKmalloc (ctx->no_u * sizeof (int));
+   Y = CHECKmalloc (n * n * sizeof (double));
+   Z = CHECKmalloc (n * n * sizeof (double));
+   if (shSrc == NULL || shDst == NULL || shL == NULL || Y == NULL ||
+       Z == NULL) {
+      CHECKfree (shSrc);
+      CHECKfree (shDst);
+      CHECKfree (shL);
+      CHECKfree (Y);
+      CHECKfree (Z);
+      return VIB_ERR_MEMORY;
+   }
+
+   LOGinfo (ctx, "\n    rebuilding the 'dH' of %d atoms by symmetry... ",
+	    ctx->nDyn - sym->nIrr);
+   for (a = 0; a < ctx->nDyn; a++) {
+      r = sym->rep[a];
+      if (r == a)
+	 continue ;
+      g = sym->op[a];
+      R = &sym->rot[9*g];
+      Dg = &sym->D[g*SYMM_DSIZE];
+
+      /* Shells of the active region and their images (dense */
+      /* indices, the shells are contiguous there).          */
+      for (at = 0, nSh = 0; at < ctx->nAtoms; at++)
+	 for (p = ctx->orbIdx[at]; p < ctx->orbIdx[at+1]; p++) {
+	    if (sym->shell[p] != p || (map != NULL && map[p] < 0))
+	       continue ;
+	    q = ctx->orbIdx[sym->image[g*ctx->nAtoms+at]]
+	       + p - ctx->orbIdx[at];
+	    shSrc[nSh] = (map == NULL ? p : map[p]);
+	    shDst[nSh] = (map == NULL ? q : map[q]);
+	    shL[nSh++] = sym->ell[p];
+	 }
+
+      /* Resets the rebuilt blocks. */
+      for (j = 0; j < 3; j++)
+	 for (s = 0; s < nspin; s++)
+	    UTILresetDoubleVector (n * n,
+				   &dH[idx3d(0,0,(3*a+j)*nspin+s,n,n)]);
+
+      for (i = 0; i < 3; i++) /* displacement 'i' of the atom 'r' */
+	 for (s = 0; s < nspin; s++) {
+	    X = &dH[idx3d(0,0,(3*r+i)*nspin+s,n,n)];
+
+	    /* 'Y = D X' (rows) */
+	    for (q = 0; q < n; q++)
+	       for (p = 0; p < nSh; p++) {
+		  l = shL[p];
+		  d = 2 * l + 1;
+		  Dl = &Dg[dOff[l]];
+		  src = shSrc[p];
+		  dst = shDst[p];
+		  for (mp = 0; mp < d; mp++) {
+		     sum = 0.0;
+		     for (m = 0; m < d; m++)
+			sum += Dl[idx(mp,m,d)] * X[idx(src+m,q,n)];
+		     Y[idx(dst+mp,q,n)] = sum;
+		  }
+	       }
+
+	    /* 'Z = Y D^T' (columns) */
+	    for (p = 0; p < nSh; p++) {
+	       l = shL[p];
+	       d = 2 * l + 1;
+	       Dl = &Dg[dOff[l]];
+	       src = shSrc[p];
+	       dst = shDst[p];
+	       for (mp = 0; mp < d; mp++) {
+		  for (q = 0; q < n; q++)
+		     Z[idx(q,dst+mp,n)] = 0.0;
+		  for (m = 0; m < d; m++)
+		     for (q = 0; q < n; q++)
+			Z[idx(q,dst+mp,n)] += Dl[idx(mp,m,d)] * Y[idx(q,src+m,n)];
+	       }
+	    }
+
+	    /* 'dH(a,j) = dH(a,j) + R(j,i) Z' */
+	    for (j = 0; j < 3; j++) {
+	       if (R[idx(j,i,3)] == 0.0)
+		  continue ;
+	       T = &dH[idx3d(0,0,(3*a+j)*nspin+s,n,n)];
+	       for (q = 0; q < n * n; q++)
+		  T[q] += R[idx(j,i,3)] * Z[q];
+	    }
+	 }
+   }
+   LOGinfo (ctx, "ok!\n");
+   LOGflush (ctx);
+
+   /* Frees memory. */
+   CHECKfree (shSrc);
+   CHECKfree (shDst);
+   CHECKfree (shL);
+   CHECKfree (Y);
+   CHECKfree (Z);
+
+   return VIB_SUCCESS;
+
+} /* SYMMrebuildDH */
+
+
+/* ************************ Drafts ************************* */
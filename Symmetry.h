@@ -0,0 +1,78 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Interface for the symmetry-reduced displacements. The  **/
+/**  point-group operations of the system ('x -> R x + t')  **/
+/**  are detected at the '.xyz' (the rotations and          **/
+/**  reflections about the centroid of the atoms, in any    **/
+/**  orientation, that take two atoms to two others of the  **/
+/**  same species and distances and then all the atoms onto **/
+/**  atoms; a warning tells when only the identity is left) **/
+/**  or read from a file, and closed into a group. Only the **/
+/**  operations that map the dynamic atoms (and the active  **/
+/**  region) onto themselves are kept. The first dynamic    **/
+/**  atom of each orbit is the irreducible one, the only    **/
+/**  one displaced: the FC columns and the corrected 'dH'   **/
+/**  of the others are rebuilt from it,                     **/
+/**     FC(g(b),g(a)) = R FC(b,a) R^T                       **/
+/**     dH(g(a),j) = sum_i R(j,i) D dH(a,i) D^T             **/
+/**  where 'D' moves each orbital to the same orbital of    **/
+/**  the image atom, rotated as a real spherical harmonic   **/
+/**  (SIESTA order and signs, 'l' up to 3, from the         **/
+/**  '.ORB_INDX' file).                                     **/
+/**  *****************************************************  **/
+
+/* Maximum number of operations of a group. */
+#define SYMM_MAX_OPS 192
+
+/* Largest angular momentum of the basis orbitals. */
+#define SYMM_LMAX 3
+
+/* Size of the real spherical harmonics rotations of an */
+/* operation ('(2l+1)^2' for each 'l' up to 'SYMM_LMAX'). */
+#define SYMM_DSIZE 84
+
+/* Distance (Ang) within which an image matches an atom. */
+#define SYMM_TOL 1.0e-3
+
+/* Symmetry operations of a system. */
+typedef struct VIBSYMMETRY vib_symmetry;
+struct VIBSYMMETRY {
+   int nOps; /* number of operations (the first is the identity) */
+   double *rot; /* their rotations 'R' (3 x 3, column-major) */
+   int *image; /* image of each atom by each operation */
+	       /* ('image[g*nAtoms+a]', from 0)           */
+   int *rep; /* irreducible atom of the orbit of each dynamic atom */
+   int *op; /* operation taking it to the dynamic atom */
+   int nIrr; /* number of irreducible dynamic atoms */
+   int *shell; /* first orbital of the shell of each orbital */
+   int *ell; /* angular momentum of each orbital */
+   double *D; /* real spherical harmonics rotations ('SYMM_DSIZE' */
+	      /* per operation, 'NULL' at "onlyPh" runs)          */
+};
+
+/* Sets up the symmetry of the system at 'ctx' from the       */
+/* positions 'pos' (Ang, 3 per atom) and the species 'species' */
+/* of its atoms (operations as set at 'ctx->symOps').         */
+int SYMMsetup (vib_context *ctx, const double *pos, const int *species);
+
+/* Frees the symmetry of the context 'ctx'. */
+void SYMMfree (vib_context *ctx);
+
+/* Returns 1 if the dynamic atom 'dyn' (from 0) is displaced */
+/* (irreducible, or no symmetry), and 0 if it is rebuilt.     */
+int SYMMirreducible (vib_context *ctx, int dyn);
+
+/* Rebuilds the columns of the rebuilt atoms of the FC matrix */
+/* reduced to the dynamic atoms ('3nDyn x 3nDyn').             */
+int SYMMrebuildFC (vib_context *ctx, double *FC);
+
+/* Rebuilds the 'dH' (all spins, dense at the active region) */
+/* of the rebuilt atoms.                                      */
+int SYMMrebuildDH (vib_context *ctx, double *dH);
@@ -0,0 +1,794 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Implementation of the per-stage timing of a run: wall  **/
+/**  and CPU times, bytes and flops of each stage (and its  **/
+/**  hardware counters, with '-DPERFCOUNT'), reported as a  **/
+/**  table at the log and as a JSON file.                   **/
+/**  *****************************************************  **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef PERFCOUNT
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "Check.h"
+#include "Utils.h"
+#include "Phonon.h"
+#include "Log.h"
+#include "Timing.h"
+
+/* Names of the hardware counters. */
+static const char *counterName[TIME_N_COUNTERS] = TIME_COUNTER_NAMES;
+
+#ifdef PERFCOUNT
+
+/* ********************************************************* */
+/* Opens the counter of the event 'config' of type 'type'    */
+/* for the calling thread, in user space only (so that it is */
+/* allowed without root at the default 'perf_event_paranoid' */
+/* level). Returns its descriptor or -1.                     */
+static int openCounter (unsigned int type, unsigned long long config)
+{
+   struct perf_event_attr attr;
+
+   memset (&attr, 0, sizeof (attr));
+   attr.size = sizeof (attr);
+   attr.type = type;
+   attr.config = config;
+   attr.exclude_kernel = 1;
+   attr.exclude_hv = 1;
+
+   return (int) syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+
+} /* openCounter */
+
+
+/* ********************************************************* */
+/* Reads at 'v' the current values of the open counters.     */
+static void readCounters (vib_context *ctx, double *v)
+{
+   register int c;
+   unsigned long long x;
+
+   for (c = 0; c < TIME_N_COUNTERS; c++)
+      if (ctx->perfFd[c] >= 0 && read (ctx->perfFd[c], &x, sizeof (x))
+	  == sizeof (x))
+	 v[c] = (double) x;
+      else
+	 v[c] = 0.0;
+
+} /* readCounters */
+
+#endif
+
+
+/* ********************************************************* */
+/* Opens the hardware counters of the calling thread for the */
+/* stages of 'ctx' (the BLAS threads are not counted).       */
+/* Returns the number of counters available: without any     */
+/* (not compiled with '-DPERFCOUNT', no PMU access, e.g. in  */
+/* a container) the stages are just timed.                   */
+int TIMEcounters (vib_context *ctx)
+{
+#ifdef PERFCOUNT
+   register int c;
+   int n = 0;
+   unsigned long long config[TIME_N_COUNTERS] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES,
+      PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+      | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      PERF_COUNT_HW_STALLED_CYCLES_BACKEND
+   };
+   unsigned int type[TIME_N_COUNTERS] = {
+      PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+      PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE
+   };
+
+   if (ctx->perfFd != NULL)
+      return 0;
+   ctx->perfFd = CHECKmalloc (TIME_N_COUNTERS * sizeof (int));
+   if (ctx->perfFd == NULL)
+      return 0;
+   for (c = 0; c < TIME_N_COUNTERS; c++)
+      if ((ctx->perfFd[c] = openCounter (type[c], config[c])) >= 0)
+	 n++;
+   if (n == 0) {
+      CHECKfree (ctx->perfFd);
+      ctx->perfFd = NULL;
+   }
+   LOGdebug (ctx, "\n %d of %d hardware counters available\n", n,
+	     TIME_N_COUNTERS);
+
+   return n;
+#else
+   LOGdebug (ctx, "\n hardware counters not compiled (-DPERFCOUNT)\n");
+
+   return 0;
+#endif
+
+} /* TIMEcounters */
+
+
+/* ********************************************************* */
+/* Closes the hardware counters and frees the stages.        */
+void TIMEfree (vib_context *ctx)
+{
+#ifdef PERFCOUNT
+   register int c;
+
+   if (ctx->perfFd != NULL)
+      for (c = 0; c < TIME_N_COUNTERS; c++)
+	 if (ctx->perfFd[c] >= 0)
+	    close (ctx->perfFd[c]);
+#endif
+   CHECKfree (ctx->perfFd);
+   CHECKfree (ctx->stages);
+   CHECKfree (ctx->progress);
+   ctx->progress = NULL;
+   ctx->perfFd = NULL;
+   ctx->stages = NULL;
+   ctx->nStages = 0;
+   ctx->curStage = -1;
+
+} /* TIMEfree */
+
+
+/* ********************************************************* */
+/* Returns the index of the stage 'name', created if it is   */
+/* new. Returns -1 if the stages can't be allocated or there */
+/* are already 'TIME_MAX_STAGES' of them (the stage is then  */
+/* just not timed).                                          */
+static int findStage (vib_context *ctx, const char *name)
+{
+   register int st;
+
+   if (ctx->stages == NULL) {
+      ctx->stages = CHECKmalloc (TIME_MAX_STAGES * sizeof (vib_stage));
+      if (ctx->stages == NULL)
+	 return -1;
+      memset (ctx->stages, 0, TIME_MAX_STAGES * sizeof (vib_stage));
+   }
+
+   for (st = 0; st < ctx->nStages; st++)
+      if (strcmp (ctx->stages[st].name, name) == 0)
+	 return st;
+   if (st == TIME_MAX_STAGES)
+      return -1;
+   strncpy (ctx->stages[st].name, name, sizeof (ctx->stages[st].name) - 1);
+   ctx->nStages++;
+
+   return st;
+
+} /* findStage */
+
+
+/* ********************************************************* */
+/* Raises the memory peak and largest block of the running   */
+/* call of the stage 'st' to 'peak' and 'largest'.           */
+static void raiseMemory (vib_context *ctx, int st, double peak,
+			 double largest)
+{
+   vib_stage *t = &ctx->stages[st];
+
+   if (peak > t->memRun)
+      t->memRun = peak;
+   if (largest > t->memRunLargest)
+      t->memRunLargest = largest;
+
+} /* raiseMemory */
+
+
+/* ********************************************************* */
+/* Starts a call of the stage 'name'. The memory statistics  */
+/* of the thread since the last mark go to the enclosing     */
+/* stage, and a new mark is set for this one.                */
+void TIMEstart (vib_context *ctx, const char *name)
+{
+   int st = findStage (ctx, name);
+   vib_stage *t;
+   check_mem m;
+
+   if (st < 0)
+      return ;
+   t = &ctx->stages[st];
+   CHECKmemStats (&m);
+   if (ctx->curStage >= 0)
+      raiseMemory (ctx, ctx->curStage, m.peak, m.largest);
+   t->parent = ctx->curStage;
+   ctx->curStage = st;
+   t->memRun = m.live;
+   t->memRunLargest = 0.0;
+   t->memAllocs0 = m.allocs;
+   t->memBytes0 = m.bytes;
+   CHECKmemMark ();
+
+   ctx->stages[st].calls++;
+   ctx->stages[st].wall0 = UTILwallTime ();
+   ctx->stages[st].cpu0 = UTILcpuTime ();
+#ifdef PERFCOUNT
+   if (ctx->perfFd != NULL)
+      readCounters (ctx, ctx->stages[st].counts0);
+#endif
+
+} /* TIMEstart */
+
+
+/* ********************************************************* */
+/* Ends the running call of the stage 'name'.                */
+void TIMEstop (vib_context *ctx, const char *name)
+{
+   int st = findStage (ctx, name);
+   vib_stage *t;
+   check_mem m;
+#ifdef PERFCOUNT
+   register int c;
+   double v[TIME_N_COUNTERS];
+#endif
+
+   if (st < 0)
+      return ;
+#ifdef PERFCOUNT
+   if (ctx->perfFd != NULL) {
+      readCounters (ctx, v);
+      for (c = 0; c < TIME_N_COUNTERS; c++)
+	 ctx->stages[st].counts[c] += v[c] - ctx->stages[st].counts0[c];
+   }
+#endif
+   ctx->stages[st].wall += UTILwallTime () - ctx->stages[st].wall0;
+   ctx->stages[st].cpu += UTILcpuTime () - ctx->stages[st].cpu0;
+
+   /* Memory of the call (with the nested stages), also */
+   /* raising the enclosing stage.                      */
+   t = &ctx->stages[st];
+   CHECKmemStats (&m);
+   raiseMemory (ctx, st, m.peak, m.largest);
+   if (t->memRun > t->memPeak)
+      t->memPeak = t->memRun;
+   if (t->memRunLargest > t->memLargest)
+      t->memLargest = t->memRunLargest;
+   t->memAllocs += m.allocs - t->memAllocs0;
+   t->memBytes += m.bytes - t->memBytes0;
+   t->rss = CHECKpeakRSS ();
+   ctx->curStage = t->parent;
+   if (t->parent >= 0)
+      raiseMemory (ctx, t->parent, t->memRun, t->memRunLargest);
+   CHECKmemMark ();
+
+} /* TIMEstop */
+
+
+/* ********************************************************* */
+/* Adds 'read' and 'written' bytes to the stage 'name'.      */
+void TIMEbytes (vib_context *ctx, const char *name, double read,
+		double written)
+{
+   int st = findStage (ctx, name);
+
+   if (st < 0)
+      return ;
+   ctx->stages[st].bytesRead += read;
+   ctx->stages[st].bytesWritten += written;
+
+} /* TIMEbytes */
+
+
+/* ********************************************************* */
+/* Adds the size of the file 'filename' to the bytes read    */
+/* (or written, if 'written') by the stage 'name'.           */
+void TIMEfile (vib_context *ctx, const char *name, const char *filename,
+	       int written)
+{
+   struct stat st;
+
+   if (stat (filename, &st) != 0)
+      return ;
+   if (written)
+      TIMEbytes (ctx, name, 0.0, (double) st.st_size);
+   else
+      TIMEbytes (ctx, name, (double) st.st_size, 0.0);
+
+} /* TIMEfile */
+
+
+/* ********************************************************* */
+/* Adds 'flops' floating point operations to the stage       */
+/* 'name'.                                                   */
+void TIMEflops (vib_context *ctx, const char *name, double flops)
+{
+   int st = findStage (ctx, name);
+
+   if (st < 0)
+      return ;
+   ctx->stages[st].flops += flops;
+
+} /* TIMEflops */
+
+
+/* ********************************************************* */
+/* Writes at 'F' the JSON number 'x / wall * 1e-9' (a rate   */
+/* in G/s), or 'null' if there is no data.                   */
+static void jsonRate (FILE *F, double x, double wall)
+{
+
+   if (x > 0.0 && wall > 0.0)
+      fprintf (F, "%.6g", 1.0e-9 * x / wall);
+   else
+      fprintf (F, "null");
+
+} /* jsonRate */
+
+
+/* ********************************************************* */
+/* Writes at 'F' the hardware counters of the stage 't' as   */
+/* JSON members ('null' if a counter is not available).      */
+static void jsonCounters (vib_context *ctx, FILE *F, vib_stage *t)
+{
+   register int c;
+
+   fprintf (F, ", \"counters\": {");
+   for (c = 0; c < TIME_N_COUNTERS; c++) {
+      fprintf (F, "%s\"%s\": ", c > 0 ? ", " : "", counterName[c]);
+      if (ctx->perfFd[c] >= 0)
+	 fprintf (F, "%.0f", t->counts[c]);
+      else
+	 fprintf (F, "null");
+   }
+   fprintf (F, "}");
+
+} /* jsonCounters */
+
+
+/* ********************************************************* */
+/* Writes at the log the hardware counters of the stages     */
+/* (in millions, '-' if not available), with the            */
+/* instructions per cycle and the stalled fraction.         */
+static void counterTable (vib_context *ctx)
+{
+   register int st, c;
+   vib_stage *t;
+
+   LOGinfo (ctx, "\n Hardware counters (millions, calling thread):\n\n");
+   LOGinfo (ctx, "    %-16s", "stage");
+   for (c = 0; c < TIME_N_COUNTERS; c++)
+      LOGinfo (ctx, " %14s", counterName[c]);
+   LOGinfo (ctx, " %6s %8s\n", "IPC", "stall%");
+   for (st = 0; st < ctx->nStages; st++) {
+      t = &ctx->stages[st];
+      LOGinfo (ctx, "    %-16s", t->name);
+      for (c = 0; c < TIME_N_COUNTERS; c++)
+	 if (ctx->perfFd[c] >= 0)
+	    LOGinfo (ctx, " %14.3f", 1.0e-6 * t->counts[c]);
+	 else
+	    LOGinfo (ctx, " %14s", "-");
+      if (ctx->perfFd[0] >= 0 && ctx->perfFd[1] >= 0 && t->counts[0] > 0.0)
+	 LOGinfo (ctx, " %6.2f", t->counts[1] / t->counts[0]);
+      else
+	 LOGinfo (ctx, " %6s", "-");
+      if (ctx->perfFd[0] >= 0 && ctx->perfFd[4] >= 0 && t->counts[0] > 0.0)
+	 LOGinfo (ctx, " %8.1f\n", 100.0 * t->counts[4] / t->counts[0]);
+      else
+	 LOGinfo (ctx, " %8s\n", "-");
+   }
+
+} /* counterTable */
+
+
+/**  ******************** Progress ***********************  **/
+
+/* ********************************************************* */
+/* Enables the progress of the loops of 'ctx': a single line */
+/* at 'stderr' (if 'line') and/or the status file (if        */
+/* 'file') rewritten at most every 'period' seconds.         */
+int TIMEsetProgress (vib_context *ctx, int line, int file, double period)
+{
+
+   if (!line && !file)
+      return VIB_SUCCESS;
+   if (ctx->progress == NULL)
+      ctx->progress = CHECKmalloc (sizeof (vib_progress));
+   if (ctx->progress == NULL)
+      return VIB_ERR_MEMORY;
+   memset (ctx->progress, 0, sizeof (vib_progress));
+   ctx->progress->line = line;
+   ctx->progress->file = file;
+   ctx->progress->period = (period > 0.0 ? period : LOG_PERIOD);
+
+   return VIB_SUCCESS;
+
+} /* TIMEsetProgress */
+
+
+/* ********************************************************* */
+/* Sets at '*elapsed', '*eta', '*MBps' and '*GFLOPs' the     */
+/* elapsed time, the estimated time left and the rates of    */
+/* the running loop (negative if still unknown).             */
+static void progressRates (vib_context *ctx, double *elapsed, double *eta,
+			   double *MBps, double *GFLOPs)
+{
+   int st;
+   vib_progress *p = ctx->progress;
+
+   *elapsed = UTILwallTime () - p->wall0;
+   *eta = *MBps = *GFLOPs = -1.0;
+   if (p->done > 0)
+      *eta = *elapsed / p->done * (p->total - p->done);
+   st = (p->source[0] != '\0' ? findStage (ctx, p->source) : -1);
+   if (st >= 0 && *elapsed > 0.0) {
+      if (ctx->stages[st].bytesRead > p->bytes0)
+	 *MBps = 1.0e-6 * (ctx->stages[st].bytesRead - p->bytes0) / *elapsed;
+      if (ctx->stages[st].flops > p->flops0)
+	 *GFLOPs = 1.0e-9 * (ctx->stages[st].flops - p->flops0) / *elapsed;
+   }
+
+} /* progressRates */
+
+
+/* ********************************************************* */
+/* Writes the seconds 't' as 'h:mm:ss' at 's'.               */
+static void hms (double t, char *s)
+{
+   int sec = (int) (t + 0.5);
+
+   sprintf (s, "%d:%02d:%02d", sec / 3600, (sec / 60) % 60, sec % 60);
+
+} /* hms */
+
+
+/* ********************************************************* */
+/* Rewrites the single progress line at 'stderr'.            */
+static void progressLine (vib_context *ctx)
+{
+   double elapsed, eta, MBps, GFLOPs;
+   char s[16];
+   vib_progress *p = ctx->progress;
+
+   progressRates (ctx, &elapsed, &eta, &MBps, &GFLOPs);
+   fprintf (stderr, "\r\033[K %s: %d/%d %s (%.0f%%)", p->stage, p->done,
+	    p->total, p->unit, 100.0 * p->done / (p->total > 0 ? p->total : 1));
+   if (MBps >= 0.0)
+      fprintf (stderr, ", %.1f MB/s", MBps);
+   if (GFLOPs >= 0.0)
+      fprintf (stderr, ", %.2f GFLOP/s", GFLOPs);
+   hms (elapsed, s);
+   fprintf (stderr, ", %s", s);
+   if (eta >= 0.0 && p->done < p->total) {
+      hms (eta, s);
+      fprintf (stderr, ", ETA %s", s);
+   }
+   fflush (stderr);
+
+} /* progressLine */
+
+
+/* ********************************************************* */
+/* Rewrites the status file '[FC directory][label].progress  */
+/* .json' (through a temporary file, so that a monitor never */
+/* reads it half written).                                   */
+static void progressFile (vib_context *ctx)
+{
+   double elapsed, eta, MBps, GFLOPs;
+   char *name, *tmp;
+   FILE *F;
+   vib_progress *p = ctx->progress;
+
+   if (ctx->FCdir == NULL)
+      return ;
+   name = CHECKmalloc (strlen (ctx->FCdir) + strlen (ctx->sysLabel) + 24);
+   tmp = CHECKmalloc (strlen (ctx->FCdir) + strlen (ctx->sysLabel) + 24);
+   if (name == NULL || tmp == NULL) {
+      CHECKfree (name);
+      CHECKfree (tmp);
+      return ;
+   }
+   sprintf (name, "%s%s.progress.json", ctx->FCdir, ctx->sysLabel);
+   sprintf (tmp, "%s.tmp", name);
+
+   progressRates (ctx, &elapsed, &eta, &MBps, &GFLOPs);
+   F = fopen (tmp, "w");
+   if (F != NULL) {
+      fprintf (F, "{\"label\": \"%s\", \"stage\": \"%s\", \"unit\":"
+	       " \"%s\", \"done\": %d, \"total\": %d,", ctx->sysLabel,
+	       p->stage, p->unit, p->done, p->total);
+      fprintf (F, " \"elapsed\": %.3f, \"eta\": ", elapsed);
+      if (eta >= 0.0)
+	 fprintf (F, "%.3f", eta);
+      else
+	 fprintf (F, "null");
+      fprintf (F, ", \"MBps\": ");
+      if (MBps >= 0.0)
+	 fprintf (F, "%.3f", MBps);
+      else
+	 fprintf (F, "null");
+      fprintf (F, ", \"GFLOPs\": ");
+      if (GFLOPs >= 0.0)
+	 fprintf (F, "%.3f", GFLOPs);
+      else
+	 fprintf (F, "null");
+      fprintf (F, ", \"updated\": %ld}\n", (long) time (NULL));
+      if (fclose (F) == 0)
+	 rename (tmp, name);
+   }
+
+   /* Frees memory. */
+   CHECKfree (name);
+   CHECKfree (tmp);
+
+} /* progressFile */
+
+
+/* ********************************************************* */
+/* Starts the loop 'stage' of 'total' steps of 'unit', whose */
+/* rates come from the bytes and flops of the stage 'source' */
+/* ("" for none).                                            */
+void TIMEprogressStart (vib_context *ctx, const char *stage,
+			const char *source, const char *unit, int total)
+{
+   int st;
+   vib_progress *p = ctx->progress;
+
+   if (p == NULL)
+      return ;
+   snprintf (p->stage, sizeof (p->stage), "%s", stage);
+   snprintf (p->source, sizeof (p->source), "%s", source);
+   p->unit = unit;
+   p->done = 0;
+   p->total = total;
+   p->wall0 = p->lineTime = p->fileTime = UTILwallTime ();
+   st = (source[0] != '\0' ? findStage (ctx, source) : -1);
+   p->bytes0 = (st >= 0 ? ctx->stages[st].bytesRead : 0.0);
+   p->flops0 = (st >= 0 ? ctx->stages[st].flops : 0.0);
+   if (p->line && ctx->out == stdout)
+      progressLine (ctx);
+   if (p->file)
+      progressFile (ctx);
+
+} /* TIMEprogressStart */
+
+
+/* ********************************************************* */
+/* Sets the completed steps of the running loop. The line is */
+/* rewritten at most every 'LOG_PERIOD' / 4 seconds and the  */
+/* status file every 'period', so the cost of a step is a    */
+/* clock read.                                               */
+void TIMEprogress (vib_context *ctx, int done)
+{
+   double now;
+   vib_progress *p = ctx->progress;
+
+   if (p == NULL)
+      return ;
+   p->done = done;
+   now = UTILwallTime ();
+   if (p->line && ctx->out == stdout && now - p->lineTime >= LOG_PERIOD / 4) {
+      progressLine (ctx);
+      p->lineTime = now;
+   }
+   if (p->file && now - p->fileTime >= p->period) {
+      progressFile (ctx);
+      p->fileTime = now;
+   }
+
+} /* TIMEprogress */
+
+
+/* ********************************************************* */
+/* Ends the running loop (with its final state at the line   */
+/* and the status file).                                     */
+void TIMEprogressEnd (vib_context *ctx)
+{
+   vib_progress *p = ctx->progress;
+
+   if (p == NULL)
+      return ;
+   if (p->line && ctx->out == stdout) {
+      progressLine (ctx);
+      fprintf (stderr, "\n");
+   }
+   if (p->file)
+      progressFile (ctx);
+
+} /* TIMEprogressEnd */
+
+
+/**  *****************************************************  **/
+
+/* ********************************************************* */
+/* Writes at 's' the size '2^b' bytes with its unit.         */
+static void binSize (int b, char *s)
+{
+
+   if (b < 10)
+      sprintf (s, "%d B", 1 << b);
+   else if (b < 20)
+      sprintf (s, "%d KB", 1 << (b - 10));
+   else if (b < 30)
+      sprintf (s, "%d MB", 1 << (b - 20));
+   else
+      sprintf (s, "%.0f GB", ldexp (1.0, b - 30));
+
+} /* binSize */
+
+
+/* ********************************************************* */
+/* Writes at the log the memory of the stages (allocated by  */
+/* the thread running them), the peaks of the process and    */
+/* the histogram of the allocation sizes.                    */
+static void memoryTable (vib_context *ctx)
+{
+   register int st, b;
+   double peak, count[CHECK_MEM_BINS], bytes[CHECK_MEM_BINS];
+   char lo[16], hi[16];
+   vib_stage *t;
+
+   LOGinfo (ctx, "\n Memory (MB; peak RSS of the process at the end of"
+	    " the stage):\n\n");
+   LOGinfo (ctx, "    %-16s %8s %11s %11s %11s %11s\n", "stage", "allocs",
+	    "allocated", "largest", "peak live", "peak RSS");
+   for (st = 0; st < ctx->nStages; st++) {
+      t = &ctx->stages[st];
+      LOGinfo (ctx, "    %-16s %8.0f %11.2f %11.2f %11.2f %11.2f\n",
+	       t->name, t->memAllocs, 1.0e-6 * t->memBytes,
+	       1.0e-6 * t->memLargest, 1.0e-6 * t->memPeak, 1.0e-6 * t->rss);
+   }
+   CHECKmemTotal (&peak);
+   LOGinfo (ctx, "    %-16s %8s %11s %11s %11.2f %11.2f\n", "process", "",
+	    "", "", 1.0e-6 * peak, 1.0e-6 * CHECKpeakRSS ());
+
+   /* Histogram of the allocation sizes (of the process). */
+   CHECKmemHistogram (count, bytes);
+   LOGinfo (ctx, "\n    %-22s %8s %11s\n", "allocation sizes", "allocs",
+	    "MB");
+   for (b = 0; b < CHECK_MEM_BINS; b++)
+      if (count[b] > 0.0) {
+	 binSize (b, lo);
+	 binSize (b + 1, hi);
+	 LOGinfo (ctx, "    [%8s, %8s) %8.0f %11.2f\n", lo, hi, count[b],
+		  1.0e-6 * bytes[b]);
+      }
+
+} /* memoryTable */
+
+
+/* ********************************************************* */
+/* Writes at 'F' the memory of the process (peaks and the    */
+/* histogram of the allocation sizes) as a JSON member.      */
+static void jsonMemory (FILE *F)
+{
+   register int b, n;
+   double peak, count[CHECK_MEM_BINS], bytes[CHECK_MEM_BINS];
+
+   CHECKmemTotal (&peak);
+   CHECKmemHistogram (count, bytes);
+   fprintf (F, "  \"memory\": {\"peak_allocated\": %.0f, \"peak_rss\":"
+	    " %.0f,\n    \"histogram\": [", peak, CHECKpeakRSS ());
+   for (b = 0, n = 0; b < CHECK_MEM_BINS; b++)
+      if (count[b] > 0.0)
+	 fprintf (F, "%s\n      {\"min_bytes\": %.0f, \"allocs\": %.0f,"
+		  " \"bytes\": %.0f}", n++ > 0 ? "," : "", ldexp (1.0, b),
+		  count[b], bytes[b]);
+   fprintf (F, "\n    ]\n  },\n");
+
+} /* jsonMemory */
+
+
+/* ********************************************************* */
+/* Writes the stages of 'ctx' (and the run totals 'wall' and */
+/* 'cpu') at the JSON file 'filename'.                       */
+static int timingJSON (vib_context *ctx, const char *filename,
+		       double wall, double cpu)
+{
+   register int st;
+   vib_stage *t;
+   FILE *F;
+
+   F = CHECKfopen (filename, "w");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+
+   fprintf (F, "{\n  \"label\": \"%s\",\n", ctx->sysLabel);
+   fprintf (F, "  \"nAtoms\": %d,\n  \"nDyn\": %d,\n  \"no_u\": %d,\n"
+	    "  \"nspin\": %d,\n", ctx->nAtoms, ctx->nDyn, ctx->no_u,
+	    ctx->nspin);
+   fprintf (F, "  \"wall\": %.6f,\n  \"cpu\": %.6f,\n", wall, cpu);
+   jsonMemory (F);
+   fprintf (F, "  \"stages\": [");
+   for (st = 0; st < ctx->nStages; st++) {
+      t = &ctx->stages[st];
+      fprintf (F, "%s\n    {\"name\": \"%s\", \"calls\": %d,"
+	       " \"wall\": %.6f, \"cpu\": %.6f,", st > 0 ? "," : "",
+	       t->name, t->calls, t->wall, t->cpu);
+      fprintf (F, " \"bytes_read\": %.0f, \"bytes_written\": %.0f,"
+	       " \"flops\": %.0f, \"GBps\": ", t->bytesRead,
+	       t->bytesWritten, t->flops);
+      jsonRate (F, t->bytesRead + t->bytesWritten, t->wall);
+      fprintf (F, ", \"GFLOPs\": ");
+      jsonRate (F, t->flops, t->wall);
+      fprintf (F, ", \"mem_allocs\": %.0f, \"mem_bytes\": %.0f,"
+	       " \"mem_largest\": %.0f, \"mem_peak\": %.0f,"
+	       " \"peak_rss\": %.0f", t->memAllocs, t->memBytes,
+	       t->memLargest, t->memPeak, t->rss);
+      if (ctx->perfFd != NULL)
+	 jsonCounters (ctx, F, t);
+      fprintf (F, "}");
+   }
+   fprintf (F, "\n  ]\n}\n");
+
+   return CHECKfclose (fclose (F), filename);
+
+} /* timingJSON */
+
+
+/* ********************************************************* */
+/* Writes the timing of the stages as a table at the log and */
+/* at the JSON file '[FC directory][label].timing.json'. The */
+/* totals are taken from the creation of the context.        */
+int TIMEreport (vib_context *ctx)
+{
+   register int st;
+   int info;
+   double wall, cpu, bytes;
+   char *jsonFile;
+   vib_stage *t;
+
+   wall = UTILwallTime () - ctx->wallStart;
+   cpu = UTILcpuTime () - ctx->cpuStart;
+
+   /* Table at the log. */
+   LOGinfo (ctx, "\n Timing (stages may nest):\n\n");
+   LOGinfo (ctx, "    %-16s %6s %10s %10s %11s %11s %8s %8s\n", "stage",
+	    "calls", "wall (s)", "cpu (s)", "read (MB)", "write (MB)",
+	    "GB/s", "GFLOP/s");
+   for (st = 0; st < ctx->nStages; st++) {
+      t = &ctx->stages[st];
+      bytes = t->bytesRead + t->bytesWritten;
+      LOGinfo (ctx, "    %-16s %6d %10.3f %10.3f %11.2f %11.2f", t->name,
+	       t->calls, t->wall, t->cpu, 1.0e-6 * t->bytesRead,
+	       1.0e-6 * t->bytesWritten);
+      if (bytes > 0.0 && t->wall > 0.0)
+	 LOGinfo (ctx, " %8.3f", 1.0e-9 * bytes / t->wall);
+      else
+	 LOGinfo (ctx, " %8s", "-");
+      if (t->flops > 0.0 && t->wall > 0.0)
+	 LOGinfo (ctx, " %8.3f\n", 1.0e-9 * t->flops / t->wall);
+      else
+	 LOGinfo (ctx, " %8s\n", "-");
+   }
+   LOGinfo (ctx, "    %-16s %6s %10.3f %10.3f\n", "total", "", wall, cpu);
+   if (ctx->perfFd != NULL)
+      counterTable (ctx);
+   memoryTable (ctx);
+   LOGflush (ctx);
+
+   /* JSON file (only once the system is known). */
+   if (ctx->FCdir == NULL)
+      return VIB_SUCCESS;
+   jsonFile = CHECKmalloc (strlen (ctx->FCdir) + strlen (ctx->sysLabel) + 16);
+   if (jsonFile == NULL)
+      return VIB_ERR_MEMORY;
+   sprintf (jsonFile, "%s%s.timing.json", ctx->FCdir, ctx->sysLabel);
+   info = timingJSON (ctx, jsonFile, wall, cpu);
+
+   /* Frees memory. */
+   CHECKfree (jsonFile);
+
+   return info;
+
+} /* TIMEreport */
+
+
+/* ************************ Drafts ************************* */
@@ -0,0 +1,128 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Interface for the per-stage timing of a run. Each      **/
+/**  stage accumulates, over its calls, the wall and CPU    **/
+/**  times (the CPU time of the whole process, so that the  **/
+/**  BLAS threads are counted), the bytes read and written  **/
+/**  and the floating point operations of its BLAS/LAPACK   **/
+/**  calls. Stages may nest (e.g. 'readHSfile' inside       **/
+/**  'deltaH'). At the end of the run the stages are        **/
+/**  written as a table at the log and as the JSON file     **/
+/**  '[FC directory][label].timing.json'. Compiled with     **/
+/**  '-DPERFCOUNT' (Linux), the stages may also count the   **/
+/**  hardware events of 'TIME_COUNTER_NAMES' of the calling **/
+/**  thread with 'perf_event_open' (see 'TIMEcounters').    **/
+/**  The memory allocated by the thread running a stage     **/
+/**  ('CHECKmalloc' statistics) is kept as well: peak of    **/
+/**  the live bytes, largest block and bytes allocated,     **/
+/**  next to the peak RSS of the process at its end.        **/
+/**  The long loops (displacements, atoms, modes) may also  **/
+/**  report their progress, rates and ETA as a single line  **/
+/**  at 'stderr' and/or as a periodically rewritten status  **/
+/**  file (see 'TIMEsetProgress').                          **/
+/**  *****************************************************  **/
+
+/* Maximum number of stages of a run. */
+#define TIME_MAX_STAGES 24
+
+/* Hardware counters of the stages: cycles, instructions, */
+/* last level cache misses, data TLB misses and stalled    */
+/* (backend) cycles.                                       */
+#define TIME_N_COUNTERS 5
+#define TIME_COUNTER_NAMES { "cycles", "instructions", "LLC_misses", \
+			     "dTLB_misses", "stalled_cycles" }
+
+/* Timing of a stage (accumulated over its calls). */
+typedef struct VIBSTAGE vib_stage;
+struct VIBSTAGE {
+   char name[24]; /* stage name */
+   int calls; /* number of calls */
+   double wall; /* wall time (s) */
+   double cpu; /* CPU time of the process (s) */
+   double bytesRead; /* bytes read (files or, at the in-memory */
+		     /* kernels, estimated memory traffic)     */
+   double bytesWritten; /* bytes written (as above) */
+   double flops; /* floating point operations */
+   double wall0, cpu0; /* start of the running call */
+   double counts[TIME_N_COUNTERS]; /* hardware counters */
+   double counts0[TIME_N_COUNTERS]; /* (at the start of the call) */
+   int parent; /* enclosing stage of the running call (-1 = none) */
+   double memAllocs, memBytes; /* allocations and bytes allocated */
+   double memPeak; /* peak of the live bytes of the thread */
+   double memLargest; /* largest block allocated */
+   double memRun, memRunLargest; /* (of the running call) */
+   double memAllocs0, memBytes0; /* (at the start of the call) */
+   double rss; /* peak RSS of the process at the end of the stage */
+};
+
+/* Progress of the running loop. */
+typedef struct VIBPROGRESS vib_progress;
+struct VIBPROGRESS {
+   int line; /* single line at 'stderr' (rewritten with '\r') */
+   int file; /* status file '[FC directory][label].progress.json' */
+   double period; /* minimum interval between status file writes (s) */
+   char stage[24]; /* running loop */
+   char source[24]; /* stage whose bytes and flops give the rates */
+   const char *unit; /* unit of the steps (e.g. "atoms") */
+   int done, total; /* completed and total steps */
+   double wall0; /* start of the loop */
+   double bytes0, flops0; /* of the stage 'source' at the start */
+   double lineTime, fileTime; /* last outputs */
+};
+
+/* Enables the progress of the loops: a single line at 'stderr' */
+/* (if 'line') and/or the status file (if 'file', rewritten at  */
+/* most every 'period' seconds).                                */
+int TIMEsetProgress (vib_context *ctx, int line, int file, double period);
+
+/* Starts the loop 'stage' of 'total' steps of 'unit', with the */
+/* rates from the bytes and flops of the stage 'source'.        */
+void TIMEprogressStart (vib_context *ctx, const char *stage,
+			const char *source, const char *unit, int total);
+
+/* Sets the completed steps of the running loop (the outputs */
+/* are rate limited, so it may be called at every step).     */
+void TIMEprogress (vib_context *ctx, int done);
+
+/* Ends the running loop. */
+void TIMEprogressEnd (vib_context *ctx);
+
+/* Opens the hardware counters of the calling thread for the */
+/* stages of 'ctx'. Returns the number of counters available */
+/* (0 if none, e.g. not compiled with '-DPERFCOUNT' or not   */
+/* allowed in a container, and the stages are just timed).   */
+int TIMEcounters (vib_context *ctx);
+
+/* Closes the hardware counters and frees the stages. */
+void TIMEfree (vib_context *ctx);
+
+/* Starts a call of the stage 'name' (created at its first call). */
+void TIMEstart (vib_context *ctx, const char *name);
+
+/* Ends the running call of the stage 'name'. */
+void TIMEstop (vib_context *ctx, const char *name);
+
+/* Adds 'read' and 'written' bytes to the stage 'name'. */
+void TIMEbytes (vib_context *ctx, const char *name, double read,
+		double written);
+
+/* Adds the size of the file 'filename' to the bytes read (or */
+/* written, if 'written') by the stage 'name'.                */
+void TIMEfile (vib_context *ctx, const char *name, const char *filename,
+	       int written);
+
+/* Adds 'flops' floating point operations to the stage 'name'. */
+void TIMEflops (vib_context *ctx, const char *name, double flops);
+
+/* Writes the timing table at the log and the JSON file. */
+int TIMEreport (vib_context *ctx);
+
+
+/* ************************ Drafts ************************* */
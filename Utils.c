@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <time.h>
 #include "Check.h"
 #include "Utils.h"
 
@@ -21,12 +22,15 @@
 
 /* ********************************************************* */
 /* Allocates and initialize a vector 'V[n]' of integers.     */
-void *UTILintVector (int n)
+/* Returns 'NULL' if there is not enough memory.             */
+void *UTILintVector (size_t n)
 {
-   register int i;
+   register size_t i;
    int *V;
 
    V = CHECKmalloc (n * sizeof (int));
+   if (V == NULL)
+      return NULL;
 
    for (i = 0; i < n; i++)
       V[i] = 0;
@@ -38,12 +42,15 @@ void *UTILintVector (int n)
 
 /* ********************************************************* */
 /* Allocates and initializes a vector 'V[n]' of doubles.     */
-void *UTILdoubleVector (int n)
+/* Returns 'NULL' if there is not enough memory.             */
+void *UTILdoubleVector (size_t n)
 {
-   register int i;
+   register size_t i;
    double *V;
 
    V = CHECKmalloc (n * sizeof (double));
+   if (V == NULL)
+      return NULL;
 
    for (i = 0; i < n; i++)
       V[i] = 0.0;
@@ -55,9 +62,9 @@ void *UTILdoubleVector (int n)
 
 /* ********************************************************* */
 /* Resets a vector 'V[n]' of doubles with 0.0's.             */
-void UTILresetDoubleVector (int n, double *V)
+void UTILresetDoubleVector (size_t n, double *V)
 {
-   register int i;
+   register size_t i;
 
    for (i = 0; i < n; i++)
       V[i] = 0.0;
@@ -68,9 +75,9 @@ void UTILresetDoubleVector (int n, double *V)
 /* ********************************************************* */
 /* Copies the elements form a vector 'Orig[n]' to another    */
 /* vector 'Dest[n]'.                                         */
-void UTILcopyVector (double *Dest, double *Orig, int n)
+void UTILcopyVector (double *Dest, double *Orig, size_t n)
 {
-   register int i;
+   register size_t i;
 
    for (i = 0; i < n; i++)
       Dest[i] = Orig[i];
@@ -109,6 +116,35 @@ double UTILnorm (int n, double *V)
 } /* UTILnorm */
 
 
+/**  ********************** Timing ***********************  **/
+
+/* ********************************************************* */
+/* Returns the wall clock time in seconds.                   */
+double UTILwallTime ()
+{
+   struct timespec t;
+
+   clock_gettime (CLOCK_MONOTONIC, &t);
+
+   return t.tv_sec + 1.0e-9 * t.tv_nsec;
+
+} /* UTILwallTime */
+
+
+/* ********************************************************* */
+/* Returns the CPU time used by the process in seconds,      */
+/* summed over all its threads (including the BLAS ones).    */
+double UTILcpuTime ()
+{
+   struct timespec t;
+
+   clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &t);
+
+   return t.tv_sec + 1.0e-9 * t.tv_nsec;
+
+} /* UTILcpuTime */
+
+
 /* ************************ Drafts ************************* */
 
 
@@ -24,9 +24,11 @@
 /* C matrix indexation (row-major order) */
 /* #define idx(i, j, ncol) ((i) * (ncol) + j) */
 
-/* Fortran matrix indexation (column-major order) */
-#define idx(i, j, nrow) (i + (j) * (nrow))
-#define idx3d(i, j, k, nrow, ncol) (i + (j) * (nrow) + (k) * (nrow) * (ncol))
+/* Fortran matrix indexation (column-major order, in 'size_t' */
+/* so that the blocks of large matrices don't overflow 'int') */
+#define idx(i, j, nrow) (i + (size_t) (j) * (nrow))
+#define idx3d(i, j, k, nrow, ncol) \
+   (i + (size_t) (j) * (nrow) + (size_t) (k) * (nrow) * (ncol))
 
 
 /**  *********************** Types ***********************  **/
@@ -41,16 +43,16 @@ typedef struct {
 /**  *********** Matrix and Vectors Utilities ************  **/
 
 /* Allocates and initialize a vector 'V[n]' of integers. */
-void *UTILintVector (int n);
+void *UTILintVector (size_t n);
 
 /* Allocates and initializes a vector 'V[n]' of doubles. */
-void *UTILdoubleVector (int n);
+void *UTILdoubleVector (size_t n);
 
 /* Resets a vector 'V[n]' of doubles with 0.0's. */
-void UTILresetDoubleVector (int n, double *V);
+void UTILresetDoubleVector (size_t n, double *V);
 
 /* Copies the elements form a vector 'Orig[n]' to 'Dest[n]'. */
-void UTILcopyVector (double *Dest, double *Orig, int n);
+void UTILcopyVector (double *Dest, double *Orig, size_t n);
 
 /* Checks if the matrix 'M[n][n]' is symetric. */
 void UTILcheckSym (char *name, double *M, int n, double lim);
@@ -58,5 +60,14 @@ void UTILcheckSym (char *name, double *M, int n, double lim);
 /* Computes the Euclidean norm of a double precision vector 'V[n]'. */
 double UTILnorm (int n, double *V);
 
+
+/**  ********************** Timing ***********************  **/
+
+/* Returns the wall clock time in seconds. */
+double UTILwallTime ();
+
+/* Returns the CPU time of the process (all threads) in seconds. */
+double UTILcpuTime ();
+
 /* ************************ Drafts ************************* */
 
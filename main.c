@@ -19,9 +19,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef INOTIFY
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+#include "Check.h"
 #include "Utils.h"
 #include "Phonon.h"
+#include "Log.h"
+#include "Meph.h"
+#include "Timing.h"
+#include "Kernels.h"
 
 /* Prints the header on the screen. */
 static void header ();
@@ -29,15 +41,155 @@ static void header ();
 /* Prints the "how to run" on the screen. */
 static void howto ();
 
+/* Prints the error message for the code 'info' and exits. */
+static void abortRun (vib_context *ctx, int info);
+
+/* Set by the signal handler to stop at the next checkpoint. */
+static volatile sig_atomic_t stopRun = 0;
+
+/* Installs the handler which stops a checkpointed run on */
+/* 'SIGTERM', 'SIGINT', 'SIGUSR1' or 'SIGUSR2'.           */
+static void catchStop ();
+
+/* Maximum number of atom subsets at '--meph-subsets'. */
+#define MAX_SUBSETS 32
+
+/* Structure for the run options (shared by the single and */
+/* the batch runs).                                         */
+typedef struct RUNOPTS runopts;
+struct RUNOPTS {
+   int checkpoint; /* stage checkpoints */
+   char *chkDir; /* checkpoint directory ('NULL' = default) */
+   int cache; /* 'dH' cache */
+   char *cacheDir; /* 'dH' cache directory ('NULL' = default) */
+   double onlySwait; /* wait for the '.onlyS' files (s, 0 = no wait) */
+   int activeShells; /* active region: neighbour shells (0 = off) */
+   double activeCutoff; /* and/or distance (Ang, 0 = off) */
+   int activeCheck; /* its truncation error against the full basis */
+   char *symOps; /* symmetry operations ("auto", a file or 'NULL') */
+   int bMeph; /* '.bMeph' format version */
+   int bMephSum; /* per-block checksums at '.bMeph' */
+   int mephText; /* text '.Meph' format */
+   double mephTol; /* tolerance of the sparse '.bMeph' (0 = dense) */
+   int mephRelTol; /* 'mephTol' is relative */
+   int project; /* projection onto the 'H0' eigenstates */
+   double projEmin, projEmax; /* its energy window (eV) */
+   int jmol; /* Jmol output */
+   int jmolFirst, jmolLast; /* modes at the Jmol output */
+   int jmolWindow; /* Jmol output only in the energy window: */
+   double jmolEmin, jmolEmax; /* (eV) */
+   int summary; /* per-mode coupling summaries */
+   int nSubsets; /* number of atom subsets of the summaries */
+   int subsets[2*MAX_SUBSETS]; /* their atom ranges */
+   int logLevel; /* log verbosity */
+   int counters; /* hardware counters at the stages */
+   int progress; /* single progress line at 'stderr' */
+   int status; /* status file '[label].progress.json' */
+   double statusPeriod; /* its minimum rewrite interval (s) */
+};
+
+/* Sets the default run options. */
+static void initOptions (runopts *o);
+
+/* Reads the option 'opt' into 'o' (returns 0 if it is unknown). */
+static int readOption (const char *opt, runopts *o);
+
+/* Sets the run options 'o' at 'ctx' for the FC directory 'FCdir'. */
+static int setOptions (vib_context *ctx, runopts *o, const char *FCdir);
+
+/* Structure for one FC directory of a batch run. */
+typedef struct BATCHJOB batchjob;
+struct BATCHJOB {
+   char FCdir[512]; /* FC directory */
+   char FCinput[256]; /* FC input file */
+   char FCsplit[16]; /* 'splitFC' or " " */
+   int calcType; /* 1 = full, 2 = onlyPh */
+   int info; /* returned error code */
+   const char *stage; /* stage where the job failed */
+   double memory; /* estimated peak memory (bytes) */
+   double time; /* wall time (seconds) */
+};
+
+/* Structure for the state shared by the batch workers. */
+typedef struct BATCHRUN batchrun;
+struct BATCHRUN {
+   batchjob *job; /* list of jobs */
+   int nJobs; /* number of jobs */
+   int next; /* next job to be run */
+   int running; /* jobs holding memory */
+   runopts opt; /* run options of all jobs */
+   double memBudget; /* memory budget (bytes, 0 = unlimited) */
+   double memUsed; /* memory held by running jobs */
+   pthread_mutex_t lock;
+   pthread_cond_t freed; /* signals memory released */
+};
+
+/* Runs many FC directories concurrently in this process. */
+static int batch (int nargs, char *arg[]);
+
+/* Structure for the watch mode options. */
+typedef struct WATCHOPTS watchopts;
+struct WATCHOPTS {
+   double poll; /* polling interval (s, 0 = inotify if available) */
+   double settle; /* time the files of an atom must stay unchanged (s) */
+};
+
+/* Reads the watch mode option 'opt' into 'w'. */
+static int readWatchOption (const char *opt, watchopts *w);
+
+/* Waits for the 'FC[i]/' runs, computing the 'dH' of each atom */
+/* as soon as its run is complete.                              */
+static int watch (vib_context *ctx, char *exec, char *FCdir,
+		  char *FCinput, int calcType, watchopts *w);
+
 int main (int nargs, char *arg[])
 {
-   int nDynTot, nDynOrb, spinPol, calcType;
+   register int i, npos;
+   int nDynTot, nDynOrb, spinPol, calcType, watchRun, info;
    double *EigVec, *EigVal, *Meph;
-   double time;
-   clock_t inicial, final;
+   runopts opt;
+   watchopts wopt;
+   vib_context *ctx;
+
+   /* Batch of FC directories. */
+   if (nargs > 1 && strcmp (arg[1], "batch") == 0) {
+      header ();
+      return batch (nargs, arg);
+   }
+
+   /* Watch mode (then a 'splitFC' run). */
+   watchRun = (nargs > 1 && strcmp (arg[1], "watch") == 0);
+   if (watchRun) {
+      arg[1] = arg[0];
+      arg++;
+      nargs--;
+   }
+   wopt.poll = 0.0;
+   wopt.settle = 5.0;
+
+   /* Separates the options from the positional arguments. */
+   initOptions (&opt);
+   for (i = 1, npos = 1; i < nargs; i++) {
+      if (strncmp (arg[i], "--", 2) != 0)
+	 arg[npos++] = arg[i];
+      else if (watchRun && readWatchOption (arg[i], &wopt))
+	 continue ;
+      else if (!readOption (arg[i], &opt)) {
+	 fprintf (stderr, "\n Unknown option or wrong value '%s'!\n", arg[i]);
+	 howto ();
+	 exit (EXIT_FAILURE);
+      }
+   }
+   nargs = npos;
+   if (watchRun && opt.symOps != NULL) {
+      fprintf (stderr, "\n The watch mode doesn't support '--symmetry'!\n");
+      howto ();
+      exit (EXIT_FAILURE);
+   }
 
    /* Writes the header on the screen. */
-   header ();
+   if (opt.logLevel > LOG_QUIET)
+      header ();
 
    /* Checks if the input were typed correctly. */
    if (nargs < 4 || nargs > 5) {
@@ -46,9 +198,6 @@ int main (int nargs, char *arg[])
       exit (EXIT_FAILURE);
    }
 
-   /* Time is running. */
-   inicial = clock();
-
    /* Checks calculation option (full or onlyPh). */
    if (strcmp (arg[3], "full") == 0)
       calcType = 1;
@@ -63,51 +212,94 @@ int main (int nargs, char *arg[])
       }
    }
 
+   /* Creates the calculation context. */
+   ctx = PHONnewContext ();
+   if (ctx == NULL)
+      abortRun (ctx, VIB_ERR_MEMORY);
+
+   /* Sets the run options (the watch mode needs the cache */
+   /* and waits for the 'onlyS' runs too).                 */
+   if (watchRun) {
+      opt.cache = 1;
+      if (opt.onlySwait == 0.0)
+	 opt.onlySwait = 86400.0;
+   }
+   info = setOptions (ctx, &opt, arg[1]);
+   if (info != VIB_SUCCESS)
+      abortRun (ctx, info);
+   if (opt.checkpoint || opt.onlySwait > 0.0)
+      catchStop ();
+
+   /* Waits for the SIESTA runs at the 'FC[i]' directories. */
+   if (watchRun) {
+      info = watch (ctx, arg[0], arg[1], arg[2], calcType, &wopt);
+      if (info != VIB_SUCCESS)
+	 abortRun (ctx, info);
+   }
+
    /* Reads info from FC fdf input file. */
-   if (nargs == 4)
-      PHONreadFCfdf (arg[0], arg[1], arg[2], calcType, " ",
-		     &nDynTot, &nDynOrb, &spinPol);
+   nDynOrb = 0;
+   if (watchRun)
+      info = PHONreadFCfdf (ctx, arg[0], arg[1], arg[2], calcType,
+			    "splitFC", &nDynTot, &nDynOrb, &spinPol);
+   else if (nargs == 4)
+      info = PHONreadFCfdf (ctx, arg[0], arg[1], arg[2], calcType, " ",
+			    &nDynTot, &nDynOrb, &spinPol);
    else
-      PHONreadFCfdf (arg[0], arg[1], arg[2], calcType, arg[4],
-		     &nDynTot, &nDynOrb, &spinPol);
+      info = PHONreadFCfdf (ctx, arg[0], arg[1], arg[2], calcType, arg[4],
+			    &nDynTot, &nDynOrb, &spinPol);
+   if (info != VIB_SUCCESS)
+      abortRun (ctx, info);
 
    /* Computes phonon frequencies. */
    EigVec = UTILdoubleVector (nDynTot * nDynTot);
    EigVal = UTILdoubleVector (nDynTot);
-   PHONfreq (EigVec, EigVal);
+   if (EigVec == NULL || EigVal == NULL)
+      abortRun (ctx, VIB_ERR_MEMORY);
+   info = PHONfreq (ctx, EigVec, EigVal);
+   if (info != VIB_SUCCESS)
+      abortRun (ctx, info);
 
-   /* Writes a 'xyz' file for each computed phonon mode. */
-   PHONjmolVib (EigVec);
+   /* Writes the phonon modes for Jmol. */
+   info = PHONjmolOut (ctx, EigVec, EigVal);
+   if (info != VIB_SUCCESS)
+      abortRun (ctx, info);
 
    /* At "onlyPh" calculations it is finished. */
    if (calcType == 2) {
 
-      /* Frees memory. */
-      free (EigVec);
-      free (EigVal);
+      /* Reports the timing of the stages. */
+      info = TIMEreport (ctx);
+      if (info != VIB_SUCCESS)
+	 abortRun (ctx, info);
 
-      /* Calculates the execution time. */
-      final = clock();
-      time = (double)(final - inicial) / CLOCKS_PER_SEC;
-      printf ("\n This calculation took %.2f seconds.\n\n", time);
+      /* Frees memory. */
+      CHECKfree (EigVec);
+      CHECKfree (EigVal);
+      PHONfreeContext (ctx);
 
       return 0;
 
    }
 
    /* Computes electron-phonon coupling matrices. */
-   Meph = UTILdoubleVector (nDynOrb * nDynOrb * nDynTot * spinPol);
-   PHONephCoupling (EigVec, EigVal, Meph);
+   Meph = UTILdoubleVector ((size_t) nDynOrb * nDynOrb * nDynTot * spinPol);
+   if (Meph == NULL)
+      abortRun (ctx, VIB_ERR_MEMORY);
+   info = PHONephCoupling (ctx, EigVec, EigVal, Meph);
+   if (info != VIB_SUCCESS)
+      abortRun (ctx, info);
 
-   /* Frees memory. */
-   free (EigVec);
-   free (EigVal);
-   free (Meph);
+   /* Reports the timing of the stages. */
+   info = TIMEreport (ctx);
+   if (info != VIB_SUCCESS)
+      abortRun (ctx, info);
 
-   /* Calculates the execution time. */
-   final = clock();
-   time = (double)(final - inicial) / CLOCKS_PER_SEC;
-   printf ("\n This calculation took %.2f seconds.\n\n", time);
+   /* Frees memory. */
+   CHECKfree (EigVec);
+   CHECKfree (EigVal);
+   CHECKfree (Meph);
+   PHONfreeContext (ctx);
 
    return 0;
    
@@ -129,7 +321,8 @@ static void header ()
    printf("**                                                     **\n");
    printf("**  *************************************************  **\n");
    printf("\n");
-   setvbuf (stdout, NULL, _IONBF, 0); /* print now! */
+   printf(" Kernels path: %s\n\n", KERNdescribe ());
+   fflush (stdout);
 
 } /* PHONheader */
 
@@ -143,7 +336,17 @@ static void howto ()
    fprintf (stderr, " [FC directory]"); /* arg[1] */
    fprintf (stderr, " [FC input file]"); /* arg[2] */
    fprintf (stderr, " [calculation type]"); /* arg[3] */
-   fprintf (stderr, " [splitFC]\n\n"); /* arg[4] */
+   fprintf (stderr, " [splitFC]"); /* arg[4] */
+   fprintf (stderr, " [options]\n");
+   fprintf (stderr, "      vibrations batch"); /* arg[1] */
+   fprintf (stderr, " [manifest file | FC directories]");
+   fprintf (stderr, " [--input=FC input file] [--type=full|onlyPh]\n");
+   fprintf (stderr, "                       [--splitFC] [--workers=N]");
+   fprintf (stderr, " [--memory=MB] [--summary=file] [options]\n");
+   fprintf (stderr, "      vibrations watch"); /* arg[1] */
+   fprintf (stderr, " [FC directory] [FC input file] [calculation type]");
+   fprintf (stderr, " [--poll[=S]]\n");
+   fprintf (stderr, "                       [--settle=S] [options]\n\n");
    fprintf (stderr,
 	    " Examples : vibrations ~/MySystem/FCdir runFC.in full\n");
    fprintf (stderr,
@@ -151,6 +354,1091 @@ static void howto ()
    fprintf (stderr,
 	    "            vibrations ~/MySystem/FCdir runFC.in onlyPh\n");
    fprintf (stderr,
-	    "            vibrations ~/MySystem/FCdir runFC.in onlyPh splitFC\n\n");
+	    "            vibrations ~/MySystem/FCdir runFC.in onlyPh splitFC\n");
+   fprintf (stderr,
+	    "            vibrations batch bias*/FCdir --input=runFC.in"
+	    " --workers=4\n");
+   fprintf (stderr,
+	    "            vibrations batch jobs.list --workers=4"
+	    " --memory=64000\n");
+   fprintf (stderr,
+	    "            vibrations watch ~/MySystem/FCdir runFC.in full"
+	    " &\n\n");
+   fprintf (stderr,
+	    " Each line of a manifest file reads: [FC directory]"
+	    " [FC input file] [full|onlyPh] [splitFC]\n\n");
+   fprintf (stderr,
+	    " The watch mode runs along with the SIESTA runs of a split FC"
+	    " calculation: it\n"
+	    " computes the 'dH' of each atom (at the cache) as soon as the"
+	    " files of its 'FC[i]'\n"
+	    " directory are complete and unchanged for --settle seconds"
+	    " (default 5), then\n"
+	    " runs as 'splitFC'. The directories are watched with inotify,"
+	    " or polled every\n"
+	    " S seconds (default 10) with --poll[=S].\n\n");
+   fprintf (stderr, " Options:\n");
+   fprintf (stderr,
+	    "  --checkpoint[=dir]  saves the completed stages (default at"
+	    " '[FC directory]/checkpoint';\n"
+	    "                      batch runs use the default) and a rerun"
+	    " resumes from them;\n"
+	    "                      SIGTERM, SIGINT, SIGUSR1 or SIGUSR2 stop"
+	    " at the next checkpoint\n");
+   fprintf (stderr,
+	    "  --cache[=dir]       stores the 'dH' columns (default at"
+	    " '[FC directory]/dHcache') under\n"
+	    "                      a hash of their inputs, so a rerun"
+	    " recomputes only the changed ones\n");
+   fprintf (stderr,
+	    "  --wait-onlys[=S]    waits up to S seconds (default 86400) for"
+	    " each pair of '.onlyS'\n"
+	    "                      files of concurrent 'runOS' drivers,"
+	    " reading the pairs as they land\n");
+   fprintf (stderr,
+	    "  --active-shells=N   builds the dense matrices only on the"
+	    " atoms with orbitals within\n"
+	    "                      N neighbour shells (nonzero 'H0' or"
+	    " 'S0' elements) of the dynamic\n"
+	    "                      orbitals\n"
+	    "  --active-cutoff=R   the same with the atoms within R Ang of a"
+	    " dynamic atom (with both\n"
+	    "                      options, the atoms of either)\n"
+	    "  --active-check      also computes 'Meph' on the full basis"
+	    " and reports the truncation\n"
+	    "                      error\n");
+   fprintf (stderr,
+	    "  --symmetry[=file]   displaces only the first dynamic atom of"
+	    " each orbit of the point\n"
+	    "                      group (listed at the log) and rebuilds"
+	    " the FC columns and 'dH'\n"
+	    "                      of the others, which need no SIESTA run"
+	    " (their 'FC[i]' may be\n"
+	    "                      missing with splitFC); the operations are"
+	    " detected at the '.xyz'\n"
+	    "                      (rotations and reflections about the"
+	    " centroid, in any\n"
+	    "                      orientation, mapping the atoms onto atoms"
+	    " of the same species;\n"
+	    "                      a warning tells when only the identity is"
+	    " found) or read from\n"
+	    "                      the file, one per line: the rotation by"
+	    " rows and optionally the\n"
+	    "                      translation (Ang). Needs the"
+	    " '[label].ORB_INDX' file ('full')\n");
+   fprintf (stderr,
+	    "  --bmeph=1|2         '.bMeph' format: 1 (bare stream, default)"
+	    " or 2 (indexed)\n");
+   fprintf (stderr,
+	    "  --bmeph-checksums   per-block checksums at '.bMeph'"
+	    " (format 2)\n");
+   fprintf (stderr,
+	    "  --meph-text=MODE    text '.Meph' output: compat (default,"
+	    " original format),\n"
+	    "                      fast (shortest round-trip numbers,"
+	    " formatted in parallel) or off\n");
+   fprintf (stderr,
+	    "  --meph-tol=X        sparse '.bMeph' (format 2): drops the"
+	    " elements below X\n"
+	    "  --meph-rtol=X       as above, below X times the largest"
+	    " element of each block\n");
+   fprintf (stderr,
+	    "  --meph-window=W     writes 'Meph' in the basis of the 'H0'"
+	    " eigenstates of the dynamic\n"
+	    "  --meph-window=A:B   block with energies in [-W,W] or [A,B]"
+	    " eV from 'E_F' (energies\n"
+	    "                      at '[label].Mstates')\n");
+   fprintf (stderr,
+	    "  --meph-summary      writes '[label].Msum' with the norm and"
+	    " the largest elements\n"
+	    "                      of the coupling matrix of each mode\n"
+	    "  --meph-subsets=A:B[,C:D...]  as above, also with the norms"
+	    " over the orbitals\n"
+	    "                      of the dynamic atoms A to B (C to D,"
+	    " ...)\n");
+   fprintf (stderr,
+	    "  --jmol=MODE         Jmol output of the phonon modes: files"
+	    " (default, one per mode),\n"
+	    "                      multi (all modes as frames of"
+	    " '[label]JMOL.xyz') or off\n"
+	    "  --jmol-modes=A[:B]  Jmol output only of the modes A to B"
+	    " (from 1)\n"
+	    "  --jmol-window=A:B   Jmol output only of the modes with"
+	    " energies in [A,B] eV\n");
+   fprintf (stderr,
+	    "  --log=LEVEL         log verbosity: quiet (only errors), info"
+	    " (default) or debug\n"
+	    "                      (also dumps the FC matrix and the"
+	    " modes to binary '.dump' files)\n");
+   fprintf (stderr,
+	    "  --counters          hardware counters (cycles, instructions,"
+	    " LLC and dTLB misses,\n"
+	    "                      stalled cycles) of the stages at the"
+	    " timing report, when\n"
+	    "                      available (built with -DPERFCOUNT)\n");
+   fprintf (stderr,
+	    "  --progress          single progress line (steps, MB/s,"
+	    " GFLOP/s and ETA of the\n"
+	    "                      displacement, atom and mode loops) at"
+	    " stderr\n"
+	    "  --progress-file[=S] the same at"
+	    " '[FC directory][label].progress.json', rewritten\n"
+	    "                      at most every S seconds (default"
+	    " 10)\n\n");
 
 } /* howto */
+
+
+/* ********************************************************* */
+/* Prints the error message for the code 'info' returned by  */
+/* the library and exits the program.                        */
+static void abortRun (vib_context *ctx, int info)
+{
+
+   fprintf (stderr, "\n vibrations: ERROR: %s!\n\n",
+	    CHECKerrorString (info));
+   if (info == VIB_ERR_STOPPED && ctx->chkDir != NULL)
+      fprintf (stderr, " Rerun the same command to resume from %s.\n\n",
+	       ctx->chkDir);
+   PHONfreeContext (ctx);
+   exit (EXIT_FAILURE);
+
+} /* abortRun */
+
+
+/* ********************************************************* */
+/* Signal handler: requests the run to stop at the next      */
+/* checkpoint (the completed stages are already saved).      */
+static void requestStop (int sig)
+{
+
+   stopRun = 1;
+
+} /* requestStop */
+
+
+/* ********************************************************* */
+/* Installs 'requestStop' as the handler of the signals used */
+/* by the batch schedulers (and the user) to stop a run.     */
+static void catchStop ()
+{
+
+   signal (SIGTERM, requestStop);
+   signal (SIGINT, requestStop);
+   signal (SIGUSR1, requestStop);
+   signal (SIGUSR2, requestStop);
+
+} /* catchStop */
+
+
+/* ********************************************************* */
+/* Sets the default run options.                             */
+static void initOptions (runopts *o)
+{
+
+   o->checkpoint = 0;
+   o->chkDir = NULL;
+   o->cache = 0;
+   o->cacheDir = NULL;
+   o->onlySwait = 0.0;
+   o->activeShells = 0;
+   o->activeCutoff = 0.0;
+   o->activeCheck = 0;
+   o->symOps = NULL;
+   o->bMeph = 1;
+   o->bMephSum = 0;
+   o->mephText = MEPH_TEXT_COMPAT;
+   o->mephTol = 0.0;
+   o->mephRelTol = 0;
+   o->project = 0;
+   o->projEmin = o->projEmax = 0.0;
+   o->jmol = JMOL_FILES;
+   o->jmolFirst = o->jmolLast = 0;
+   o->jmolWindow = 0;
+   o->jmolEmin = o->jmolEmax = 0.0;
+   o->summary = 0;
+   o->nSubsets = 0;
+   o->logLevel = LOG_INFO;
+   o->counters = 0;
+   o->progress = 0;
+   o->status = 0;
+   o->statusPeriod = 10.0;
+
+} /* initOptions */
+
+
+/* ********************************************************* */
+/* Reads the command line option 'opt' into 'o'. Returns 0   */
+/* if the option is unknown or has a wrong value.            */
+static int readOption (const char *opt, runopts *o)
+{
+   char *end;
+
+   if (strcmp (opt, "--checkpoint") == 0)
+      o->checkpoint = 1;
+   else if (strncmp (opt, "--checkpoint=", 13) == 0) {
+      o->checkpoint = 1;
+      o->chkDir = (char *) opt + 13;
+   }
+   else if (strcmp (opt, "--cache") == 0)
+      o->cache = 1;
+   else if (strncmp (opt, "--cache=", 8) == 0) {
+      o->cache = 1;
+      o->cacheDir = (char *) opt + 8;
+   }
+   else if (strcmp (opt, "--wait-onlys") == 0)
+      o->onlySwait = 86400.0;
+   else if (strncmp (opt, "--wait-onlys=", 13) == 0) {
+      o->onlySwait = strtod (opt + 13, &end);
+      if (*end != '\0' || o->onlySwait <= 0.0)
+	 return 0;
+   }
+   else if (strncmp (opt, "--active-shells=", 16) == 0) {
+      o->activeShells = (int) strtol (opt + 16, &end, 10);
+      if (*end != '\0' || o->activeShells < 1)
+	 return 0;
+   }
+   else if (strncmp (opt, "--active-cutoff=", 16) == 0) {
+      o->activeCutoff = strtod (opt + 16, &end);
+      if (*end != '\0' || o->activeCutoff <= 0.0)
+	 return 0;
+   }
+   else if (strcmp (opt, "--active-check") == 0)
+      o->activeCheck = 1;
+   else if (strcmp (opt, "--symmetry") == 0)
+      o->symOps = "auto";
+   else if (strncmp (opt, "--symmetry=", 11) == 0) {
+      o->symOps = (char *) opt + 11;
+      if (*o->symOps == '\0')
+	 return 0;
+   }
+   else if (strcmp (opt, "--bmeph=1") == 0)
+      o->bMeph = 1;
+   else if (strcmp (opt, "--bmeph=2") == 0)
+      o->bMeph = 2;
+   else if (strcmp (opt, "--bmeph-checksums") == 0)
+      o->bMephSum = 1;
+   else if (strcmp (opt, "--meph-text=off") == 0)
+      o->mephText = MEPH_TEXT_OFF;
+   else if (strcmp (opt, "--meph-text=fast") == 0)
+      o->mephText = MEPH_TEXT_FAST;
+   else if (strcmp (opt, "--meph-text=compat") == 0)
+      o->mephText = MEPH_TEXT_COMPAT;
+   else if (strncmp (opt, "--meph-tol=", 11) == 0 ||
+	    strncmp (opt, "--meph-rtol=", 12) == 0) {
+      o->mephRelTol = (opt[7] == 'r');
+      o->mephTol = strtod (strchr (opt, '=') + 1, &end);
+      if (*end != '\0' || o->mephTol <= 0.0)
+	 return 0;
+   }
+   else if (strncmp (opt, "--meph-window=", 14) == 0) {
+      o->project = 1;
+      o->projEmin = strtod (opt + 14, &end);
+      if (*end == ':')
+	 o->projEmax = strtod (end + 1, &end);
+      else { /* half width around 'E_F' */
+	 o->projEmax = o->projEmin;
+	 o->projEmin = -o->projEmax;
+      }
+      if (*end != '\0' || o->projEmax <= o->projEmin)
+	 return 0;
+   }
+   else if (strcmp (opt, "--meph-summary") == 0)
+      o->summary = 1;
+   else if (strncmp (opt, "--meph-subsets=", 15) == 0) {
+      o->summary = 1;
+      o->nSubsets = 0;
+      end = (char *) opt + 14;
+      do {
+	 if (o->nSubsets == MAX_SUBSETS)
+	    return 0;
+	 o->subsets[2*o->nSubsets] = (int) strtol (end + 1, &end, 10);
+	 if (*end != ':')
+	    return 0;
+	 o->subsets[2*o->nSubsets+1] = (int) strtol (end + 1, &end, 10);
+	 o->nSubsets++;
+      } while (*end == ',');
+      if (*end != '\0')
+	 return 0;
+   }
+   else if (strcmp (opt, "--log=quiet") == 0)
+      o->logLevel = LOG_QUIET;
+   else if (strcmp (opt, "--log=info") == 0)
+      o->logLevel = LOG_INFO;
+   else if (strcmp (opt, "--log=debug") == 0)
+      o->logLevel = LOG_DEBUG;
+   else if (strcmp (opt, "--counters") == 0)
+      o->counters = 1;
+   else if (strcmp (opt, "--progress") == 0)
+      o->progress = 1;
+   else if (strcmp (opt, "--progress-file") == 0)
+      o->status = 1;
+   else if (strncmp (opt, "--progress-file=", 16) == 0) {
+      o->status = 1;
+      o->statusPeriod = strtod (opt + 16, &end);
+      if (*end != '\0' || o->statusPeriod <= 0.0)
+	 return 0;
+   }
+   else if (strcmp (opt, "--jmol=files") == 0)
+      o->jmol = JMOL_FILES;
+   else if (strcmp (opt, "--jmol=multi") == 0)
+      o->jmol = JMOL_MULTI;
+   else if (strcmp (opt, "--jmol=off") == 0)
+      o->jmol = JMOL_OFF;
+   else if (strncmp (opt, "--jmol-modes=", 13) == 0) {
+      o->jmolFirst = o->jmolLast = (int) strtol (opt + 13, &end, 10);
+      if (*end == ':')
+	 o->jmolLast = (int) strtol (end + 1, &end, 10);
+      if (*end != '\0' || o->jmolFirst < 1 || o->jmolLast < o->jmolFirst)
+	 return 0;
+   }
+   else if (strncmp (opt, "--jmol-window=", 14) == 0) {
+      o->jmolWindow = 1;
+      o->jmolEmin = strtod (opt + 14, &end);
+      if (*end != ':')
+	 return 0;
+      o->jmolEmax = strtod (end + 1, &end);
+      if (*end != '\0' || o->jmolEmax < o->jmolEmin)
+	 return 0;
+   }
+   else
+      return 0;
+
+   return 1;
+
+} /* readOption */
+
+
+/* ********************************************************* */
+/* Sets the run options 'o' at the context 'ctx'. The        */
+/* default checkpoint and cache directories are inside the   */
+/* FC directory 'FCdir'.                                     */
+static int setOptions (vib_context *ctx, runopts *o, const char *FCdir)
+{
+   int info = VIB_SUCCESS;
+   char *defDir;
+
+   defDir = CHECKmalloc (strlen (FCdir) + 16);
+   if (defDir == NULL)
+      return VIB_ERR_MEMORY;
+
+   /* Checkpoints (default at '[FC directory]/checkpoint'). */
+   if (o->checkpoint) {
+      sprintf (defDir, "%s/checkpoint", FCdir);
+      info = PHONsetCheckpoint (ctx, o->chkDir != NULL ? o->chkDir : defDir);
+      ctx->stop = &stopRun;
+   }
+
+   /* 'dH' cache (default at '[FC directory]/dHcache'). */
+   if (info == VIB_SUCCESS && o->cache) {
+      sprintf (defDir, "%s/dHcache", FCdir);
+      info = PHONsetCache (ctx, o->cacheDir != NULL ? o->cacheDir : defDir);
+   }
+
+   /* Concurrent 'onlyS' runs (stopped by the same signals). */
+   ctx->onlySwait = o->onlySwait;
+   if (o->onlySwait > 0.0)
+      ctx->stop = &stopRun;
+
+   /* Active region of the basis ('full' calculations). */
+   if (info == VIB_SUCCESS && o->activeCheck && o->activeShells == 0 &&
+       o->activeCutoff == 0.0) {
+      fprintf (stderr, "\n ERROR: '--active-check' needs '--active-shells'"
+	       " or '--active-cutoff'!\n\n");
+      info = VIB_ERR_INPUT;
+   }
+   ctx->activeShells = o->activeShells;
+   ctx->activeCutoff = o->activeCutoff;
+   ctx->activeCheck = o->activeCheck;
+
+   /* Symmetry-reduced displacements. */
+   if (info == VIB_SUCCESS && o->symOps != NULL)
+      info = PHONsetSymmetry (ctx, o->symOps);
+
+   /* Output formats. */
+   if (info == VIB_SUCCESS && (o->mephTol > 0.0 || o->bMephSum)
+       && o->bMeph == 1) {
+      fprintf (stderr, "\n ERROR: the sparse '.bMeph' and its checksums"
+	       " need the format 2 ('--bmeph=2')!\n\n");
+      info = VIB_ERR_INPUT;
+   }
+   ctx->bMeph = o->bMeph;
+   ctx->bMephSum = o->bMephSum;
+   ctx->mephText = o->mephText;
+   ctx->mephTol = o->mephTol;
+   ctx->mephRelTol = o->mephRelTol;
+   ctx->project = o->project;
+   ctx->projEmin = o->projEmin;
+   ctx->projEmax = o->projEmax;
+   ctx->jmol = o->jmol;
+   ctx->jmolFirst = o->jmolFirst;
+   ctx->jmolLast = o->jmolLast;
+   ctx->jmolWindow = o->jmolWindow;
+   ctx->jmolEmin = o->jmolEmin;
+   ctx->jmolEmax = o->jmolEmax;
+   ctx->logLevel = o->logLevel;
+
+   /* Hardware counters (the stages are just timed if there */
+   /* are none).                                             */
+   if (o->counters)
+      TIMEcounters (ctx);
+
+   /* Progress of the loops. */
+   if (info == VIB_SUCCESS)
+      info = TIMEsetProgress (ctx, o->progress, o->status, o->statusPeriod);
+
+   /* Per-mode coupling summaries. */
+   if (info == VIB_SUCCESS && o->summary)
+      info = PHONsetSummary (ctx, &o->nSubsets, o->subsets);
+
+   /* Frees memory. */
+   CHECKfree (defDir);
+
+   return info;
+
+} /* setOptions */
+
+
+/* ********************************************************* */
+/* Appends a job to the list 'b->job'. Returns the new job   */
+/* or 'NULL' if there is not enough memory.                  */
+static batchjob *addJob (batchrun *b, const char *FCdir)
+{
+   batchjob *job;
+
+   job = CHECKrealloc (b->job, (b->nJobs + 1) * sizeof (batchjob));
+   if (job == NULL)
+      return NULL;
+   b->job = job;
+   job = &b->job[b->nJobs++];
+
+   snprintf (job->FCdir, sizeof (job->FCdir), "%s", FCdir);
+   job->FCinput[0] = '\0';
+   strcpy (job->FCsplit, " ");
+   job->calcType = 0;
+   job->info = VIB_SUCCESS;
+   job->stage = "";
+   job->memory = 0.0;
+   job->time = 0.0;
+
+   return job;
+
+} /* addJob */
+
+
+/* ********************************************************* */
+/* Reads a batch manifest: each (non-empty and non-comented) */
+/* line gives "[FC directory] [FC input file] [calculation   */
+/* type] [splitFC]", where the last two are optional.        */
+static int readManifest (batchrun *b, const char *manifest)
+{
+   int n, lineNo;
+   char line[1024], type[16], split[16];
+   char dir[512], input[256];
+   batchjob *job;
+   FILE *MAN;
+
+   MAN = CHECKfopen (manifest, "r");
+   if (MAN == NULL)
+      return VIB_ERR_FILE;
+
+   for (lineNo = 1; fgets (line, sizeof (line), MAN) != NULL; lineNo++) {
+      type[0] = split[0] = '\0';
+      n = sscanf (line, "%511s %255s %15s %15s", dir, input, type, split);
+      if (n < 1 || dir[0] == '#')
+	 continue ;
+      if (n < 2) {
+	 fprintf (stderr, "\n vibrations: ERROR: missing FC input file at");
+	 fprintf (stderr, " line %d of '%s'!\n\n", lineNo, manifest);
+	 fclose (MAN);
+	 return VIB_ERR_INPUT;
+      }
+      job = addJob (b, dir);
+      if (job == NULL) {
+	 fclose (MAN);
+	 return VIB_ERR_MEMORY;
+      }
+      strcpy (job->FCinput, input);
+      if (strcmp (type, "full") == 0)
+	 job->calcType = 1;
+      else if (strcmp (type, "onlyPh") == 0)
+	 job->calcType = 2;
+      if (strcmp (type, "splitFC") == 0 || strcmp (split, "splitFC") == 0)
+	 strcpy (job->FCsplit, "splitFC");
+   }
+
+   return CHECKfclose (fclose (MAN), manifest);
+
+} /* readManifest */
+
+
+/* ********************************************************* */
+/* Waits until 'memory' bytes fit into the batch memory      */
+/* budget and reserves them. A job bigger than the budget    */
+/* runs alone.                                               */
+static void reserveMemory (batchrun *b, double memory)
+{
+
+   pthread_mutex_lock (&b->lock);
+   while (b->memBudget > 0.0 && b->running > 0
+	  && b->memUsed + memory > b->memBudget)
+      pthread_cond_wait (&b->freed, &b->lock);
+   b->memUsed += memory;
+   b->running++;
+   pthread_mutex_unlock (&b->lock);
+
+} /* reserveMemory */
+
+
+/* ********************************************************* */
+/* Releases the 'memory' bytes reserved by a job.            */
+static void releaseMemory (batchrun *b, double memory)
+{
+
+   pthread_mutex_lock (&b->lock);
+   b->memUsed -= memory;
+   b->running--;
+   pthread_cond_broadcast (&b->freed);
+   pthread_mutex_unlock (&b->lock);
+
+} /* releaseMemory */
+
+
+/* ********************************************************* */
+/* Runs one job of the batch. The log of the run is written  */
+/* at '[FC directory]/vibrations.out' and the Jmol files at  */
+/* the FC directory.                                         */
+static void runJob (batchrun *b, batchjob *job)
+{
+   int nDynTot, nDynOrb, spinPol, reserved = 0;
+   double *EigVec = NULL, *EigVal = NULL, *Meph = NULL;
+   char *outFile, *exec;
+   vib_context *ctx;
+
+   job->time = UTILwallTime ();
+
+   /* Sets the log file and the "executable" path (whose */
+   /* directory is where the Jmol files are written).    */
+   outFile = CHECKmalloc (strlen (job->FCdir) + 32);
+   exec = CHECKmalloc (strlen (job->FCdir) + 32);
+   ctx = PHONnewContext ();
+   if (outFile == NULL || exec == NULL || ctx == NULL) {
+      job->info = VIB_ERR_MEMORY;
+      job->stage = "setup";
+   }
+   else {
+      sprintf (outFile, "%s/vibrations.out", job->FCdir);
+      sprintf (exec, "%s/vibrations", job->FCdir);
+      ctx->out = CHECKfopen (outFile, b->opt.checkpoint ? "a" : "w");
+      if (ctx->out == NULL) {
+	 ctx->out = stdout;
+	 job->info = VIB_ERR_FILE;
+	 job->stage = "setup";
+      }
+   }
+
+   /* Sets the run options. */
+   if (job->info == VIB_SUCCESS) {
+      job->info = setOptions (ctx, &b->opt, job->FCdir);
+      if (job->info != VIB_SUCCESS)
+	 job->stage = "setup";
+   }
+
+   /* Reads info from FC fdf input file. */
+   if (job->info == VIB_SUCCESS) {
+      job->stage = "PHONreadFCfdf";
+      nDynOrb = 0;
+      job->info = PHONreadFCfdf (ctx, exec, job->FCdir, job->FCinput,
+				 job->calcType, job->FCsplit,
+				 &nDynTot, &nDynOrb, &spinPol);
+   }
+
+   /* Waits for room at the memory budget. */
+   if (job->info == VIB_SUCCESS) {
+      job->memory = PHONmemEstimate (ctx);
+      reserveMemory (b, job->memory);
+      reserved = 1;
+   }
+
+   /* Computes phonon frequencies and modes. */
+   if (job->info == VIB_SUCCESS) {
+      job->stage = "PHONfreq";
+      EigVec = UTILdoubleVector (nDynTot * nDynTot);
+      EigVal = UTILdoubleVector (nDynTot);
+      if (EigVec == NULL || EigVal == NULL)
+	 job->info = VIB_ERR_MEMORY;
+      else
+	 job->info = PHONfreq (ctx, EigVec, EigVal);
+   }
+   if (job->info == VIB_SUCCESS) {
+      job->stage = "PHONjmolOut";
+      job->info = PHONjmolOut (ctx, EigVec, EigVal);
+   }
+
+   /* Computes electron-phonon coupling matrices. */
+   if (job->info == VIB_SUCCESS && job->calcType == 1) {
+      job->stage = "PHONephCoupling";
+      Meph = UTILdoubleVector ((size_t) nDynOrb * nDynOrb * nDynTot * spinPol);
+      if (Meph == NULL)
+	 job->info = VIB_ERR_MEMORY;
+      else
+	 job->info = PHONephCoupling (ctx, EigVec, EigVal, Meph);
+   }
+   if (job->info == VIB_SUCCESS) {
+      job->stage = "TIMEreport";
+      job->info = TIMEreport (ctx);
+   }
+   if (job->info == VIB_SUCCESS)
+      job->stage = "";
+
+   /* Frees memory. */
+   CHECKfree (EigVec);
+   CHECKfree (EigVal);
+   CHECKfree (Meph);
+   if (reserved)
+      releaseMemory (b, job->memory);
+   if (ctx != NULL && ctx->out != stdout)
+      fclose (ctx->out);
+   PHONfreeContext (ctx);
+   CHECKfree (outFile);
+   CHECKfree (exec);
+
+   job->time = UTILwallTime () - job->time;
+
+} /* runJob */
+
+
+/* ********************************************************* */
+/* Batch worker: runs the jobs not yet taken by the other    */
+/* workers.                                                  */
+static void *batchWorker (void *arg)
+{
+   int j;
+   batchrun *b = arg;
+
+   for (;;) {
+      pthread_mutex_lock (&b->lock);
+      j = b->next++;
+      pthread_mutex_unlock (&b->lock);
+      if (j >= b->nJobs)
+	 break ;
+
+      /* After a stop request the remaining jobs are not started. */
+      if (stopRun) {
+	 b->job[j].info = VIB_ERR_STOPPED;
+	 b->job[j].stage = "queue";
+	 continue ;
+      }
+
+      runJob (b, &b->job[j]);
+
+      printf (" [%d/%d] %s: %s (%.2f s)\n", j + 1, b->nJobs,
+	      b->job[j].FCdir, b->job[j].info == VIB_SUCCESS ? "ok"
+	      : CHECKerrorString (b->job[j].info), b->job[j].time);
+      fflush (stdout);
+   }
+
+   return NULL;
+
+} /* batchWorker */
+
+
+/* ********************************************************* */
+/* Writes the summary of the batch run (timings and          */
+/* failures) at 'SUM'. Returns the number of failed jobs.    */
+static int batchSummary (batchrun *b, double time, FILE *SUM)
+{
+   register int j;
+   int nFail = 0;
+
+   fprintf (SUM, "# %-40s %-7s %10s %10s  %s\n", "FC directory",
+	    "type", "time(s)", "mem(MB)", "status");
+   for (j = 0; j < b->nJobs; j++) {
+      fprintf (SUM, "  %-40s %-7s %10.2f %10.1f  ", b->job[j].FCdir,
+	       b->job[j].calcType == 1 ? "full" : "onlyPh",
+	       b->job[j].time, b->job[j].memory / 1048576.0);
+      if (b->job[j].info == VIB_SUCCESS)
+	 fprintf (SUM, "ok\n");
+      else {
+	 fprintf (SUM, "FAILED at %s: %s\n", b->job[j].stage,
+		  CHECKerrorString (b->job[j].info));
+	 nFail++;
+      }
+   }
+   fprintf (SUM, "# %d jobs, %d failed, total wall time %.2f s\n",
+	    b->nJobs, nFail, time);
+
+   return nFail;
+
+} /* batchSummary */
+
+
+/* ********************************************************* */
+/* Runs the FC directories given at the command line (or at  */
+/* manifest files) with at most 'workers' concurrent jobs    */
+/* sharing a memory budget. A failing directory doesn't      */
+/* abort the batch, it is reported at the summary.           */
+static int batch (int nargs, char *arg[])
+{
+   register int i;
+   int workers = 1, calcType = 1, split = 0, nFail, info = VIB_SUCCESS;
+   double memory = 0.0, time;
+   char *input = NULL, *summary = "vibrations.batch";
+   struct stat st;
+   pthread_t *thread;
+   batchrun b;
+   FILE *SUM;
+
+   b.job = NULL;
+   b.nJobs = b.next = b.running = 0;
+   initOptions (&b.opt);
+   b.memUsed = 0.0;
+
+   /* Reads options, FC directories and manifest files. */
+   for (i = 2; i < nargs && info == VIB_SUCCESS; i++) {
+      if (strncmp (arg[i], "--input=", 8) == 0)
+	 input = arg[i] + 8;
+      else if (strcmp (arg[i], "--type=full") == 0)
+	 calcType = 1;
+      else if (strcmp (arg[i], "--type=onlyPh") == 0)
+	 calcType = 2;
+      else if (strcmp (arg[i], "--splitFC") == 0)
+	 split = 1;
+      else if (strncmp (arg[i], "--workers=", 10) == 0)
+	 info = CHECKsscanf (sscanf (arg[i] + 10, "%d", &workers), 1, arg[i]);
+      else if (strncmp (arg[i], "--memory=", 9) == 0)
+	 info = CHECKsscanf (sscanf (arg[i] + 9, "%lf", &memory), 1, arg[i]);
+      else if (strncmp (arg[i], "--summary=", 10) == 0)
+	 summary = arg[i] + 10;
+      else if (strncmp (arg[i], "--checkpoint=", 13) == 0) {
+	 fprintf (stderr, "\n At batch runs the checkpoints are at"
+		  " '[FC directory]/checkpoint'!\n");
+	 info = VIB_ERR_INPUT;
+      }
+      else if (readOption (arg[i], &b.opt))
+	 continue ;
+      else if (stat (arg[i], &st) == 0 && S_ISDIR (st.st_mode)) {
+	 if (addJob (&b, arg[i]) == NULL)
+	    info = VIB_ERR_MEMORY;
+      }
+      else if (stat (arg[i], &st) == 0 && S_ISREG (st.st_mode))
+	 info = readManifest (&b, arg[i]);
+      else {
+	 fprintf (stderr, "\n Unknown option or missing file '%s'!\n", arg[i]);
+	 info = VIB_ERR_INPUT;
+      }
+   }
+   if (info == VIB_SUCCESS && b.nJobs == 0) {
+      fprintf (stderr, "\n No FC directories to run!\n");
+      info = VIB_ERR_INPUT;
+   }
+
+   /* Fills the defaults for the directories without a manifest. */
+   for (i = 0; i < b.nJobs && info == VIB_SUCCESS; i++) {
+      if (b.job[i].FCinput[0] == '\0') {
+	 if (input == NULL) {
+	    fprintf (stderr, "\n Missing '--input=[FC input file]'!\n");
+	    info = VIB_ERR_INPUT;
+	    break ;
+	 }
+	 snprintf (b.job[i].FCinput, sizeof (b.job[i].FCinput), "%s", input);
+      }
+      if (b.job[i].calcType == 0)
+	 b.job[i].calcType = calcType;
+      if (split)
+	 strcpy (b.job[i].FCsplit, "splitFC");
+   }
+   if (info != VIB_SUCCESS) {
+      howto ();
+      CHECKfree (b.job);
+      return EXIT_FAILURE;
+   }
+
+   if (workers < 1)
+      workers = 1;
+   if (workers > b.nJobs)
+      workers = b.nJobs;
+   b.memBudget = memory * 1048576.0;
+   printf (" Batch of %d FC directories with %d workers", b.nJobs, workers);
+   if (b.memBudget > 0.0)
+      printf (" and a memory budget of %.0f MB", memory);
+   printf (".\n\n");
+   fflush (stdout);
+
+   /* Runs the jobs (the calling thread is one of the workers). */
+   if (b.opt.checkpoint || b.opt.onlySwait > 0.0)
+      catchStop ();
+   time = UTILwallTime ();
+   pthread_mutex_init (&b.lock, NULL);
+   pthread_cond_init (&b.freed, NULL);
+   thread = CHECKmalloc (workers * sizeof (pthread_t));
+   if (thread == NULL)
+      workers = 1;
+   for (i = 1; i < workers; i++)
+      if (pthread_create (&thread[i], NULL, batchWorker, &b) != 0)
+	 break ;
+   workers = i;
+   batchWorker (&b);
+   for (i = 1; i < workers; i++)
+      pthread_join (thread[i], NULL);
+   pthread_cond_destroy (&b.freed);
+   pthread_mutex_destroy (&b.lock);
+   time = UTILwallTime () - time;
+
+   /* Writes the summary. */
+   printf ("\n Batch summary (also at \"%s\"):\n\n", summary);
+   nFail = batchSummary (&b, time, stdout);
+   SUM = CHECKfopen (summary, "w");
+   if (SUM != NULL) {
+      batchSummary (&b, time, SUM);
+      CHECKfclose (fclose (SUM), summary);
+   }
+   printf ("\n");
+
+   /* Frees memory. */
+   CHECKfree (thread);
+   CHECKfree (b.job);
+
+   return (nFail == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+
+} /* batch */
+
+
+/* ********************************************************* */
+/* Reads the watch mode option 'opt' into 'w' (returns 0 if  */
+/* it is not a watch option or has a wrong value).           */
+static int readWatchOption (const char *opt, watchopts *w)
+{
+   char *end;
+
+   if (strcmp (opt, "--poll") == 0)
+      w->poll = 10.0;
+   else if (strncmp (opt, "--poll=", 7) == 0) {
+      w->poll = strtod (opt + 7, &end);
+      if (*end != '\0' || w->poll <= 0.0)
+	 return 0;
+   }
+   else if (strncmp (opt, "--settle=", 9) == 0) {
+      w->settle = strtod (opt + 9, &end);
+      if (*end != '\0' || w->settle < 0.0)
+	 return 0;
+   }
+   else
+      return 0;
+
+   return 1;
+
+} /* readWatchOption */
+
+
+/* ********************************************************* */
+/* Counts the lines of the file 'name' (-1 if it is missing). */
+static int countLines (const char *name)
+{
+   int c, n = 0;
+   FILE *F;
+
+   F = fopen (name, "r");
+   if (F == NULL)
+      return -1;
+   while ((c = fgetc (F)) != EOF)
+      if (c == '\n')
+	 n++;
+   fclose (F);
+
+   return n;
+
+} /* countLines */
+
+
+/* ********************************************************* */
+/* Checks the files of the run of the dynamic atom 'atom' at */
+/* '[FC directory]FC[atom]/': the header and columns of its  */
+/* '.FC', the '.ef' lines and (at "full" calculations) six   */
+/* '.gHS' files, plus the '000.gHS' and '.orb' of the first  */
+/* dynamic atom. Returns 0 if any is missing or incomplete,  */
+/* otherwise a signature of their sizes and modification    */
+/* times.                                                    */
+static unsigned long long atomSignature (vib_context *ctx, int atom)
+{
+   register int n;
+   unsigned long long sig = 1469598103934665603ULL;
+   char name[1024];
+   struct stat st;
+
+   /* Force constants columns and Fermi energies. */
+   snprintf (name, sizeof (name), "%sFC%d/%s.FC", ctx->FCdir, atom,
+	     ctx->sysLabel);
+   if (countLines (name) < 6 * ctx->nAtoms + 1)
+      return 0;
+   snprintf (name, sizeof (name), "%sFC%d/%s.ef", ctx->FCdir, atom,
+	     ctx->sysLabel);
+   if (ctx->calcType == 1 && countLines (name) < 7)
+      return 0;
+
+   for (n = -2; n <= (ctx->calcType == 1 ? 6 : -1); n++) {
+      if (n == -2)
+	 snprintf (name, sizeof (name), "%sFC%d/%s.FC", ctx->FCdir, atom,
+		   ctx->sysLabel);
+      else if (n == -1 && ctx->calcType != 1)
+	 continue ;
+      else if (n == -1)
+	 snprintf (name, sizeof (name), "%sFC%d/%s.ef", ctx->FCdir, atom,
+		   ctx->sysLabel);
+      else if (n == 0 && atom != ctx->FCfirst)
+	 continue ;
+      else
+	 snprintf (name, sizeof (name), "%sFC%d/%s_%.3d.gHS", ctx->FCdir,
+		   atom, ctx->sysLabel, n);
+      if (stat (name, &st) != 0 || st.st_size == 0)
+	 return 0;
+      sig = (sig ^ (unsigned long long) st.st_size) * 1099511628211ULL;
+      sig = (sig ^ (unsigned long long) st.st_mtime) * 1099511628211ULL;
+   }
+   if (ctx->calcType == 1 && atom == ctx->FCfirst) {
+      snprintf (name, sizeof (name), "%sFC%d/%s.orb", ctx->FCdir, atom,
+		ctx->sysLabel);
+      if (stat (name, &st) != 0 || st.st_size == 0)
+	 return 0;
+   }
+
+   return (sig == 0 ? 1 : sig);
+
+} /* atomSignature */
+
+
+/* ********************************************************* */
+/* Watch mode: monitors the 'FC[i]/' directories of a split  */
+/* FC calculation while their SIESTA runs are going on. As   */
+/* the files of an atom become complete (and unchanged for   */
+/* 'w->settle' seconds) its 'dH' is computed and stored at   */
+/* the 'dH' cache ('PHONwatchAtom'), so that after the last  */
+/* atom the 'splitFC' run only diagonalizes and computes the */
+/* couplings. The directories are watched with inotify (when */
+/* compiled with '-DINOTIFY') or polled every 'w->poll' s.   */
+static int watch (vib_context *ctx, char *exec, char *FCdir,
+		  char *FCinput, int calcType, watchopts *w)
+{
+   register int a;
+   int nDynTot, nDynOrb, spinPol, nDone = 0, fd = -1, info;
+   int *done, *wd;
+   unsigned long long s, *sig;
+   double now, wait, *since;
+#ifdef INOTIFY
+   char dir[1024], events[4096];
+   struct pollfd pfd;
+#endif
+
+   /* Only the system (the '.ef' and '.orb' are not there yet). */
+   info = PHONreadFCfdf (ctx, exec, FCdir, FCinput, 2, " ",
+			 &nDynTot, &nDynOrb, &spinPol);
+   if (info != VIB_SUCCESS)
+      return info;
+   ctx->calcType = calcType;
+
+   /* Allocates memory. */
+   done = CHECKmalloc (ctx->nDyn * sizeof (int));
+   wd = CHECKmalloc (ctx->nDyn * sizeof (int));
+   sig = CHECKmalloc (ctx->nDyn * sizeof (unsigned long long));
+   since = CHECKmalloc (ctx->nDyn * sizeof (double));
+   if (done == NULL || wd == NULL || sig == NULL || since == NULL)
+      info = VIB_ERR_MEMORY;
+   for (a = 0; a < ctx->nDyn && info == VIB_SUCCESS; a++) {
+      done[a] = wd[a] = 0;
+      sig[a] = 0;
+      since[a] = 0.0;
+   }
+
+#ifdef INOTIFY
+   if (w->poll == 0.0) {
+      fd = inotify_init1 (IN_NONBLOCK);
+      if (fd >= 0 && inotify_add_watch (fd, ctx->FCdir, IN_CREATE
+					| IN_MOVED_TO) < 0) {
+	 close (fd);
+	 fd = -1;
+      }
+   }
+#endif
+   if (fd < 0 && w->poll == 0.0)
+      w->poll = 10.0;
+   LOGinfo (ctx, "\n Watching %d 'FC[i]' directories at %s (%s):\n\n",
+	    ctx->nDyn, ctx->FCdir, fd >= 0 ? "inotify" : "polling");
+   LOGflush (ctx);
+
+   while (nDone < ctx->nDyn && info == VIB_SUCCESS) {
+      now = UTILwallTime ();
+      for (a = 0; a < ctx->nDyn && info == VIB_SUCCESS; a++) {
+	 if (done[a])
+	    continue ;
+
+#ifdef INOTIFY
+	 /* Watches the directory once it is created. */
+	 if (fd >= 0 && wd[a] <= 0) {
+	    snprintf (dir, sizeof (dir), "%sFC%d", ctx->FCdir,
+		      ctx->FCfirst + a);
+	    wd[a] = inotify_add_watch (fd, dir, IN_CLOSE_WRITE | IN_MODIFY
+				       | IN_CREATE | IN_MOVED_TO);
+	 }
+#endif
+
+	 /* The files must stay unchanged for 'w->settle' s. */
+	 s = atomSignature (ctx, ctx->FCfirst + a);
+	 if (s == 0 || s != sig[a]) {
+	    sig[a] = s;
+	    since[a] = now;
+	    continue ;
+	 }
+	 if (now - since[a] < w->settle)
+	    continue ;
+
+	 /* 'S0' is read from the run of the first dynamic atom. */
+	 if (calcType == 1 && a > 0 && !done[0])
+	    continue ;
+	 if (calcType == 1)
+	    info = PHONwatchAtom (ctx, ctx->FCfirst + a);
+	 if (info == VIB_SUCCESS) {
+	    done[a] = 1;
+	    nDone++;
+	    LOGinfo (ctx, "    atom %d ready (%d of %d, %.1f s)\n",
+		     ctx->FCfirst + a, nDone, ctx->nDyn,
+		     UTILwallTime () - ctx->wallStart);
+	    LOGflush (ctx);
+	 }
+      }
+      if (nDone == ctx->nDyn || info != VIB_SUCCESS)
+	 break ;
+      if (stopRun) {
+	 info = VIB_ERR_STOPPED;
+	 break ;
+      }
+
+      /* Waits for changes (and rescans every 'w->settle' s). */
+      wait = (w->settle > 1.0 ? w->settle : 1.0);
+#ifdef INOTIFY
+      if (fd >= 0) {
+	 pfd.fd = fd;
+	 pfd.events = POLLIN;
+	 if (poll (&pfd, 1, (int) (1000.0 * wait)) > 0)
+	    while (read (fd, events, sizeof (events)) > 0)
+	       ;
+	 continue ;
+      }
+#endif
+      for (wait = w->poll; wait > 0.0 && !stopRun; wait -= 1.0)
+	 usleep ((useconds_t) (1.0e6 * (wait < 1.0 ? wait : 1.0)));
+   }
+   if (info == VIB_SUCCESS)
+      LOGinfo (ctx, "\n All %d atoms ready after %.1f s.\n", ctx->nDyn,
+	       UTILwallTime () - ctx->wallStart);
+
+   /* Frees memory. */
+   if (fd >= 0)
+      close (fd);
+   CHECKfree (done);
+   CHECKfree (wd);
+   CHECKfree (sig);
+   CHECKfree (since);
+
+   return info;
+
+} /* watch */
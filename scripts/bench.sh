@@ -0,0 +1,78 @@
+#!/bin/bash
+
+#  *******************************************************************  #
+#                  ** PhOnonS ITeratIVE VIBRATIONS **                   #
+#                                                                       #
+#                           **  Version 2  **                           #
+#                                                                       #
+#  Written by Pedro Brandimarte (brandimarte@gmail.com)                 #
+#                                                                       #
+#  Copyright (c), All Rights Reserved                                   #
+#                                                                       #
+#  This program is free software. You can redistribute it and/or        #
+#  modify it under the terms of the GNU General Public License          #
+#  (version 3 or later) as published by the Free Software Foundation    #
+#  <http://fsf.org/>.                                                   #
+#                                                                       #
+#  This program is distributed in the hope that it will be useful, but  #
+#  WITHOUT ANY WARRANTY, without even the implied warranty of           #
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU     #
+#  General Public License for more details (file 'LICENSE_GPL'          #
+#  distributed along with this program or at                            #
+#  <http://www.gnu.org/licenses/gpl.html>).                             #
+#  *******************************************************************  #
+#                               bench.sh                                #
+#  *******************************************************************  #
+#  This script generates synthetic FC directories of increasing size   #
+#  with 'vibgen' and runs 'vibrations' ('onlyPh' and 'full') on each    #
+#  of them, keeping the per-stage timings ('[label].timing.json') as    #
+#  '[bench directory]/[size]_[type].timing.json' and printing a        #
+#  summary of the wall times.                                           #
+#                                                                       #
+#  Input:  ${1} :  directory with 'vibrations', 'vibgen' and            #
+#                  'setInput.sh'                                        #
+#          ${2} :  bench directory (default '/tmp/vibbench')            #
+#                                                                       #
+#  Environment:  BENCH_SIZES : numbers of atoms of the sweep            #
+#                              (default "16 32 64")                     #
+#                BENCH_ARGS  : other 'vibgen' options                   #
+#                              (default "--orbs=9 --band=2")            #
+#                                                                       #
+#  Use: ./bench.sh [binaries directory] [bench directory]               #
+#  *******************************************************************  #
+
+bin=`cd ${1:-.} && pwd`
+benchDir=${2:-/tmp/vibbench}
+sizes=${BENCH_SIZES:-"16 32 64"}
+args=${BENCH_ARGS:-"--orbs=9 --band=2"}
+export PATH=${bin}:${PATH}
+
+mkdir -p ${benchDir} || exit -1
+> ${benchDir}/summary.txt
+printf "# %6s %6s %8s %12s %12s\n" "atoms" "dyn" "type" "wall(s)" "cpu(s)"   \
+    | tee -a ${benchDir}/summary.txt
+
+for n in ${sizes}
+do
+    # A quarter of the atoms are dynamic.
+    nDyn=$(( n / 4 > 0 ? n / 4 : 1 ))
+    FCdir=${benchDir}/n${n}
+    rm -rf ${FCdir}
+    vibgen ${FCdir} --atoms=${n} --dyn=${nDyn} ${args} > /dev/null || exit -1
+
+    for type in onlyPh full
+    do
+	( cd ${FCdir} && vibrations . synth.fdf ${type} --log=quiet          \
+	    --jmol=off --meph-text=off ) || exit -1
+	cp ${FCdir}/synth.timing.json ${benchDir}/${n}_${type}.timing.json
+	wall=`grep '"wall"' ${FCdir}/synth.timing.json | head -n1         \
+	    | sed 's/[^0-9.]//g'`
+	cpu=`grep '"cpu"' ${FCdir}/synth.timing.json | head -n1           \
+	    | sed 's/[^0-9.]//g'`
+	printf "  %6d %6d %8s %12s %12s\n" ${n} ${nDyn} ${type} ${wall}     \
+	    ${cpu} | tee -a ${benchDir}/summary.txt
+    done
+    rm -rf ${FCdir}
+done
+
+echo -e "\n Per-stage timings at ${benchDir}/[atoms]_[type].timing.json\n"
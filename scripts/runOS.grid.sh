@@ -25,7 +25,11 @@
 #  *******************************************************************  #
 #  This script receives an input 'fdf' file for a force constants (FC)  #
 #  run, changes it by removing the flag 'FCwriteHS' and including the   #
-#  flag 'FConlyS' and changing the geometry and number of atoms.        #
+#  flag 'FConlyS' and changing the geometry and number of atoms. The   #
+#  six displaced 'onlyS' runs are executed concurrently at the          #
+#  directories 'OS[1-6]/', on disjoint subsets of the cores, and each   #
+#  '.onlyS' file is moved to the FC directory as soon as it is done.    #
+#  A summary of the runs (and failures) is printed at the end.          #
 #                                                                       #
 #  Input:  ${1} :  FC calculation main directory                        #
 #          ${2} :  FC input file                                        #
@@ -296,145 +300,122 @@ fi
 
 # --- Only S runs: ---
 
-echo -e "vibrations: Including atomic coordinates with at"              \
-    "'pbCoord.fdf'.\n"
-echo -e "%block AtomicCoordinatesAndAtomicSpecies" > ${FCdir}pbCoord.fdf
-awk '{printf "\t% .10f\t% .10f\t% .10f%3d\n", $1, $2, $3, $4}'          \
-    ${FCdir}pbCoord.tmp >> ${FCdir}pbCoord.fdf
-submit="${3} ${4}"
-
-# 1. '-x' move.
-echo -e "vibrations: Changing the system label to '${slabel}_1'.\n"
-check=`grep -i "SYSTEMLABEL" ${FCfdf}`
-sed "s/${check}/SystemLabel             ${slabel}_1/I" -i ${FCfdf}
-
-echo -e "vibrations: Shifting half of the atoms to '-x' direction.\n"
-awk -v var=${displ}                                                     \
-    '{printf "\t% .10f\t% .10f\t% .10f%3d\n", $1 - var, $2, $3, $4}'    \
-    ${FCdir}pbCoord.tmp >> ${FCdir}pbCoord.fdf
-echo -e "%endblock AtomicCoordinatesAndAtomicSpecies"                   \
-    >> ${FCdir}pbCoord.fdf
-
-# Submits the job.
-echo -e "vibrations: Running 'onlyS' calculation for '-x'"              \
-    "direction...\n\n"
-${submit} < ${FCfdf}
-wait
-rm *_1.alloc *_1.BONDS* *_1.KP *_1.STRUCT_* INPUT_TMP.*
-
-# 2. '+x' move.
-echo -e "vibrations: Changing the system label to '${slabel}_2'.\n"
-check=`grep -i "SYSTEMLABEL" ${FCfdf}`
-sed "s/${check}/SystemLabel             ${slabel}_2/I" -i ${FCfdf}
-
-echo -e "\nvibrations: Shifting half of the atoms to '+x' direction.\n"
-first=$[ ${natoms} + 2 ]
-last=$[ 2 * ${natoms} + 2 ]
-sed "${first},${last}d" -i ${FCdir}pbCoord.fdf
-awk -v var=${displ} \
-    '{printf "\t% .10f\t% .10f\t% .10f%3d\n", $1 + var, $2, $3, $4}'    \
-    ${FCdir}pbCoord.tmp >> ${FCdir}pbCoord.fdf
-echo -e "%endblock AtomicCoordinatesAndAtomicSpecies"                   \
-    >> ${FCdir}pbCoord.fdf
-
-# Submits the job.
-echo -e "vibrations: Running 'onlyS' calculation for '+x'"              \
-    "direction...\n\n"
-${submit} < ${FCfdf}
-wait
-rm *_2.alloc *_2.BONDS* *_2.KP *_2.STRUCT_* INPUT_TMP.*
-
-# 3. '-y' move.
-echo -e "vibrations: Changing the system label to '${slabel}_3'.\n"
-check=`grep -i "SYSTEMLABEL" ${FCfdf}`
-sed "s/${check}/SystemLabel             ${slabel}_3/I" -i ${FCfdf}
-
-echo -e "\nvibrations: Shifting half of the atoms to '-y' direction.\n"
-first=$[ ${natoms} + 2 ]
-last=$[ 2 * ${natoms} + 2 ]
-sed "${first},${last}d" -i ${FCdir}pbCoord.fdf
-awk -v var=${displ}                                                     \
-    '{printf "\t% .10f\t% .10f\t% .10f%3d\n", $1, $2 - var, $3, $4}'    \
-    ${FCdir}pbCoord.tmp >> ${FCdir}pbCoord.fdf
-echo -e "%endblock AtomicCoordinatesAndAtomicSpecies"                   \
-    >> ${FCdir}pbCoord.fdf
-
-# Submits the job.
-echo -e "vibrations: Running 'onlyS' calculation for '-y'"              \
-    "direction...\n\n"
-${submit} < ${FCfdf}
-wait
-rm *_3.alloc *_3.BONDS* *_3.KP *_3.STRUCT_* INPUT_TMP.*
-
-# 4. '+y' move.
-echo -e "vibrations: Changing the system label to '${slabel}_4'.\n"
-check=`grep -i "SYSTEMLABEL" ${FCfdf}`
-sed "s/${check}/SystemLabel             ${slabel}_4/I" -i ${FCfdf}
-
-echo -e "\nvibrations: Shifting half of the atoms to '+y' direction.\n"
-first=$[ ${natoms} + 2 ]
-last=$[ 2 * ${natoms} + 2 ]
-sed "${first},${last}d" -i ${FCdir}pbCoord.fdf
-awk -v var=${displ}                                                     \
-    '{printf "\t% .10f\t% .10f\t% .10f%3d\n", $1, $2 + var, $3, $4}'    \
-    ${FCdir}pbCoord.tmp >> ${FCdir}pbCoord.fdf
-echo -e "%endblock AtomicCoordinatesAndAtomicSpecies"                   \
-    >> ${FCdir}pbCoord.fdf
-
-# Submits the job.
-echo -e "vibrations: Running 'onlyS' calculation for '+y'"              \
-    "direction...\n\n"
-${submit} < ${FCfdf}
-wait
-rm *_4.alloc *_4.BONDS* *_4.KP *_4.STRUCT_* INPUT_TMP.*
-
-# 5. '-z' move.
-echo -e "vibrations: Changing the system label to '${slabel}_5'.\n"
-check=`grep -i "SYSTEMLABEL" ${FCfdf}`
-sed "s/${check}/SystemLabel             ${slabel}_5/I" -i ${FCfdf}
-
-echo -e "\nvibrations: Shifting half of the atoms to '-z' direction.\n"
-first=$[ ${natoms} + 2 ]
-last=$[ 2 * ${natoms} + 2 ]
-sed "${first},${last}d" -i ${FCdir}pbCoord.fdf
-awk -v var=${displ}                                                     \
-    '{printf "\t% .10f\t% .10f\t% .10f%3d\n", $1, $2, $3 - var, $4}'    \
-    ${FCdir}pbCoord.tmp >> ${FCdir}pbCoord.fdf
-echo -e "%endblock AtomicCoordinatesAndAtomicSpecies"                   \
-    >> ${FCdir}pbCoord.fdf
-
-# Submits the job.
-echo -e "vibrations: Running 'onlyS' calculation for '-z'"              \
-    "direction...\n\n"
-${submit} < ${FCfdf}
-wait
-rm *_5.alloc *_5.BONDS* *_5.KP *_5.STRUCT_* INPUT_TMP.*
-
-# 6. '+z' move.
-echo -e "vibrations: Changing the system label to '${slabel}_6'.\n"
-check=`grep -i "SYSTEMLABEL" ${FCfdf}`
-sed "s/${check}/SystemLabel             ${slabel}_6/I" -i ${FCfdf}
-
-echo -e "\nvibrations: Shifting half of the atoms to '+z' direction.\n"
-first=$[ ${natoms} + 2 ]
-last=$[ 2 * ${natoms} + 2 ]
-sed "${first},${last}d" -i ${FCdir}pbCoord.fdf
-awk -v var=${displ}                                                     \
-    '{printf "\t% .10f\t% .10f\t% .10f%3d\n", $1, $2, $3 + var, $4}'    \
-    ${FCdir}pbCoord.tmp >> ${FCdir}pbCoord.fdf
-echo -e "%endblock AtomicCoordinatesAndAtomicSpecies"                   \
-    >> ${FCdir}pbCoord.fdf
-
-# Submits the job.
-echo -e "vibrations: Running 'onlyS' calculation for '+z'"              \
-    "direction...\n\n"
-${submit} < ${FCfdf}
+# Get the pseudo-potential file extention.
+if ls ${FCdir}*.psf > /dev/null 2>&1
+then
+    pseudo=".psf"
+elif ls ${FCdir}*.vps > /dev/null 2>&1
+then
+    pseudo=".vps"
+else
+    echo -e " ERROR: couldn't find any pseudo-potential file (psf or"   \
+	"vps) at \"${FCdir}\"!\n"
+    exit -1
+fi
+
+# The six displacements ('-x', '+x', '-y', '+y', '-z' and '+z', at
+# the order of the '.onlyS' files) run concurrently, packed onto
+# disjoint subsets of the cores: at most 'slots' runs at a time with
+# 'per' cores each (a run waits for the one before it at its slot).
+cores=${OS_CORES:-`nproc`} # cores of the host (or 'OS_CORES')
+slots=$(( ${cores} < 6 ? ${cores} : 6 ))
+per=$(( ${cores} / ${slots} ))
+echo -e "vibrations: Running the 6 'onlyS' calculations at 'OS[1-6]/',"   \
+    "${slots} at a time with ${per} cores each.\n"
+
+FCabs=`cd ${FCdir} && pwd`/ # the runs change directory
+dirs=( "" "-x" "+x" "-y" "+y" "-z" "+z" )
+dx=( 0 -1 1 0 0 0 0 )
+dy=( 0 0 0 -1 1 0 0 )
+dz=( 0 0 0 0 0 -1 1 )
+for n in `seq 1 6`
+do
+    # Per-run working directory with the input files.
+    OSdir=${FCdir}OS${n}/
+    rm -rf ${OSdir}
+    mkdir ${OSdir}
+    cp ${FCdir}*${pseudo} ${OSdir}
+    check=`grep -i "SYSTEMLABEL" ${FCfdf}`
+    sed "s/${check}/SystemLabel             ${slabel}_${n}/I"           \
+	${FCfdf} > ${OSdir}pbFCrun.fdf
+
+    # Half of the atoms shifted to the direction of the run.
+    echo -e "%block AtomicCoordinatesAndAtomicSpecies"                  \
+	> ${OSdir}pbCoord.fdf
+    awk '{printf "\t% .10f\t% .10f\t% .10f%3d\n", $1, $2, $3, $4}'      \
+	${FCdir}pbCoord.tmp >> ${OSdir}pbCoord.fdf
+    awk -v x=${dx[n]} -v y=${dy[n]} -v z=${dz[n]} -v var=${displ}       \
+	'{printf "\t% .10f\t% .10f\t% .10f%3d\n", $1 + x * var,
+	  $2 + y * var, $3 + z * var, $4}'                              \
+	${FCdir}pbCoord.tmp >> ${OSdir}pbCoord.fdf
+    echo -e "%endblock AtomicCoordinatesAndAtomicSpecies"               \
+	>> ${OSdir}pbCoord.fdf
+
+    # Waits for the run holding the same cores.
+    slot=$(( (${n} - 1) % ${slots} ))
+    if [ ${n} -gt ${slots} ]
+    then
+	wait ${pid[n-slots]}
+    fi
+    submit="${3} -n ${per} ${4}"
+    if which taskset > /dev/null 2>&1
+    then
+	submit="taskset -c $(( ${slot} * ${per} ))-$(( (${slot} + 1) * ${per} - 1 )) ${submit}"
+    fi
+
+    # Runs it in background. The '.onlyS' file is moved to the FC
+    # directory only when complete, so 'vibrations --wait-onlys'
+    # (or 'vibrations watch') may read each pair as soon as it lands.
+    echo -e "vibrations: Running 'onlyS' calculation for"               \
+	"'${dirs[n]}' direction...\n"
+    (
+	cd ${OSdir}
+	start=$(date +%s)
+	${submit} < pbFCrun.fdf > ${slabel}_${n}.out 2>&1
+	code=${?}
+	if [ ${code} == 0 ] && [ ! -s ${slabel}_${n}.onlyS ]
+	then
+	    code=-1
+	fi
+	if [ ${code} == 0 ]
+	then
+	    mv ${slabel}_${n}.onlyS ${FCabs}
+	    rm -f *_${n}.alloc *_${n}.BONDS* *_${n}.KP *_${n}.STRUCT_*    \
+		INPUT_TMP.*
+	fi
+	echo "${code} $(( $(date +%s) - ${start} ))" > status
+    ) &
+    pid[n]=${!}
+done
 wait
-rm *_6.alloc *_6.BONDS* *_6.KP *_6.STRUCT_* INPUT_TMP.*
+
+# Summary of the runs.
+echo -e "\nvibrations: Summary of the 'onlyS' runs:\n"
+printf "     %3s  %9s  %5s  %8s  %s\n" "run" "direction" "cores"          \
+    "time(s)" "status"
+nfail=0
+for n in `seq 1 6`
+do
+    code=-1
+    time=0
+    if [ -r ${FCdir}OS${n}/status ]
+    then
+	read code time < ${FCdir}OS${n}/status
+    fi
+    if [ "${code}" == "0" ]
+    then
+	status="ok"
+    else
+	status="FAILED (exit ${code}, see OS${n}/${slabel}_${n}.out)"
+	nfail=$(( ${nfail} + 1 ))
+    fi
+    printf "     %3d  %9s  %5d  %8d  %s\n" ${n} "${dirs[n]}" ${per}       \
+	${time} "${status}"
+done
+echo ""
 
 # Finishing.
 rm ${FCdir}pbCoord.tmp
-rm ${FCdir}pbCoord.fdf
 rm ${FCfdf}
 end=$(date +%s%N) # final time with nanoseconds accuracy
 echo -e ""
@@ -443,4 +424,10 @@ date
 tempo=`echo "scale = 10; (${end} - ${begin}) / 60000000000" | bc`
 echo -e "\nvibrations: Run time: ${tempo} min\n"
 
+if [ ${nfail} != 0 ]
+then
+    echo -e "vibrations: ERROR: ${nfail} of the 6 'onlyS' runs failed!\n"
+    exit -1
+fi
+
 exit 0
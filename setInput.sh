@@ -197,14 +197,32 @@ then
     # Concatenate calculated constant forces matrices and Fermi
     # energies, and copy '.gHS' files, renaming accordingly.
     echo "Force constants matrix" > ${FCdir}${slabel}.FC
+    nlines=$(( ${natoms} * 6 ))
 
     if [ "${3}" == "1" ]
     then
 	head -n1 ${FCdir}FC${FCfirst}/${slabel}.ef > ${FCdir}${slabel}.ef
-        nlines=$(( ${natoms} * 6 ))
 	j=0
 	for i in `seq ${FCfirst} ${FClast}`
 	do
+	    if [ ! -d ${FCdir}FC${i} ]
+	    then
+                # Atom rebuilt by symmetry (zero placeholders).
+		echo -e " FC${i}/ not found: atom ${i} must be rebuilt"  \
+		    "by symmetry ('--symmetry')."
+		for k in `seq 1 ${nlines}`
+		do
+		    echo "0.0 0.0 0.0" >> ${FCdir}${slabel}.FC
+		done
+		for k in `seq 1 6`
+		do
+		    printf "%12d  % .14f\n" $(( ${j} + ${k} )) 0.0        \
+			>> ${FCdir}${slabel}.ef
+		done
+		j=$(( ${j} + 6 ))
+		continue
+	    fi
+
             # Concatenated FC matrix.
 	    tail -n${nlines} ${FCdir}FC${i}/${slabel}.FC                \
 		>> ${FCdir}${slabel}.FC
@@ -228,10 +246,24 @@ then
         # Copy one of the '000.gHS' and '.orb' to main FC folder.
 	cp ${FCdir}FC${FCfirst}/${slabel}_000.gHS ${FCdir}
 	cp ${FCdir}FC${FCfirst}/${slabel}.orb ${FCdir}
+	if [ -r ${FCdir}FC${FCfirst}/${slabel}.ORB_INDX ]
+	then
+	    cp ${FCdir}FC${FCfirst}/${slabel}.ORB_INDX ${FCdir}
+	fi
 
     else # onlyPh calculation
 	for i in `seq ${FCfirst} ${FClast}`
 	do
+	    if [ ! -d ${FCdir}FC${i} ]
+	    then
+                # Atom rebuilt by symmetry (zero placeholders).
+		for k in `seq 1 ${nlines}`
+		do
+		    echo "0.0 0.0 0.0" >> ${FCdir}${slabel}.FC
+		done
+		continue
+	    fi
+
             # Concatenated FC matrix.
 	    tail -n${nlines} ${FCdir}FC${i}/${slabel}.FC                \
 		>> ${FCdir}${slabel}.FC
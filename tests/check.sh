@@ -0,0 +1,315 @@
+#!/bin/bash
+
+#  *******************************************************************  #
+#                  ** PhOnonS ITeratIVE VIBRATIONS **                   #
+#                                                                       #
+#                           **  Version 2  **                           #
+#                                                                       #
+#  Written by Pedro Brandimarte (brandimarte@gmail.com)                 #
+#                                                                       #
+#  Copyright (c), All Rights Reserved                                   #
+#                                                                       #
+#  This program is free software. You can redistribute it and/or        #
+#  modify it under the terms of the GNU General Public License          #
+#  (version 3 or later) as published by the Free Software Foundation    #
+#  <http://fsf.org/>.                                                   #
+#                                                                       #
+#  This program is distributed in the hope that it will be useful, but  #
+#  WITHOUT ANY WARRANTY, without even the implied warranty of           #
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU     #
+#  General Public License for more details (file 'LICENSE_GPL'          #
+#  distributed along with this program or at                            #
+#  <http://www.gnu.org/licenses/gpl.html>).                             #
+#  *******************************************************************  #
+#                               check.sh                                #
+#  *******************************************************************  #
+#  This script generates tiny FC directories with 'vibgen', runs        #
+#  'vibrations' on each of them and compares the outputs with the      #
+#  golden ones at 'tests/golden' with 'vibcmp' (up to the signs and     #
+#  rotations of degenerate modes):                                      #
+#   - spin1 :  'full' run, '.Meph' and '.bMeph' vs 'spin1.Meph';        #
+#   - spin2 :  'full' spin-polarized run, vs 'spin2.Meph';              #
+#   - api   :  couplings of the spin1 directory through the in-memory  #
+#              interface ('vibapi', which also checks the repeated      #
+#              displacements), vs 'spin1.Meph';                         #
+#   - fortran: the same through the wrappers of 'Fortran.h' ('vibapi   #
+#              --fortran'), vs 'spin1.Meph';                            #
+#   - bmeph :  '.bMeph' format 2 of the spin1 system, dense, sparse     #
+#              ('--meph-tol') and with checksums (verified by           #
+#              'vibcmp'), read by the mapped reader, vs 'spin1.Meph';   #
+#   - window:  'Meph' projected onto the 'H0' eigenstates in            #
+#              [-3,4] eV ('--meph-window'), vs 'window.Meph';           #
+#   - resume:  spin1 run resumed from a checkpoint of only its first    #
+#              two displacement pairs, with a 'dH' cache, vs            #
+#              'spin1.Meph';                                            #
+#   - cache :  rerun of the resumed case with all the 'dH' read from    #
+#              the cache (also those of the checkpoint), vs             #
+#              'spin1.Meph';                                            #
+#   - watch :  'watch' run of the 'FC[atom]' folders of the spin1       #
+#              system, vs 'spin1.Meph';                                 #
+#   - active:  spin1 run on the active region of one neighbour shell    #
+#              ('--active-shells=1'), vs 'active.Meph';                 #
+#   - split :  'full splitFC' run of the 'FC[atom]' folders of the      #
+#              spin1 system, vs 'spin1.Meph';                           #
+#   - onlyPh:  phonon modes of the spin1 system ('--jmol=multi'), vs    #
+#              'onlyPh.xyz';                                            #
+#   - symm  :  'full' run of the C4v system of 'vibgen --symmetric',    #
+#              vs 'symm.Meph';                                          #
+#   - symmRed: 'full splitFC --symmetry' run of the same system with    #
+#              only its irreducible atoms displaced (the 'FC[atom]'     #
+#              folders of the others removed), vs 'symm.Meph';          #
+#   - tiltRed: the same as symmRed with the molecule rotated off the    #
+#              axes ('vibgen --tilted'), vs the 'full' run of all its   #
+#              atoms (case 'tilt').                                     #
+#  The spin1 and symm goldens agree with the outputs of the version 1   #
+#  of 'vibrations' (commit bf60376) up to 4e-16 (the largest relative   #
+#  difference of 'vibcmp'). The spin2 golden differs from them on       #
+#  purpose: version 1 built the spin down Hamiltonian from the spin up  #
+#  values of the '.gHS' files.                                          #
+#  Exits with the number of failed comparisons.                         #
+#                                                                       #
+#  Input:  ${1} :  directory with 'vibrations', 'vibgen', 'vibcmp',     #
+#                  'vibapi' and 'setInput.sh'                           #
+#          ${2} :  work directory (default '/tmp/vibcheck')             #
+#                                                                       #
+#  Environment:  CHECK_UPDATE : if set, rewrites the golden outputs     #
+#                               instead of comparing them               #
+#                                                                       #
+#  Use: ./check.sh [binaries directory] [work directory]                #
+#  *******************************************************************  #
+
+bin=`cd ${1:-.} && pwd`
+checkDir=${2:-/tmp/vibcheck}
+golden=`cd \`dirname ${0}\` && pwd`/golden
+gen="--atoms=6 --dyn=2 --orbs=3 --band=1"
+run="--log=quiet"
+export PATH=${bin}:${PATH}
+
+# Tolerances: the '.Meph' text has 16 digits and the Jmol output
+# 7, and the nearly degenerate modes are compared as a group.
+tolMeph="--rtol=1e-6 --deg=1e-4"
+tolJmol="--rtol=1e-5 --deg=1e-4"
+
+# The tilted molecule maps the displacements along x, y and z onto
+# combinations of them, equal only up to the second order of the
+# finite differences (thus a smaller displacement and tolerance).
+tolTilt="--rtol=1e-4 --etol=1e-5 --deg=1e-4"
+
+rm -rf ${checkDir}
+mkdir -p ${checkDir} || exit -1
+nFail=0
+
+# Compares the output ${2} of the case ${1} with the golden ${3}
+# (tolerances at ${4}).
+compare ()
+{
+    if [ -n "${CHECK_UPDATE}" ]
+    then
+	cp ${checkDir}/${1}/${2} ${golden}/${3} || exit -1
+	echo " ${1}: ${golden}/${3} updated"
+    elif vibcmp ${4} ${golden}/${3} ${checkDir}/${1}/${2}              \
+	> ${checkDir}/${1}/vibcmp.out 2>&1
+    then
+	echo " ${1}: ${2} PASS"
+    else
+	echo " ${1}: ${2} FAIL (see ${checkDir}/${1}/vibcmp.out)"
+	nFail=$(( ${nFail} + 1 ))
+    fi
+}
+
+# Compares the output ${2} of the case ${1} with the same output of
+# the case ${3} (tolerances at ${4}).
+compareCase ()
+{
+    if vibcmp ${4} ${checkDir}/${3}/${2} ${checkDir}/${1}/${2}           \
+	> ${checkDir}/${1}/vibcmp.out 2>&1
+    then
+	echo " ${1}: ${2} PASS"
+    else
+	echo " ${1}: ${2} FAIL (see ${checkDir}/${1}/vibcmp.out)"
+	nFail=$(( ${nFail} + 1 ))
+    fi
+}
+
+# Reruns 'vibrations' at the case ${1} with the arguments ${2} (and
+# the options ${3} instead of the default ones).
+rerun ()
+{
+    ( cd ${checkDir}/${1} && rm -f synth.Meph synth.bMeph &&            \
+	vibrations . synth.fdf ${2} ${3:-${run}} > vibrations.out 2>&1 )
+    if [ $? -ne 0 ]
+    then
+	echo " ${1}: vibrations FAIL (see ${checkDir}/${1}/vibrations.out)"
+	nFail=$(( ${nFail} + 1 ))
+	return 1
+    fi
+}
+
+# Generates the case ${1} with the 'vibgen' options ${2}, removes
+# its folders ${4} and runs 'vibrations' with the arguments ${3}.
+generate ()
+{
+    vibgen ${checkDir}/${1} ${gen} ${2} > /dev/null || exit -1
+    for f in ${4}
+    do
+	rm -rf ${checkDir}/${1}/${f}
+    done
+    ( cd ${checkDir}/${1} && vibrations . synth.fdf ${3} ${run}         \
+	> vibrations.out 2>&1 )
+    if [ $? -ne 0 ]
+    then
+	echo " ${1}: vibrations FAIL (see ${checkDir}/${1}/vibrations.out)"
+	nFail=$(( ${nFail} + 1 ))
+	return 1
+    fi
+}
+
+echo -e "\n Checking against the golden outputs at ${golden}:\n"
+
+if generate spin1 "" "full --jmol=off"
+then
+    compare spin1 synth.Meph spin1.Meph "${tolMeph}"
+    [ -z "${CHECK_UPDATE}" ]                                            \
+	&& compare spin1 synth.bMeph spin1.Meph "${tolMeph}"
+fi
+
+if generate spin2 "--nspin=2" "full --jmol=off"
+then
+    compare spin2 synth.Meph spin2.Meph "${tolMeph}"
+    [ -z "${CHECK_UPDATE}" ]                                            \
+	&& compare spin2 synth.bMeph spin2.Meph "${tolMeph}"
+fi
+
+if [ -z "${CHECK_UPDATE}" ] && [ -d ${checkDir}/spin1 ]
+then
+    mkdir -p ${checkDir}/api
+    if vibapi ${checkDir}/spin1 > ${checkDir}/api/vibapi.out 2>&1
+    then
+	mv ${checkDir}/spin1/synthAPI.Meph ${checkDir}/api/
+	compare api synthAPI.Meph spin1.Meph "${tolMeph}"
+    else
+	echo " api: vibapi FAIL (see ${checkDir}/api/vibapi.out)"
+	nFail=$(( ${nFail} + 1 ))
+    fi
+fi
+
+if [ -z "${CHECK_UPDATE}" ] && [ -d ${checkDir}/spin1 ]
+then
+    mkdir -p ${checkDir}/fortran
+    if vibapi --fortran ${checkDir}/spin1                               \
+	> ${checkDir}/fortran/vibapi.out 2>&1
+    then
+	mv ${checkDir}/spin1/synthAPI.Meph ${checkDir}/fortran/
+	compare fortran synthAPI.Meph spin1.Meph "${tolMeph}"
+    else
+	echo " fortran: vibapi FAIL (see ${checkDir}/fortran/vibapi.out)"
+	nFail=$(( ${nFail} + 1 ))
+    fi
+fi
+
+if [ -z "${CHECK_UPDATE}" ] && generate bmeph ""                        \
+    "full --jmol=off --meph-text=off --bmeph=2"
+then
+    mv ${checkDir}/bmeph/synth.bMeph ${checkDir}/bmeph/dense.bMeph
+    compare bmeph dense.bMeph spin1.Meph "${tolMeph}"
+    if rerun bmeph "full --jmol=off --meph-text=off --bmeph=2            \
+	--meph-tol=1e-14"
+    then
+	mv ${checkDir}/bmeph/synth.bMeph ${checkDir}/bmeph/sparse.bMeph
+	compare bmeph sparse.bMeph spin1.Meph "${tolMeph}"
+    fi
+    if rerun bmeph "full --jmol=off --meph-text=off --bmeph=2            \
+	--bmeph-checksums"
+    then
+	mv ${checkDir}/bmeph/synth.bMeph ${checkDir}/bmeph/checksums.bMeph
+	compare bmeph checksums.bMeph spin1.Meph "${tolMeph}"
+    fi
+fi
+
+if generate window "" "full --jmol=off --meph-window=-3:4"
+then
+    compare window synth.Meph window.Meph "${tolMeph}"
+fi
+
+# (the manifest is cut as if the first run was stopped after the
+# second displacement pair, and the cache is filled by the resumed
+# run, with the pairs of the checkpoint too)
+if [ -z "${CHECK_UPDATE}" ] && generate resume ""                       \
+    "full --jmol=off --checkpoint=ck"
+then
+    head -n 6 ${checkDir}/resume/ck/manifest > ${checkDir}/resume/manifest
+    mv ${checkDir}/resume/manifest ${checkDir}/resume/ck/manifest
+    rerun resume "full --jmol=off --checkpoint=ck --cache=dHcache"          \
+	&& compare resume synth.Meph spin1.Meph "${tolMeph}"
+    cp -r ${checkDir}/resume ${checkDir}/cache
+    if rerun cache "full --jmol=off --cache=dHcache" "--log=info"
+    then
+	if grep -q " 6 of 6 displacement pairs reused"                     \
+	    ${checkDir}/cache/vibrations.out
+	then
+	    compare cache synth.Meph spin1.Meph "${tolMeph}"
+	else
+	    echo " cache: not all the 'dH' read from the cache FAIL"
+	    nFail=$(( ${nFail} + 1 ))
+	fi
+    fi
+fi
+
+if [ -z "${CHECK_UPDATE}" ]
+then
+    vibgen ${checkDir}/watch ${gen} --split > /dev/null || exit -1
+    if ( cd ${checkDir}/watch && vibrations watch . synth.fdf full        \
+	--poll=1 --settle=0 --jmol=off ${run} > vibrations.out 2>&1 )
+    then
+	compare watch synth.Meph spin1.Meph "${tolMeph}"
+    else
+	echo " watch: vibrations FAIL (see ${checkDir}/watch/vibrations.out)"
+	nFail=$(( ${nFail} + 1 ))
+    fi
+fi
+
+if generate active "" "full --jmol=off --active-shells=1"
+then
+    compare active synth.Meph active.Meph "${tolMeph}"
+fi
+
+if [ -z "${CHECK_UPDATE}" ] && generate split "--split"                 \
+    "full splitFC --jmol=off"
+then
+    compare split synth.Meph spin1.Meph "${tolMeph}"
+fi
+
+if generate onlyPh "" "onlyPh --jmol=multi"
+then
+    compare onlyPh synthJMOL.xyz onlyPh.xyz "${tolJmol}"
+fi
+
+if generate symm "--symmetric" "full --jmol=off"
+then
+    compare symm synth.Meph symm.Meph "${tolMeph}"
+fi
+
+# (atoms 4 to 6 are rebuilt from the atom 3)
+if [ -z "${CHECK_UPDATE}" ] && generate symmRed "--symmetric --split"     \
+    "full splitFC --symmetry --jmol=off" "FC4 FC5 FC6"
+then
+    compare symmRed synth.Meph symm.Meph "${tolMeph}"
+fi
+
+# (same as above, with no symmetry axis along x, y or z)
+if [ -z "${CHECK_UPDATE}" ]                                             \
+    && generate tilt "--tilted --displ=0.002" "full --jmol=off"          \
+    && generate tiltRed "--tilted --displ=0.002 --split"                 \
+    "full splitFC --symmetry --jmol=off" "FC4 FC5 FC6"
+then
+    compareCase tiltRed synth.Meph tilt "${tolTilt}"
+fi
+
+if [ ${nFail} -eq 0 ]
+then
+    echo -e "\n All checks passed.\n"
+else
+    echo -e "\n ${nFail} check(s) failed!\n"
+fi
+
+exit ${nFail}
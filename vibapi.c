@@ -0,0 +1,503 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Drives the in-memory interface ('PHONsetSystem',       **/
+/**  'PHONaddDisplacement', 'PHONaddOnlyS' and              **/
+/**  'PHONephInMemory') with the files of a 'vibgen'        **/
+/**  directory (without split), as a host code like SIESTA  **/
+/**  would, and writes the couplings at '[label]API.Meph'   **/
+/**  to be compared with those of the file based run. On    **/
+/**  the way it checks that a repeated non-displaced system **/
+/**  replaces the previous one (a wrong one is handed       **/
+/**  first) and that a repeated displacement is rejected    **/
+/**  without changing the context. With '--fortran' it      **/
+/**  calls the same entry points through the wrappers of    **/
+/**  'Fortran.h', as a fortran host code would.             **/
+/**  *****************************************************  **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <signal.h>
+#include "Check.h"
+#include "Utils.h"
+#include "Phonon.h"
+#include "Log.h"
+#include "Meph.h"
+#include "Fortran.h"
+
+/* Structure for the system read from the 'vibgen' directory. */
+typedef struct APISYSTEM apisystem;
+struct APISYSTEM {
+   const char *dir; /* 'vibgen' directory */
+   char label[256]; /* system label */
+   int nAtoms; /* number of atoms */
+   int nspin; /* spin polarization */
+   int FCfirst, FClast; /* first and last dynamic atoms */
+   int nDyn; /* number of dynamic atoms */
+   double displ; /* atoms displacement (Bohr) */
+   int *Zdyn; /* atomic numbers of the dynamic atoms */
+   int *orbIdx; /* first orbital of each atom (and 'no_u') */
+   double *ef; /* Fermi energies (eV) */
+   double *FC; /* '.FC' rows: 'nAtoms' for each displacement */
+};
+
+/* Structure for a sparse '.gHS' or '.onlyS' file. */
+typedef struct APISPARSE apisparse;
+struct APISPARSE {
+   int n; /* number of rows */
+   int nspin; /* spin components of 'H' (0 for '.onlyS') */
+   int nnz; /* number of nonzero elements */
+   int *numh, *listh; /* SIESTA sparse pattern */
+   double *H, *S; /* Hamiltonian (Ry) and overlap */
+};
+
+/* Calls the wrappers of 'Fortran.h' instead ('--fortran'). */
+static int fortran = 0;
+
+/* Prints the usage. */
+static void howto ();
+
+
+/* ********************************************************* */
+/* Reads from the '.fdf' input of 'sys' the dimensions, the  */
+/* displacement and the atomic numbers of the dynamic atoms. */
+static int readFdf (apisystem *sys)
+{
+   register int a;
+   int spec, nSpec, *Zspec, info = VIB_SUCCESS;
+   double x;
+   char file[1100], line[256], unit[16];
+   FILE *F;
+
+   snprintf (file, sizeof (file), "%s/%s.fdf", sys->dir, sys->label);
+   F = CHECKfopen (file, "r");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+
+   sys->nAtoms = sys->FCfirst = sys->FClast = 0;
+   sys->nspin = 1;
+   sys->displ = 0.0;
+   nSpec = 0;
+   Zspec = NULL;
+   while (info == VIB_SUCCESS && fgets (line, sizeof (line), F) != NULL) {
+      if (sscanf (line, "NumberOfAtoms %d", &sys->nAtoms) == 1
+	  || sscanf (line, "MD.FCfirst %d", &sys->FCfirst) == 1
+	  || sscanf (line, "MD.FClast %d", &sys->FClast) == 1)
+	 continue ;
+      if (strncmp (line, "SpinPolarized true", 18) == 0)
+	 sys->nspin = 2;
+      else if (sscanf (line, "MD.FCdispl %lf %15s", &x, unit) == 2)
+	 sys->displ = (strcasecmp (unit, "Bohr") == 0 ? x : x / bohr2ang);
+      else if (strncmp (line, "%block ChemicalSpeciesLabel", 27) == 0) {
+	 CHECKfree (Zspec);
+	 Zspec = CHECKmalloc (100 * sizeof (int));
+	 if (Zspec == NULL)
+	    info = VIB_ERR_MEMORY;
+	 while (info == VIB_SUCCESS && fgets (line, sizeof (line), F) != NULL
+		&& sscanf (line, "%d", &spec) == 1)
+	    if (spec < 1 || spec > 99
+		|| sscanf (line, "%*d %d", &Zspec[spec]) != 1)
+	       info = VIB_ERR_FORMAT;
+	    else if (spec > nSpec)
+	       nSpec = spec;
+      }
+      else if (strncmp (line,
+			"%block AtomicCoordinatesAndAtomicSpecies", 40) == 0) {
+	 if (Zspec == NULL || sys->FCfirst < 1 || sys->FClast < sys->FCfirst
+	     || sys->FClast > sys->nAtoms) {
+	    info = VIB_ERR_FORMAT;
+	    break ;
+	 }
+	 sys->nDyn = sys->FClast - sys->FCfirst + 1;
+	 sys->Zdyn = CHECKmalloc (sys->nDyn * sizeof (int));
+	 if (sys->Zdyn == NULL)
+	    info = VIB_ERR_MEMORY;
+	 for (a = 1; a <= sys->nAtoms && info == VIB_SUCCESS; a++)
+	    if (fgets (line, sizeof (line), F) == NULL
+		|| sscanf (line, "%*f %*f %*f %d", &spec) != 1
+		|| spec < 1 || spec > nSpec)
+	       info = VIB_ERR_FORMAT;
+	    else if (a >= sys->FCfirst && a <= sys->FClast)
+	       sys->Zdyn[a-sys->FCfirst] = Zspec[spec];
+      }
+   }
+   if (info == VIB_SUCCESS && (sys->Zdyn == NULL || sys->displ <= 0.0))
+      info = VIB_ERR_FORMAT;
+   if (info != VIB_SUCCESS)
+      fprintf (stderr, "\n ERROR: wrong or missing data at '%s'!\n", file);
+   fclose (F);
+
+   /* Frees memory. */
+   CHECKfree (Zspec);
+
+   return info;
+
+} /* readFdf */
+
+
+/* ********************************************************* */
+/* Reads the '.orb', '.ef' and '.FC' files of 'sys'.         */
+static int readOrbEfFC (apisystem *sys)
+{
+   register int i;
+   int n, info;
+   char file[1100], line[256];
+   FILE *F;
+
+   /* First orbital of each atom. */
+   snprintf (file, sizeof (file), "%s/%s.orb", sys->dir, sys->label);
+   sys->orbIdx = CHECKmalloc ((sys->nAtoms + 1) * sizeof (int));
+   if (sys->orbIdx == NULL)
+      return VIB_ERR_MEMORY;
+   F = CHECKfopen (file, "r");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+   info = VIB_SUCCESS;
+   for (i = 0; i <= sys->nAtoms && info == VIB_SUCCESS; i++)
+      info = CHECKfscanf (fscanf (F, "%d", &sys->orbIdx[i]), file);
+   fclose (F);
+   if (info != VIB_SUCCESS)
+      return info;
+
+   /* Fermi energies. */
+   n = 6 * sys->nDyn + 1;
+   snprintf (file, sizeof (file), "%s/%s.ef", sys->dir, sys->label);
+   sys->ef = UTILdoubleVector (n);
+   if (sys->ef == NULL)
+      return VIB_ERR_MEMORY;
+   F = CHECKfopen (file, "r");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+   for (i = 0; i < n && info == VIB_SUCCESS; i++)
+      info = CHECKfscanf (fscanf (F, "%*d %lf", &sys->ef[i]), file);
+   fclose (F);
+   if (info != VIB_SUCCESS)
+      return info;
+
+   /* Force constants (after the title line). */
+   n = 3 * sys->nAtoms * 6 * sys->nDyn;
+   snprintf (file, sizeof (file), "%s/%s.FC", sys->dir, sys->label);
+   sys->FC = UTILdoubleVector (n);
+   if (sys->FC == NULL)
+      return VIB_ERR_MEMORY;
+   F = CHECKfopen (file, "r");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+   if (fgets (line, sizeof (line), F) == NULL)
+      info = VIB_ERR_FORMAT;
+   for (i = 0; i < n && info == VIB_SUCCESS; i++)
+      info = CHECKfscanf (fscanf (F, "%lf", &sys->FC[i]), file);
+   fclose (F);
+
+   return info;
+
+} /* readOrbEfFC */
+
+
+/* ********************************************************* */
+/* Frees the arrays of the sparse matrices 'sp'.             */
+static void freeSparse (apisparse *sp)
+{
+
+   CHECKfree (sp->numh);
+   CHECKfree (sp->listh);
+   CHECKfree (sp->H);
+   CHECKfree (sp->S);
+   sp->numh = sp->listh = NULL;
+   sp->H = sp->S = NULL;
+
+} /* freeSparse */
+
+
+/* ********************************************************* */
+/* Reads the '.gHS' file (or the '.onlyS' file, if 'onlyS') */
+/* 'file' into 'sp'.                                         */
+static int readSparse (const char *file, int onlyS, apisparse *sp)
+{
+   int info;
+   FILE *F;
+
+   F = CHECKfopen (file, "rb");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+   sp->nspin = 0;
+   info = CHECKfread (fread (&sp->n, sizeof (int), 1, F), 1, F, file);
+   if (info == VIB_SUCCESS && !onlyS)
+      info = CHECKfread (fread (&sp->nspin, sizeof (int), 1, F), 1, F, file);
+   if (info == VIB_SUCCESS)
+      info = CHECKfread (fread (&sp->nnz, sizeof (int), 1, F), 1, F, file);
+   if (info == VIB_SUCCESS && (sp->n < 1 || sp->nnz < 1 || sp->nspin < 0
+			       || sp->nspin > 2))
+      info = VIB_ERR_FORMAT;
+   if (info == VIB_SUCCESS) {
+      sp->numh = CHECKmalloc (sp->n * sizeof (int));
+      sp->listh = CHECKmalloc (sp->nnz * sizeof (int));
+      sp->H = CHECKmalloc (((size_t) sp->nspin * sp->nnz + 1)
+			   * sizeof (double));
+      sp->S = CHECKmalloc (sp->nnz * sizeof (double));
+      if (sp->numh == NULL || sp->listh == NULL || sp->H == NULL
+	  || sp->S == NULL)
+	 info = VIB_ERR_MEMORY;
+   }
+   if (info == VIB_SUCCESS)
+      info = CHECKfread (fread (sp->numh, sizeof (int), sp->n, F),
+			 sp->n, F, file);
+   if (info == VIB_SUCCESS)
+      info = CHECKfread (fread (sp->listh, sizeof (int), sp->nnz, F),
+			 sp->nnz, F, file);
+   if (info == VIB_SUCCESS && !onlyS)
+      info = CHECKfread (fread (sp->H, sizeof (double),
+				(size_t) sp->nspin * sp->nnz, F),
+			 (size_t) sp->nspin * sp->nnz, F, file);
+   if (info == VIB_SUCCESS)
+      info = CHECKfread (fread (sp->S, sizeof (double), sp->nnz, F),
+			 sp->nnz, F, file);
+   fclose (F);
+
+   return info;
+
+} /* readSparse */
+
+
+/* ********************************************************* */
+/* Hands the displacement 'disp' of 'sys' to 'ctx' (with its */
+/* Hamiltonian scaled by 'scale' and its Fermi energy        */
+/* shifted by 'shift' eV, to hand a wrong system).           */
+static int addDisplacement (vib_context *ctx, apisystem *sys, int disp,
+			    double scale, double shift)
+{
+   register int i;
+   int info;
+   double sign, Ef, *forces, *FC;
+   char file[1100];
+   apisparse sp;
+
+   sp.numh = sp.listh = NULL;
+   sp.H = sp.S = NULL;
+   snprintf (file, sizeof (file), "%s/%s_%.3d.gHS", sys->dir, sys->label,
+	     disp);
+   info = readSparse (file, 0, &sp);
+   if (info == VIB_SUCCESS && (sp.n != sys->orbIdx[sys->nAtoms]
+			       || sp.nspin != sys->nspin))
+      info = VIB_ERR_FORMAT;
+   forces = UTILdoubleVector (3 * sys->nAtoms);
+   if (forces == NULL)
+      info = VIB_ERR_MEMORY;
+
+   /* Forces (Ry/Bohr) back from the force constants. */
+   if (info == VIB_SUCCESS && disp > 0) {
+      sign = (disp % 2 == 1 ? -1.0 : 1.0);
+      FC = &sys->FC[idx(0,disp-1,3*sys->nAtoms)];
+      for (i = 0; i < 3 * sys->nAtoms; i++)
+	 forces[i] = - sign * FC[i] * bohr2ang * sys->displ
+	    * (bohr2ang / rydberg2eV);
+   }
+
+   if (info == VIB_SUCCESS) {
+      for (i = 0; i < sp.nspin * sp.nnz; i++)
+	 sp.H[i] *= scale;
+      Ef = (sys->ef[disp] + shift) / rydberg2eV;
+      if (fortran)
+	 phonadddisplacement_ (&ctx, &disp, sp.numh, sp.listh, sp.H, sp.S,
+			       forces, &Ef, &info);
+      else
+	 info = PHONaddDisplacement (ctx, &disp, sp.numh, sp.listh, sp.H,
+				     sp.S, forces, &Ef);
+   }
+
+   /* Frees memory. */
+   freeSparse (&sp);
+   CHECKfree (forces);
+
+   return info;
+
+} /* addDisplacement */
+
+
+/* ********************************************************* */
+/* Hands the 'onlyS' run 'disp' of 'sys' to 'ctx'.           */
+static int addOnlyS (vib_context *ctx, apisystem *sys, int disp)
+{
+   int info;
+   char file[1100];
+   apisparse sp;
+
+   sp.numh = sp.listh = NULL;
+   sp.H = sp.S = NULL;
+   snprintf (file, sizeof (file), "%s/%s_%d.onlyS", sys->dir, sys->label,
+	     disp);
+   info = readSparse (file, 1, &sp);
+   if (info == VIB_SUCCESS && sp.n != 2 * sys->orbIdx[sys->nAtoms])
+      info = VIB_ERR_FORMAT;
+   if (info == VIB_SUCCESS && fortran)
+      phonaddonlys_ (&ctx, &disp, sp.numh, sp.listh, sp.S, &info);
+   else if (info == VIB_SUCCESS)
+      info = PHONaddOnlyS (ctx, &disp, sp.numh, sp.listh, sp.S);
+
+   /* Frees memory. */
+   freeSparse (&sp);
+
+   return info;
+
+} /* addOnlyS */
+
+
+/* ********************************************************* */
+/* Checks that the repeated call of the displacement 'disp'  */
+/* is rejected (returns the number of failures).             */
+static int repeated (vib_context *ctx, apisystem *sys, int disp)
+{
+   int info;
+
+   info = addDisplacement (ctx, sys, disp, 2.0, 0.1 * disp);
+   if (info == VIB_ERR_INPUT)
+      return 0;
+   fprintf (stderr, " repeated displacement %d not rejected: %s\n", disp,
+	    CHECKerrorString (info));
+
+   return 1;
+
+} /* repeated */
+
+
+int main (int nargs, char *arg[])
+{
+   register int k;
+   int a, nFail, nOrb, firstOrb, nModes, info;
+   double *EigVec, *EigVal, *Meph;
+   char file[1100];
+   apisystem sys;
+   vib_context *ctx;
+
+   a = 1;
+   if (nargs > 1 && strcmp (arg[1], "--fortran") == 0) {
+      fortran = 1;
+      a++;
+   }
+   if (nargs - a < 1 || nargs - a > 2 || strncmp (arg[a], "--", 2) == 0) {
+      howto ();
+      return 2;
+   }
+   sys.dir = arg[a];
+   snprintf (sys.label, sizeof (sys.label), "%s",
+	     nargs - a == 2 ? arg[a+1] : "synth");
+   sys.nDyn = 0;
+   sys.Zdyn = sys.orbIdx = NULL;
+   sys.ef = sys.FC = NULL;
+   EigVec = EigVal = Meph = NULL;
+
+   /* Reads the system. */
+   info = readFdf (&sys);
+   if (info == VIB_SUCCESS)
+      info = readOrbEfFC (&sys);
+   if (fortran)
+      phonnewcontext_ (&ctx);
+   else
+      ctx = PHONnewContext ();
+   if (ctx == NULL)
+      info = VIB_ERR_MEMORY;
+   if (info == VIB_SUCCESS)
+      ctx->logLevel = LOG_QUIET;
+   if (info == VIB_SUCCESS && fortran) /* (label without '\0') */
+      phonsetsystem_ (&ctx, sys.label, &sys.nAtoms, &sys.nspin,
+		      &sys.FCfirst, &sys.FClast, &sys.displ, sys.Zdyn,
+		      sys.orbIdx, &info, strlen (sys.label));
+   else if (info == VIB_SUCCESS)
+      info = PHONsetSystem (ctx, sys.label, &sys.nAtoms, &sys.nspin,
+			    &sys.FCfirst, &sys.FClast, &sys.displ,
+			    sys.Zdyn, sys.orbIdx);
+
+   /* A wrong non-displaced system first, replaced at the end, */
+   /* and each displacement twice.                             */
+   nFail = 0;
+   if (info == VIB_SUCCESS)
+      info = addDisplacement (ctx, &sys, 0, 2.0, 0.1);
+   for (k = 1; k <= 6 * sys.nDyn && info == VIB_SUCCESS; k++) {
+      info = addDisplacement (ctx, &sys, k, 1.0, 0.0);
+      if (info == VIB_SUCCESS)
+	 nFail += repeated (ctx, &sys, k);
+   }
+   if (info == VIB_SUCCESS)
+      info = addDisplacement (ctx, &sys, 0, 1.0, 0.0);
+   for (k = 1; k <= 6 && info == VIB_SUCCESS; k++)
+      info = addOnlyS (ctx, &sys, k);
+
+   /* Computes and writes the couplings. */
+   nModes = 3 * sys.nDyn;
+   if (info == VIB_SUCCESS) {
+      firstOrb = sys.orbIdx[sys.FCfirst-1];
+      nOrb = sys.orbIdx[sys.FClast] - firstOrb;
+      EigVec = CHECKmalloc (nModes * nModes * sizeof (double));
+      EigVal = CHECKmalloc (nModes * sizeof (double));
+      Meph = CHECKmalloc ((size_t) nModes * sys.nspin * nOrb * nOrb
+			  * sizeof (double));
+      if (EigVec == NULL || EigVal == NULL || Meph == NULL)
+	 info = VIB_ERR_MEMORY;
+   }
+   if (info == VIB_SUCCESS && fortran)
+      phonephinmemory_ (&ctx, EigVec, EigVal, Meph, &info);
+   else if (info == VIB_SUCCESS)
+      info = PHONephInMemory (ctx, EigVec, EigVal, Meph);
+   if (info == VIB_SUCCESS) {
+      snprintf (file, sizeof (file), "%s/%sAPI.Meph", sys.dir, sys.label);
+      info = MEPHwriteText (file, sys.nspin, sys.nDyn, nOrb, firstOrb + 1,
+			    EigVal, Meph);
+   }
+
+   if (info != VIB_SUCCESS)
+      fprintf (stderr, "\n vibapi: ERROR: %s!\n\n", CHECKerrorString (info));
+   else
+      printf (" %s written (%d repeated displacements not rejected)\n",
+	      file, nFail);
+
+   /* Frees memory. */
+   if (fortran)
+      phonfreecontext_ (&ctx);
+   else
+      PHONfreeContext (ctx);
+   CHECKfree (sys.Zdyn);
+   CHECKfree (sys.orbIdx);
+   CHECKfree (sys.ef);
+   CHECKfree (sys.FC);
+   CHECKfree (EigVec);
+   CHECKfree (EigVal);
+   CHECKfree (Meph);
+
+   if (info != VIB_SUCCESS)
+      return 2;
+
+   return (nFail == 0 ? 0 : 1);
+
+} /* main */
+
+
+/* ********************************************************* */
+/* Prints the usage.                                         */
+static void howto ()
+{
+
+   fprintf (stderr, "\n Use: vibapi [--fortran] [directory] [label]\n\n");
+   fprintf (stderr,
+	    " Computes the couplings of the 'vibgen' directory (without"
+	    " '--split') through\n"
+	    " the in-memory interface and writes them at"
+	    " '[directory]/[label]API.Meph'\n"
+	    " (label 'synth' by default). Returns 0 on success, 1 if a"
+	    " repeated\n"
+	    " displacement was not rejected and 2 on errors. With"
+	    " '--fortran' the\n"
+	    " interface is called through the wrappers of 'Fortran.h'"
+	    " (as from fortran).\n\n");
+
+} /* howto */
+
+
+/* ************************ Drafts ************************* */
@@ -0,0 +1,540 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Microbenchmark of the kernels of the calculation       **/
+/**  (egg-box removal, symmetrization, sparse to dense      **/
+/**  scatter with the Fermi shift, finite differences of    **/
+/**  'dH', 'dH' correction and electron-phonon coupling),   **/
+/**  called through 'PHONkernel' on generated data for a    **/
+/**  grid of system sizes (linear chains as 'vibgen', with  **/
+/**  a quarter of the atoms dynamic). Each kernel is warmed **/
+/**  up and timed several times; the median, the spread,    **/
+/**  the GFLOP/s and GB/s (from operation and compulsory    **/
+/**  memory traffic counts) are compared with the roofline  **/
+/**  'min(peak GFLOP/s, intensity * peak GB/s)', the peaks  **/
+/**  measured with a 'dgemm' and a triad loop (or given).   **/
+/**  *****************************************************  **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include "Extern.h"
+#include "Check.h"
+#include "Utils.h"
+#include "Phonon.h"
+#include "Log.h"
+#include "Kernels.h"
+
+/* Maximum number of sizes of the grid. */
+#define BENCH_MAX_SIZES 16
+
+/* Names of the kernels (as 'PHON_KERNEL_*'). */
+static const char *kernelName[PHON_N_KERNELS] = {
+   "eggBox", "symmetrize", "scatter", "deltaH", "dHCorrection", "eph"
+};
+
+/* Structure for the benchmark parameters. */
+typedef struct BENCHPARAM benchparam;
+struct BENCHPARAM {
+   int nSizes; /* number of sizes of the grid */
+   int sizes[BENCH_MAX_SIZES]; /* numbers of atoms */
+   int nOrb; /* orbitals per atom */
+   int nspin; /* spin polarization */
+   int band; /* neighbour atoms coupled (each side) */
+   int warmup; /* untimed calls */
+   int reps; /* timed calls */
+   int run[PHON_N_KERNELS]; /* kernels to run */
+   double peakFlops; /* peak GFLOP/s (0 = measured) */
+   double peakBytes; /* peak GB/s (0 = measured) */
+};
+
+/* Prints the usage. */
+static void howto ();
+
+
+/* ********************************************************* */
+/* Fills the 'n' values of 'x' with pseudo-random values in  */
+/* '[-scale,scale)' from the state '*seed'.                  */
+static void fill (double *x, size_t n, double scale,
+		  unsigned long long *seed)
+{
+   register size_t i;
+
+   for (i = 0; i < n; i++) {
+      *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      x[i] = scale * ((double) (*seed >> 11) / 4503599627370496.0 - 1.0);
+   }
+
+} /* fill */
+
+
+/* ********************************************************* */
+/* Compares two doubles (for 'qsort').                       */
+static int cmpDouble (const void *a, const void *b)
+{
+   double x = *(const double *) a, y = *(const double *) b;
+
+   return (x > y) - (x < y);
+
+} /* cmpDouble */
+
+
+/* ********************************************************* */
+/* Measures the peak GFLOP/s with a 'dgemm' and the peak     */
+/* GB/s with a triad loop (the best of a few calls).         */
+static int measurePeaks (double *peakFlops, double *peakBytes)
+{
+   register int r;
+   register size_t i;
+   int n = 512;
+   size_t len = 4 * 1024 * 1024; /* 32 MB arrays */
+   double alpha = 1.0, beta = 0.0, t, best;
+   double *A, *B, *C;
+   unsigned long long seed = 7;
+
+   A = CHECKmalloc (len * sizeof (double));
+   B = CHECKmalloc (len * sizeof (double));
+   C = CHECKmalloc (len * sizeof (double));
+   if (A == NULL || B == NULL || C == NULL) {
+      CHECKfree (A);
+      CHECKfree (B);
+      CHECKfree (C);
+      return VIB_ERR_MEMORY;
+   }
+   fill (A, len, 1.0, &seed);
+   fill (B, len, 1.0, &seed);
+   fill (C, len, 1.0, &seed);
+
+   if (*peakFlops <= 0.0) {
+      for (r = 0, best = 1.0e30; r < 4; r++) {
+	 t = UTILwallTime ();
+	 dgemm ("N", "N", &n, &n, &n, &alpha, A, &n, B, &n, &beta, C, &n);
+	 t = UTILwallTime () - t;
+	 if (r > 0 && t < best) /* the first call is a warm-up */
+	    best = t;
+      }
+      *peakFlops = 2.0e-9 * n * n * n / best;
+   }
+
+   if (*peakBytes <= 0.0) {
+      for (r = 0, best = 1.0e30; r < 6; r++) {
+	 t = UTILwallTime ();
+	 for (i = 0; i < len; i++)
+	    A[i] = B[i] + 0.5 * C[i];
+	 t = UTILwallTime () - t;
+	 if (r > 0 && t < best)
+	    best = t;
+      }
+      *peakBytes = 1.0e-9 * 3 * len * sizeof (double) / best;
+   }
+
+   /* Frees memory. */
+   CHECKfree (A);
+   CHECKfree (B);
+   CHECKfree (C);
+
+   return VIB_SUCCESS;
+
+} /* measurePeaks */
+
+
+/* ********************************************************* */
+/* Sets at '*flops' and '*bytes' the floating point          */
+/* operations and the compulsory memory traffic (each        */
+/* operand read or written once) of a call of 'kernel' with  */
+/* the sizes of 'ctx' ('nnz' nonzero elements per spin at    */
+/* the sparse matrices). The flops of 'dHCorrection' and     */
+/* 'eph' are counted as at the run timings ('Timing.h').     */
+static void kernelModel (vib_context *ctx, int kernel, int nnz,
+			 double *flops, double *bytes)
+{
+   double n, nDyn3, nspin, nOrb;
+
+   n = ctx->no_u;
+   nDyn3 = 3.0 * ctx->nDyn;
+   nspin = ctx->nspin;
+   nOrb = ctx->orbIdx[ctx->FClast] - ctx->orbIdx[ctx->FCfirst-1];
+
+   switch (kernel) {
+   case PHON_KERNEL_EGGBOX:
+      *flops = nDyn3 * 3.0 * ctx->nAtoms;
+      *bytes = 8.0 * nDyn3 * 3.0 * ctx->nAtoms;
+      break;
+   case PHON_KERNEL_SYMM:
+      *flops = 5.0 * nDyn3 * (nDyn3 + 1.0) / 2.0;
+      *bytes = 2.0 * 8.0 * nDyn3 * nDyn3;
+      break;
+   case PHON_KERNEL_SCATTER:
+      *flops = nnz * (2.0 * nspin + 1.0) + 2.0 * nspin * n * n;
+      *bytes = nnz * (4.0 + 8.0 * (nspin + 1.0)) /* sparse */
+	 + 2.0 * 8.0 * nnz * (nspin + 1.0) /* scattered */
+	 + 8.0 * (3.0 * nspin) * n * n; /* shift */
+      break;
+   case PHON_KERNEL_DELTAH:
+      *flops = 4.0 * nDyn3 * nspin * n * n;
+      *bytes = 8.0 * 4.0 * nDyn3 * nspin * n * n;
+      break;
+   case PHON_KERNEL_DHCORR:
+      *flops = 2.0 * n * n * n + nDyn3 * nspin * 8.0 * n * n * n;
+      *bytes = 8.0 * 3.0 * n * n + 8.0 * 16.0 * nDyn3 * nspin * n * n;
+      break;
+   case PHON_KERNEL_EPH:
+      *flops = 2.0 * nDyn3 * nDyn3 * nspin * nOrb * nOrb;
+      *bytes = 8.0 * 3.0 * nDyn3 * nDyn3 * nspin * nOrb * nOrb;
+      break;
+   default:
+      *flops = *bytes = 0.0;
+   }
+
+} /* kernelModel */
+
+
+/* ********************************************************* */
+/* Sets the SIESTA sparse pattern 'numh' and 'listh' (with   */
+/* 'nOrb' orbitals per atom and coupling the atoms up to     */
+/* 'band' neighbours apart) of a chain of 'nAtoms' atoms.    */
+/* Returns the number of nonzero elements.                   */
+static int pattern (int nAtoms, int nOrb, int band, int *numh, int *listh)
+{
+   register int a, b, i, j, k;
+
+   for (a = 0, k = 0; a < nAtoms; a++)
+      for (i = 0; i < nOrb; i++) {
+	 numh[a*nOrb+i] = 0;
+	 for (b = (a - band > 0 ? a - band : 0);
+	      b <= a + band && b < nAtoms; b++)
+	    for (j = 0; j < nOrb; j++, k++) {
+	       listh[k] = b * nOrb + j + 1;
+	       numh[a*nOrb+i]++;
+	    }
+      }
+
+   return k;
+
+} /* pattern */
+
+
+/* ********************************************************* */
+/* Benchmarks the kernels of 'p' for a chain of 'nAtoms'     */
+/* atoms, printing a line per kernel.                        */
+static int benchSize (benchparam *p, int nAtoms, double peakFlops,
+		      double peakBytes)
+{
+   register int i, r, kernel;
+   int nDyn, FCfirst, FClast, no_u, nspin, nOrb, nnz = 0, info;
+   int *Zdyn, *orbIndex;
+   size_t nH, nM;
+   double displ = 0.04, flops, bytes, gflops, gbs, roof, *t;
+   unsigned long long seed = 1;
+   vib_kernel_data d;
+   vib_context *ctx;
+
+   nDyn = (nAtoms / 4 > 0 ? nAtoms / 4 : 1);
+   FCfirst = (nAtoms - nDyn) / 2 + 1;
+   FClast = FCfirst + nDyn - 1;
+   nspin = p->nspin;
+   no_u = nAtoms * p->nOrb;
+   nOrb = nDyn * p->nOrb;
+   nH = (size_t) 3 * nDyn * nspin * no_u * no_u;
+   nM = (size_t) 3 * nDyn * nspin * nOrb * nOrb;
+
+   /* Context of the system (owns 'H0', 'S0', 'dH', 'dS' and */
+   /* 'fullFCneg').                                          */
+   memset (&d, 0, sizeof (d));
+   ctx = PHONnewContext ();
+   Zdyn = CHECKmalloc (nDyn * sizeof (int));
+   orbIndex = CHECKmalloc ((nAtoms + 1) * sizeof (int));
+   t = CHECKmalloc (p->reps * sizeof (double));
+   if (ctx == NULL || Zdyn == NULL || orbIndex == NULL || t == NULL)
+      info = VIB_ERR_MEMORY;
+   else {
+      for (i = 0; i < nDyn; i++)
+	 Zdyn[i] = 6;
+      for (i = 0; i <= nAtoms; i++)
+	 orbIndex[i] = i * p->nOrb;
+      info = PHONsetSystem (ctx, "bench", &nAtoms, &nspin, &FCfirst,
+			    &FClast, &displ, Zdyn, orbIndex);
+   }
+
+   /* Operands. */
+   if (info == VIB_SUCCESS) {
+      ctx->logLevel = LOG_QUIET;
+      d.fullFC = ctx->fullFCneg;
+      d.H0 = ctx->H0;
+      d.S0 = ctx->S0;
+      d.dH = ctx->dH;
+      d.dS = ctx->dS;
+      d.FC = CHECKmalloc ((size_t) 9 * nDyn * nDyn * sizeof (double));
+      d.numh = CHECKmalloc (no_u * sizeof (int));
+      d.listh = CHECKmalloc ((size_t) no_u * (2 * p->band + 1) * p->nOrb
+			     * sizeof (int));
+      d.Hsparse = CHECKmalloc ((size_t) nspin * no_u * (2 * p->band + 1)
+			       * p->nOrb * sizeof (double));
+      d.Ssparse = CHECKmalloc ((size_t) no_u * (2 * p->band + 1) * p->nOrb
+			       * sizeof (double));
+      d.Hm = CHECKmalloc (nH * sizeof (double));
+      d.Hp = CHECKmalloc (nH * sizeof (double));
+      d.EigVec = CHECKmalloc ((size_t) 9 * nDyn * nDyn * sizeof (double));
+      d.EigVal = CHECKmalloc (3 * nDyn * sizeof (double));
+      d.Meph = UTILdoubleVector (nM);
+      if (d.FC == NULL || d.numh == NULL || d.listh == NULL ||
+	  d.Hsparse == NULL || d.Ssparse == NULL || d.Hm == NULL ||
+	  d.Hp == NULL || d.EigVec == NULL || d.EigVal == NULL ||
+	  d.Meph == NULL)
+	 info = VIB_ERR_MEMORY;
+   }
+   if (info == VIB_SUCCESS) {
+      nnz = pattern (nAtoms, p->nOrb, p->band, d.numh, d.listh);
+      fill (d.fullFC, (size_t) 9 * nAtoms * nDyn, 1.0, &seed);
+      fill (d.FC, (size_t) 9 * nDyn * nDyn, 1.0, &seed);
+      fill (d.Hsparse, (size_t) nspin * nnz, 1.0, &seed);
+      fill (d.Ssparse, (size_t) nnz, 0.1, &seed);
+      fill (d.H0, (size_t) nspin * no_u * no_u, 1.0, &seed);
+      fill (d.S0, (size_t) no_u * no_u, 0.1 / no_u, &seed);
+      for (i = 0; i < no_u; i++) /* 'S0' invertible */
+	 d.S0[idx(i,i,no_u)] += 1.0;
+      fill (d.Hm, nH, 1.0, &seed);
+      fill (d.Hp, nH, 1.0, &seed);
+      fill (d.dH, nH, 1.0, &seed);
+      fill (d.dS, (size_t) 3 * no_u * no_u, 0.1, &seed);
+      fill (d.EigVec, (size_t) 9 * nDyn * nDyn, 1.0, &seed);
+      for (i = 0; i < 3 * nDyn; i++)
+	 d.EigVal[i] = 0.01 + 0.1 * i / (3.0 * nDyn);
+      fill (ctx->ef, 6 * nDyn + 1, 1.0, &seed);
+      d.efermi = -4.0;
+   }
+
+   /* Times each kernel. */
+   for (kernel = 0; kernel < PHON_N_KERNELS && info == VIB_SUCCESS;
+	kernel++) {
+      if (!p->run[kernel])
+	 continue ;
+      for (r = 0; r < p->warmup && info == VIB_SUCCESS; r++)
+	 info = PHONkernel (ctx, kernel, &d);
+      for (r = 0; r < p->reps && info == VIB_SUCCESS; r++) {
+	 t[r] = UTILwallTime ();
+	 info = PHONkernel (ctx, kernel, &d);
+	 t[r] = UTILwallTime () - t[r];
+      }
+      if (info != VIB_SUCCESS)
+	 break ;
+      qsort (t, p->reps, sizeof (double), cmpDouble);
+      kernelModel (ctx, kernel, nnz, &flops, &bytes);
+      gflops = 1.0e-9 * flops / t[p->reps/2];
+      gbs = 1.0e-9 * bytes / t[p->reps/2];
+      roof = flops / bytes * peakBytes;
+      if (roof > peakFlops)
+	 roof = peakFlops;
+      printf ("  %6d %6d %-13s %11.2f %8.1f %9.3f %9.3f %7.3f %9.3f"
+	      " %6.1f %s\n", nAtoms, no_u, kernelName[kernel],
+	      1.0e6 * t[p->reps/2],
+	      100.0 * (t[p->reps-1] - t[0]) / t[p->reps/2], gflops, gbs,
+	      flops / bytes, roof, 100.0 * gflops / roof,
+	      flops / bytes < peakFlops / peakBytes ? "memory" : "compute");
+      fflush (stdout);
+   }
+
+   /* Frees memory. */
+   CHECKfree (d.FC);
+   CHECKfree (d.numh);
+   CHECKfree (d.listh);
+   CHECKfree (d.Hsparse);
+   CHECKfree (d.Ssparse);
+   CHECKfree (d.Hm);
+   CHECKfree (d.Hp);
+   CHECKfree (d.EigVec);
+   CHECKfree (d.EigVal);
+   CHECKfree (d.Meph);
+   CHECKfree (Zdyn);
+   CHECKfree (orbIndex);
+   CHECKfree (t);
+   PHONfreeContext (ctx);
+
+   return info;
+
+} /* benchSize */
+
+
+/* ********************************************************* */
+/* Reads the comma separated list 'list' of sizes into 'p'   */
+/* (returns 0 on wrong values).                              */
+static int readSizes (const char *list, benchparam *p)
+{
+   char *end;
+
+   p->nSizes = 0;
+   do {
+      if (p->nSizes == BENCH_MAX_SIZES)
+	 return 0;
+      p->sizes[p->nSizes] = (int) strtol (list, &end, 10);
+      if (end == list || p->sizes[p->nSizes] < 1)
+	 return 0;
+      p->nSizes++;
+      list = end + 1;
+   } while (*end == ',');
+
+   return (*end == '\0');
+
+} /* readSizes */
+
+
+/* ********************************************************* */
+/* Reads the comma separated list 'list' of kernel names     */
+/* into 'p' (returns 0 on unknown names).                    */
+static int readKernels (const char *list, benchparam *p)
+{
+   register int k;
+   size_t len;
+
+   memset (p->run, 0, sizeof (p->run));
+   while (*list != '\0') {
+      len = strcspn (list, ",");
+      for (k = 0; k < PHON_N_KERNELS; k++)
+	 if (strlen (kernelName[k]) == len &&
+	     strncmp (list, kernelName[k], len) == 0)
+	    break ;
+      if (k == PHON_N_KERNELS)
+	 return 0;
+      p->run[k] = 1;
+      list += len + (list[len] == ',');
+   }
+
+   return 1;
+
+} /* readKernels */
+
+
+/* ********************************************************* */
+/* Reads the option 'opt' into 'p' (returns 0 if it is       */
+/* unknown or has a wrong value).                            */
+static int readOption (const char *opt, benchparam *p)
+{
+   char *end;
+
+   end = "";
+   if (strncmp (opt, "--atoms=", 8) == 0)
+      return readSizes (opt + 8, p);
+   else if (strncmp (opt, "--kernels=", 10) == 0)
+      return readKernels (opt + 10, p);
+   else if (strncmp (opt, "--orbs=", 7) == 0)
+      p->nOrb = (int) strtol (opt + 7, &end, 10);
+   else if (strncmp (opt, "--nspin=", 8) == 0)
+      p->nspin = (int) strtol (opt + 8, &end, 10);
+   else if (strncmp (opt, "--band=", 7) == 0)
+      p->band = (int) strtol (opt + 7, &end, 10);
+   else if (strncmp (opt, "--warmup=", 9) == 0)
+      p->warmup = (int) strtol (opt + 9, &end, 10);
+   else if (strncmp (opt, "--reps=", 7) == 0)
+      p->reps = (int) strtol (opt + 7, &end, 10);
+   else if (strncmp (opt, "--peak-gflops=", 14) == 0)
+      p->peakFlops = strtod (opt + 14, &end);
+   else if (strncmp (opt, "--peak-gbs=", 11) == 0)
+      p->peakBytes = strtod (opt + 11, &end);
+   else
+      return 0;
+
+   return (*end == '\0');
+
+} /* readOption */
+
+
+int main (int nargs, char *arg[])
+{
+   register int i;
+   int info;
+   double peakFlops, peakBytes;
+   benchparam p;
+
+   /* Default parameters. */
+   p.nSizes = 3;
+   p.sizes[0] = 8;
+   p.sizes[1] = 16;
+   p.sizes[2] = 32;
+   p.nOrb = 9;
+   p.nspin = 1;
+   p.band = 2;
+   p.warmup = 2;
+   p.reps = 11;
+   p.peakFlops = p.peakBytes = 0.0;
+   for (i = 0; i < PHON_N_KERNELS; i++)
+      p.run[i] = 1;
+
+   for (i = 1; i < nargs; i++)
+      if (!readOption (arg[i], &p)) {
+	 fprintf (stderr, "\n Unknown option or wrong value '%s'!\n", arg[i]);
+	 howto ();
+	 return EXIT_FAILURE;
+      }
+   if (p.nOrb < 1 || (p.nspin != 1 && p.nspin != 2) || p.band < 0 ||
+       p.warmup < 0 || p.reps < 1) {
+      fprintf (stderr, "\n Wrong arguments!\n");
+      howto ();
+      return EXIT_FAILURE;
+   }
+
+   /* Roofline of the machine. */
+   peakFlops = p.peakFlops;
+   peakBytes = p.peakBytes;
+   info = measurePeaks (&peakFlops, &peakBytes);
+   if (info == VIB_SUCCESS) {
+      printf (" Peak: %.2f GFLOP/s (%s), %.2f GB/s (%s), ridge at %.2f"
+	      " flop/byte\n", peakFlops, p.peakFlops > 0.0 ? "given" :
+	      "dgemm", peakBytes, p.peakBytes > 0.0 ? "given" : "triad",
+	      peakFlops / peakBytes);
+      printf (" %d orbitals per atom, nspin %d, median of %d calls after"
+	      " %d warm-up, kernels path %s\n\n", p.nOrb, p.nspin, p.reps,
+	      p.warmup, KERNdescribe ());
+      printf ("# %6s %6s %-13s %11s %8s %9s %9s %7s %9s %6s %s\n", "atoms",
+	      "no_u", "kernel", "median(us)", "spread%", "GFLOP/s", "GB/s",
+	      "flop/B", "roof", "roof%", "bound");
+   }
+
+   /* Kernels of each size. */
+   for (i = 0; i < p.nSizes && info == VIB_SUCCESS; i++)
+      info = benchSize (&p, p.sizes[i], peakFlops, peakBytes);
+
+   if (info != VIB_SUCCESS)
+      fprintf (stderr, "\n vibbench: ERROR: %s!\n\n",
+	       CHECKerrorString (info));
+
+   return (info == VIB_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE);
+
+} /* main */
+
+
+/* ********************************************************* */
+/* Prints the usage.                                         */
+static void howto ()
+{
+
+   fprintf (stderr, "\n Use: vibbench [options]\n\n");
+   fprintf (stderr,
+	    "  --atoms=N,M,...    numbers of atoms of the size grid, a"
+	    " quarter of them\n"
+	    "                     dynamic (default 8,16,32)\n"
+	    "  --orbs=N           orbitals per atom (default 9)\n"
+	    "  --nspin=1|2        spin polarization (default 1)\n"
+	    "  --band=N           neighbour atoms coupled at the sparse"
+	    " matrices (default 2)\n"
+	    "  --kernels=K,...    kernels to run (default all): eggBox,"
+	    " symmetrize,\n"
+	    "                     scatter, deltaH, dHCorrection, eph\n"
+	    "  --warmup=N         untimed calls (default 2)\n"
+	    "  --reps=N           timed calls (default 11)\n"
+	    "  --peak-gflops=X    peak GFLOP/s of the roofline (default"
+	    " measured)\n"
+	    "  --peak-gbs=X       peak GB/s of the roofline (default"
+	    " measured)\n\n");
+
+} /* howto */
+
+
+/* ************************ Drafts ************************* */
@@ -0,0 +1,558 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Compares two electron-phonon coupling outputs (a       **/
+/**  reference and a new one, each a text '.Meph' or a      **/
+/**  '.bMeph' of version 1 or 2, dense or sparse) within    **/
+/**  tolerances, to validate changes of the numerical       **/
+/**  kernels against golden outputs. The phonon modes are   **/
+/**  defined up to a sign and, for degenerate energies, up  **/
+/**  to a rotation of their subspace, which carries over to **/
+/**  the coupling matrices 'M_l'. So the modes are grouped  **/
+/**  by (near) degenerate energies and, for each group,     **/
+/**  the new matrices are compared with the orthogonal      **/
+/**  combination 'R' of the reference ones closest to them  **/
+/**  (the polar factor of the overlaps 'C_ab = <N_a,M_b>',  **/
+/**  which for a single mode is just its sign).             **/
+/**  The phonon modes of an 'onlyPh' run are compared the   **/
+/**  same way from the multi-frame Jmol output ('JMOL.xyz', **/
+/**  all the modes, '--jmol=multi'), each mode a block of   **/
+/**  the displacements of all atoms.                        **/
+/**  *****************************************************  **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include "Check.h"
+#include "Utils.h"
+#include "Phonon.h"
+#include "Meph.h"
+
+/* Structure for a coupling output read in memory. */
+typedef struct MEPHDATA mephdata;
+struct MEPHDATA {
+   int nspin; /* spin polarization */
+   int nDyn; /* number of dynamic atoms */
+   int nOrb; /* number of orbitals of the dynamic atoms */
+   int firstOrb, lastOrb; /* orbitals range */
+   double *freq; /* phonon energies (eV, highest first as at the file) */
+   double *M; /* blocks 'nOrb x nOrb' (column-major) of each mode */
+	      /* (as 'freq') and spin, zero if not written        */
+   size_t len; /* values of each mode (all spins) at 'M' */
+};
+
+/* Structure for the tolerances. */
+typedef struct CMPTOL cmptol;
+struct CMPTOL {
+   double rtol; /* relative to the largest element of a group */
+   double atol; /* absolute */
+   double etol; /* relative for the energies */
+   double deg; /* energies closer than 'deg' (eV) are degenerate */
+};
+
+/* Prints the usage. */
+static void howto ();
+
+
+/* ********************************************************* */
+/* Allocates the energies and the blocks of 'len' values of  */
+/* each mode of 'd' from its dimensions (already set).       */
+static int allocData (mephdata *d, size_t len)
+{
+   size_t n;
+
+   if (d->nspin < 1 || d->nspin > 2 || d->nDyn < 1 || d->nOrb < 1)
+      return VIB_ERR_FORMAT;
+   d->len = len;
+   n = len * 3 * d->nDyn;
+   d->freq = CHECKmalloc (3 * d->nDyn * sizeof (double));
+   d->M = CHECKmalloc (n * sizeof (double));
+   if (d->freq == NULL || d->M == NULL)
+      return VIB_ERR_MEMORY;
+   memset (d->M, 0, n * sizeof (double));
+
+   return VIB_SUCCESS;
+
+} /* allocData */
+
+
+/* ********************************************************* */
+/* Reads the text '.Meph' file 'filename' into 'd'.          */
+static int readText (const char *filename, mephdata *d)
+{
+   register int i, j, l, s;
+   int nOrb, info;
+   FILE *F;
+
+   F = CHECKfopen (filename, "r");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+   info = CHECKfscanf (fscanf (F, "%d %d %d %d %d", &d->nspin, &d->nDyn,
+			       &d->nOrb, &d->firstOrb, &d->lastOrb), filename);
+   if (info == VIB_SUCCESS)
+      info = allocData (d, (size_t) d->nOrb * d->nOrb * d->nspin);
+   nOrb = d->nOrb;
+   for (l = 0; l < 3 * d->nDyn && info == VIB_SUCCESS; l++)
+      info = CHECKfscanf (fscanf (F, "%lf", &d->freq[l]), filename);
+
+   /* The rows of the blocks of the modes with positive energy. */
+   for (l = 0; l < 3 * d->nDyn && info == VIB_SUCCESS; l++)
+      if (d->freq[l] > 0.0)
+	 for (s = 0; s < d->nspin; s++)
+	    for (i = 0; i < nOrb && info == VIB_SUCCESS; i++)
+	       for (j = 0; j < nOrb && info == VIB_SUCCESS; j++)
+		  info = CHECKfscanf (fscanf (F, "%lf",
+			     &d->M[idx3d(i,j,l*d->nspin+s,nOrb,nOrb)]),
+				      filename);
+
+   if (info == VIB_SUCCESS)
+      info = CHECKfclose (fclose (F), filename);
+   else
+      fclose (F);
+
+   return info;
+
+} /* readText */
+
+
+/* ********************************************************* */
+/* Reads 'count' items of 'size' bytes from 'F' to 'buf'.    */
+static int readItems (void *buf, size_t size, size_t count, FILE *F,
+		      const char *filename)
+{
+
+   return CHECKfread (fread (buf, size, count, F), count, F, filename);
+
+} /* readItems */
+
+
+/* ********************************************************* */
+/* Reads the '.bMeph' version 1 file 'filename' into 'd'.    */
+static int readBinary1 (const char *filename, mephdata *d)
+{
+   register int l, s;
+   int dims[5], nOrb, info;
+   FILE *F;
+
+   F = CHECKfopen (filename, "rb");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+   info = readItems (dims, sizeof (int), 5, F, filename);
+   if (info == VIB_SUCCESS) {
+      d->nspin = dims[0];
+      d->nDyn = dims[1];
+      d->nOrb = dims[2];
+      d->firstOrb = dims[3];
+      d->lastOrb = dims[4];
+      info = allocData (d, (size_t) d->nOrb * d->nOrb * d->nspin);
+   }
+   if (info == VIB_SUCCESS)
+      info = readItems (d->freq, sizeof (double), 3 * d->nDyn, F, filename);
+   nOrb = d->nOrb;
+   for (l = 0; l < 3 * d->nDyn && info == VIB_SUCCESS; l++)
+      if (d->freq[l] > 0.0)
+	 for (s = 0; s < d->nspin && info == VIB_SUCCESS; s++)
+	    info = readItems (&d->M[idx3d(0,0,l*d->nspin+s,nOrb,nOrb)],
+			      sizeof (double), nOrb * nOrb, F, filename);
+
+   if (info == VIB_SUCCESS)
+      info = CHECKfclose (fclose (F), filename);
+   else
+      fclose (F);
+
+   return info;
+
+} /* readBinary1 */
+
+
+/* ********************************************************* */
+/* Reads the '.bMeph' version 2 file 'filename' (dense or    */
+/* sparse) into 'd', verifying the checksums of the blocks   */
+/* if it has them.                                           */
+static int readBinary2 (const char *filename, mephdata *d)
+{
+   register int l, s;
+   int nOrb, info;
+   meph_file *m;
+
+   m = MEPHopen (filename, &info);
+   if (m == NULL)
+      return info;
+   d->nspin = m->head->nspin;
+   d->nDyn = m->head->nDyn;
+   d->nOrb = nOrb = m->head->nOrb;
+   d->firstOrb = m->head->firstOrb;
+   d->lastOrb = m->head->lastOrb;
+   info = allocData (d, (size_t) nOrb * nOrb * d->nspin);
+   if (info == VIB_SUCCESS)
+      memcpy (d->freq, m->freq, 3 * d->nDyn * sizeof (double));
+   for (l = 0; l < 3 * d->nDyn && info == VIB_SUCCESS; l++)
+      if (d->freq[l] > 0.0)
+	 for (s = 0; s < d->nspin && info == VIB_SUCCESS; s++) {
+	    if (m->head->flags & MEPH_CHECKSUMS)
+	       info = MEPHverify (m, l, s);
+	    if (info != VIB_SUCCESS)
+	       fprintf (stderr, "\n ERROR: wrong checksum of the block of"
+			" mode %d, spin %d at %s!\n", l + 1, s, filename);
+	    else
+	       info = MEPHexpand (m, l, s,
+				  &d->M[idx3d(0,0,l*d->nspin+s,nOrb,nOrb)]);
+	 }
+   MEPHclose (m);
+
+   return info;
+
+} /* readBinary2 */
+
+
+/* ********************************************************* */
+/* Reads the multi-frame Jmol output 'filename' (all the     */
+/* modes, one frame each) into 'd', as a single spin with    */
+/* the blocks of the '3 x nAtoms' displacements.             */
+static int readJmol (const char *filename, mephdata *d)
+{
+   register int a, l;
+   int nAtoms, nLines, mode, info;
+   char line[1024], *p;
+   double *v;
+   FILE *F;
+
+   F = CHECKfopen (filename, "r");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+
+   /* Number of atoms (first line) and of modes (frames). */
+   nAtoms = nLines = 0;
+   while (fgets (line, sizeof (line), F) != NULL)
+      if (nLines++ == 0)
+	 nAtoms = atoi (line);
+   info = VIB_SUCCESS;
+   if (nAtoms < 1 || nLines % (nAtoms + 2) != 0 ||
+       (nLines / (nAtoms + 2)) % 3 != 0) {
+      fprintf (stderr, "\n ERROR: the file %s is not a Jmol output of"
+	       " all the modes!\n", filename);
+      info = VIB_ERR_FORMAT;
+   }
+   if (info == VIB_SUCCESS) {
+      d->nspin = 1;
+      d->nDyn = nLines / (nAtoms + 2) / 3;
+      d->nOrb = 3 * nAtoms;
+      d->firstOrb = d->lastOrb = 0;
+      info = allocData (d, (size_t) d->nOrb);
+   }
+
+   /* Each frame: atoms, mode and energy, and the coordinates */
+   /* and displacements (stored as 'freq', highest first).    */
+   rewind (F);
+   for (l = 0; l < 3 * d->nDyn && info == VIB_SUCCESS; l++) {
+      mode = 0;
+      if (fgets (line, sizeof (line), F) == NULL ||
+	  fgets (line, sizeof (line), F) == NULL ||
+	  (p = strstr (line, "mode=")) == NULL ||
+	  sscanf (p, "mode=%d", &mode) != 1 || mode < 1 ||
+	  mode > 3 * d->nDyn || (p = strstr (line, "energy=")) == NULL ||
+	  sscanf (p, "energy=%lf", &d->freq[3*d->nDyn-mode]) != 1)
+	 info = VIB_ERR_FORMAT;
+      v = &d->M[(3*d->nDyn-mode)*d->len];
+      for (a = 0; a < nAtoms && info == VIB_SUCCESS; a++)
+	 if (fgets (line, sizeof (line), F) == NULL ||
+	     sscanf (line, "%*s %*f %*f %*f %lf %lf %lf", &v[3*a],
+		     &v[3*a+1], &v[3*a+2]) != 3)
+	    info = VIB_ERR_FORMAT;
+      if (info != VIB_SUCCESS)
+	 fprintf (stderr, "\n ERROR: the file %s is not written"
+		  " correctly!\n", filename);
+   }
+
+   if (info == VIB_SUCCESS)
+      info = CHECKfclose (fclose (F), filename);
+   else
+      fclose (F);
+
+   return info;
+
+} /* readJmol */
+
+
+/* ********************************************************* */
+/* Reads the coupling output 'filename' into 'd', from its   */
+/* format: '.bMeph' version 2 (by its magic), version 1 (by  */
+/* the extension), the Jmol output (by the extension) or the */
+/* text '.Meph'.                                             */
+static int readMeph (const char *filename, mephdata *d)
+{
+   size_t len;
+   char magic[8];
+   FILE *F;
+
+   d->freq = d->M = NULL;
+   F = CHECKfopen (filename, "rb");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+   len = fread (magic, 1, sizeof (magic), F);
+   fclose (F);
+
+   if (len == sizeof (magic) && strcmp (magic, MEPH_MAGIC) == 0)
+      return readBinary2 (filename, d);
+   len = strlen (filename);
+   if (len > 6 && strcmp (filename + len - 6, ".bMeph") == 0)
+      return readBinary1 (filename, d);
+   if (len > 4 && strcmp (filename + len - 4, ".xyz") == 0)
+      return readJmol (filename, d);
+
+   return readText (filename, d);
+
+} /* readMeph */
+
+
+/* ********************************************************* */
+/* Inner product of the 'n' values of 'x' and 'y'.           */
+static double dot (const double *x, const double *y, size_t n)
+{
+   register size_t i;
+   double s = 0.0;
+
+   for (i = 0; i < n; i++)
+      s += x[i] * y[i];
+
+   return s;
+
+} /* dot */
+
+
+/* ********************************************************* */
+/* Compares the group of the 'k' modes starting at 'first'   */
+/* (blocks of 'len' values, all spins): sets 'R' to the      */
+/* orthogonal 'k x k' combination of the reference blocks    */
+/* closest to the new ones, 'R = C (C^T C)^-1/2' with        */
+/* 'C_ab = <N_a,M_b>', and returns at '*diff' and '*scale'   */
+/* the largest difference of an element and the largest     */
+/* element of the group.                                     */
+static int compareGroup (const double *ref, const double *new, size_t len,
+			 int first, int k, double *diff, double *scale)
+{
+   register int a, b, c;
+   register size_t i;
+   int info;
+   double *C, *A, *W, *R, x, wmax;
+
+   C = CHECKmalloc (4 * k * k * sizeof (double));
+   if (C == NULL)
+      return VIB_ERR_MEMORY;
+   A = C + k * k;
+   W = A + k * k;
+   R = W + k * k;
+
+   /* Overlaps 'C' and 'A = C^T C'. */
+   for (a = 0; a < k; a++)
+      for (b = 0; b < k; b++)
+	 C[idx(a,b,k)] = dot (&new[(first+a)*len], &ref[(first+b)*len], len);
+   for (a = 0; a < k; a++)
+      for (b = 0; b < k; b++)
+	 for (c = 0, A[idx(a,b,k)] = 0.0; c < k; c++)
+	    A[idx(a,b,k)] += C[idx(c,a,k)] * C[idx(c,b,k)];
+
+   /* 'A = V w V^T' and 'W = V w^-1/2 V^T' (pseudo-inverse: the */
+   /* directions where both outputs are zero are dropped).      */
+   info = CHECKdsyevd (k, A, R);
+   if (info != VIB_SUCCESS) {
+      CHECKfree (C);
+      return info;
+   }
+   wmax = R[k-1];
+   for (a = 0; a < k; a++)
+      for (b = 0; b < k; b++) {
+	 W[idx(a,b,k)] = 0.0;
+	 for (c = 0; c < k; c++)
+	    if (R[c] > 1.0e-24 * wmax && R[c] > 0.0)
+	       W[idx(a,b,k)] += A[idx(a,c,k)] * A[idx(b,c,k)] / sqrt (R[c]);
+      }
+
+   /* 'R = C W'. */
+   for (a = 0; a < k; a++)
+      for (b = 0; b < k; b++)
+	 for (c = 0, R[idx(a,b,k)] = 0.0; c < k; c++)
+	    R[idx(a,b,k)] += C[idx(a,c,k)] * W[idx(c,b,k)];
+
+   /* Largest difference between 'N_a' and 'sum_b R_ab M_b'. */
+   *diff = *scale = 0.0;
+   for (a = 0; a < k; a++)
+      for (i = 0; i < len; i++) {
+	 for (b = 0, x = 0.0; b < k; b++)
+	    x += R[idx(a,b,k)] * ref[(first+b)*len+i];
+	 x = fabs (new[(first+a)*len+i] - x);
+	 if (x > *diff)
+	    *diff = x;
+	 if (fabs (ref[(first+a)*len+i]) > *scale)
+	    *scale = fabs (ref[(first+a)*len+i]);
+      }
+
+   CHECKfree (C);
+
+   return VIB_SUCCESS;
+
+} /* compareGroup */
+
+
+/* ********************************************************* */
+/* Compares the outputs 'ref' and 'new'. Returns the number  */
+/* of failures (dimensions, energies or groups of modes).    */
+static int compare (mephdata *ref, mephdata *new, cmptol *tol, int *info)
+{
+   register int l, k;
+   int nModes, nFail = 0;
+   size_t len;
+   double diff, scale, worst = 0.0;
+
+   *info = VIB_SUCCESS;
+   if (ref->nspin != new->nspin || ref->nDyn != new->nDyn ||
+       ref->nOrb != new->nOrb || ref->firstOrb != new->firstOrb ||
+       ref->len != new->len) {
+      printf (" FAIL: dimensions differ (nspin %d/%d, nDyn %d/%d,"
+	      " nOrb %d/%d, first orbital %d/%d)\n", ref->nspin, new->nspin,
+	      ref->nDyn, new->nDyn, ref->nOrb, new->nOrb, ref->firstOrb,
+	      new->firstOrb);
+      return 1;
+   }
+   nModes = 3 * ref->nDyn;
+   len = ref->len;
+
+   /* Phonon energies. */
+   for (l = 0; l < nModes; l++)
+      if (fabs (new->freq[l] - ref->freq[l])
+	  > tol->etol * fabs (ref->freq[l]) + 1.0e-14) {
+	 printf (" FAIL: energy of mode %d: %.10e (reference %.10e)\n",
+		 nModes - l, new->freq[l], ref->freq[l]);
+	 nFail++;
+      }
+   if (nFail > 0)
+      return nFail;
+
+   /* Groups of degenerate modes (of positive energy). */
+   for (l = 0; l < nModes && ref->freq[l] > 0.0; l += k) {
+      for (k = 1; l + k < nModes && ref->freq[l+k] > 0.0 &&
+	      ref->freq[l+k-1] - ref->freq[l+k] <= tol->deg; k++);
+      *info = compareGroup (ref->M, new->M, len, l, k, &diff, &scale);
+      if (*info != VIB_SUCCESS)
+	 return nFail + 1;
+      if (diff > tol->atol + tol->rtol * scale) {
+	 printf (" FAIL: modes %d to %d (%.6e eV): largest difference"
+		 " %.3e (largest element %.3e)\n", nModes - l - k + 1,
+		 nModes - l, ref->freq[l], diff, scale);
+	 nFail++;
+      }
+      if (scale > 0.0 && diff / scale > worst)
+	 worst = diff / scale;
+   }
+   printf (" largest relative difference of a group: %.3e\n", worst);
+
+   return nFail;
+
+} /* compare */
+
+
+int main (int nargs, char *arg[])
+{
+   register int i;
+   int npos, nFail, info;
+   char *file[2];
+   cmptol tol;
+   mephdata ref, new;
+
+   /* Default tolerances. */
+   tol.rtol = 1.0e-8;
+   tol.atol = 1.0e-12;
+   tol.etol = 1.0e-8;
+   tol.deg = 1.0e-6;
+
+   for (i = 1, npos = 0; i < nargs; i++) {
+      if (strncmp (arg[i], "--rtol=", 7) == 0)
+	 tol.rtol = atof (arg[i] + 7);
+      else if (strncmp (arg[i], "--atol=", 7) == 0)
+	 tol.atol = atof (arg[i] + 7);
+      else if (strncmp (arg[i], "--etol=", 7) == 0)
+	 tol.etol = atof (arg[i] + 7);
+      else if (strncmp (arg[i], "--deg=", 6) == 0)
+	 tol.deg = atof (arg[i] + 6);
+      else if (strncmp (arg[i], "--", 2) != 0 && npos < 2)
+	 file[npos++] = arg[i];
+      else {
+	 fprintf (stderr, "\n Unknown option or wrong value '%s'!\n", arg[i]);
+	 howto ();
+	 return 2;
+      }
+   }
+   if (npos != 2) {
+      fprintf (stderr, "\n Wrong number of arguments!\n");
+      howto ();
+      return 2;
+   }
+
+   /* Reads both outputs. */
+   ref.freq = ref.M = new.freq = new.M = NULL;
+   info = readMeph (file[0], &ref);
+   if (info == VIB_SUCCESS)
+      info = readMeph (file[1], &new);
+
+   /* Compares them. */
+   nFail = 0;
+   if (info == VIB_SUCCESS) {
+      printf (" Comparing %s with the reference %s:\n", file[1], file[0]);
+      nFail = compare (&ref, &new, &tol, &info);
+   }
+   if (info != VIB_SUCCESS)
+      fprintf (stderr, "\n vibcmp: ERROR: %s!\n\n", CHECKerrorString (info));
+   else
+      printf (" %s\n", nFail == 0 ? "PASS" : "FAIL");
+
+   /* Frees memory. */
+   CHECKfree (ref.freq);
+   CHECKfree (ref.M);
+   CHECKfree (new.freq);
+   CHECKfree (new.M);
+
+   if (info != VIB_SUCCESS)
+      return 2;
+
+   return (nFail == 0 ? 0 : 1);
+
+} /* main */
+
+
+/* ********************************************************* */
+/* Prints the usage.                                         */
+static void howto ()
+{
+
+   fprintf (stderr, "\n Use: vibcmp [options] [reference] [new]\n\n");
+   fprintf (stderr,
+	    " Compares two coupling outputs ('.Meph' text or '.bMeph'"
+	    " version 1 or 2) up to\n"
+	    " the signs and the rotations of degenerate phonon modes."
+	    " Returns 0 if they\n"
+	    " agree, 1 if not and 2 on errors. The phonon modes alone"
+	    " are compared from\n"
+	    " the multi-frame Jmol outputs ('[label]JMOL.xyz' of all the"
+	    " modes).\n\n"
+	    "  --rtol=X  tolerance relative to the largest element of a"
+	    " group of modes\n"
+	    "            (default 1e-8)\n"
+	    "  --atol=X  absolute tolerance of the elements (default"
+	    " 1e-12)\n"
+	    "  --etol=X  relative tolerance of the energies (default"
+	    " 1e-8)\n"
+	    "  --deg=X   energies closer than X eV are degenerate"
+	    " (default 1e-6)\n\n");
+
+} /* howto */
+
+
+/* ************************ Drafts ************************* */
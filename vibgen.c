@@ -0,0 +1,1061 @@
+/**  *****************************************************  **/
+/**             ** Phonon Vibration Analysis **             **/
+/**                                                         **/
+/**                    **  Version 2  **                    **/
+/**                                                         **/
+/**   By: Pedro Brandimarte (brandimarte@gmail.com) and     **/
+/**       Alexandre Reily Rocha (reilya@ift.unesp.br)       **/
+/**                                                         **/
+/**  *****************************************************  **/
+/**  Generator of synthetic FC directories, for benchmarks  **/
+/**  and bug reports without running SIESTA. It writes the  **/
+/**  files read by 'vibrations' ('.fdf', '.FC', '.ef',      **/
+/**  '.orb', '.xyz', '_NNN.gHS' and '_N.onlyS') of a linear **/
+/**  chain of atoms with the dynamic ones at its middle, or **/
+/**  with '--split' the 'FC[atom]' folders of a 'splitFC'   **/
+/**  run (one SIESTA run per dynamic atom):                 **/
+/**   - force constants of springs between the atoms up to  **/
+/**   'band' neighbours apart (so that the dynamic block is **/
+/**   positive definite and the egg-box correction exact);  **/
+/**   - Hamiltonian and overlap matrices coupling the       **/
+/**   orbitals of atoms up to 'band' neighbours apart (a    **/
+/**   fraction 'fill' of them), with the displaced systems  **/
+/**   changed only at the rows and columns of the orbitals  **/
+/**   of the displaced atom.                                **/
+/**  The values come from a hash of the indices and the     **/
+/**  seed, so the matrices are never stored dense and the   **/
+/**  output depends only on the parameters.                 **/
+/**  With '--symmetric' it writes instead a small C4v       **/
+/**  molecule (two Au, four C and an O on the axis, with s, **/
+/**  s+p and s+p+d orbitals) and its '.ORB_INDX', to check  **/
+/**  the symmetry-reduced displacements ('--symmetry')      **/
+/**  against the full ones. Its matrices are rotation       **/
+/**  covariant: a two-center model from the real spherical  **/
+/**  harmonics (SIESTA order and signs) of the bond         **/
+/**  direction, and forces of springs between all the       **/
+/**  atoms. With '--tilted' the molecule is rotated off the **/
+/**  axes, to check the symmetry detection in any           **/
+/**  orientation.                                           **/
+/**  *****************************************************  **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "Check.h"
+#include "Utils.h"
+
+/* Distance between neighbour atoms of the chain (Ang). */
+#define GEN_BOND 1.4
+
+/* Atoms of the symmetric system and its dynamic ones. */
+#define GEN_SYMM_ATOMS 7
+#define GEN_SYMM_FIRST 3
+
+/* Positions (Ang), species (1 Au, 2 C and 3 O) and largest */
+/* angular momentum of each species of the symmetric system. */
+static const double symmPos[3*GEN_SYMM_ATOMS] = {
+   0.0, 0.0, 4.0,   0.0, 0.0, -4.0,
+   1.3, 0.0, 0.5,   0.0, 1.3, 0.5,   -1.3, 0.0, 0.5,   0.0, -1.3, 0.5,
+   0.0, 0.0, -0.3
+};
+static const int symmSpec[GEN_SYMM_ATOMS] = {1, 1, 2, 2, 2, 2, 3};
+static const int symmLmax[4] = {0, 0, 1, 2};
+static const char *symmName[4] = {"", "Au", "C", "O"};
+static const int symmZ[4] = {0, 79, 6, 8};
+
+/* Structure for the generator parameters. */
+typedef struct GENPARAM genparam;
+struct GENPARAM {
+   char *dir; /* output FC directory */
+   char label[30]; /* system label */
+   int nAtoms; /* number of atoms */
+   int nDyn; /* number of dynamic atoms */
+   int FCfirst, FClast; /* dynamic atoms range */
+   int nOrb; /* orbitals per atom */
+   int nspin; /* spin polarization */
+   int band; /* neighbour atoms coupled (each side) */
+   double fill; /* fraction of the orbital pairs kept at the band */
+   double displ; /* atoms displacement (Ang) */
+   unsigned long long seed; /* random seed */
+   int split; /* 'FC[atom]' folder for each dynamic atom */
+   int symm; /* symmetric system instead of the chain */
+   int tilt; /* symmetric system rotated off the axes */
+   double base[3*GEN_SYMM_ATOMS]; /* its non-displaced positions (Ang) */
+   int no_u; /* number of orbitals */
+   int *first; /* first orbital of each atom (and the total) */
+   int *orbAtom; /* atom of each orbital (symmetric system) */
+   int *ell, *em; /* its angular momentum and 'm' */
+   double *pos; /* displaced positions (Ang, 3 per atom) */
+};
+
+/* Structure for a sparse pattern in SIESTA form. */
+typedef struct GENSPARSE gensparse;
+struct GENSPARSE {
+   int n; /* number of rows */
+   int nnz; /* number of nonzero elements */
+   int *numh; /* nonzero elements of each row */
+   int *listh; /* their column indices (starting at 1) */
+};
+
+/* Prints the usage. */
+static void howto ();
+
+
+/* ********************************************************* */
+/* Returns a pseudo-random value in [-1,1) from the indices  */
+/* 'i' and 'j', the tag 't' and the seed (a 'splitmix64'     */
+/* hash, so the same arguments give always the same value).  */
+static double urand (genparam *p, int t, int i, int j)
+{
+   unsigned long long z;
+
+   z = p->seed ^ ((unsigned long long) t << 48)
+      ^ ((unsigned long long) i << 24) ^ (unsigned long long) j;
+   z += 0x9E3779B97F4A7C15ULL;
+   z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+   z = z ^ (z >> 31);
+
+   return 2.0 * (z >> 11) * (1.0 / 9007199254740992.0) - 1.0;
+
+} /* urand */
+
+
+/* ********************************************************* */
+/* Returns 1 if the orbitals 'i' and 'j' are coupled (the    */
+/* pattern is symmetric), and 0 otherwise.                   */
+static int coupled (genparam *p, int i, int j)
+{
+   int ai, aj, lo, hi;
+
+   ai = i / p->nOrb;
+   aj = j / p->nOrb;
+   if (abs (ai - aj) > p->band)
+      return 0;
+   if (ai == aj || p->fill >= 1.0)
+      return 1;
+   lo = (i < j ? i : j);
+   hi = (i < j ? j : i);
+
+   return (0.5 * (urand (p, 1, lo, hi) + 1.0) < p->fill);
+
+} /* coupled */
+
+
+/* ********************************************************* */
+/* Builds the sparse pattern of a 'mult * no_u' square       */
+/* matrix made of 'mult x mult' blocks with the coupling     */
+/* pattern of the orbitals.                                  */
+static int pattern (genparam *p, int mult, gensparse *sp)
+{
+   register int i, j, k, m;
+   int no_u, lo, hi, size;
+
+   no_u = p->no_u;
+   sp->n = mult * no_u;
+   if (p->symm) /* dense */
+      size = sp->n * sp->n;
+   else
+      size = sp->n * mult * (2 * p->band + 1) * p->nOrb;
+   sp->numh = CHECKmalloc (sp->n * sizeof (int));
+   sp->listh = CHECKmalloc (size * sizeof (int));
+   if (sp->numh == NULL || sp->listh == NULL) {
+      CHECKfree (sp->numh);
+      CHECKfree (sp->listh);
+      sp->numh = sp->listh = NULL; /* (freed again by 'main') */
+      return VIB_ERR_MEMORY;
+   }
+
+   for (i = 0, k = 0; i < sp->n; i++) {
+      if (p->symm) {
+	 lo = 0;
+	 hi = no_u;
+      }
+      else {
+	 lo = (i % no_u) / p->nOrb - p->band;
+	 hi = (i % no_u) / p->nOrb + p->band;
+	 lo = (lo < 0 ? 0 : lo * p->nOrb);
+	 hi = (hi >= p->nAtoms ? no_u : (hi + 1) * p->nOrb);
+      }
+      sp->numh[i] = 0;
+      for (m = 0; m < mult; m++) /* blocks */
+	 for (j = lo; j < hi; j++)
+	    if (p->symm || coupled (p, i % no_u, j)) {
+	       sp->listh[k++] = m * no_u + j + 1;
+	       sp->numh[i]++;
+	    }
+   }
+   sp->nnz = k;
+
+   return VIB_SUCCESS;
+
+} /* pattern */
+
+
+/* ********************************************************* */
+/* Returns the element '(i,j)' of the overlap matrix of the  */
+/* non-displaced system. The off-diagonal elements are small */
+/* enough to keep it diagonally dominant (thus positive      */
+/* definite).                                                */
+static double overlap (genparam *p, int i, int j)
+{
+   int lo, hi;
+   double d;
+
+   if (i == j)
+      return 1.0;
+   lo = (i < j ? i : j);
+   hi = (i < j ? j : i);
+   d = GEN_BOND * abs (i / p->nOrb - j / p->nOrb);
+
+   return 0.4 * exp (- d / GEN_BOND) * urand (p, 2, lo, hi)
+      / ((2 * p->band + 1) * p->nOrb);
+
+} /* overlap */
+
+
+/* ********************************************************* */
+/* Returns the element '(i,j)' of the Hamiltonian (eV) of    */
+/* spin 's' of the non-displaced system.                     */
+static double hamiltonian (genparam *p, int i, int j, int s)
+{
+   int lo, hi;
+   double d;
+
+   lo = (i < j ? i : j);
+   hi = (i < j ? j : i);
+   if (i == j) /* onsite energies */
+      return -3.0 + 2.0 * urand (p, 3, i, s) + 0.2 * s;
+   d = GEN_BOND * abs (i / p->nOrb - j / p->nOrb);
+
+   return -2.5 * exp (- d / GEN_BOND) * urand (p, 4, lo, hi)
+      * (1.0 + 0.05 * s);
+
+} /* hamiltonian */
+
+
+/* ********************************************************* */
+/* Returns the derivative of the element '(i,j)' of the      */
+/* Hamiltonian (eV/Ang, tag 5) or of the overlap (1/Ang, tag */
+/* 6) with respect to the displacement 'c' (dynamic atom     */
+/* 'c/3', direction 'c%3'). Only the bonds of the displaced  */
+/* atom change.                                              */
+static double derivative (genparam *p, int t, int i, int j, int c)
+{
+   int a, ai, aj, lo, hi;
+   double scale;
+
+   a = p->FCfirst - 1 + c / 3;
+   ai = i / p->nOrb;
+   aj = j / p->nOrb;
+   if ((ai == a) == (aj == a))
+      return 0.0;
+   lo = (i < j ? i : j);
+   hi = (i < j ? j : i);
+   scale = (c % 3 == 0 ? 1.0 : 0.3); /* stretching is stronger */
+   if (t == 6)
+      scale *= 0.1 / ((2 * p->band + 1) * p->nOrb);
+
+   return scale * exp (- GEN_BOND * abs (ai - aj) / GEN_BOND)
+      * urand (p, t, lo, hi) * (1.0 + 0.1 * urand (p, t + 2, c, 0));
+
+} /* derivative */
+
+
+/* ********************************************************* */
+/* Sets up the orbitals of the symmetric system (one shell   */
+/* for each 'l' up to the largest of the species of each     */
+/* atom) and its positions (rotated with '--tilted').        */
+static int symmSystem (genparam *p)
+{
+   register int a, l, m, i;
+   int no_u;
+   double T[9], ca, sa, cb, sb, cc, sc;
+
+   /* Positions, rotated by 'Rz(0.3) Ry(0.7) Rx(1.1)' with */
+   /* '--tilted' (so no symmetry axis is along x, y or z).  */
+   ca = cos (p->tilt ? 0.3 : 0.0);
+   sa = sin (p->tilt ? 0.3 : 0.0);
+   cb = cos (p->tilt ? 0.7 : 0.0);
+   sb = sin (p->tilt ? 0.7 : 0.0);
+   cc = cos (p->tilt ? 1.1 : 0.0);
+   sc = sin (p->tilt ? 1.1 : 0.0);
+   T[0] = ca * cb;
+   T[1] = ca * sb * sc - sa * cc;
+   T[2] = ca * sb * cc + sa * sc;
+   T[3] = sa * cb;
+   T[4] = sa * sb * sc + ca * cc;
+   T[5] = sa * sb * cc - ca * sc;
+   T[6] = - sb;
+   T[7] = cb * sc;
+   T[8] = cb * cc;
+   for (a = 0; a < GEN_SYMM_ATOMS; a++)
+      for (i = 0; i < 3; i++)
+	 p->base[3*a+i] = T[3*i] * symmPos[3*a]
+	    + T[3*i+1] * symmPos[3*a+1] + T[3*i+2] * symmPos[3*a+2];
+
+   p->nAtoms = GEN_SYMM_ATOMS;
+   p->FCfirst = GEN_SYMM_FIRST;
+   p->FClast = GEN_SYMM_ATOMS;
+   p->nDyn = p->FClast - p->FCfirst + 1;
+   for (a = 0, no_u = 0; a < p->nAtoms; a++)
+      no_u += (symmLmax[symmSpec[a]] + 1) * (symmLmax[symmSpec[a]] + 1);
+   p->no_u = no_u;
+
+   p->first = CHECKmalloc ((p->nAtoms + 1) * sizeof (int));
+   p->orbAtom = CHECKmalloc (no_u * sizeof (int));
+   p->ell = CHECKmalloc (no_u * sizeof (int));
+   p->em = CHECKmalloc (no_u * sizeof (int));
+   p->pos = CHECKmalloc (3 * p->nAtoms * sizeof (double));
+   if (p->first == NULL || p->orbAtom == NULL || p->ell == NULL ||
+       p->em == NULL || p->pos == NULL)
+      return VIB_ERR_MEMORY;
+
+   for (a = 0, i = 0; a < p->nAtoms; a++) {
+      p->first[a] = i;
+      for (l = 0; l <= symmLmax[symmSpec[a]]; l++)
+	 for (m = -l; m <= l; m++, i++) {
+	    p->orbAtom[i] = a;
+	    p->ell[i] = l;
+	    p->em[i] = m;
+	 }
+   }
+   p->first[p->nAtoms] = no_u;
+
+   return VIB_SUCCESS;
+
+} /* symmSystem */
+
+
+/* ********************************************************* */
+/* Sets the positions 'p->pos' of the symmetric system with  */
+/* the coordinate 'dir' of the atom 'a' displaced by 'q'     */
+/* (all the atoms if 'a < 0', none if 'dir < 0').            */
+static void symmMove (genparam *p, int a, int dir, double q)
+{
+   register int b;
+
+   memcpy (p->pos, p->base, 3 * p->nAtoms * sizeof (double));
+   if (dir >= 0)
+      for (b = 0; b < p->nAtoms; b++)
+	 if (a < 0 || b == a)
+	    p->pos[3*b+dir] += q;
+
+} /* symmMove */
+
+
+/* ********************************************************* */
+/* Returns the real spherical harmonic 'l', 'm' (up to       */
+/* 'l = 2', SIESTA order and signs, normalized to a unit     */
+/* mean over the sphere) of the unit vector 'n'.             */
+static double harmonic (int l, int m, const double *n)
+{
+   double x = n[0], y = n[1], z = n[2];
+
+   if (l == 0)
+      return 1.0;
+   if (l == 1)
+      return sqrt (3.0) * (m < 0 ? y : (m == 0 ? z : x));
+   switch (m) {
+   case -2:
+      return sqrt (15.0) * x * y;
+   case -1:
+      return sqrt (15.0) * y * z;
+   case 0:
+      return 0.5 * sqrt (5.0) * (3.0 * z * z - 1.0);
+   case 1:
+      return sqrt (15.0) * x * z;
+   default:
+      return 0.5 * sqrt (15.0) * (x * x - y * y);
+   }
+
+} /* harmonic */
+
+
+/* ********************************************************* */
+/* Returns the element '(i,j)' of the Hamiltonian (eV, tag   */
+/* 5) of spin 's' or of the overlap (tag 6) of the symmetric */
+/* system, with the atoms of the orbitals at 'ri' and 'rj':  */
+/* the two-center term 'f(d) Y_i(n) Y_j(-n)' of the bond     */
+/* direction 'n' plus 'g(d)' between equal 'l' and 'm', with */
+/* 'f' and 'g' of the species and shells.                    */
+static double symmElement (genparam *p, int t, int i, int j,
+			   const double *ri, const double *rj, int s)
+{
+   int ci, cj;
+   double r[3], mr[3], d, h, v;
+
+   r[0] = rj[0] - ri[0];
+   r[1] = rj[1] - ri[1];
+   r[2] = rj[2] - ri[2];
+   d = sqrt (r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+   ci = 4 * symmSpec[p->orbAtom[i]] + p->ell[i];
+   cj = 4 * symmSpec[p->orbAtom[j]] + p->ell[j];
+   h = 0.5 * (urand (p, t + 20, (ci < cj ? ci : cj),
+		     (ci < cj ? cj : ci)) + 1.0);
+
+   /* Same atom (orthonormal orbitals). */
+   if (d < 1.0e-12) {
+      if (i != j)
+	 return 0.0;
+      return (t == 6 ? 1.0 : -3.0 + p->ell[i] + 0.3 * h + 0.1 * s);
+   }
+
+   r[0] /= d;
+   r[1] /= d;
+   r[2] /= d;
+   mr[0] = - r[0];
+   mr[1] = - r[1];
+   mr[2] = - r[2];
+   v = (0.5 + h) * d * d * exp (- d * d / 4.0)
+      * harmonic (p->ell[i], p->em[i], r)
+      * harmonic (p->ell[j], p->em[j], mr);
+   if (p->ell[i] == p->ell[j] && p->em[i] == p->em[j])
+      v += (t == 6 ? 1.0 : -1.5 - 0.2 * h - 0.05 * s)
+	 * exp (- d * d / (3.0 + h));
+
+   return v;
+
+} /* symmElement */
+
+
+/* ********************************************************* */
+/* Returns the Fermi energy (eV) of the symmetric system at  */
+/* the positions 'p->pos'.                                   */
+static double symmFermi (genparam *p)
+{
+   register int a, b, i;
+   double d, e = -4.5;
+
+   for (a = 0; a < p->nAtoms; a++)
+      for (b = a + 1; b < p->nAtoms; b++) {
+	 for (i = 0, d = 0.0; i < 3; i++)
+	    d += (p->pos[3*b+i] - p->pos[3*a+i])
+	       * (p->pos[3*b+i] - p->pos[3*a+i]);
+	 e += 0.01 * exp (- sqrt (d));
+      }
+
+   return e;
+
+} /* symmFermi */
+
+
+/* ********************************************************* */
+/* Computes at 'F' the forces (eV/Ang) on the atoms of the   */
+/* symmetric system at the positions 'p->pos', from springs  */
+/* between all the atoms (stretched 5% at 'p->base').        */
+static void symmForces (genparam *p, double *F)
+{
+   register int a, b, i;
+   double r[3], d, d0, k;
+
+   memset (F, 0, 3 * p->nAtoms * sizeof (double));
+   for (a = 0; a < p->nAtoms; a++)
+      for (b = a + 1; b < p->nAtoms; b++) {
+	 for (i = 0, d = d0 = 0.0; i < 3; i++) {
+	    r[i] = p->pos[3*b+i] - p->pos[3*a+i];
+	    d += r[i] * r[i];
+	    d0 += (p->base[3*b+i] - p->base[3*a+i])
+	       * (p->base[3*b+i] - p->base[3*a+i]);
+	 }
+	 d = sqrt (d);
+	 d0 = 0.95 * sqrt (d0);
+	 k = 5.0 * exp (- d / 2.0)
+	    * (1.0 + 0.1 * (symmSpec[a] + symmSpec[b]));
+	 for (i = 0; i < 3; i++) {
+	    F[3*a+i] += k * (d - d0) * r[i] / d;
+	    F[3*b+i] -= k * (d - d0) * r[i] / d;
+	 }
+      }
+
+} /* symmForces */
+
+
+/* ********************************************************* */
+/* Writes the '.ORB_INDX' file of the symmetric system at    */
+/* the folder 'dir' (the columns read by 'vibrations').      */
+static int writeOrbIndx (genparam *p, const char *dir)
+{
+   register int i;
+   int a;
+   char file[1100];
+   FILE *F;
+
+   snprintf (file, sizeof (file), "%s/%s.ORB_INDX", dir, p->label);
+   F = CHECKfopen (file, "w");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+   fprintf (F, "%d %d = orbitals in unit cell and supercell. See end of"
+	    " file.\n\n", p->no_u, p->no_u);
+   fprintf (F, "    io    ia is   spec iao  n  l  m  z  p          sym"
+	    "      rc    isc     iuo\n");
+   for (i = 0; i < p->no_u; i++) {
+      a = p->orbAtom[i];
+      fprintf (F, "%6d%6d%3d%7s%4d%3d%3d%3d  1  F  sym  5.0  0 0 0 %6d\n",
+	       i + 1, a + 1, symmSpec[a], symmName[symmSpec[a]],
+	       i - p->first[a] + 1, p->ell[i] + 2, p->ell[i], p->em[i],
+	       i + 1);
+   }
+
+   return CHECKfclose (fclose (F), file);
+
+} /* writeOrbIndx */
+
+
+/* ********************************************************* */
+/* Sets 'c0' and 'nc' to the first dynamic coordinate and    */
+/* the number of them of the SIESTA run 'g' (all of them     */
+/* without split) and writes its folder at 'dir'.            */
+static void runFolder (genparam *p, int g, int *c0, int *nc, char *dir,
+		       size_t size)
+{
+
+   if (p->split) {
+      *c0 = 3 * g;
+      *nc = 3;
+      snprintf (dir, size, "%s/FC%d", p->dir, p->FCfirst + g);
+   }
+   else {
+      *c0 = 0;
+      *nc = 3 * p->nDyn;
+      snprintf (dir, size, "%s", p->dir);
+   }
+
+} /* runFolder */
+
+
+/* ********************************************************* */
+/* Writes the '.fdf' input of the FC run.                    */
+static int writeFdf (genparam *p)
+{
+   register int a;
+   char file[1024];
+   FILE *F;
+
+   snprintf (file, sizeof (file), "%s/%s.fdf", p->dir, p->label);
+   F = CHECKfopen (file, "w");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+
+   fprintf (F, "SystemLabel %s\n", p->label);
+   fprintf (F, "NumberOfAtoms %d\n", p->nAtoms);
+   if (p->symm) {
+      fprintf (F, "NumberOfSpecies 3\n%%block ChemicalSpeciesLabel\n");
+      for (a = 1; a <= 3; a++)
+	 fprintf (F, "%d %d %s\n", a, symmZ[a], symmName[a]);
+      fprintf (F, "%%endblock ChemicalSpeciesLabel\n");
+   }
+   else
+      fprintf (F, "NumberOfSpecies 2\n%%block ChemicalSpeciesLabel\n"
+	       "1 6 C\n2 79 Au\n%%endblock ChemicalSpeciesLabel\n");
+   if (p->nspin == 2)
+      fprintf (F, "SpinPolarized true\n");
+   fprintf (F, "MD.FCfirst %d\nMD.FClast %d\n", p->FCfirst, p->FClast);
+   fprintf (F, "MD.FCdispl %g Ang\n", p->displ);
+   fprintf (F, "%%block AtomicCoordinatesAndAtomicSpecies\n");
+   for (a = 0; a < p->nAtoms; a++)
+      if (p->symm)
+	 fprintf (F, "%.10f %.10f %.10f %d\n", p->base[3*a],
+		  p->base[3*a+1], p->base[3*a+2], symmSpec[a]);
+      else
+	 fprintf (F, "%.4f 0.0 0.0 %d\n", a * GEN_BOND,
+		  (a + 1 >= p->FCfirst && a + 1 <= p->FClast) ? 1 : 2);
+   fprintf (F, "%%endblock AtomicCoordinatesAndAtomicSpecies\n");
+
+   return CHECKfclose (fclose (F), file);
+
+} /* writeFdf */
+
+
+/* ********************************************************* */
+/* Writes the '.xyz' file.                                   */
+static int writeXyz (genparam *p)
+{
+   register int a;
+   char file[1024];
+   FILE *F;
+
+   snprintf (file, sizeof (file), "%s/%s.xyz", p->dir, p->label);
+   F = CHECKfopen (file, "w");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+   fprintf (F, "%d\n", p->nAtoms);
+   for (a = 0; a < p->nAtoms; a++)
+      if (p->symm)
+	 fprintf (F, "%s %.10f %.10f %.10f\n", symmName[symmSpec[a]],
+		  p->base[3*a], p->base[3*a+1], p->base[3*a+2]);
+      else
+	 fprintf (F, "%s %.6f 0.000000 0.000000\n",
+		  (a + 1 >= p->FCfirst && a + 1 <= p->FClast) ? "C" : "Au",
+		  a * GEN_BOND);
+
+   return CHECKfclose (fclose (F), file);
+
+} /* writeXyz */
+
+
+/* ********************************************************* */
+/* Writes the '.orb' and '.ef' files of the SIESTA run 'g'  */
+/* (and the '.ORB_INDX' of the symmetric system).            */
+static int writeOrbEf (genparam *p, int g)
+{
+   register int a, k;
+   int c, c0, nc, info;
+   double q;
+   char dir[1024], file[1100];
+   FILE *F;
+
+   runFolder (p, g, &c0, &nc, dir, sizeof (dir));
+   if (p->symm) {
+      info = writeOrbIndx (p, dir);
+      if (info != VIB_SUCCESS)
+	 return info;
+   }
+
+   /* First orbital of each atom (and the total). */
+   snprintf (file, sizeof (file), "%s/%s.orb", dir, p->label);
+   F = CHECKfopen (file, "w");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+   for (a = 0; a <= p->nAtoms; a++)
+      fprintf (F, "%d%c", p->symm ? p->first[a] : a * p->nOrb,
+	       a < p->nAtoms ? ' ' : '\n');
+   info = CHECKfclose (fclose (F), file);
+   if (info != VIB_SUCCESS)
+      return info;
+
+   /* Fermi energies (non-displaced and each displacement). */
+   snprintf (file, sizeof (file), "%s/%s.ef", dir, p->label);
+   F = CHECKfopen (file, "w");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+   if (p->symm) {
+      for (k = 0; k <= 2 * nc; k++) {
+	 c = c0 + (k - 1) / 2;
+	 q = (k % 2 ? - p->displ : p->displ);
+	 symmMove (p, p->FCfirst - 1 + c / 3, k == 0 ? -1 : c % 3, q);
+	 fprintf (F, "%12d  % .14f\n", k, symmFermi (p));
+      }
+   }
+   else {
+      fprintf (F, "%12d  % .14f\n", 0, -4.5);
+      for (k = 1; k <= 2 * nc; k++)
+	 fprintf (F, "%12d  % .14f\n", k,
+		  -4.5 + (k % 2 ? -1.0 : 1.0) * p->displ * 0.05
+		  * urand (p, 9, c0 + (k - 1) / 2, 0));
+   }
+
+   return CHECKfclose (fclose (F), file);
+
+} /* writeOrbEf */
+
+
+/* ********************************************************* */
+/* Returns the spring constant (eV/Ang^2) between the atoms  */
+/* 'a' and 'b' (stiffer along the chain direction 'x').      */
+static double spring (genparam *p, int a, int b, int dir)
+{
+   int lo, hi;
+
+   if (a == b || abs (a - b) > (p->band > 0 ? p->band : 1))
+      return 0.0;
+   lo = (a < b ? a : b);
+   hi = (a < b ? b : a);
+
+   return 12.0 * exp (1.0 - abs (a - b)) * (dir == 0 ? 1.0 : 0.4)
+      * (1.0 + 0.2 * urand (p, 10, lo, hi));
+
+} /* spring */
+
+
+/* ********************************************************* */
+/* Writes the '.FC' file of the SIESTA run 'g': for each    */
+/* dynamic coordinate, the force constants of all atoms for  */
+/* the negative and the positive displacements (with a small */
+/* anharmonic noise).                                        */
+static int writeFC (genparam *p, int g)
+{
+   register int i, j, b, n;
+   int a, dir, disp, c0, nc;
+   double k, q, F0[3*GEN_SYMM_ATOMS], Fq[3*GEN_SYMM_ATOMS];
+   char folder[1024], file[1100];
+   FILE *F;
+
+   runFolder (p, g, &c0, &nc, folder, sizeof (folder));
+   snprintf (file, sizeof (file), "%s/%s.FC", folder, p->label);
+   F = CHECKfopen (file, "w");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+   fprintf (F, "Force constants matrix\n");
+   if (p->symm) {
+      symmMove (p, 0, -1, 0.0);
+      symmForces (p, F0);
+   }
+
+   for (j = c0; j < c0 + nc; j++) {
+      a = p->FCfirst - 1 + j / 3;
+      dir = j % 3;
+      for (disp = 0; disp < 2 && p->symm; disp++) {
+	 /* Finite differences of the springs forces. */
+	 q = (disp == 0 ? - p->displ : p->displ);
+	 symmMove (p, a, dir, q);
+	 symmForces (p, Fq);
+	 for (i = 0; i < 3 * p->nAtoms; i++)
+	    fprintf (F, "% .8E%c", - (Fq[i] - F0[i]) / q,
+		     i % 3 == 2 ? '\n' : ' ');
+      }
+      for (disp = 0; disp < 2 && !p->symm; disp++)
+	 for (i = 0; i < 3 * p->nAtoms; i++) {
+	    b = i / 3;
+	    k = 0.0;
+	    if (i % 3 == dir) {
+	       if (b == a) /* sum of the springs of 'a' */
+		  for (n = 0; n < p->nAtoms; n++)
+		     k += spring (p, a, n, dir);
+	       else
+		  k = - spring (p, a, b, dir);
+	    }
+	    k *= 1.0 + 1.0e-3 * urand (p, 11 + disp, i, j);
+	    fprintf (F, "% .8E%c", k, i % 3 == 2 ? '\n' : ' ');
+	 }
+   }
+
+   return CHECKfclose (fclose (F), file);
+
+} /* writeFC */
+
+
+/* ********************************************************* */
+/* Writes the '.gHS' file of the displacement 'k' of the    */
+/* SIESTA run 'g' (0 is the non-displaced system, '2c+1' and */
+/* '2c+2' the negative and positive displacements of its     */
+/* coordinate 'c').                                          */
+static int writeHS (genparam *p, gensparse *sp, int g, int k, double *buf)
+{
+   register int i, j, s, n;
+   int c, c0, nc, no_u, info = VIB_SUCCESS;
+   double q;
+   char dir[1024], file[1100];
+   FILE *F;
+
+   no_u = p->no_u;
+   runFolder (p, g, &c0, &nc, dir, sizeof (dir));
+   c = c0 + (k - 1) / 2;
+   q = (k == 0 ? 0.0 : (k % 2 ? - p->displ : p->displ));
+   if (p->symm)
+      symmMove (p, p->FCfirst - 1 + c / 3, k == 0 ? -1 : c % 3, q);
+
+   snprintf (file, sizeof (file), "%s/%s_%.3d.gHS", dir, p->label, k);
+   F = CHECKfopen (file, "wb");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+   fwrite (&no_u, sizeof (int), 1, F);
+   fwrite (&p->nspin, sizeof (int), 1, F);
+   fwrite (&sp->nnz, sizeof (int), 1, F);
+   fwrite (sp->numh, sizeof (int), no_u, F);
+   fwrite (sp->listh, sizeof (int), sp->nnz, F);
+
+   /* Hamiltonian (Ry), one row at a time. */
+   for (s = 0; s < p->nspin; s++)
+      for (i = 0, n = 0; i < no_u; i++) {
+	 for (j = 0; j < sp->numh[i]; j++, n++) {
+	    if (p->symm)
+	       buf[j] = symmElement (p, 5, i, sp->listh[n] - 1,
+				     &p->pos[3*p->orbAtom[i]],
+				     &p->pos[3*p->orbAtom[sp->listh[n]-1]], s);
+	    else {
+	       buf[j] = hamiltonian (p, i, sp->listh[n] - 1, s);
+	       if (k > 0) /* (with a small second order term) */
+		  buf[j] += (q + 0.1 * q * q)
+		     * derivative (p, 5, i, sp->listh[n] - 1, c);
+	    }
+	    buf[j] /= rydberg2eV;
+	 }
+	 fwrite (buf, sizeof (double), sp->numh[i], F);
+      }
+
+   /* Overlap. */
+   for (i = 0, n = 0; i < no_u; i++) {
+      for (j = 0; j < sp->numh[i]; j++, n++)
+	 if (p->symm)
+	    buf[j] = symmElement (p, 6, i, sp->listh[n] - 1,
+				  &p->pos[3*p->orbAtom[i]],
+				  &p->pos[3*p->orbAtom[sp->listh[n]-1]], 0);
+	 else {
+	    buf[j] = overlap (p, i, sp->listh[n] - 1);
+	    if (k > 0)
+	       buf[j] += q * derivative (p, 6, i, sp->listh[n] - 1, c);
+	 }
+      fwrite (buf, sizeof (double), sp->numh[i], F);
+   }
+
+   if (ferror (F)) {
+      fprintf (stderr, "\n ERROR: unable to write the file %s!\n\n", file);
+      fclose (F);
+      return VIB_ERR_FILE;
+   }
+   info = CHECKfclose (fclose (F), file);
+
+   return info;
+
+} /* writeHS */
+
+
+/* ********************************************************* */
+/* Writes the '.onlyS' file 'k' (1 to 6: negative and        */
+/* positive rigid displacements along x, y and z): the       */
+/* overlap of the doubled system, whose off-diagonal blocks  */
+/* hold '<i|j(Q)>'.                                          */
+static int writeOnlyS (genparam *p, gensparse *sp2, int k, double *buf)
+{
+   register int i, j, n;
+   int r, c, no_u, dir, info;
+   double q, t;
+   char file[1024];
+   FILE *F;
+
+   no_u = p->no_u;
+   dir = (k - 1) / 2;
+   q = (k % 2 ? - p->displ : p->displ);
+   if (p->symm) /* rigid displacement of the second copy */
+      symmMove (p, -1, dir, q);
+
+   snprintf (file, sizeof (file), "%s/%s_%d.onlyS", p->dir, p->label, k);
+   F = CHECKfopen (file, "wb");
+   if (F == NULL)
+      return VIB_ERR_FILE;
+   fwrite (&sp2->n, sizeof (int), 1, F);
+   fwrite (&sp2->nnz, sizeof (int), 1, F);
+   fwrite (sp2->numh, sizeof (int), sp2->n, F);
+   fwrite (sp2->listh, sizeof (int), sp2->nnz, F);
+
+   for (i = 0, n = 0; i < sp2->n; i++) {
+      for (j = 0; j < sp2->numh[i]; j++, n++) {
+	 r = i % no_u;
+	 c = (sp2->listh[n] - 1) % no_u;
+	 if (p->symm) {
+	    buf[j] = symmElement (p, 6, r, c, i < no_u ?
+				  &p->base[3*p->orbAtom[r]] :
+				  &p->pos[3*p->orbAtom[r]],
+				  sp2->listh[n] - 1 < no_u ?
+				  &p->base[3*p->orbAtom[c]] :
+				  &p->pos[3*p->orbAtom[c]], 0);
+	    continue ;
+	 }
+	 buf[j] = overlap (p, r, c);
+	 if ((i < no_u) != (sp2->listh[n] - 1 < no_u)) {
+	    /* '<r|c(Q)>' changes with the sign of the bond direction. */
+	    if (i >= no_u) { /* lower block holds '<c|r(Q)>' */
+	       r = c;
+	       c = i % no_u;
+	    }
+	    t = (c / p->nOrb > r / p->nOrb ? 1.0 :
+		 (c / p->nOrb < r / p->nOrb ? -1.0 : 0.0));
+	    if (dir > 0)
+	       t *= 0.3;
+	    buf[j] += q * t * 0.2 * fabs (overlap (p, r, c));
+	 }
+      }
+      fwrite (buf, sizeof (double), sp2->numh[i], F);
+   }
+
+   if (ferror (F)) {
+      fprintf (stderr, "\n ERROR: unable to write the file %s!\n\n", file);
+      fclose (F);
+      return VIB_ERR_FILE;
+   }
+   info = CHECKfclose (fclose (F), file);
+
+   return info;
+
+} /* writeOnlyS */
+
+
+/* ********************************************************* */
+/* Reads the option 'opt' into 'p' (returns 0 if it is       */
+/* unknown or has a wrong value).                            */
+static int readOption (const char *opt, genparam *p)
+{
+   char *end;
+
+   end = "";
+   if (strncmp (opt, "--atoms=", 8) == 0)
+      p->nAtoms = (int) strtol (opt + 8, &end, 10);
+   else if (strncmp (opt, "--dyn=", 6) == 0)
+      p->nDyn = (int) strtol (opt + 6, &end, 10);
+   else if (strncmp (opt, "--orbs=", 7) == 0)
+      p->nOrb = (int) strtol (opt + 7, &end, 10);
+   else if (strncmp (opt, "--nspin=", 8) == 0)
+      p->nspin = (int) strtol (opt + 8, &end, 10);
+   else if (strncmp (opt, "--band=", 7) == 0)
+      p->band = (int) strtol (opt + 7, &end, 10);
+   else if (strncmp (opt, "--fill=", 7) == 0)
+      p->fill = strtod (opt + 7, &end);
+   else if (strncmp (opt, "--displ=", 8) == 0)
+      p->displ = strtod (opt + 8, &end);
+   else if (strncmp (opt, "--seed=", 7) == 0)
+      p->seed = strtoull (opt + 7, &end, 10);
+   else if (strncmp (opt, "--label=", 8) == 0 && strlen (opt + 8) > 0 &&
+	    strlen (opt + 8) < sizeof (p->label))
+      strcpy (p->label, opt + 8);
+   else if (strcmp (opt, "--split") == 0)
+      p->split = 1;
+   else if (strcmp (opt, "--symmetric") == 0)
+      p->symm = 1;
+   else if (strcmp (opt, "--tilted") == 0)
+      p->symm = p->tilt = 1;
+   else
+      return 0;
+
+   return (*end == '\0');
+
+} /* readOption */
+
+
+int main (int nargs, char *arg[])
+{
+   register int i, g, k;
+   int nRuns, c0, nc, info;
+   char dir[1024];
+   double *buf;
+   gensparse sp, sp2;
+   genparam p;
+
+   /* Default parameters. */
+   p.dir = NULL;
+   strcpy (p.label, "synth");
+   p.nAtoms = 16;
+   p.nDyn = 4;
+   p.nOrb = 9;
+   p.nspin = 1;
+   p.band = 2;
+   p.fill = 1.0;
+   p.displ = 0.02;
+   p.seed = 1;
+   p.split = 0;
+   p.symm = 0;
+   p.tilt = 0;
+   p.first = p.orbAtom = p.ell = p.em = NULL;
+   p.pos = NULL;
+
+   for (i = 1; i < nargs; i++)
+      if (strncmp (arg[i], "--", 2) != 0)
+	 p.dir = arg[i];
+      else if (!readOption (arg[i], &p)) {
+	 fprintf (stderr, "\n Unknown option or wrong value '%s'!\n", arg[i]);
+	 howto ();
+	 return EXIT_FAILURE;
+      }
+   if (p.dir == NULL || p.nAtoms < 1 || p.nDyn < 1 || p.nDyn > p.nAtoms ||
+       p.nOrb < 1 || (p.nspin != 1 && p.nspin != 2) || p.band < 0 ||
+       p.fill <= 0.0 || p.fill > 1.0 || p.displ <= 0.0) {
+      fprintf (stderr, "\n Wrong arguments!\n");
+      howto ();
+      return EXIT_FAILURE;
+   }
+
+   /* The symmetric system, or the dynamic atoms at the */
+   /* middle of the chain.                               */
+   info = VIB_SUCCESS;
+   if (p.symm)
+      info = symmSystem (&p);
+   else {
+      p.FCfirst = (p.nAtoms - p.nDyn) / 2 + 1;
+      p.FClast = p.FCfirst + p.nDyn - 1;
+      p.no_u = p.nAtoms * p.nOrb;
+   }
+
+   mkdir (p.dir, 0755);
+   printf (" Writing %s/%s.* (%d atoms, %d dynamic, %d orbitals)... ",
+	   p.dir, p.label, p.nAtoms, p.nDyn, p.no_u);
+   fflush (stdout);
+
+   /* Sparse patterns of the system and of the doubled system. */
+   sp.numh = sp2.numh = NULL;
+   sp.listh = sp2.listh = NULL;
+   if (info == VIB_SUCCESS)
+      info = pattern (&p, 1, &sp);
+   if (info == VIB_SUCCESS)
+      info = pattern (&p, 2, &sp2);
+   buf = CHECKmalloc (2 * p.no_u * sizeof (double));
+   if (buf == NULL)
+      info = VIB_ERR_MEMORY;
+
+   if (info == VIB_SUCCESS)
+      info = writeFdf (&p);
+   if (info == VIB_SUCCESS)
+      info = writeXyz (&p);
+
+   /* Files of each SIESTA run (a single one without split). */
+   nRuns = (p.split ? p.nDyn : 1);
+   for (g = 0; g < nRuns && info == VIB_SUCCESS; g++) {
+      runFolder (&p, g, &c0, &nc, dir, sizeof (dir));
+      mkdir (dir, 0755);
+      info = writeOrbEf (&p, g);
+      if (info == VIB_SUCCESS)
+	 info = writeFC (&p, g);
+      for (k = 0; k <= 2 * nc && info == VIB_SUCCESS; k++)
+	 info = writeHS (&p, &sp, g, k, buf);
+   }
+   for (k = 1; k <= 6 && info == VIB_SUCCESS; k++)
+      info = writeOnlyS (&p, &sp2, k, buf);
+
+   if (info == VIB_SUCCESS)
+      printf ("ok!\n (%.1f%% of the Hamiltonian elements nonzero)\n",
+	      100.0 * sp.nnz / ((double) sp.n * sp.n));
+   else
+      fprintf (stderr, "\n vibgen: ERROR: %s!\n\n", CHECKerrorString (info));
+
+   /* Frees memory. */
+   CHECKfree (sp.numh);
+   CHECKfree (sp.listh);
+   CHECKfree (sp2.numh);
+   CHECKfree (sp2.listh);
+   CHECKfree (buf);
+   CHECKfree (p.first);
+   CHECKfree (p.orbAtom);
+   CHECKfree (p.ell);
+   CHECKfree (p.em);
+   CHECKfree (p.pos);
+
+   return (info == VIB_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE);
+
+} /* main */
+
+
+/* ********************************************************* */
+/* Prints the usage.                                         */
+static void howto ()
+{
+
+   fprintf (stderr, "\n Use: vibgen [options] [FC directory]\n\n");
+   fprintf (stderr,
+	    "  --atoms=N    number of atoms of the chain (default 16)\n"
+	    "  --dyn=N      number of dynamic atoms, at the middle"
+	    " (default 4)\n"
+	    "  --orbs=N     orbitals per atom (default 9)\n"
+	    "  --nspin=1|2  spin polarization (default 1)\n"
+	    "  --band=N     neighbour atoms coupled at each side"
+	    " (default 2)\n"
+	    "  --fill=F     fraction of the orbital pairs of different"
+	    " atoms kept at the band\n"
+	    "               (default 1)\n"
+	    "  --displ=Q    atoms displacement in Ang (default 0.02)\n"
+	    "  --seed=S     random seed (default 1)\n"
+	    "  --label=L    system label (default 'synth'), the input is"
+	    " '[label].fdf'\n"
+	    "  --split      'FC[atom]' folder for each dynamic atom (a"
+	    " 'splitFC' run)\n"
+	    "  --symmetric  C4v molecule (7 atoms, 5 dynamic, s to d"
+	    " orbitals) with its\n"
+	    "               '.ORB_INDX' instead of the chain (ignores"
+	    " '--atoms' to '--fill')\n"
+	    "  --tilted     the same molecule rotated off the x, y and z"
+	    " axes\n\n");
+
+} /* howto */
+
+
+/* ************************ Drafts ************************* */